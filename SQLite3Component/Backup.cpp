@@ -0,0 +1,112 @@
+#include "Backup.h"
+
+namespace SQLite3 {
+  Backup::Backup()
+    : destination(nullptr)
+    , ownsDestination(false)
+    , backup(nullptr)
+    , remaining(0)
+    , pageCount(0)
+    , copied(0)
+    , restarts(0)
+    , lockedSteps(0) {
+  }
+
+  Backup::~Backup() {
+    Finish();
+    closeDestination();
+  }
+
+  int Backup::Open(sqlite3* destination, sqlite3* source) {
+    Finish();
+    closeDestination();
+    return start(destination, source);
+  }
+
+  int Backup::OpenFile(const char* destinationPath, sqlite3* source, int busyTimeoutMilliseconds) {
+    Finish();
+    closeDestination();
+    sqlite3* file = nullptr;
+    int result = sqlite3_open_v2(destinationPath, &file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+    // Kept even when opening failed, it holds the error message
+    destination = file;
+    ownsDestination = true;
+    if (result != SQLITE_OK) {
+      return result;
+    }
+    sqlite3_busy_timeout(file, busyTimeoutMilliseconds);
+    return start(file, source);
+  }
+
+  int Backup::Step(int pages) {
+    if (!backup) {
+      return SQLITE_MISUSE;
+    }
+    int result = sqlite3_backup_step(backup, pages);
+    if (result == SQLITE_BUSY || result == SQLITE_LOCKED) {
+      ++lockedSteps;
+      return SQLITE_OK;
+    }
+    if (result != SQLITE_OK && result != SQLITE_DONE) {
+      return result;
+    }
+    remaining = sqlite3_backup_remaining(backup);
+    pageCount = sqlite3_backup_pagecount(backup);
+    // Every step copies at least one page, unless the copy started over
+    int nowCopied = pageCount - remaining;
+    if (result == SQLITE_OK && copied > 0 && nowCopied <= copied) {
+      ++restarts;
+    }
+    copied = nowCopied;
+    return result;
+  }
+
+  int Backup::Finish() {
+    if (!backup) {
+      return SQLITE_OK;
+    }
+    int result = sqlite3_backup_finish(backup);
+    backup = nullptr;
+    return result;
+  }
+
+  int Backup::Remaining() const {
+    return remaining;
+  }
+
+  int Backup::PageCount() const {
+    return pageCount;
+  }
+
+  long long Backup::Restarts() const {
+    return restarts;
+  }
+
+  long long Backup::LockedSteps() const {
+    return lockedSteps;
+  }
+
+  const char* Backup::ErrorMessage() const {
+    return destination ? sqlite3_errmsg(destination) : "";
+  }
+
+  int Backup::start(sqlite3* destination, sqlite3* source) {
+    this->destination = destination;
+    remaining = 0;
+    pageCount = 0;
+    copied = 0;
+    restarts = 0;
+    lockedSteps = 0;
+    backup = sqlite3_backup_init(destination, "main", source, "main");
+    // The error is stored in the destination connection
+    return backup ? SQLITE_OK : sqlite3_errcode(destination);
+  }
+
+  void Backup::closeDestination() {
+    if (ownsDestination) {
+      sqlite3_close(destination);
+    }
+    destination = nullptr;
+    ownsDestination = false;
+  }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  // Copies the main database of a connection to another database in steps
+  // of a few pages through the backup API. The source is only locked while
+  // a step runs. When another connection writes to the source, the next
+  // step starts the copy over, writes through the source connection itself
+  // are copied along.
+  class Backup {
+  public:
+    Backup();
+    ~Backup();
+
+    // The destination connection stays owned by the caller
+    int Open(sqlite3* destination, sqlite3* source);
+    // Opens or creates the file as the destination, it is closed with the
+    // backup. Steps wait up to the timeout for other connections to release
+    // the file.
+    int OpenFile(const char* destinationPath, sqlite3* source, int busyTimeoutMilliseconds);
+
+    // Copies up to pages pages, negative copies all that remain. Returns
+    // SQLITE_OK while pages remain and SQLITE_DONE once the copy is
+    // complete. A step that finds either database locked copies nothing and
+    // returns SQLITE_OK, the next one tries again.
+    int Step(int pages);
+    // Ends the backup, an incomplete copy leaves the destination unchanged.
+    // Returns the error of the last step, if any.
+    int Finish();
+
+    int Remaining() const;
+    int PageCount() const;
+    // Times the copy started over because the source changed
+    long long Restarts() const;
+    // Steps that found a database locked
+    long long LockedSteps() const;
+    const char* ErrorMessage() const;
+
+  private:
+    Backup(const Backup&);
+    Backup& operator=(const Backup&);
+
+    int start(sqlite3* destination, sqlite3* source);
+    void closeDestination();
+
+    sqlite3* destination;
+    bool ownsDestination;
+    sqlite3_backup* backup;
+    int remaining;
+    int pageCount;
+    int copied;
+    long long restarts;
+    long long lockedSteps;
+  };
+}
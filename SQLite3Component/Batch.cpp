@@ -0,0 +1,149 @@
+#include <sstream>
+
+#include "Batch.h"
+#include "RowWriter.h"
+#include "WriteCoordinator.h"
+
+namespace SQLite3 {
+  namespace {
+    const char* const savepoint = "sqlite3_batch";
+
+    int execute(sqlite3* db, const std::string& sql) {
+      return sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr);
+    }
+
+    // Rolls the savepoint back unless it was released, also when a binder
+    // throws
+    class Savepoint {
+    public:
+      explicit Savepoint(sqlite3* db) : db(db), open(false) {}
+
+      ~Savepoint() {
+        if (open) {
+          execute(db, std::string("ROLLBACK TO ") + savepoint);
+          execute(db, std::string("RELEASE ") + savepoint);
+        }
+      }
+
+      int Begin() {
+        int result = execute(db, std::string("SAVEPOINT ") + savepoint);
+        open = result == SQLITE_OK;
+        return result;
+      }
+
+      int Release() {
+        int result = execute(db, std::string("RELEASE ") + savepoint);
+        open = result != SQLITE_OK;
+        return result;
+      }
+
+    private:
+      sqlite3* db;
+      bool open;
+    };
+
+    class StatementGuard {
+    public:
+      StatementGuard() : statement(nullptr) {}
+      ~StatementGuard() {
+        sqlite3_finalize(statement);
+      }
+
+      sqlite3_stmt* statement;
+    };
+
+    // Waits for shared cache locks while no row was returned yet
+    int step(sqlite3_stmt* statement, UnlockWait* unlockWait, bool restartable) {
+      return unlockWait ? unlockWait->Step(statement, restartable) : sqlite3_step(statement);
+    }
+
+    // Runs the statement and writes its result, returns a result code
+    int run(sqlite3* db, sqlite3_stmt* statement, UnlockWait* unlockWait, std::string& result) {
+      result.clear();
+      int stepResult;
+      if (sqlite3_column_count(statement) > 0) {
+        RowWriter writer(statement);
+        result = "{\"rows\":[";
+        bool first = true;
+        while ((stepResult = step(statement, unlockWait, first)) == SQLITE_ROW) {
+          if (!first) {
+            result.push_back(',');
+          }
+          first = false;
+          writer.WriteRow(result);
+        }
+        result += "]}";
+      } else {
+        while ((stepResult = step(statement, unlockWait, true)) == SQLITE_ROW) {
+        }
+        std::ostringstream changes;
+        changes << "{\"changes\":" << sqlite3_changes(db) << ",\"lastInsertRowId\":" << sqlite3_last_insert_rowid(db) << '}';
+        result = changes.str();
+      }
+      return stepResult == SQLITE_DONE ? SQLITE_OK : stepResult;
+    }
+  }
+
+  BatchResult ExecuteBatch(sqlite3* db, const std::vector<std::string>& sql, BatchBinder* binder, bool transactional, bool coordinateWrites,
+    UnlockWait* unlockWait) {
+    BatchResult result;
+    result.resultCode = SQLITE_OK;
+    result.entry = 0;
+
+    // Declared first, so the savepoint is rolled back before it
+    WriteTransaction write(db);
+    Savepoint transaction(db);
+    if (transactional && coordinateWrites) {
+      result.resultCode = write.Begin();
+    }
+    if (transactional && result.resultCode == SQLITE_OK) {
+      result.resultCode = transaction.Begin();
+    }
+
+    std::string entryResult;
+    result.json.push_back('[');
+    for (size_t entry = 0; entry < sql.size() && result.resultCode == SQLITE_OK; ++entry) {
+      result.entry = entry;
+      entryResult = "{\"changes\":0,\"lastInsertRowId\":0}";
+      int offset = 0;
+      const char* tail = sql[entry].c_str();
+      while (*tail && result.resultCode == SQLITE_OK) {
+        StatementGuard guard;
+        result.resultCode = unlockWait ? unlockWait->Prepare(db, tail, &guard.statement, &tail)
+          : sqlite3_prepare_v2(db, tail, -1, &guard.statement, &tail);
+        if (result.resultCode != SQLITE_OK || !guard.statement) {
+          // Only whitespace or comments were left
+          break;
+        }
+        if (binder) {
+          result.resultCode = binder->Bind(entry, offset, guard.statement);
+          offset += sqlite3_bind_parameter_count(guard.statement);
+        }
+        if (result.resultCode == SQLITE_OK) {
+          result.resultCode = run(db, guard.statement, unlockWait, entryResult);
+        }
+      }
+      if (result.resultCode == SQLITE_OK) {
+        if (entry) {
+          result.json.push_back(',');
+        }
+        result.json += entryResult;
+      }
+    }
+    result.json.push_back(']');
+
+    if (result.resultCode == SQLITE_OK && transactional) {
+      result.resultCode = transaction.Release();
+    }
+    if (result.resultCode == SQLITE_OK) {
+      result.resultCode = write.Commit();
+    }
+    if (result.resultCode != SQLITE_OK) {
+      std::ostringstream message;
+      message << "Statement " << result.entry + 1 << ": " << sqlite3_errmsg(db);
+      result.message = message.str();
+      result.json.clear();
+    }
+    return result;
+  }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "sqlite3.h"
+#include "UnlockWait.h"
+
+namespace SQLite3 {
+  // Binds the parameters of a batch entry. The SQL of an entry may consist of
+  // several statements, Bind is called for each of them. offset is the number
+  // of positional parameters the previous statements of the entry used.
+  class BatchBinder {
+  public:
+    virtual ~BatchBinder() {}
+    // Returns a SQLite result code, binders may also throw
+    virtual int Bind(size_t entry, int offset, sqlite3_stmt* statement) = 0;
+  };
+
+  struct BatchResult {
+    int resultCode;
+    std::string message;
+    // Index of the entry that failed
+    size_t entry;
+    // A JSON array with the result of the last statement of every entry,
+    // {"rows":[...]} when it returned columns and
+    // {"changes":n,"lastInsertRowId":id} otherwise
+    std::string json;
+  };
+
+  // Runs the entries back to back. With transactional set they run inside a
+  // savepoint that is rolled back when one of them fails, otherwise the
+  // entries before the failing one keep their changes. With coordinateWrites
+  // also set the savepoint is opened inside a WriteTransaction. Statements
+  // wait for the table locks of a shared cache when unlockWait is given.
+  BatchResult ExecuteBatch(sqlite3* db, const std::vector<std::string>& sql, BatchBinder* binder, bool transactional, bool coordinateWrites,
+    UnlockWait* unlockWait);
+}
@@ -0,0 +1,79 @@
+#include "Blob.h"
+
+namespace SQLite3 {
+  Blob::Blob()
+    : db(nullptr)
+    , blob(nullptr) {
+  }
+
+  Blob::~Blob() {
+    Close();
+  }
+
+  int Blob::Open(sqlite3* db, const char* table, const char* column, sqlite3_int64 rowId, bool writable) {
+    Close();
+    this->db = db;
+    int result = sqlite3_blob_open(db, "main", table, column, rowId, writable ? 1 : 0, &blob);
+    if (result != SQLITE_OK) {
+      // sqlite3_blob_open may hand out a handle even when it fails
+      sqlite3_blob_close(blob);
+      blob = nullptr;
+    }
+    return result;
+  }
+
+  int Blob::Reopen(sqlite3_int64 rowId) {
+    if (!blob) {
+      return SQLITE_MISUSE;
+    }
+    return sqlite3_blob_reopen(blob, rowId);
+  }
+
+  int Blob::Close() {
+    int result = sqlite3_blob_close(blob);
+    blob = nullptr;
+    return result;
+  }
+
+  int Blob::Read(sqlite3_int64 offset, void* buffer, int count, int& read) {
+    read = 0;
+    if (!blob) {
+      return SQLITE_MISUSE;
+    }
+    if (offset < 0 || count < 0) {
+      return SQLITE_RANGE;
+    }
+    sqlite3_int64 size = sqlite3_blob_bytes(blob);
+    if (offset >= size || count == 0) {
+      return SQLITE_OK;
+    }
+    int length = static_cast<int>(count < size - offset ? count : size - offset);
+    int result = sqlite3_blob_read(blob, buffer, length, static_cast<int>(offset));
+    if (result == SQLITE_OK) {
+      read = length;
+    }
+    return result;
+  }
+
+  int Blob::Write(sqlite3_int64 offset, const void* data, int count) {
+    if (!blob) {
+      return SQLITE_MISUSE;
+    }
+    if (offset < 0 || count < 0 || offset + count > sqlite3_blob_bytes(blob)) {
+      return SQLITE_RANGE;
+    }
+    return sqlite3_blob_write(blob, data, count, static_cast<int>(offset));
+  }
+
+  bool Blob::IsOpen() const {
+    return blob != nullptr;
+  }
+
+  int Blob::Size() const {
+    return blob ? sqlite3_blob_bytes(blob) : 0;
+  }
+
+  const char* Blob::ErrorMessage() const {
+    return db ? sqlite3_errmsg(db) : "Blob is not open";
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  // Incremental access to a single BLOB value through sqlite3_blob_open, so
+  // large values can be read and written in chunks. Changing the row through
+  // SQL expires the handle, every call then fails with SQLITE_ABORT until it
+  // is reopened.
+  class Blob {
+  public:
+    Blob();
+    ~Blob();
+
+    int Open(sqlite3* db, const char* table, const char* column, sqlite3_int64 rowId, bool writable);
+    // Moves the open handle to another row of the same table and column
+    int Reopen(sqlite3_int64 rowId);
+    int Close();
+
+    // Reads up to count bytes at offset. Reads past the end are shortened,
+    // the number of bytes read is stored in read.
+    int Read(sqlite3_int64 offset, void* buffer, int count, int& read);
+    // The size of a BLOB is fixed, writes must lie within it
+    int Write(sqlite3_int64 offset, const void* data, int count);
+
+    bool IsOpen() const;
+    int Size() const;
+    const char* ErrorMessage() const;
+
+  private:
+    Blob(const Blob&);
+    Blob& operator=(const Blob&);
+
+    sqlite3* db;
+    sqlite3_blob* blob;
+  };
+}
@@ -0,0 +1,78 @@
+#include <ppltasks.h>
+
+#include <robuffer.h>
+
+#include "BlobStream.h"
+#include "Database.h"
+
+namespace SQLite3 {
+  ZeroBlob::ZeroBlob(int size)
+    : size(size) {
+    if (size < 0) {
+      throw ref new Platform::InvalidArgumentException(L"Size must not be negative");
+    }
+  }
+
+  BlobStream::BlobStream(Database^ database, std::unique_ptr<Blob> blob)
+    : database(database)
+    , blob(std::move(blob)) {
+  }
+
+  // The context of the connection is entered before the lock of the
+  // stream, as by a scheduled operation that releases the last reference
+
+  BlobStream::~BlobStream() {
+    ExecutionContext::Scope scope(database->Context());
+    std::lock_guard<std::mutex> lock(mutex);
+    blob->Close();
+  }
+
+  int64 BlobStream::Size::get() {
+    ExecutionContext::Scope scope(database->Context());
+    std::lock_guard<std::mutex> lock(mutex);
+    return blob->Size();
+  }
+
+  Windows::Foundation::IAsyncOperation<Windows::Storage::Streams::IBuffer^>^ BlobStream::ReadAsync(int64 offset, unsigned int count) {
+    return Concurrency::create_async([this, offset, count]() -> Windows::Storage::Streams::IBuffer^ {
+      ExecutionContext::Scope scope(database->Context());
+      std::lock_guard<std::mutex> lock(mutex);
+      auto buffer = ref new Windows::Storage::Streams::Buffer(count);
+      byte* data;
+      winrt_as<Windows::Storage::Streams::IBufferByteAccess>(buffer)->Buffer(&data);
+      int read;
+      throwIfFailed(blob->Read(offset, data, static_cast<int>(count), read));
+      buffer->Length = static_cast<unsigned int>(read);
+      return buffer;
+    });
+  }
+
+  Windows::Foundation::IAsyncAction^ BlobStream::WriteAsync(int64 offset, Windows::Storage::Streams::IBuffer^ buffer) {
+    if (!buffer) {
+      throw ref new Platform::InvalidArgumentException(L"Buffer must not be null");
+    }
+    return Concurrency::create_async([this, offset, buffer]() {
+      ExecutionContext::Scope scope(database->Context());
+      std::lock_guard<std::mutex> lock(mutex);
+      byte* data;
+      winrt_as<Windows::Storage::Streams::IBufferByteAccess>(buffer)->Buffer(&data);
+      throwIfFailed(blob->Write(offset, data, static_cast<int>(buffer->Length)));
+    });
+  }
+
+  Windows::Foundation::IAsyncAction^ BlobStream::ReopenAsync(int64 rowId) {
+    return Concurrency::create_async([this, rowId]() {
+      ExecutionContext::Scope scope(database->Context());
+      std::lock_guard<std::mutex> lock(mutex);
+      throwIfFailed(blob->Reopen(rowId));
+    });
+  }
+
+  void BlobStream::throwIfFailed(int resultCode) {
+    if (resultCode == SQLITE_RANGE) {
+      throwSQLiteError(resultCode, ref new Platform::String(L"Offset and count must lie within the blob"));
+    } else if (resultCode != SQLITE_OK) {
+      throwSQLiteError(resultCode, ToPlatformString(blob->ErrorMessage()));
+    }
+  }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <mutex>
+
+#include "Blob.h"
+#include "Common.h"
+
+namespace SQLite3 {
+  // Binding a ZeroBlob inserts a BLOB of the given size filled with zeros,
+  // which can then be written in chunks through a BlobStream
+  public ref class ZeroBlob sealed {
+  public:
+    ZeroBlob(int size);
+
+    property int Size {
+      int get() {
+        return size;
+      };
+    }
+
+  private:
+    int size;
+  };
+
+  // Reads and writes a single BLOB value in chunks instead of copying it
+  // whole through the JSON rows
+  public ref class BlobStream sealed {
+  public:
+    virtual ~BlobStream();
+
+    Windows::Foundation::IAsyncOperation<Windows::Storage::Streams::IBuffer^>^ ReadAsync(int64 offset, unsigned int count);
+    Windows::Foundation::IAsyncAction^ WriteAsync(int64 offset, Windows::Storage::Streams::IBuffer^ buffer);
+    // Moves the stream to the same column of another row
+    Windows::Foundation::IAsyncAction^ ReopenAsync(int64 rowId);
+
+    property int64 Size {
+      int64 get();
+    }
+
+  internal:
+    BlobStream(Database^ database, std::unique_ptr<Blob> blob);
+
+  private:
+    void throwIfFailed(int resultCode);
+
+    // Keeps the connection open as long as the BLOB handle is
+    Database^ database;
+    std::unique_ptr<Blob> blob;
+    std::mutex mutex;
+  };
+}
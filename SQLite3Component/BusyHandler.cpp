@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <thread>
+
+#include "BusyHandler.h"
+
+namespace SQLite3 {
+  BusyPolicy::BusyPolicy()
+    : kind(BusyBackoff)
+    , timeoutMilliseconds(5000)
+    , initialDelayMilliseconds(2)
+    , maxDelayMilliseconds(100) {
+  }
+
+  BusyHandler::BusyHandler()
+    : operationStart(Clock::now())
+    , budgeted(false)
+    , random(static_cast<std::minstd_rand::result_type>(Clock::now().time_since_epoch().count())) {
+    counters.waits = 0;
+    counters.retries = 0;
+    counters.failures = 0;
+    counters.waitMicroseconds = 0;
+    counters.longestWaitMicroseconds = 0;
+  }
+
+  void BusyHandler::Install(sqlite3* db) {
+    sqlite3_busy_handler(db, onBusy, this);
+  }
+
+  BusyPolicy BusyHandler::Policy() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return policy;
+  }
+
+  void BusyHandler::SetPolicy(const BusyPolicy& policy) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->policy = policy;
+  }
+
+  void BusyHandler::BeginOperation() {
+    std::lock_guard<std::mutex> lock(mutex);
+    operationStart = Clock::now();
+    budgeted = false;
+  }
+
+  void BusyHandler::BeginOperation(unsigned budgetMilliseconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    operationStart = Clock::now();
+    budgeted = true;
+    budgetEnd = operationStart + std::chrono::milliseconds(budgetMilliseconds);
+  }
+
+  BusyCounters BusyHandler::Counters() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+  }
+
+  int BusyHandler::onBusy(void* handler, int count) {
+    return static_cast<BusyHandler*>(handler)->busy(count);
+  }
+
+  // Called by SQLite with the number of times it was called before for the
+  // same lock, returning zero gives up
+  int BusyHandler::busy(int count) {
+    Clock::time_point start;
+    unsigned sleepMilliseconds;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      Clock::time_point now = Clock::now();
+      if (count == 0) {
+        waitStart = now;
+        ++counters.waits;
+      }
+      start = waitStart;
+
+      Clock::time_point deadline = (policy.kind == BusyDeadline ? operationStart : waitStart) +
+        std::chrono::milliseconds(policy.timeoutMilliseconds);
+      if (budgeted) {
+        deadline = std::min(deadline, budgetEnd);
+      }
+      if (policy.kind == BusyFail || now >= deadline) {
+        ++counters.failures;
+        return 0;
+      }
+      long long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1;
+      sleepMilliseconds = static_cast<unsigned>(std::min<long long>(delay(count), remaining));
+      ++counters.retries;
+    }
+
+    Clock::time_point before = Clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(sleepMilliseconds));
+    Clock::time_point after = Clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.waitMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(after - before).count();
+    counters.longestWaitMicroseconds = std::max<long long>(counters.longestWaitMicroseconds,
+      std::chrono::duration_cast<std::chrono::microseconds>(after - start).count());
+    return 1;
+  }
+
+  unsigned BusyHandler::delay(int count) {
+    unsigned initial = std::max(policy.initialDelayMilliseconds, 1u);
+    if (policy.kind == BusyTimeout) {
+      return initial;
+    }
+    // Doubles up to the maximum, then picks a random delay between half and
+    // all of it so competing connections do not retry in lockstep
+    unsigned ceiling = initial;
+    for (int i = 0; i < count && ceiling < policy.maxDelayMilliseconds; ++i) {
+      ceiling *= 2;
+    }
+    ceiling = std::max(std::min(ceiling, policy.maxDelayMilliseconds), 1u);
+    return ceiling / 2 + static_cast<unsigned>(random() % (ceiling - ceiling / 2 + 1));
+  }
+}
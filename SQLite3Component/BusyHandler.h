@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <random>
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  enum BusyPolicyKind {
+    // Fails with SQLITE_BUSY right away, the SQLite default
+    BusyFail,
+    // Retries at a fixed interval until the timeout
+    BusyTimeout,
+    // Retries after exponentially growing, jittered delays until the timeout
+    BusyBackoff,
+    // Like BusyBackoff, but the timeout counts from the start of the
+    // operation, so all waits of one operation share it
+    BusyDeadline
+  };
+
+  struct BusyPolicy {
+    BusyPolicy();
+
+    BusyPolicyKind kind;
+    unsigned timeoutMilliseconds;
+    // The fixed interval of BusyTimeout and the first delay of the backoff
+    unsigned initialDelayMilliseconds;
+    unsigned maxDelayMilliseconds;
+  };
+
+  struct BusyCounters {
+    // Times the database was found locked
+    long long waits;
+    long long retries;
+    // Waits that ended with SQLITE_BUSY
+    long long failures;
+    long long waitMicroseconds;
+    long long longestWaitMicroseconds;
+  };
+
+  // The busy handler of a connection, waiting for the locks of other
+  // connections or processes according to the policy and counting the
+  // waits.
+  class BusyHandler {
+  public:
+    BusyHandler();
+
+    // Replaces the connection's busy handler or timeout
+    void Install(sqlite3* db);
+
+    BusyPolicy Policy() const;
+    void SetPolicy(const BusyPolicy& policy);
+
+    // Starts the deadline of BusyDeadline, to be called on the thread that
+    // runs the operation
+    void BeginOperation();
+    // Like BeginOperation, but the waits of the operation also end after the
+    // budget, whatever the policy allows
+    void BeginOperation(unsigned budgetMilliseconds);
+
+    BusyCounters Counters() const;
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    BusyHandler(const BusyHandler&);
+    BusyHandler& operator=(const BusyHandler&);
+
+    static int onBusy(void* handler, int count);
+    int busy(int count);
+    unsigned delay(int count);
+
+    mutable std::mutex mutex;
+    BusyPolicy policy;
+    Clock::time_point operationStart;
+    bool budgeted;
+    Clock::time_point budgetEnd;
+    Clock::time_point waitStart;
+    std::minstd_rand random;
+    BusyCounters counters;
+  };
+}
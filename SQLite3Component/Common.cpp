@@ -40,15 +40,34 @@ namespace SQLite3 {
   }
 
   std::wstring ToWString(const char* utf8String, unsigned int length) {
-    DWORD numCharacters = MultiByteToWideChar(CP_UTF8, 0, utf8String, length, nullptr, 0);
-    auto wideText = new std::wstring::value_type[numCharacters];
-    MultiByteToWideChar(CP_UTF8, 0, utf8String, length, wideText, numCharacters);
-    std::wstring result(wideText);
-    delete[] wideText;
+    int inputLength = static_cast<int>(length);
+    int numCharacters = MultiByteToWideChar(CP_UTF8, 0, utf8String, inputLength, nullptr, 0);
+    std::wstring result(numCharacters, L'\0');
+    if (numCharacters > 0) {
+      MultiByteToWideChar(CP_UTF8, 0, utf8String, inputLength, &result[0], numCharacters);
+    }
+    // A length of -1 makes the conversion include the terminating null character
+    if (inputLength == -1 && numCharacters > 0) {
+      result.resize(numCharacters - 1);
+    }
     return result;
   }
 
   Platform::String^ ToPlatformString(const char* utf8String, unsigned int length) {
-    return ref new Platform::String(ToWString(utf8String, length).data());
+    auto text = ToWString(utf8String, length);
+    return ref new Platform::String(text.data(), static_cast<unsigned int>(text.length()));
+  }
+
+  std::string ToUtf8String(Platform::String^ text) {
+    if (!text || text->IsEmpty()) {
+      return std::string();
+    }
+    int inputLength = static_cast<int>(text->Length());
+    int numBytes = WideCharToMultiByte(CP_UTF8, 0, text->Data(), inputLength, nullptr, 0, nullptr, nullptr);
+    std::string result(numBytes, '\0');
+    if (numBytes > 0) {
+      WideCharToMultiByte(CP_UTF8, 0, text->Data(), inputLength, &result[0], numBytes, nullptr, nullptr);
+    }
+    return result;
   }
 }
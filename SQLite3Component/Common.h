@@ -1,6 +1,7 @@
 #pragma once;
 
 #include <memory>
+#include <string>
 #include <vector>
 #include <wrl\client.h>
 #include "sqlite3.h"
@@ -23,6 +24,7 @@ namespace SQLite3 {
   void throwSQLiteError(int resultCode, Platform::String^ message = nullptr);
   std::wstring ToWString(const char* utf8String, unsigned int length = -1);
   Platform::String^ ToPlatformString(const char* utf8String, unsigned int length = -1);
+  std::string ToUtf8String(Platform::String^ text);
 
   template <typename To>
   Microsoft::WRL::ComPtr<To> winrt_as(Platform::Object^ const from) {
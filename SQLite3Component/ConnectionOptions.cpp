@@ -0,0 +1,88 @@
+#include <cctype>
+#include <iomanip>
+#include <sstream>
+
+#include "ConnectionOptions.h"
+
+// Not in the sqlite3.h the component is compiled with yet. sqlite3_limit
+// returns -1 for limits the library does not know.
+#ifndef SQLITE_LIMIT_WORKER_THREADS
+#define SQLITE_LIMIT_WORKER_THREADS 11
+#endif
+
+namespace SQLite3 {
+  namespace {
+    // SQLITE_DEFAULT_LOOKASIDE, used when only one of the two is given
+    const int defaultLookasideSlotSize = 1200;
+    const int defaultLookasideSlotCount = 100;
+  }
+
+  ConnectionOptions::ConnectionOptions()
+    : lookasideSlotSize(-1)
+    , lookasideSlotCount(-1)
+    , loadIntoMemory(false)
+    , persistIntervalMilliseconds(0)
+    , immutable(false)
+    , noMutex(false)
+    , coordinateWrites(false)
+    , mmapSize(-1)
+    , workerThreads(-1)
+    , pageProfile(false) {
+  }
+
+  std::string ImmutableUri(const std::string& path) {
+    std::string uri = "file:";
+    // Windows paths start with a drive letter, which SQLite expects after an
+    // empty authority
+    if (path.size() >= 2 && std::isalpha(static_cast<unsigned char>(path[0])) && path[1] == ':') {
+      uri += "///";
+    }
+    for (std::string::size_type i = 0; i < path.size(); ++i) {
+      char c = path[i];
+      if (c == '\\') {
+        uri += '/';
+      } else if (c == '%' || c == '?' || c == '#' || c == ' ') {
+        std::ostringstream escaped;
+        escaped << '%' << std::uppercase << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(static_cast<unsigned char>(c));
+        uri += escaped.str();
+      } else {
+        uri += c;
+      }
+    }
+    return uri + "?immutable=1&nolock=1";
+  }
+
+  int SetWorkerThreads(sqlite3* db, int threads) {
+    sqlite3_limit(db, SQLITE_LIMIT_WORKER_THREADS, threads);
+    return WorkerThreads(db);
+  }
+
+  int WorkerThreads(sqlite3* db) {
+    return sqlite3_limit(db, SQLITE_LIMIT_WORKER_THREADS, -1);
+  }
+
+  int ApplyConnectionOptions(sqlite3* db, const ConnectionOptions& options) {
+    if (options.lookasideSlotSize >= 0 || options.lookasideSlotCount >= 0) {
+      // Lookaside can only be reconfigured while none of its slots are in
+      // use, which is the case for a freshly opened connection
+      int result = sqlite3_db_config(db, SQLITE_DBCONFIG_LOOKASIDE, nullptr,
+        options.lookasideSlotSize >= 0 ? options.lookasideSlotSize : defaultLookasideSlotSize,
+        options.lookasideSlotCount >= 0 ? options.lookasideSlotCount : defaultLookasideSlotCount);
+      if (result != SQLITE_OK) {
+        return result;
+      }
+    }
+    if (options.mmapSize >= 0) {
+      std::ostringstream pragma;
+      pragma << "PRAGMA mmap_size = " << options.mmapSize;
+      int result = sqlite3_exec(db, pragma.str().c_str(), nullptr, nullptr, nullptr);
+      if (result != SQLITE_OK) {
+        return result;
+      }
+    }
+    if (options.workerThreads >= 0) {
+      SetWorkerThreads(db, options.workerThreads);
+    }
+    return SQLITE_OK;
+  }
+}
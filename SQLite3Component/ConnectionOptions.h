@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  // Per connection settings that are applied once, right after the database
+  // has been opened. Negative values keep the SQLite defaults.
+  struct ConnectionOptions {
+    ConnectionOptions();
+
+    // Size in bytes and number of the lookaside slots small allocations of
+    // the parser and the VDBE are served from without locking
+    int lookasideSlotSize;
+    int lookasideSlotCount;
+
+    // Loads the file into an in-memory connection, see MemoryDatabase. Not
+    // applied by ApplyConnectionOptions, the caller opens the connection
+    // accordingly.
+    bool loadIntoMemory;
+    // Milliseconds between writing the changes of an in-memory connection
+    // back to the file, zero only writes them when asked to
+    int persistIntervalMilliseconds;
+
+    // Opens the file read only as immutable, see ImmutableUri. SQLite then
+    // takes no locks and never checks whether another connection changed
+    // the file. Not applied by ApplyConnectionOptions either.
+    bool immutable;
+    // Opens the connection with SQLITE_OPEN_NOMUTEX, the caller then keeps
+    // more than one thread from using it at a time, see ExecutionContext.
+    // Not applied by ApplyConnectionOptions either.
+    bool noMutex;
+    // Write transactions of the component queue for their turn on the file,
+    // see WriteTransaction. Not applied by ApplyConnectionOptions either.
+    bool coordinateWrites;
+    // Bytes of the database file that are memory mapped instead of read
+    // into the page cache, PRAGMA mmap_size
+    long long mmapSize;
+
+    // Auxiliary threads the sorter may use for large ORDER BY, GROUP BY and
+    // CREATE INDEX, see SetWorkerThreads
+    int workerThreads;
+
+    // Opens the file through the PageProfile VFS, which records the pages
+    // read after opening and prefetches them on the next open
+    bool pageProfile;
+
+    // Statements prepared right after opening, so their first run finds
+    // them in the connection's statement cache
+    std::vector<std::string> prepareStatements;
+  };
+
+  // mmap_size used for immutable databases when none is given, the file
+  // can not change under the mapping
+  const long long defaultImmutableMmapSize = 256 * 1024 * 1024;
+
+  // The URI that opens the file immutable and without locking, for
+  // sqlite3_open_v2 with SQLITE_OPEN_URI
+  std::string ImmutableUri(const std::string& path);
+
+  // Sets the upper bound of the auxiliary threads the sorter of the
+  // connection starts, PRAGMA threads, and returns the bound in effect. The
+  // library caps it at SQLITE_MAX_WORKER_THREADS, zero sorts on the calling
+  // thread only. Returns -1 for libraries older than 3.8.7, which always
+  // sort on the calling thread.
+  int SetWorkerThreads(sqlite3* db, int threads);
+  int WorkerThreads(sqlite3* db);
+
+  // Returns the SQLite result code of the first setting that failed
+  int ApplyConnectionOptions(sqlite3* db, const ConnectionOptions& options);
+}
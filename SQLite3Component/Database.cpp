@@ -2,12 +2,25 @@
 #include <ppltasks.h>
 
 #include <collection.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <map>
-#include <regex>
+#include <mutex>
+#include <sstream>
 #include <assert.h>
 
 #include "Database.h"
 #include "Statement.h"
+#include "SqlFunctions.h"
+#include "PageCache.h"
+#include "MemoryAllocator.h"
+#include "ConnectionOptions.h"
+#include "Importer.h"
+#include "Exporter.h"
+#include "Batch.h"
 
 using Windows::UI::Core::CoreDispatcher;
 using Windows::UI::Core::CoreDispatcherPriority;
@@ -33,18 +46,7 @@ namespace SQLite3 {
   }
 
   static int WinLocaleCollateUtf8(void* data, int str1Length, const void* str1Data, int str2Length, const void* str2Data) {
-    std::wstring string1 = ToWString((const char*)str1Data, str1Length);
-    std::wstring string2 = ToWString((const char*)str2Data, str2Length);
-    // SQLite expects unsigned int argument but length returns size_t (unsigned machine word). I think its safe to cast this warning away here
-    // since "no one ever needs strings bigger than 2 GB in size". If they do, they have to fix the signature and internals of SQLite themself.
-    return WinLocaleCollateUtf16(data, (int)(string1.length()*sizeof(wchar_t)), string1.c_str(), (int)(string2.length()*sizeof(wchar_t)), string2.c_str());
-  }
-
-  static void SqliteRegexUtf16( sqlite3_context *context, int argc, sqlite3_value **argv ) {
-    const wchar_t* patternText = (const wchar_t*) sqlite3_value_text16(argv[0]);
-    std::wstring searchText((const wchar_t*) sqlite3_value_text16(argv[1]));
-    std::wregex regex(patternText);
-    sqlite3_result_int(context, std::regex_search(searchText.begin(), searchText.end(), regex) ? 1 : 0);
+    return CollateUtf8AsUtf16(WinLocaleCollateUtf16, data, str1Length, str1Data, str2Length, str2Data);
   }
 
   static SafeParameterVector CopyParameters(ParameterVector^ params) {
@@ -57,6 +59,170 @@ namespace SQLite3 {
     return paramsCopy;
   }
 
+  // Rows of OneAsync or AllAsync kept in the result cache
+  class CachedRows : public CachedResult {
+  public:
+    explicit CachedRows(Platform::String^ rows) : rows(rows) {}
+
+    Platform::String^ rows;
+  };
+
+  // Appends a parameter to a result cache key, returns false for values that
+  // can not be part of a key, e.g. BLOBs
+  static bool AppendCacheKeyValue(std::string& key, Platform::Object^ value) {
+    std::ostringstream text;
+    // Enough digits to tell all doubles apart
+    text.precision(17);
+    if (value == nullptr) {
+      text << 'n';
+    } else {
+      switch (Platform::Type::GetTypeCode(value->GetType())) {
+      case Platform::TypeCode::DateTime:
+        text << 'd' << static_cast<Windows::Foundation::DateTime>(value).UniversalTime;
+        break;
+      case Platform::TypeCode::Double:
+        text << 'f' << static_cast<double>(value);
+        break;
+      case Platform::TypeCode::String:
+        text << 's' << ToUtf8String(static_cast<Platform::String^>(value));
+        break;
+      case Platform::TypeCode::Boolean:
+        text << (static_cast<Platform::Boolean>(value) ? "i1" : "i0");
+        break;
+      case Platform::TypeCode::Int8:
+      case Platform::TypeCode::Int16:
+      case Platform::TypeCode::Int32:
+      case Platform::TypeCode::UInt8:
+      case Platform::TypeCode::UInt16:
+      case Platform::TypeCode::UInt32:
+        text << 'i' << static_cast<int>(value);
+        break;
+      case Platform::TypeCode::Int64:
+      case Platform::TypeCode::UInt64:
+        text << 'i' << static_cast<int64>(value);
+        break;
+      default:
+        return false;
+      }
+    }
+    key += text.str();
+    key.push_back('\0');
+    return true;
+  }
+
+  static bool ResultCacheKey(const char* kind, Platform::String^ sql, const SafeParameterVector& params, std::string& key) {
+    key = kind;
+    key.push_back('\0');
+    key += ToUtf8String(sql);
+    key.push_back('\0');
+    for (size_t i = 0; i < params.size(); ++i) {
+      if (!AppendCacheKeyValue(key, params[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Named parameters are sorted, the same values in another order give the
+  // same key
+  static bool ResultCacheKey(const char* kind, Platform::String^ sql, ParameterMap^ params, std::string& key) {
+    key = kind;
+    key.push_back('\0');
+    key += ToUtf8String(sql);
+    key.push_back('\0');
+    if (!params) {
+      return true;
+    }
+    std::map<std::string, Platform::Object^> sorted;
+    for (auto pair = params->First(); pair->HasCurrent; pair->MoveNext()) {
+      sorted[ToUtf8String(pair->Current->Key)] = pair->Current->Value;
+    }
+    for (auto param = sorted.begin(); param != sorted.end(); ++param) {
+      key += param->first;
+      key.push_back('=');
+      if (!AppendCacheKeyValue(key, param->second)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template <typename Result>
+  static void FailClosed(const Concurrency::task_completion_event<Result>& done) {
+    try {
+      throwSQLiteError(SQLITE_MISUSE, ref new Platform::String(L"The database was closed"));
+    } catch (...) {
+      done.set_exception(std::current_exception());
+    }
+  }
+
+  // Completion of an operation owned by its queued jobs. Fails the
+  // operation when the last of them is dropped before settling it, which
+  // happens when the connection closes with the job still queued.
+  template <typename Result>
+  struct PendingTask {
+    PendingTask()
+      : settled(false) {
+    }
+
+    ~PendingTask() {
+      if (!settled) {
+        FailClosed(done);
+      }
+    }
+
+    Concurrency::task_completion_event<Result> done;
+    bool settled;
+  };
+
+  // State of a BackupAsync shared by the jobs running its steps
+  struct BackupOperation : PendingTask<int64> {
+    BackupOperation(const std::string& destinationPath, int pagesPerStep, unsigned pauseMilliseconds,
+      SchedulerPriority priority, Concurrency::progress_reporter<BackupProgress> reporter, Concurrency::cancellation_token token)
+      : destinationPath(destinationPath)
+      , pagesPerStep(pagesPerStep)
+      , pauseMilliseconds(pauseMilliseconds)
+      , priority(priority)
+      , reporter(reporter)
+      , token(token)
+      , opened(false) {
+    }
+
+    std::string destinationPath;
+    int pagesPerStep;
+    unsigned pauseMilliseconds;
+    SchedulerPriority priority;
+    Concurrency::progress_reporter<BackupProgress> reporter;
+    Concurrency::cancellation_token token;
+    bool opened;
+    Backup backup;
+  };
+
+  static BackupProgress ToBackupProgress(const Backup& backup) {
+    BackupProgress progress;
+    progress.PagesCopied = backup.PageCount() - backup.Remaining();
+    progress.PageCount = backup.PageCount();
+    progress.Restarts = backup.Restarts();
+    return progress;
+  }
+
+  // Files written by backups and persists wait for other connections like
+  // the database itself does
+  static int DestinationBusyTimeout(const BusyPolicy& policy) {
+    return policy.kind == BusyFail ? 0 : static_cast<int>(policy.timeoutMilliseconds);
+  }
+
+  template <typename Result, typename Work>
+  static void CompleteTask(const Concurrency::task_completion_event<Result>& done, Work& work) {
+    done.set(work());
+  }
+
+  template <typename Work>
+  static void CompleteTask(const Concurrency::task_completion_event<void>& done, Work& work) {
+    work();
+    done.set();
+  }
+
   static std::map<Platform::String^, Windows::ApplicationModel::Resources::ResourceLoader^> resourceLoaders;
   static void TranslateUtf16(sqlite3_context *context, int argc, sqlite3_value **argv) {
     int param0Type = sqlite3_value_type(argv[0]);
@@ -88,57 +254,430 @@ namespace SQLite3 {
     sqlite3_result_text16(context, translation->Data(), (translation->Length()+1)*sizeof(wchar_t), SQLITE_TRANSIENT);
   }
 
+  static double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0;
+  }
+
+  static int IntOption(ParameterMap^ options, Platform::String^ name, int defaultValue) {
+    if (!options || !options->HasKey(name)) {
+      return defaultValue;
+    }
+
+    auto value = options->Lookup(name);
+    switch (Platform::Type::GetTypeCode(value->GetType())) {
+    case Platform::TypeCode::Double:
+      return static_cast<int>(static_cast<double>(value));
+    case Platform::TypeCode::Int8:
+    case Platform::TypeCode::Int16:
+    case Platform::TypeCode::Int32:
+    case Platform::TypeCode::UInt8:
+    case Platform::TypeCode::UInt16:
+    case Platform::TypeCode::UInt32:
+      return static_cast<int>(value);
+    default:
+      throw ref new Platform::InvalidArgumentException(L"Option " + name + L" must be a number");
+    }
+  }
+
+  static bool BoolOption(ParameterMap^ options, Platform::String^ name, bool defaultValue) {
+    if (!options || !options->HasKey(name)) {
+      return defaultValue;
+    }
+
+    auto value = options->Lookup(name);
+    if (Platform::Type::GetTypeCode(value->GetType()) != Platform::TypeCode::Boolean) {
+      throw ref new Platform::InvalidArgumentException(L"Option " + name + L" must be a boolean");
+    }
+    return static_cast<Platform::Boolean>(value);
+  }
+
+  static std::string StringOption(ParameterMap^ options, Platform::String^ name) {
+    if (!options || !options->HasKey(name)) {
+      return std::string();
+    }
+
+    auto value = options->Lookup(name);
+    if (Platform::Type::GetTypeCode(value->GetType()) != Platform::TypeCode::String) {
+      throw ref new Platform::InvalidArgumentException(L"Option " + name + L" must be a string");
+    }
+    return ToUtf8String(static_cast<Platform::String^>(value));
+  }
+
+  // A JSON array of strings, WinRT property sets can not hold JavaScript
+  // arrays
+  static std::vector<std::string> StringListOption(ParameterMap^ options, Platform::String^ name) {
+    std::vector<std::string> list;
+    if (!options || !options->HasKey(name)) {
+      return list;
+    }
+
+    auto value = options->Lookup(name);
+    Windows::Data::Json::JsonArray^ array;
+    if (Platform::Type::GetTypeCode(value->GetType()) != Platform::TypeCode::String ||
+        !Windows::Data::Json::JsonArray::TryParse(static_cast<Platform::String^>(value), &array)) {
+      throw ref new Platform::InvalidArgumentException(L"Option " + name + L" must be a JSON array of strings");
+    }
+    for (unsigned i = 0; i < array->Size; ++i) {
+      auto item = array->GetAt(i);
+      if (item->ValueType != Windows::Data::Json::JsonValueType::String) {
+        throw ref new Platform::InvalidArgumentException(L"Option " + name + L" must be a JSON array of strings");
+      }
+      list.push_back(ToUtf8String(item->GetString()));
+    }
+    return list;
+  }
+
+  static ImportOptions ParseImportOptions(Platform::String^ format, Platform::String^ table, ParameterMap^ options) {
+    ImportOptions parsed;
+    if (format == L"csv") {
+      parsed.format = ImportCsv;
+    } else if (format == L"ndjson") {
+      parsed.format = ImportNdjson;
+    } else {
+      throw ref new Platform::InvalidArgumentException(L"Format must be csv or ndjson");
+    }
+    if (!table || table->IsEmpty()) {
+      throw ref new Platform::InvalidArgumentException(L"You must specify a table");
+    }
+    parsed.table = ToUtf8String(table);
+
+    // The JS wrapper passes the column names joined by commas
+    std::string columns = StringOption(options, L"columns");
+    for (size_t start = 0; start < columns.size();) {
+      size_t end = columns.find(',', start);
+      end = end == std::string::npos ? columns.size() : end;
+      parsed.columns.push_back(columns.substr(start, end - start));
+      start = end + 1;
+    }
+
+    parsed.header = BoolOption(options, L"header", parsed.header);
+    std::string delimiter = StringOption(options, L"delimiter");
+    if (delimiter.size() > 1) {
+      throw ref new Platform::InvalidArgumentException(L"The delimiter must be a single character");
+    } else if (delimiter.size() == 1) {
+      parsed.delimiter = delimiter[0];
+    }
+    parsed.batchSize = IntOption(options, L"batchSize", parsed.batchSize);
+    if (parsed.batchSize <= 0) {
+      throw ref new Platform::InvalidArgumentException(L"The batch size must be positive");
+    }
+    std::string conflict = StringOption(options, L"conflict");
+    std::transform(conflict.begin(), conflict.end(), conflict.begin(), ::toupper);
+    if (conflict != "" && conflict != "REPLACE" && conflict != "IGNORE") {
+      throw ref new Platform::InvalidArgumentException(L"Conflict must be replace or ignore");
+    }
+    parsed.conflict = conflict;
+    return parsed;
+  }
+
+  // Reads the file for the importer on the thread it runs on
+  class StreamImportSource : public ImportSource {
+  public:
+    explicit StreamImportSource(Windows::Storage::Streams::IInputStream^ stream)
+      : reader(ref new Windows::Storage::Streams::DataReader(stream)) {
+      reader->InputStreamOptions = Windows::Storage::Streams::InputStreamOptions::Partial;
+    }
+
+    size_t Read(char* buffer, size_t size) {
+      unsigned int loaded = Concurrency::create_task(reader->LoadAsync(static_cast<unsigned int>(size))).get();
+      if (loaded) {
+        reader->ReadBytes(Platform::ArrayReference<unsigned char>(reinterpret_cast<unsigned char*>(buffer), loaded));
+      }
+      return loaded;
+    }
+
+  private:
+    Windows::Storage::Streams::DataReader^ reader;
+  };
+
+  // Forwards importer and exporter progress to the async operation
+  class TaskProgress : public ImportProgress, public ExportProgress {
+  public:
+    TaskProgress(Concurrency::progress_reporter<int64> reporter, Concurrency::cancellation_token token)
+      : reporter(reporter)
+      , token(token) {
+    }
+
+    bool Report(long long rows) {
+      reporter.report(rows);
+      return !token.is_canceled();
+    }
+
+  private:
+    Concurrency::progress_reporter<int64> reporter;
+    Concurrency::cancellation_token token;
+  };
+
+  static ExportFormat ParseExportFormat(Platform::String^ format) {
+    auto name = ToUtf8String(format);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (name == "ndjson") {
+      return ExportNdjson;
+    } else if (name == "csv") {
+      return ExportCsv;
+    }
+    throw ref new Platform::InvalidArgumentException(L"Format must be ndjson or csv");
+  }
+
+  static ConnectionOptions ParseConnectionOptions(ParameterMap^ options) {
+    ConnectionOptions parsed;
+    parsed.lookasideSlotSize = IntOption(options, L"lookasideSlotSize", parsed.lookasideSlotSize);
+    parsed.lookasideSlotCount = IntOption(options, L"lookasideSlotCount", parsed.lookasideSlotCount);
+    parsed.loadIntoMemory = BoolOption(options, L"loadIntoMemory", parsed.loadIntoMemory);
+    parsed.persistIntervalMilliseconds = IntOption(options, L"persistInterval", parsed.persistIntervalMilliseconds);
+    if (parsed.persistIntervalMilliseconds < 0) {
+      throw ref new Platform::InvalidArgumentException(L"The persist interval must not be negative");
+    }
+    parsed.immutable = BoolOption(options, L"immutable", parsed.immutable);
+    if (parsed.immutable && parsed.loadIntoMemory) {
+      throw ref new Platform::InvalidArgumentException(L"An immutable database can not be loaded into memory");
+    }
+    parsed.noMutex = BoolOption(options, L"noMutex", parsed.noMutex);
+    parsed.coordinateWrites = BoolOption(options, L"coordinateWrites", parsed.coordinateWrites);
+    parsed.mmapSize = IntOption(options, L"mmapSize", -1);
+    if (parsed.immutable && parsed.mmapSize < 0) {
+      parsed.mmapSize = defaultImmutableMmapSize;
+    }
+    parsed.workerThreads = IntOption(options, L"threads", parsed.workerThreads);
+    parsed.prepareStatements = StringListOption(options, L"prepare");
+    parsed.pageProfile = BoolOption(options, L"pageProfile", parsed.pageProfile);
+    if (parsed.pageProfile && parsed.loadIntoMemory) {
+      throw ref new Platform::InvalidArgumentException(L"A database loaded into memory can not record a page profile");
+    }
+    return parsed;
+  }
+
   bool Database::sharedCache = false;
+  AllocatorKind Database::allocator = AllocatorKind::System;
+  bool Database::libraryConfigured = false;
+
+  // Global SQLite configuration has to happen before the library is
+  // initialized by the first sqlite3_open
+  void Database::configureLibrary() {
+    static std::once_flag configured;
+    std::call_once(configured, []() {
+      MemoryAllocator::Install(allocator == AllocatorKind::Pool ? MemoryAllocator::Pool : MemoryAllocator::System);
+      PageCache::Install();
+      TempStore::Install();
+      libraryConfigured = true;
+    });
+  }
+
+  PageCacheStatistics Database::GetPageCacheStatistics() {
+    PageCacheCounters counters = PageCache::Counters();
+    PageCacheStatistics statistics;
+    statistics.Hits = counters.hits;
+    statistics.Misses = counters.misses;
+    statistics.Evictions = counters.evictions;
+    statistics.Promotions = counters.promotions;
+    statistics.Pages = counters.pages;
+    statistics.Slabs = counters.slabs;
+    statistics.ArenaBytes = counters.arenaBytes;
+    return statistics;
+  }
+
+  PageProfileStatistics Database::GetPageProfileStatistics() {
+    PageProfileCounters counters = PageProfile::Counters();
+    PageProfileStatistics statistics;
+    statistics.RecordedPages = counters.recordedPages;
+    statistics.ProfilesWritten = counters.profilesWritten;
+    statistics.Prefetches = counters.prefetches;
+    statistics.PrefetchedPages = counters.prefetchedPages;
+    statistics.PrefetchReads = counters.prefetchReads;
+    statistics.PrefetchBytes = counters.prefetchBytes;
+    statistics.PrefetchMilliseconds = counters.prefetchMicroseconds / 1000.0;
+    return statistics;
+  }
+
+  TempStoreStatistics Database::GetTempStoreStatistics() {
+    TempStoreCounters counters = TempStore::Counters();
+    TempStoreStatistics statistics;
+    statistics.Spills = counters.spills;
+    statistics.SpilledBytes = counters.spilledBytes;
+    statistics.LiveBytes = counters.liveBytes;
+    statistics.PeakBytes = counters.peakBytes;
+    return statistics;
+  }
+
+  WriteCoordinatorStatistics Database::GetWriteCoordinatorStatistics() {
+    WriteCoordinatorCounters counters = WriteCoordinator::Counters();
+    WriteCoordinatorStatistics statistics;
+    statistics.Acquisitions = counters.acquisitions;
+    statistics.Contended = counters.contended;
+    statistics.TotalWaitMilliseconds = counters.waitMicroseconds / 1000.0;
+    statistics.LongestWaitMilliseconds = counters.longestWaitMicroseconds / 1000.0;
+    return statistics;
+  }
+
+  MemoryStatistics Database::GetMemoryStatistics() {
+    MemoryCounters counters = MemoryAllocator::Counters();
+    MemoryStatistics statistics;
+    statistics.StatusAvailable = counters.statusAvailable;
+    statistics.BytesInUse = counters.bytesInUse;
+    statistics.BytesHighWater = counters.bytesHighWater;
+    statistics.AllocationsInUse = counters.allocationsInUse;
+    statistics.AllocationsHighWater = counters.allocationsHighWater;
+    statistics.LargestRequest = counters.largestRequest;
+    statistics.TotalAllocations = counters.totalAllocations;
+    statistics.PoolBytes = counters.poolBytes;
+    return statistics;
+  }
+
+  void Database::ResetMemoryHighWater() {
+    MemoryAllocator::ResetHighWater();
+  }
 
   IAsyncOperation<Database^>^ Database::OpenAsync(Platform::String^ dbPath) {
+    return OpenWithOptionsAsync(dbPath, nullptr);
+  }
+
+  IAsyncOperation<Database^>^ Database::OpenWithOptionsAsync(Platform::String^ dbPath, ParameterMap^ options) {
     if (!dbPath->Length()) {
       throw ref new Platform::COMException(E_INVALIDARG, L"You must specify a path or :memory:");
     }
 
+    ConnectionOptions connectionOptions = ParseConnectionOptions(options);
+    configureLibrary();
+
     // Need to remember the current thread for later callbacks into JS
     CoreDispatcher^ dispatcher = CoreWindow::GetForCurrentThread()->Dispatcher;
+    auto started = std::chrono::steady_clock::now();
     
-    return Concurrency::create_async([dbPath, dispatcher]() {
+    return Concurrency::create_async([dbPath, dispatcher, connectionOptions, started]() {
+      auto openStarted = std::chrono::steady_clock::now();
+      const char* vfs = nullptr;
+      if (connectionOptions.pageProfile) {
+        int registered = PageProfile::Register(nullptr);
+        if (registered != SQLITE_OK) {
+          throwSQLiteError(registered, ref new Platform::String(L"Could not register the page profile VFS"));
+        }
+        vfs = PageProfile::VfsName;
+      }
+
       sqlite3* sqlite;
-      int ret = sqlite3_open16(dbPath->Data(), &sqlite);
+      int ret;
+      int threading = connectionOptions.noMutex ? SQLITE_OPEN_NOMUTEX : 0;
+      if (connectionOptions.immutable) {
+        ret = sqlite3_open_v2(ImmutableUri(ToUtf8String(dbPath)).c_str(), &sqlite, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI | threading, vfs);
+      } else if (connectionOptions.loadIntoMemory) {
+        ret = sqlite3_open_v2(":memory:", &sqlite, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | threading, nullptr);
+      } else if (vfs || threading) {
+        ret = sqlite3_open_v2(ToUtf8String(dbPath).c_str(), &sqlite, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | threading, vfs);
+      } else {
+        ret = sqlite3_open16(dbPath->Data(), &sqlite);
+      }
+
+      if (ret == SQLITE_OK) {
+        ret = ApplyConnectionOptions(sqlite, connectionOptions);
+      }
 
       if (ret != SQLITE_OK) {
         sqlite3_close(sqlite);
         throwSQLiteError(ret, dbPath);
       }
 
-      return ref new Database(sqlite, dispatcher);
+      std::unique_ptr<MemoryDatabase> memoryDatabase;
+      if (connectionOptions.loadIntoMemory) {
+        memoryDatabase.reset(new MemoryDatabase());
+        ret = memoryDatabase->Load(sqlite, ToUtf8String(dbPath).c_str());
+        if (ret != SQLITE_OK) {
+          sqlite3_close(sqlite);
+          throwSQLiteError(ret, dbPath + L": " + ToPlatformString(memoryDatabase->ErrorMessage().c_str()));
+        }
+      }
+
+      Database^ database = ref new Database(sqlite, dispatcher, connectionOptions.immutable, connectionOptions.noMutex);
+      database->openStatistics.OpenMilliseconds = MillisecondsSince(openStarted);
+      database->coordinateWrites = connectionOptions.coordinateWrites;
+      // Runs on this thread pool thread like the open itself, nothing else
+      // uses the connection yet and a failure closes it again
+      database->warmUp(connectionOptions.prepareStatements);
+      if (memoryDatabase) {
+        database->memoryDatabase = std::move(memoryDatabase);
+        if (connectionOptions.persistIntervalMilliseconds > 0) {
+          database->schedulePersist(static_cast<unsigned>(connectionOptions.persistIntervalMilliseconds));
+        }
+      }
+      database->openStatistics.TotalMilliseconds = MillisecondsSince(started);
+      return database;
     });    
   }
 
-  Database::Database(sqlite3* sqlite, CoreDispatcher^ dispatcher)
+  Database::Database(sqlite3* sqlite, CoreDispatcher^ dispatcher, bool immutable, bool noMutex)
     : collationLanguage(nullptr) // will use user locale
     , dispatcher(dispatcher)
     , fireEvents(true)
+    , slowQueryThreshold(0)
+    , slowQueryLog(50)
+    , resultCache(0)
+    , statementCache(16)
+    , openStatistics()
+    , tempStoreBudget(0)
+    , immutable(immutable)
+    , coordinateWrites(false)
+    , unlockWait(5000)
+    , priority(OperationPriority::Normal)
     , changeHandlers(0)
     , insertChangeHandlers(0)
     , updateChangeHandlers(0)
     , deleteChangeHandlers(0)
-    , sqlite(sqlite) {
+    , sqlite(sqlite)
+    , context(noMutex)
+    , scheduler(250, &context) {
       assert(sqlite);
+      busyHandler.Install(sqlite);
+      checkpointer.Install(sqlite);
       sqlite3_create_collation_v2(sqlite, "WINLOCALE", SQLITE_UTF16, reinterpret_cast<void*>(this), WinLocaleCollateUtf16, nullptr);
       sqlite3_create_collation_v2(sqlite, "WINLOCALE", SQLITE_UTF8, reinterpret_cast<void*>(this), WinLocaleCollateUtf8, nullptr);
 
       sqlite3_create_function_v2(sqlite, "APPTRANSLATE", 1, SQLITE_UTF16, NULL, TranslateUtf16, nullptr, nullptr, nullptr);
       sqlite3_create_function_v2(sqlite, "APPTRANSLATE", 2, SQLITE_UTF16, NULL, TranslateUtf16, nullptr, nullptr, nullptr);
 
-      sqlite3_create_function_v2(sqlite, "REGEXP", 2, SQLITE_UTF16, NULL, SqliteRegexUtf16, nullptr, nullptr, nullptr);
+      sqlite3_create_function_v2(sqlite, "REGEXP", 2, SQLITE_UTF8, NULL, SqliteRegexUtf8, nullptr, nullptr, nullptr);
   }
 
   Database::~Database() {
+    // Queued operations fail instead of running against the closed handle,
+    // the running one finishes first
+    scheduler.Stop();
+    ExecutionContext::Scope scope(context);
+    // Changes of a database loaded into memory are not lost on close, there
+    // is nobody left to report a failure to
+    if (memoryDatabase) {
+      memoryDatabase->Persist(sqlite, DestinationBusyTimeout(busyHandler.Policy()));
+      memoryDatabase.reset();
+    }
+    resultCache.Detach();
+    statementCache.Clear();
     sqlite3_close(sqlite);
   }
 
+  void Database::warmUp(const std::vector<std::string>& statements) {
+    WarmUp warmUp;
+    int ret = warmUp.LoadSchema(sqlite);
+    if (ret != SQLITE_OK) {
+      throwSQLiteError(ret, ref new Platform::String(static_cast<const wchar_t*>(sqlite3_errmsg16(sqlite))));
+    }
+    ret = warmUp.Prepare(sqlite, statements, statementCache);
+    WarmUpCounters counters = warmUp.Counters();
+    openStatistics.SchemaMilliseconds = counters.schemaMicroseconds / 1000.0;
+    openStatistics.PrepareMilliseconds = counters.prepareMicroseconds / 1000.0;
+    openStatistics.PreparedStatements = counters.statements;
+    if (ret != SQLITE_OK) {
+      throwSQLiteError(ret, ToPlatformString(warmUp.FailedSql().c_str()));
+    }
+  }
+
+  OpenStatistics Database::GetOpenStatistics() {
+    return openStatistics;
+  }
+
   void Database::addChangeHandler(int& handlerCount) {
     assert(changeHandlers >= 0);
     assert(handlerCount >= 0);
+    ExecutionContext::Scope scope(context);
     ++handlerCount;
-    if (changeHandlers++ == 0) {
+    if (changeHandlers++ == 0 && !resultCache.Attached()) {
       sqlite3_update_hook(sqlite, UpdateHook, reinterpret_cast<void*>(this));
     }
   }
@@ -146,8 +685,9 @@ namespace SQLite3 {
   void Database::removeChangeHandler(int& handlerCount) {
     assert(changeHandlers > 0);
     assert(handlerCount > 0);
+    ExecutionContext::Scope scope(context);
     --handlerCount;
-    if (--changeHandlers == 0) {
+    if (--changeHandlers == 0 && !resultCache.Attached()) {
       sqlite3_update_hook(sqlite, nullptr, nullptr);
     }
   }
@@ -155,6 +695,9 @@ namespace SQLite3 {
   void Database::UpdateHook(void* data, int action, char const* dbName, char const* tableName, sqlite3_int64 rowId) {
     assert(data);
     Database^ database = reinterpret_cast<Database^>(data);
+    if (database->resultCache.Attached()) {
+      database->resultCache.OnRowChanged(tableName);
+    }
     database->OnChange(action, dbName, tableName, rowId);
   }
 
@@ -169,6 +712,278 @@ namespace SQLite3 {
     });
   }
 
+  Windows::Foundation::IAsyncOperationWithProgress<int64, BackupProgress>^ Database::BackupAsync(Platform::String^ destPath,
+    int pagesPerStep, int pauseMilliseconds) {
+    if (!destPath || destPath->IsEmpty()) {
+      throw ref new Platform::InvalidArgumentException(L"You must specify a destination path");
+    }
+    if (pagesPerStep <= 0) {
+      throw ref new Platform::InvalidArgumentException(L"Pages per step must be positive");
+    }
+    if (pauseMilliseconds < 0) {
+      throw ref new Platform::InvalidArgumentException(L"Pause must not be negative");
+    }
+
+    return Concurrency::create_async([this, destPath, pagesPerStep, pauseMilliseconds](Concurrency::progress_reporter<BackupProgress> reporter, Concurrency::cancellation_token token) {
+      auto operation = std::make_shared<BackupOperation>(ToUtf8String(destPath), pagesPerStep,
+        static_cast<unsigned>(pauseMilliseconds), static_cast<SchedulerPriority>(priority), reporter, token);
+      scheduler.Submit(operation->priority, [this, operation]() {
+        backupStep(operation);
+      });
+      return Concurrency::create_task(operation->done, token);
+    });
+  }
+
+  // Runs one step of a backup and queues the next one, so the backup only
+  // holds the worker and the read lock for a few pages at a time
+  void Database::backupStep(std::shared_ptr<BackupOperation> operation) {
+    Backup& backup = operation->backup;
+    // Canceled, the task is already canceled through the token. Finishing
+    // an incomplete backup leaves the destination unchanged.
+    if (operation->token.is_canceled()) {
+      operation->settled = true;
+      backup.Finish();
+      return;
+    }
+
+    busyHandler.BeginOperation();
+    int ret = SQLITE_OK;
+    if (!operation->opened) {
+      ret = backup.OpenFile(operation->destinationPath.c_str(), sqlite, DestinationBusyTimeout(busyHandler.Policy()));
+      operation->opened = true;
+    }
+    if (ret == SQLITE_OK) {
+      ret = backup.Step(operation->pagesPerStep);
+    }
+    if (ret == SQLITE_OK) {
+      operation->reporter.report(ToBackupProgress(backup));
+      auto next = [this, operation]() {
+        backupStep(operation);
+      };
+      if (operation->pauseMilliseconds) {
+        scheduler.SubmitAfter(operation->priority, operation->pauseMilliseconds, next);
+      } else {
+        scheduler.Submit(operation->priority, next);
+      }
+      return;
+    }
+
+    if (ret == SQLITE_DONE) {
+      ret = backup.Finish();
+    }
+    operation->settled = true;
+    if (ret == SQLITE_OK) {
+      operation->reporter.report(ToBackupProgress(backup));
+      operation->done.set(backup.PageCount());
+      return;
+    }
+    backup.Finish();
+    lastErrorMessage = ToWString(backup.ErrorMessage());
+    try {
+      throwSQLiteError(ret, ToPlatformString(backup.ErrorMessage()));
+    } catch (...) {
+      operation->done.set_exception(std::current_exception());
+    }
+  }
+
+  IAsyncAction^ Database::PersistAsync() {
+    return Concurrency::create_async([this](Concurrency::cancellation_token token) {
+      return schedule<void>([this]() {
+        if (!memoryDatabase) {
+          throwSQLiteError(SQLITE_MISUSE, ref new Platform::String(L"The database was not loaded into memory"));
+        }
+        int ret = memoryDatabase->Persist(sqlite, DestinationBusyTimeout(busyHandler.Policy()));
+        if (ret != SQLITE_OK) {
+          lastErrorMessage = ToWString(memoryDatabase->ErrorMessage().c_str());
+          throwSQLiteError(ret, ref new Platform::String(lastErrorMessage.c_str()));
+        }
+      }, token);
+    });
+  }
+
+  // Persists a database loaded into memory every interval while the
+  // connection is idle. Only holds a weak reference, so the timer does not
+  // keep the connection alive.
+  void Database::schedulePersist(unsigned intervalMilliseconds) {
+    Platform::WeakReference weakThis(this);
+    scheduler.SubmitAfter(PriorityBackground, intervalMilliseconds, [weakThis, intervalMilliseconds]() {
+      Database^ database = weakThis.Resolve<Database>();
+      if (!database || !database->memoryDatabase) {
+        return;
+      }
+      database->busyHandler.BeginOperation();
+      // Failures are counted, the next interval tries again
+      database->memoryDatabase->Persist(database->sqlite, DestinationBusyTimeout(database->busyHandler.Policy()));
+      database->schedulePersist(intervalMilliseconds);
+    });
+  }
+
+  // Queues the work with the current priority. Must be called from the
+  // create_async lambda, which runs synchronously when it returns a task, so
+  // operations are queued in the order they were started.
+  template <typename Result, typename Work>
+  Concurrency::task<Result> Database::schedule(Work work, Concurrency::cancellation_token token) {
+    auto pending = std::make_shared<PendingTask<Result>>();
+    scheduler.Submit(static_cast<SchedulerPriority>(priority), [this, pending, work, token]() mutable {
+      pending->settled = true;
+      // Canceled while queued, the task is already canceled through the token
+      if (token.is_canceled()) {
+        return;
+      }
+      busyHandler.BeginOperation();
+      try {
+        CompleteTask(pending->done, work);
+      } catch (...) {
+        pending->done.set_exception(std::current_exception());
+      }
+      // Queued behind everything else, so the checkpoint runs when the
+      // connection is idle rather than inside a commit
+      if (checkpointer.Due()) {
+        scheduler.Submit(PriorityBackground, [this]() {
+          // Passive checkpoints do not wait, the others give up early and
+          // are retried later
+          busyHandler.BeginOperation(checkpointer.Policy().busyMilliseconds);
+          checkpointer.Run(sqlite);
+        });
+      }
+    });
+    return Concurrency::create_task(pending->done, token);
+  }
+
+  Windows::Foundation::IAsyncOperationWithProgress<int64, int64>^ Database::ImportAsync(Windows::Storage::IStorageFile^ file,
+    Platform::String^ format, Platform::String^ table, ParameterMap^ options) {
+    ImportOptions importOptions = ParseImportOptions(format, table, options);
+    importOptions.coordinateWrites = coordinateWrites;
+    importOptions.unlockWait = &unlockWait;
+
+    return Concurrency::create_async([this, file, importOptions](Concurrency::progress_reporter<int64> reporter, Concurrency::cancellation_token token) {
+      return schedule<int64>([this, file, importOptions, reporter, token]() -> int64 {
+        ImportResult result;
+        try {
+          auto stream = Concurrency::create_task(file->OpenSequentialReadAsync()).get();
+          StreamImportSource source(stream);
+          TaskProgress progress(reporter, token);
+          result = Import(sqlite, importOptions, source, &progress);
+        } catch (Platform::Exception^ e) {
+          saveLastErrorMessage();
+          throw;
+        }
+
+        if (result.resultCode == SQLITE_INTERRUPT && token.is_canceled()) {
+          Concurrency::cancel_current_task();
+        }
+        if (result.resultCode != SQLITE_OK) {
+          lastErrorMessage = ToWString(result.message.c_str());
+          throwSQLiteError(result.resultCode, ToPlatformString(result.message.c_str()));
+        }
+        return result.rows;
+      }, token);
+    });
+  }
+
+  Windows::Foundation::IAsyncOperationWithProgress<int64, int64>^ Database::ExportAsyncVector(Platform::String^ sql,
+    ParameterVector^ params, Platform::String^ path, Platform::String^ format) {
+    return ExportAsync(sql, CopyParameters(params), path, ParseExportFormat(format));
+  }
+
+  Windows::Foundation::IAsyncOperationWithProgress<int64, int64>^ Database::ExportAsyncMap(Platform::String^ sql,
+    ParameterMap^ params, Platform::String^ path, Platform::String^ format) {
+    return ExportAsync(sql, params, path, ParseExportFormat(format));
+  }
+
+  template <typename ParameterContainer>
+  Windows::Foundation::IAsyncOperationWithProgress<int64, int64>^ Database::ExportAsync(Platform::String^ sql,
+    ParameterContainer params, Platform::String^ path, ExportFormat format) {
+    return Concurrency::create_async([this, sql, params, path, format](Concurrency::progress_reporter<int64> reporter, Concurrency::cancellation_token token) {
+      return schedule<int64>([this, sql, params, path, format, reporter, token]() -> int64 {
+        std::FILE* file = nullptr;
+        long long rows = 0;
+        try {
+          StatementPtr statement = PrepareAndBind(sql, params);
+          if (_wfopen_s(&file, path->Data(), L"wb") != 0) {
+            throwSQLiteError(SQLITE_CANTOPEN, path);
+          }
+          FileExportSink sink(file);
+          TaskProgress progress(reporter, token);
+          rows = statement->Export(format, sink, &progress);
+          logIfSlow(*statement);
+        } catch (Platform::Exception^ e) {
+          saveLastErrorMessage();
+          if (file) {
+            std::fclose(file);
+            _wremove(path->Data());
+          }
+          throw;
+        }
+
+        // A canceled or incomplete export leaves no partial file behind
+        bool closed = std::fclose(file) == 0;
+        if (rows < 0 || !closed) {
+          _wremove(path->Data());
+        }
+        if (rows < 0) {
+          Concurrency::cancel_current_task();
+        }
+        if (!closed) {
+          throwSQLiteError(SQLITE_IOERR, ref new Platform::String(L"Could not write export file"));
+        }
+        return rows;
+      }, token);
+    });
+  }
+
+  IAsyncOperation<Platform::String^>^ Database::ExecuteManyAsync(StatementBatch^ batch, bool transactional) {
+    if (!batch) {
+      throw ref new Platform::InvalidArgumentException(L"Batch must not be null");
+    }
+    auto entries = batch->Snapshot();
+
+    return Concurrency::create_async([this, entries, transactional](Concurrency::cancellation_token token) {
+      return schedule<Platform::String^>([this, entries, transactional]() {
+        BatchResult result;
+        try {
+          StatementBatchBinder binder(entries);
+          result = ExecuteBatch(sqlite, entries->sql, &binder, transactional, coordinateWrites, &unlockWait);
+        } catch (Platform::Exception^ e) {
+          saveLastErrorMessage();
+          throw;
+        }
+
+        if (result.resultCode != SQLITE_OK) {
+          lastErrorMessage = ToWString(result.message.c_str());
+          throwSQLiteError(result.resultCode, ToPlatformString(result.message.c_str()));
+        }
+        return ToPlatformString(result.json.data(), static_cast<unsigned int>(result.json.size()));
+      }, token);
+    });
+  }
+
+  IAsyncOperation<BlobStream^>^ Database::OpenBlobAsync(Platform::String^ table, Platform::String^ column,
+    int64 rowId, bool writable) {
+    return Concurrency::create_async([this, table, column, rowId, writable](Concurrency::cancellation_token token) {
+      return schedule<BlobStream^>([this, table, column, rowId, writable]() {
+        std::unique_ptr<Blob> blob(new Blob());
+        int ret = blob->Open(sqlite, ToUtf8String(table).c_str(), ToUtf8String(column).c_str(), rowId, writable);
+        if (ret != SQLITE_OK) {
+          saveLastErrorMessage();
+          throwSQLiteError(ret, ref new Platform::String(lastErrorMessage.c_str()));
+        }
+        return ref new BlobStream(this, std::move(blob));
+      }, token);
+    });
+  }
+
+  LookasideStatistics Database::GetLookasideStatistics() {
+    LookasideStatistics statistics;
+    int unused;
+    ExecutionContext::Scope scope(context);
+    sqlite3_db_status(sqlite, SQLITE_DBSTATUS_LOOKASIDE_USED, &statistics.SlotsInUse, &statistics.SlotsHighWater, 0);
+    sqlite3_db_status(sqlite, SQLITE_DBSTATUS_LOOKASIDE_HIT, &unused, &statistics.Hits, 0);
+    sqlite3_db_status(sqlite, SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, &unused, &statistics.MissesSize, 0);
+    sqlite3_db_status(sqlite, SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, &unused, &statistics.MissesFull, 0);
+    return statistics;
+  }
+
   void Database::OnChange(int action, char const* dbName, char const* tableName, sqlite3_int64 rowId) {
     if (fireEvents) {
       DispatchedHandler^ handler;
@@ -221,15 +1036,19 @@ namespace SQLite3 {
 
   template <typename ParameterContainer>
   IAsyncOperation<int>^ Database::RunAsync(Platform::String^ sql, ParameterContainer params) {
-    return Concurrency::create_async([this, sql, params] {
-      try {
-        StatementPtr statement = PrepareAndBind(sql, params);
-        statement->Run();
-        return sqlite3_changes(sqlite);
-      } catch (Platform::Exception^ e) {
-        saveLastErrorMessage();
-        throw;
-      }
+    return Concurrency::create_async([this, sql, params](Concurrency::cancellation_token token) {
+      return schedule<int>([this, sql, params]() {
+        try {
+          StatementPtr statement = PrepareAndBind(sql, params);
+          statement->Run();
+          int changes = sqlite3_changes(sqlite);
+          logIfSlow(*statement);
+          return changes;
+        } catch (Platform::Exception^ e) {
+          saveLastErrorMessage();
+          throw;
+        }
+      }, token);
     });
   }
 
@@ -243,14 +1062,15 @@ namespace SQLite3 {
 
   template <typename ParameterContainer>
   IAsyncOperation<Platform::String^>^ Database::OneAsync(Platform::String^ sql, ParameterContainer params) {
-    return Concurrency::create_async([this, sql, params]() {
-      try {
-        StatementPtr statement = PrepareAndBind(sql, params);
-        return statement->One();
-      } catch (Platform::Exception^ e) {
-        saveLastErrorMessage();
-        throw;
-      }
+    return Concurrency::create_async([this, sql, params](Concurrency::cancellation_token token) {
+      return schedule<Platform::String^>([this, sql, params]() {
+        try {
+          return QueryRows(sql, params, false);
+        } catch (Platform::Exception^ e) {
+          saveLastErrorMessage();
+          throw;
+        }
+      }, token);
     });
   }
 
@@ -264,14 +1084,72 @@ namespace SQLite3 {
 
   template <typename ParameterContainer>
   IAsyncOperation<Platform::String^>^ Database::AllAsync(Platform::String^ sql, ParameterContainer params) {
-    return Concurrency::create_async([this, sql, params]() {
-      try {
-        StatementPtr statement = PrepareAndBind(sql, params);
-        return statement->All();
-      } catch (Platform::Exception^ e) {
-        saveLastErrorMessage();
-        throw;
-      }
+    return Concurrency::create_async([this, sql, params](Concurrency::cancellation_token token) {
+      return schedule<Platform::String^>([this, sql, params]() {
+        try {
+          return QueryRows(sql, params, true);
+        } catch (Platform::Exception^ e) {
+          saveLastErrorMessage();
+          throw;
+        }
+      }, token);
+    });
+  }
+
+  template <typename ParameterContainer>
+  Platform::String^ Database::QueryRows(Platform::String^ sql, ParameterContainer params, bool all) {
+    std::string key;
+    bool cacheable = resultCache.Attached() && ResultCacheKey(all ? "all" : "one", sql, params, key);
+    if (!cacheable) {
+      StatementPtr statement = PrepareAndBind(sql, params);
+      auto rows = all ? statement->All() : statement->One();
+      logIfSlow(*statement);
+      return rows;
+    }
+
+    auto cached = resultCache.Lookup(key);
+    if (cached) {
+      return static_cast<const CachedRows&>(*cached).rows;
+    }
+    StatementPtr statement;
+    StatementTables tables;
+    {
+      ResultCache::Collection collection(resultCache);
+      // A cached statement would not be prepared, the collection would miss
+      // its tables
+      statement = PrepareAndBind(sql, params, false);
+      tables = collection.Tables(statement->ReadOnly());
+    }
+    auto rows = all ? statement->All() : statement->One();
+    logIfSlow(*statement);
+    // OneAsync without a row caches the null result too
+    size_t bytes = rows ? rows->Length() * sizeof(wchar_t) : 0;
+    resultCache.Insert(key, tables, std::make_shared<CachedRows>(rows), bytes);
+    return rows;
+  }
+
+  IAsyncOperation<ResultSet^>^ Database::QueryAsyncVector(Platform::String^ sql, ParameterVector^ params) {
+    return QueryAsync(sql, CopyParameters(params));
+  }
+
+  IAsyncOperation<ResultSet^>^ Database::QueryAsyncMap(Platform::String^ sql, ParameterMap^ params) {
+    return QueryAsync(sql, params);
+  }
+
+  template <typename ParameterContainer>
+  IAsyncOperation<ResultSet^>^ Database::QueryAsync(Platform::String^ sql, ParameterContainer params) {
+    return Concurrency::create_async([this, sql, params](Concurrency::cancellation_token token) {
+      return schedule<ResultSet^>([this, sql, params]() {
+        try {
+          StatementPtr statement = PrepareAndBind(sql, params);
+          auto rows = ref new ResultSet(statement->Collect());
+          logIfSlow(*statement);
+          return rows;
+        } catch (Platform::Exception^ e) {
+          saveLastErrorMessage();
+          throw;
+        }
+      }, token);
     });
   }
 
@@ -285,24 +1163,227 @@ namespace SQLite3 {
 
   template <typename ParameterContainer>
   IAsyncAction^ Database::EachAsync(Platform::String^ sql, ParameterContainer params, EachCallback^ callback) {
-    return Concurrency::create_async([this, sql, params, callback] {
-      try {
-        StatementPtr statement = PrepareAndBind(sql, params);
-        statement->Each(callback, dispatcher);
-      } catch (Platform::Exception^ e) {
-        saveLastErrorMessage();
-        throw;
-      }
+    return Concurrency::create_async([this, sql, params, callback](Concurrency::cancellation_token token) {
+      return schedule<void>([this, sql, params, callback]() {
+        try {
+          StatementPtr statement = PrepareAndBind(sql, params);
+          statement->Each(callback, dispatcher);
+          logIfSlow(*statement);
+        } catch (Platform::Exception^ e) {
+          saveLastErrorMessage();
+          throw;
+        }
+      }, token);
     });
   }
 
   template <typename ParameterContainer>
-  StatementPtr Database::PrepareAndBind(Platform::String^ sql, ParameterContainer params) {
-    StatementPtr statement = Statement::Prepare(sqlite, sql);
+  StatementPtr Database::PrepareAndBind(Platform::String^ sql, ParameterContainer params, bool cached) {
+    StatementPtr statement = Statement::Prepare(sqlite, sql, &unlockWait, cached ? &statementCache : nullptr);
+    if (slowQueryThreshold > 0) {
+      statement->EnableProfiling();
+    }
     statement->Bind(params);
     return statement;
   }
 
+  void Database::logIfSlow(const Statement& statement) {
+    double threshold = slowQueryThreshold;
+    if (threshold <= 0) {
+      return;
+    }
+    double elapsed = statement.StepMilliseconds();
+    if (elapsed < threshold) {
+      return;
+    }
+
+    SlowQuery query;
+    query.sql = statement.Sql();
+    query.parameterTypes = statement.ParameterTypes();
+    query.rowCount = statement.RowCount();
+    query.elapsedMilliseconds = elapsed;
+    query.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+    query.queryPlan = statement.QueryPlan();
+    slowQueryLog.Add(query);
+  }
+
+  Platform::String^ Database::GetSlowQueries() {
+    std::string result;
+    slowQueryLog.ToJson(result);
+    return ToPlatformString(result.data(), static_cast<unsigned int>(result.size()));
+  }
+
+  void Database::ClearSlowQueries() {
+    slowQueryLog.Clear();
+  }
+
+  BusyStatistics Database::GetBusyStatistics() {
+    BusyCounters counters = busyHandler.Counters();
+    BusyStatistics statistics;
+    statistics.Waits = counters.waits;
+    statistics.Retries = counters.retries;
+    statistics.Failures = counters.failures;
+    statistics.TotalWaitMilliseconds = counters.waitMicroseconds / 1000.0;
+    statistics.LongestWaitMilliseconds = counters.longestWaitMicroseconds / 1000.0;
+    return statistics;
+  }
+
+  ExecutionContextStatistics Database::GetExecutionContextStatistics() {
+    ExecutionContextCounters counters = context.Counters();
+    ExecutionContextStatistics statistics;
+    statistics.Entries = counters.entries;
+    statistics.Contended = counters.contended;
+    statistics.TotalWaitMilliseconds = counters.waitMicroseconds / 1000.0;
+    return statistics;
+  }
+
+  LockWaitStatistics Database::GetLockWaitStatistics() {
+    UnlockWaitCounters counters = unlockWait.Counters();
+    LockWaitStatistics statistics;
+    statistics.Waits = counters.waits;
+    statistics.Timeouts = counters.timeouts;
+    statistics.Deadlocks = counters.deadlocks;
+    statistics.TotalWaitMilliseconds = counters.waitMicroseconds / 1000.0;
+    statistics.LongestWaitMilliseconds = counters.longestWaitMicroseconds / 1000.0;
+    return statistics;
+  }
+
+  MemoryDatabaseStatistics Database::GetMemoryDatabaseStatistics() {
+    // All zero unless the database was loaded into memory
+    MemoryDatabaseCounters counters = MemoryDatabaseCounters();
+    if (memoryDatabase) {
+      counters = memoryDatabase->Counters();
+    }
+    int cacheBytes = 0;
+    int highWater = 0;
+    ExecutionContext::Scope scope(context);
+    sqlite3_db_status(sqlite, SQLITE_DBSTATUS_CACHE_USED, &cacheBytes, &highWater, 0);
+
+    MemoryDatabaseStatistics statistics;
+    statistics.Loaded = memoryDatabase != nullptr;
+    statistics.LoadMilliseconds = counters.loadMicroseconds / 1000.0;
+    statistics.DatabaseBytes = counters.bytes;
+    statistics.CacheBytes = cacheBytes;
+    statistics.Persists = counters.persists;
+    statistics.PersistFailures = counters.persistFailures;
+    statistics.TotalPersistMilliseconds = counters.persistMicroseconds / 1000.0;
+    statistics.LastPersistMilliseconds = counters.lastPersistMicroseconds / 1000.0;
+    return statistics;
+  }
+
+  CheckpointStatistics Database::GetCheckpointStatistics() {
+    CheckpointCounters counters = checkpointer.Counters();
+    CheckpointStatistics statistics;
+    statistics.Passive = counters.passive;
+    statistics.Restart = counters.restart;
+    statistics.Truncate = counters.truncate;
+    statistics.Busy = counters.busy;
+    statistics.WalFrames = counters.walFrames;
+    statistics.FramesCheckpointed = counters.framesCheckpointed;
+    statistics.FramesRemaining = counters.framesRemaining;
+    statistics.TotalLatencyMilliseconds = counters.latencyMicroseconds / 1000.0;
+    statistics.LongestLatencyMilliseconds = counters.longestLatencyMicroseconds / 1000.0;
+    return statistics;
+  }
+
+  ResultCacheStatistics Database::GetResultCacheStatistics() {
+    ResultCacheCounters counters = resultCache.Counters();
+    ResultCacheStatistics statistics;
+    statistics.Hits = counters.hits;
+    statistics.Misses = counters.misses;
+    statistics.Insertions = counters.insertions;
+    statistics.Invalidations = counters.invalidations;
+    statistics.Evictions = counters.evictions;
+    statistics.Entries = counters.entries;
+    statistics.Bytes = counters.bytes;
+    return statistics;
+  }
+
+  void Database::ClearResultCache() {
+    resultCache.Clear();
+  }
+
+  StatementCacheStatistics Database::GetStatementCacheStatistics() {
+    StatementCacheCounters counters = statementCache.Counters();
+    StatementCacheStatistics statistics;
+    statistics.Hits = counters.hits;
+    statistics.Misses = counters.misses;
+    statistics.Evictions = counters.evictions;
+    statistics.Entries = counters.entries;
+    return statistics;
+  }
+
+  // True when no other connection can change the database: immutable,
+  // private in-memory or temporary databases and exclusive locking mode
+  static bool OnlyWriter(sqlite3* db, bool immutable) {
+    const char* path = sqlite3_db_filename(db, "main");
+    if (immutable || !path || !*path) {
+      return true;
+    }
+    sqlite3_stmt* statement = nullptr;
+    bool exclusive = false;
+    if (sqlite3_prepare_v2(db, "PRAGMA main.locking_mode", -1, &statement, nullptr) == SQLITE_OK &&
+        sqlite3_step(statement) == SQLITE_ROW) {
+      exclusive = std::strcmp(reinterpret_cast<const char*>(sqlite3_column_text(statement, 0)), "exclusive") == 0;
+    }
+    sqlite3_finalize(statement);
+    return exclusive;
+  }
+
+  void Database::setResultCacheBudget(int64 value) {
+    if (value < 0) {
+      throw ref new Platform::InvalidArgumentException(L"Result cache budget must not be negative");
+    }
+    ExecutionContext::Scope scope(context);
+    resultCache.SetBudget(static_cast<size_t>(value));
+    // The update hook reports row changes to the cache, it stays installed
+    // while there are change handlers
+    if (value > 0 && !resultCache.Attached()) {
+      if (!resultCache.Attach(sqlite, !OnlyWriter(sqlite, immutable))) {
+        resultCache.SetBudget(0);
+        throwSQLiteError(SQLITE_MISUSE, ref new Platform::String(
+          L"The result cache needs SQLite 3.8.4 unless the connection is the only writer"));
+      }
+      statementCache.SetCacheWrites(false);
+      if (changeHandlers == 0) {
+        sqlite3_update_hook(sqlite, UpdateHook, reinterpret_cast<void*>(this));
+      }
+    } else if (value == 0 && resultCache.Attached()) {
+      resultCache.Detach();
+      statementCache.SetCacheWrites(true);
+      if (changeHandlers == 0) {
+        sqlite3_update_hook(sqlite, nullptr, nullptr);
+      }
+    }
+  }
+
+  void Database::setTempStoreBudget(int64 value) {
+    if (value < 0) {
+      throw ref new Platform::InvalidArgumentException(L"Temp store budget must not be negative");
+    }
+    ExecutionContext::Scope scope(context);
+    int ret = ApplyTempStoreBudget(sqlite, value);
+    if (ret != SQLITE_OK) {
+      throwSQLiteError(ret, ref new Platform::String(static_cast<const wchar_t*>(sqlite3_errmsg16(sqlite))));
+    }
+    tempStoreBudget = value;
+  }
+
+  int Database::getWorkerThreads() {
+    ExecutionContext::Scope scope(context);
+    // Qualified, the property of the same name hides the function
+    return std::max(SQLite3::WorkerThreads(sqlite), 0);
+  }
+
+  void Database::setWorkerThreads(int value) {
+    if (value < 0) {
+      throw ref new Platform::InvalidArgumentException(L"Worker threads must not be negative");
+    }
+    ExecutionContext::Scope scope(context);
+    SetWorkerThreads(sqlite, value);
+  }
+
   void Database::saveLastErrorMessage() {
     if (sqlite3_errcode(sqlite) != SQLITE_OK) {
       lastErrorMessage = (WCHAR*)sqlite3_errmsg16(sqlite);
@@ -1,7 +1,27 @@
 #pragma once
 
+#include <atomic>
+#include <ppltasks.h>
+
 #include "sqlite3.h"
+#include "Backup.h"
+#include "BlobStream.h"
+#include "BusyHandler.h"
 #include "Common.h"
+#include "ExecutionContext.h"
+#include "Exporter.h"
+#include "MemoryDatabase.h"
+#include "PageProfile.h"
+#include "ResultCache.h"
+#include "ResultSet.h"
+#include "Scheduler.h"
+#include "SlowQueryLog.h"
+#include "StatementBatch.h"
+#include "StatementCache.h"
+#include "TempStore.h"
+#include "WalCheckpointer.h"
+#include "WarmUp.h"
+#include "WriteCoordinator.h"
 
 namespace SQLite3 {
   public value struct ChangeEvent {
@@ -10,10 +30,239 @@ namespace SQLite3 {
   };
   
   public delegate void ChangeHandler(Platform::Object^ source, ChangeEvent event);
+
+  // Process wide counters of the page cache shared by all connections
+  public value struct PageCacheStatistics {
+    int64 Hits;
+    int64 Misses;
+    int64 Evictions;
+    int64 Promotions;
+    int64 Pages;
+    int64 Slabs;
+    int64 ArenaBytes;
+  };
+
+  // Process wide counters of the pageProfile open option
+  public value struct PageProfileStatistics {
+    int64 RecordedPages;
+    int64 ProfilesWritten;
+    int64 Prefetches;
+    int64 PrefetchedPages;
+    int64 PrefetchReads;
+    int64 PrefetchBytes;
+    double PrefetchMilliseconds;
+  };
+
+  // Process wide counters of the temporary files connections spill to
+  // once their temporary data outgrows Database::TempStoreBudget
+  public value struct TempStoreStatistics {
+    int64 Spills;
+    int64 SpilledBytes;
+    int64 LiveBytes;
+    int64 PeakBytes;
+  };
+
+  // Process wide waits of write transactions of connections opened with the
+  // coordinateWrites option for their turn on the database file
+  public value struct WriteCoordinatorStatistics {
+    int64 Acquisitions;
+    int64 Contended;
+    double TotalWaitMilliseconds;
+    double LongestWaitMilliseconds;
+  };
+
+  // Memory SQLite allocated for all connections, see sqlite3_status
+  public value struct MemoryStatistics {
+    // False when SQLite was built without memory status, e.g. by the
+    // Performance profile. The in use and high-water counts are zero then.
+    bool StatusAvailable;
+    int64 BytesInUse;
+    int64 BytesHighWater;
+    int64 AllocationsInUse;
+    int64 AllocationsHighWater;
+    int64 LargestRequest;
+    int64 TotalAllocations;
+    int64 PoolBytes;
+  };
+
+  public value struct LookasideStatistics {
+    int SlotsInUse;
+    int SlotsHighWater;
+    int Hits;
+    int MissesSize;
+    int MissesFull;
+  };
+
+  // Counters of the connection's query result cache
+  public value struct ResultCacheStatistics {
+    int64 Hits;
+    int64 Misses;
+    int64 Insertions;
+    int64 Invalidations;
+    int64 Evictions;
+    int64 Entries;
+    int64 Bytes;
+  };
+
+  // Counters of the connection's prepared statement cache
+  public value struct StatementCacheStatistics {
+    int64 Hits;
+    int64 Misses;
+    int64 Evictions;
+    int64 Entries;
+  };
+
+  // Time Database::OpenWithOptionsAsync spent in each phase before it
+  // completed
+  public value struct OpenStatistics {
+    // Opening the file, applying the options and loading it into memory
+    double OpenMilliseconds;
+    double SchemaMilliseconds;
+    // Preparing the statements of the prepare option
+    double PrepareMilliseconds;
+    int64 PreparedStatements;
+    // From the call until the database was handed back
+    double TotalMilliseconds;
+  };
+
+  // How a connection waits when another connection or process locked the
+  // database, see Database::BusyTimeout
+  public enum class BusyWaitPolicy {
+    // Fail with SQLITE_BUSY right away
+    Fail,
+    // Retry at a fixed interval
+    Timeout,
+    // Retry after exponentially growing, jittered delays
+    Backoff,
+    // Like Backoff, but the timeout counts from the start of the operation
+    Deadline
+  };
+
+  public value struct BusyStatistics {
+    int64 Waits;
+    int64 Retries;
+    int64 Failures;
+    double TotalWaitMilliseconds;
+    double LongestWaitMilliseconds;
+  };
+
+  // Uses of a connection opened with the noMutex option outside of its
+  // operations, e.g. by property setters, and how long they waited for a
+  // running operation
+  public value struct ExecutionContextStatistics {
+    int64 Entries;
+    int64 Contended;
+    double TotalWaitMilliseconds;
+  };
+
+  // Waits for table locks of other connections of the shared cache
+  public value struct LockWaitStatistics {
+    int64 Waits;
+    int64 Timeouts;
+    int64 Deadlocks;
+    double TotalWaitMilliseconds;
+    double LongestWaitMilliseconds;
+  };
+
+  // A database opened with the loadIntoMemory option, see
+  // Database::PersistAsync
+  public value struct MemoryDatabaseStatistics {
+    bool Loaded;
+    double LoadMilliseconds;
+    // Size of the database when it was last loaded or persisted
+    int64 DatabaseBytes;
+    // Memory the connection's pages use right now
+    int64 CacheBytes;
+    int64 Persists;
+    int64 PersistFailures;
+    double TotalPersistMilliseconds;
+    double LastPersistMilliseconds;
+  };
+
+  // Checkpoints the connection ran in WAL mode, see
+  // Database::CheckpointFrames
+  public value struct CheckpointStatistics {
+    int64 Passive;
+    int64 Restart;
+    int64 Truncate;
+    int64 Busy;
+    int64 WalFrames;
+    int64 FramesCheckpointed;
+    int64 FramesRemaining;
+    double TotalLatencyMilliseconds;
+    double LongestLatencyMilliseconds;
+  };
+
+  // Progress of Database::BackupAsync, the copy starts over when another
+  // connection writes to the database
+  public value struct BackupProgress {
+    int64 PagesCopied;
+    int64 PageCount;
+    int64 Restarts;
+  };
+
+  // Queued operations of a connection run in priority order, see
+  // Database::Priority
+  public enum class OperationPriority {
+    Interactive,
+    Normal,
+    Background
+  };
+
+  public enum class AllocatorKind {
+    System,
+    Pool
+  };
   
+  struct BackupOperation;
+
   public ref class Database sealed {
   public:
     static IAsyncOperation<Database^>^ OpenAsync(Platform::String^ dbPath);
+    static IAsyncOperation<Database^>^ OpenWithOptionsAsync(Platform::String^ dbPath, ParameterMap^ options);
+    static PageCacheStatistics GetPageCacheStatistics();
+    static PageProfileStatistics GetPageProfileStatistics();
+    static TempStoreStatistics GetTempStoreStatistics();
+    static WriteCoordinatorStatistics GetWriteCoordinatorStatistics();
+    static MemoryStatistics GetMemoryStatistics();
+    static void ResetMemoryHighWater();
+
+    // Version and source id of the SQLite library
+    static property Platform::String^ Version {
+      Platform::String^ get() {
+        return ToPlatformString((std::string(sqlite3_libversion()) + " (" + sqlite3_sourceid() + ")").c_str());
+      };
+    }
+
+    // The allocator is installed when the first database is opened and
+    // can not be changed afterwards
+    static property AllocatorKind Allocator {
+      AllocatorKind get() {
+        return allocator;
+      };
+
+      void set(AllocatorKind value) {
+        if (libraryConfigured) {
+          throwSQLiteError(SQLITE_MISUSE, ref new Platform::String(L"The allocator must be chosen before the first database is opened"));
+        }
+        allocator = value;
+      };
+    }
+
+    // Milliseconds after opening during which databases opened with the
+    // pageProfile option record the pages they read, 10000 by default
+    static property int PageProfileDuration {
+      int get() {
+        return static_cast<int>(PageProfile::RecordMilliseconds());
+      };
+
+      void set(int value) {
+        if (value < 0) {
+          throw ref new Platform::InvalidArgumentException(L"Page profile duration must not be negative");
+        }
+        PageProfile::SetRecordMilliseconds(static_cast<unsigned>(value));
+      };
+    }
 
     static property bool SharedCache {
       bool get() {
@@ -36,10 +285,60 @@ namespace SQLite3 {
     Windows::Foundation::IAsyncOperation<Platform::String^>^ OneAsyncMap(Platform::String^ sql, ParameterMap^ params);
     Windows::Foundation::IAsyncOperation<Platform::String^>^ AllAsyncVector(Platform::String^ sql, ParameterVector^ params);
     Windows::Foundation::IAsyncOperation<Platform::String^>^ AllAsyncMap(Platform::String^ sql, ParameterMap^ params);
+    Windows::Foundation::IAsyncOperation<ResultSet^>^ QueryAsyncVector(Platform::String^ sql, ParameterVector^ params);
+    Windows::Foundation::IAsyncOperation<ResultSet^>^ QueryAsyncMap(Platform::String^ sql, ParameterMap^ params);
     Windows::Foundation::IAsyncAction^ EachAsyncVector(Platform::String^ sql, ParameterVector^ params, EachCallback^ callback);
     Windows::Foundation::IAsyncAction^ EachAsyncMap(Platform::String^ sql, ParameterMap^ params, EachCallback^ callback);
 
+    // Runs all statements of the batch in one call on the worker thread,
+    // optionally inside a single transaction. Returns a JSON array with the
+    // rows or the change count of every statement.
+    Windows::Foundation::IAsyncOperation<Platform::String^>^ ExecuteManyAsync(StatementBatch^ batch, bool transactional);
+
     Windows::Foundation::IAsyncAction^ VacuumAsync();
+
+    // Writes a database opened with the loadIntoMemory option back to its
+    // file, if it changed since it was loaded or last persisted
+    Windows::Foundation::IAsyncAction^ PersistAsync();
+
+    // Copies the main database to a file while it stays in use,
+    // pagesPerStep pages at a time. Other queued operations run between the
+    // steps, which are pauseMilliseconds apart. Completes with the number of
+    // pages copied.
+    Windows::Foundation::IAsyncOperationWithProgress<int64, BackupProgress>^ BackupAsync(Platform::String^ destPath,
+      int pagesPerStep, int pauseMilliseconds);
+
+    // Loads a CSV or NDJSON file into a table, the progress is the number of
+    // committed rows
+    Windows::Foundation::IAsyncOperationWithProgress<int64, int64>^ ImportAsync(Windows::Storage::IStorageFile^ file,
+      Platform::String^ format, Platform::String^ table, ParameterMap^ options);
+
+    // Writes the rows of a query to a file as NDJSON or CSV, the progress is
+    // the number of rows written
+    Windows::Foundation::IAsyncOperationWithProgress<int64, int64>^ ExportAsyncVector(Platform::String^ sql,
+      ParameterVector^ params, Platform::String^ path, Platform::String^ format);
+    Windows::Foundation::IAsyncOperationWithProgress<int64, int64>^ ExportAsyncMap(Platform::String^ sql,
+      ParameterMap^ params, Platform::String^ path, Platform::String^ format);
+
+    // Opens a BLOB of the main database for incremental reading and, when
+    // writable, writing. Use ZeroBlob to insert a BLOB of the final size.
+    Windows::Foundation::IAsyncOperation<BlobStream^>^ OpenBlobAsync(Platform::String^ table, Platform::String^ column,
+      int64 rowId, bool writable);
+
+    LookasideStatistics GetLookasideStatistics();
+
+    Platform::String^ GetSlowQueries();
+    void ClearSlowQueries();
+
+    BusyStatistics GetBusyStatistics();
+    ExecutionContextStatistics GetExecutionContextStatistics();
+    LockWaitStatistics GetLockWaitStatistics();
+    CheckpointStatistics GetCheckpointStatistics();
+    MemoryDatabaseStatistics GetMemoryDatabaseStatistics();
+    ResultCacheStatistics GetResultCacheStatistics();
+    void ClearResultCache();
+    StatementCacheStatistics GetStatementCacheStatistics();
+    OpenStatistics GetOpenStatistics();
     
     property Platform::String^ LastError {
       Platform::String^ get() {
@@ -113,12 +412,274 @@ namespace SQLite3 {
       };
     }
 
+    // Statements whose accumulated step time in milliseconds reaches this
+    // threshold are recorded in the slow query log. Zero disables the log.
+    property double SlowQueryThreshold {
+      double get() {
+        return slowQueryThreshold;
+      };
+      void set(double value) {
+        slowQueryThreshold = value;
+      };
+    }
+
+    property int SlowQueryLogCapacity {
+      int get() {
+        return static_cast<int>(slowQueryLog.Capacity());
+      };
+      void set(int value) {
+        if (value < 0) {
+          throw ref new Platform::InvalidArgumentException(L"Slow query log capacity must not be negative");
+        }
+        slowQueryLog.SetCapacity(value);
+      };
+    }
+
+    property BusyWaitPolicy BusyWait {
+      BusyWaitPolicy get() {
+        return static_cast<BusyWaitPolicy>(busyHandler.Policy().kind);
+      };
+      void set(BusyWaitPolicy value) {
+        BusyPolicy policy = busyHandler.Policy();
+        policy.kind = static_cast<BusyPolicyKind>(value);
+        busyHandler.SetPolicy(policy);
+      };
+    }
+
+    // Milliseconds to wait for a locked database before failing with
+    // SQLITE_BUSY, 5000 by default
+    property int BusyTimeout {
+      int get() {
+        return static_cast<int>(busyHandler.Policy().timeoutMilliseconds);
+      };
+      void set(int value) {
+        if (value < 0) {
+          throw ref new Platform::InvalidArgumentException(L"Busy timeout must not be negative");
+        }
+        BusyPolicy policy = busyHandler.Policy();
+        policy.timeoutMilliseconds = static_cast<unsigned>(value);
+        busyHandler.SetPolicy(policy);
+      };
+    }
+
+    // Milliseconds a statement waits for a table another connection of the
+    // shared cache locked before failing with SQLITE_LOCKED. Statements that
+    // would deadlock fail right away. Zero disables waiting.
+    property int LockTimeout {
+      int get() {
+        return static_cast<int>(unlockWait.Timeout());
+      };
+      void set(int value) {
+        if (value < 0) {
+          throw ref new Platform::InvalidArgumentException(L"Lock timeout must not be negative");
+        }
+        unlockWait.SetTimeout(static_cast<unsigned>(value));
+      };
+    }
+
+    // Priority of the operations started afterwards. A connection runs its
+    // operations one at a time, queued operations of a higher priority
+    // first and operations of the same priority in the order they were
+    // started.
+    property OperationPriority Priority {
+      OperationPriority get() {
+        return priority;
+      };
+      void set(OperationPriority value) {
+        priority = value;
+      };
+    }
+
+    // Every interval in milliseconds a queued operation waits raises its
+    // priority by one, so background work is not starved. Zero disables
+    // aging.
+    property int PriorityAging {
+      int get() {
+        return static_cast<int>(scheduler.Aging());
+      };
+      void set(int value) {
+        if (value < 0) {
+          throw ref new Platform::InvalidArgumentException(L"Priority aging must not be negative");
+        }
+        scheduler.SetAging(static_cast<unsigned>(value));
+      };
+    }
+
+    // In WAL mode the connection checkpoints itself instead of during the
+    // commit that crosses PRAGMA wal_autocheckpoint: once this many frames
+    // were written since the last checkpoint, a passive checkpoint is queued
+    // with background priority. 1000 by default, zero checkpoints after
+    // every commit.
+    property int CheckpointFrames {
+      int get() {
+        return static_cast<int>(checkpointer.Policy().passiveFrames);
+      };
+      void set(int value) {
+        if (value < 0) {
+          throw ref new Platform::InvalidArgumentException(L"Checkpoint frames must not be negative");
+        }
+        CheckpointPolicy policy = checkpointer.Policy();
+        policy.passiveFrames = static_cast<unsigned>(value);
+        checkpointer.SetPolicy(policy);
+      };
+    }
+
+    // WAL size in frames from which the checkpoint waits for readers, up to
+    // the busy timeout, and restarts the WAL so it stops growing. 4000 by
+    // default.
+    property int CheckpointRestartFrames {
+      int get() {
+        return static_cast<int>(checkpointer.Policy().restartFrames);
+      };
+      void set(int value) {
+        if (value < 0) {
+          throw ref new Platform::InvalidArgumentException(L"Checkpoint restart frames must not be negative");
+        }
+        CheckpointPolicy policy = checkpointer.Policy();
+        policy.restartFrames = static_cast<unsigned>(value);
+        checkpointer.SetPolicy(policy);
+      };
+    }
+
+    // WAL size in frames from which the checkpoint also truncates the WAL
+    // file, where SQLite supports it. 16000 by default.
+    property int CheckpointTruncateFrames {
+      int get() {
+        return static_cast<int>(checkpointer.Policy().truncateFrames);
+      };
+      void set(int value) {
+        if (value < 0) {
+          throw ref new Platform::InvalidArgumentException(L"Checkpoint truncate frames must not be negative");
+        }
+        CheckpointPolicy policy = checkpointer.Policy();
+        policy.truncateFrames = static_cast<unsigned>(value);
+        checkpointer.SetPolicy(policy);
+      };
+    }
+
+    // Milliseconds a frame may stay in the WAL without being checkpointed
+    // before the checkpoint restarts the WAL, 30000 by default. Zero
+    // disables the limit.
+    property int CheckpointRestartAge {
+      int get() {
+        return static_cast<int>(checkpointer.Policy().restartAgeMilliseconds);
+      };
+      void set(int value) {
+        if (value < 0) {
+          throw ref new Platform::InvalidArgumentException(L"Checkpoint restart age must not be negative");
+        }
+        CheckpointPolicy policy = checkpointer.Policy();
+        policy.restartAgeMilliseconds = static_cast<unsigned>(value);
+        checkpointer.SetPolicy(policy);
+      };
+    }
+
+    // Bytes the results of OneAsync and AllAsync may keep cached until a
+    // table they read changes. Zero, the default, disables the cache. The
+    // cache uses the connection's authorizer, commit and rollback hooks.
+    property int64 ResultCacheBudget {
+      int64 get() {
+        return static_cast<int64>(resultCache.Budget());
+      };
+      void set(int64 value) {
+        setResultCacheBudget(value);
+      };
+    }
+
+    // Bytes of temporary tables, indexes and statement journals the
+    // connection keeps in memory before spilling to temporary files. Sorts
+    // spill once they outgrow the main database's cache. Zero, the default,
+    // keeps all temporary data in memory. Changing it drops the connection's
+    // temporary tables and is not possible inside a transaction that uses
+    // them.
+    property int64 TempStoreBudget {
+      int64 get() {
+        return tempStoreBudget;
+      };
+      void set(int64 value) {
+        setTempStoreBudget(value);
+      };
+    }
+
+    // Auxiliary threads the sorter may start for large ORDER BY, GROUP BY
+    // and CREATE INDEX, PRAGMA threads. Zero, the default, sorts on the
+    // connection's own thread. The library caps the value at
+    // SQLITE_MAX_WORKER_THREADS and reads back the value in effect.
+    property int WorkerThreads {
+      int get() {
+        return getWorkerThreads();
+      };
+      void set(int value) {
+        setWorkerThreads(value);
+      };
+    }
+
+    // Number of prepared statements kept for reuse by the next operation
+    // with the same SQL, 16 by default. Zero finalizes every statement
+    // after its operation.
+    property int StatementCacheCapacity {
+      int get() {
+        return static_cast<int>(statementCache.Capacity());
+      };
+      void set(int value) {
+        if (value < 0) {
+          throw ref new Platform::InvalidArgumentException(L"Statement cache capacity must not be negative");
+        }
+        // Finalizes the statements that no longer fit
+        ExecutionContext::Scope scope(context);
+        statementCache.SetCapacity(static_cast<size_t>(value));
+      };
+    }
+
+    // True when the database was opened with the immutable option
+    property bool Immutable {
+      bool get() {
+        return immutable;
+      };
+    }
+
+    // True when the database was opened with the noMutex option. SQLite
+    // then takes no lock in each call, the connection's operations run one
+    // at a time and property setters wait for the running operation.
+    property bool NoMutex {
+      bool get() {
+        return context.Enabled();
+      };
+    }
+
+    // True when the database was opened with the coordinateWrites option.
+    // Transactional batches and imports then begin with BEGIN IMMEDIATE
+    // once the writers of other such connections to the file are done.
+    property bool CoordinateWrites {
+      bool get() {
+        return coordinateWrites;
+      };
+    }
+
+  internal:
+    // Entered by everything that uses the connection outside of its
+    // scheduled operations
+    ExecutionContext& Context() {
+      return context;
+    }
+
   private:
     static bool sharedCache;
-    Database(sqlite3* sqlite, Windows::UI::Core::CoreDispatcher^ dispatcher);
+    static AllocatorKind allocator;
+    static bool libraryConfigured;
+    static void configureLibrary();
+    Database(sqlite3* sqlite, Windows::UI::Core::CoreDispatcher^ dispatcher, bool immutable, bool noMutex);
+
+    // Statements are taken from the statement cache unless cached is false,
+    // e.g. because the result cache has to see them being prepared
+    template <typename ParameterContainer>
+    StatementPtr PrepareAndBind(Platform::String^ sql, ParameterContainer params, bool cached = true);
+
+    template <typename Result, typename Work>
+    Concurrency::task<Result> schedule(Work work, Concurrency::cancellation_token token);
 
     template <typename ParameterContainer>
-    StatementPtr PrepareAndBind(Platform::String^ sql, ParameterContainer params);
+    Platform::String^ QueryRows(Platform::String^ sql, ParameterContainer params, bool all);
 
     template <typename ParameterContainer>
     Windows::Foundation::IAsyncOperation<int>^ RunAsync(Platform::String^ sql, ParameterContainer params);
@@ -127,12 +688,40 @@ namespace SQLite3 {
     template <typename ParameterContainer>
     Windows::Foundation::IAsyncOperation<Platform::String^>^ AllAsync(Platform::String^ sql, ParameterContainer params);
     template <typename ParameterContainer>
+    Windows::Foundation::IAsyncOperationWithProgress<int64, int64>^ ExportAsync(Platform::String^ sql,
+      ParameterContainer params, Platform::String^ path, ExportFormat format);
+    template <typename ParameterContainer>
+    Windows::Foundation::IAsyncOperation<ResultSet^>^ QueryAsync(Platform::String^ sql, ParameterContainer params);
+    template <typename ParameterContainer>
     Windows::Foundation::IAsyncAction^ EachAsync(Platform::String^ sql, ParameterContainer params, EachCallback^ callback);
 
     static void __cdecl UpdateHook(void* data, int action, char const* dbName, char const* tableName, sqlite3_int64 rowId);
     void OnChange(int action, char const* dbName, char const* tableName, sqlite3_int64 rowId);
 
+    void logIfSlow(const Statement& statement);
+    void backupStep(std::shared_ptr<BackupOperation> operation);
+    void schedulePersist(unsigned intervalMilliseconds);
+    void warmUp(const std::vector<std::string>& statements);
+    void setResultCacheBudget(int64 value);
+    void setTempStoreBudget(int64 value);
+    int getWorkerThreads();
+    void setWorkerThreads(int value);
+
     bool fireEvents;
+    // Set from the calling thread, read by the connection's operations
+    std::atomic<double> slowQueryThreshold;
+    SlowQueryLog slowQueryLog;
+    ResultCache resultCache;
+    StatementCache statementCache;
+    OpenStatistics openStatistics;
+    int64 tempStoreBudget;
+    bool immutable;
+    bool coordinateWrites;
+    UnlockWait unlockWait;
+    BusyHandler busyHandler;
+    WalCheckpointer checkpointer;
+    std::unique_ptr<MemoryDatabase> memoryDatabase;
+    OperationPriority priority;
     Platform::String^ collationLanguage;
     Windows::UI::Core::CoreDispatcher^ dispatcher;
     sqlite3* sqlite;
@@ -150,5 +739,10 @@ namespace SQLite3 {
     int changeHandlers;
     void addChangeHandler(int& handlerCount);
     void removeChangeHandler(int& handlerCount);
+
+    ExecutionContext context;
+    // Declared last so it is destroyed first, while the members its jobs use
+    // still exist
+    Scheduler scheduler;
   };
 }
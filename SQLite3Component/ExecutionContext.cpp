@@ -0,0 +1,70 @@
+#include <chrono>
+
+#include "ExecutionContext.h"
+
+namespace SQLite3 {
+  ExecutionContext::ExecutionContext(bool enabled)
+    : enabled(enabled)
+    , owner(std::thread::id())
+    , depth(0)
+    , entries(0)
+    , contended(0)
+    , waitMicroseconds(0) {
+  }
+
+  bool ExecutionContext::Enabled() const {
+    return enabled;
+  }
+
+  bool ExecutionContext::HeldByCurrentThread() const {
+    return enabled && owner.load(std::memory_order_relaxed) == std::this_thread::get_id();
+  }
+
+  ExecutionContextCounters ExecutionContext::Counters() const {
+    ExecutionContextCounters counters;
+    counters.entries = entries;
+    counters.contended = contended;
+    counters.waitMicroseconds = waitMicroseconds;
+    return counters;
+  }
+
+  void ExecutionContext::Enter() {
+    if (!enabled) {
+      return;
+    }
+    std::thread::id self = std::this_thread::get_id();
+    if (owner.load(std::memory_order_relaxed) == self) {
+      ++depth;
+      return;
+    }
+    if (!mutex.try_lock()) {
+      auto started = std::chrono::steady_clock::now();
+      mutex.lock();
+      ++contended;
+      waitMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    }
+    owner.store(self, std::memory_order_relaxed);
+    depth = 1;
+    ++entries;
+  }
+
+  void ExecutionContext::Leave() {
+    if (!enabled) {
+      return;
+    }
+    if (--depth == 0) {
+      owner.store(std::thread::id(), std::memory_order_relaxed);
+      mutex.unlock();
+    }
+  }
+
+  ExecutionContext::Scope::Scope(ExecutionContext& context)
+    : context(context) {
+    context.Enter();
+  }
+
+  ExecutionContext::Scope::~Scope() {
+    context.Leave();
+  }
+}
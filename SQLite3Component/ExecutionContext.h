@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace SQLite3 {
+  struct ExecutionContextCounters {
+    // Outermost scopes entered
+    long long entries;
+    // Scopes that had to wait for another thread to leave the context
+    long long contended;
+    long long waitMicroseconds;
+  };
+
+  // Gives one thread at a time access to a connection opened with
+  // SQLITE_OPEN_NOMUTEX, which leaves that to the application. The
+  // connection's scheduler runs every job inside the context, everything
+  // else that touches the connection enters a Scope first. A thread takes
+  // the lock once per job instead of SQLite taking the connection mutex in
+  // every call. Scopes nest on the same thread. A disabled context grants
+  // access without locking, for connections SQLite serializes itself.
+  class ExecutionContext {
+  public:
+    explicit ExecutionContext(bool enabled);
+
+    bool Enabled() const;
+    // False for a disabled context
+    bool HeldByCurrentThread() const;
+
+    ExecutionContextCounters Counters() const;
+
+    // For callers that can not tie the access to a block, like the scheduler
+    // whose job may destroy the context. No-ops when disabled.
+    void Enter();
+    void Leave();
+
+    class Scope {
+    public:
+      explicit Scope(ExecutionContext& context);
+      ~Scope();
+
+    private:
+      Scope(const Scope&);
+      Scope& operator=(const Scope&);
+
+      ExecutionContext& context;
+    };
+
+  private:
+    ExecutionContext(const ExecutionContext&);
+    ExecutionContext& operator=(const ExecutionContext&);
+
+    const bool enabled;
+    std::mutex mutex;
+    // Only ever equal to the id of the calling thread if that thread is the
+    // owner, so reading it without the lock is safe
+    std::atomic<std::thread::id> owner;
+    int depth;
+    std::atomic<long long> entries;
+    std::atomic<long long> contended;
+    std::atomic<long long> waitMicroseconds;
+  };
+}
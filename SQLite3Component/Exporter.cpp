@@ -0,0 +1,112 @@
+#include <cstring>
+
+#include "Exporter.h"
+
+namespace SQLite3 {
+  namespace {
+    const size_t chunkBytes = 64 * 1024;
+  }
+
+  FileExportSink::FileExportSink(std::FILE* file)
+    : file(file) {
+  }
+
+  bool FileExportSink::Write(const char* data, size_t size) {
+    return std::fwrite(data, 1, size, file) == size;
+  }
+
+  ExportWriter::ExportWriter(sqlite3_stmt* statement, ExportFormat format, ExportSink& sink)
+    : statement(statement)
+    , format(format)
+    , sink(sink)
+    , rowWriter(statement)
+    , rows(0) {
+    buffer.reserve(chunkBytes + chunkBytes / 4);
+    if (format == ExportCsv) {
+      int columnCount = sqlite3_column_count(statement);
+      for (int i = 0; i < columnCount; ++i) {
+        if (i) {
+          buffer.push_back(',');
+        }
+        const char* name = sqlite3_column_name(statement, i);
+        writeCsvField(name, std::strlen(name));
+      }
+      buffer.append("\r\n");
+    }
+  }
+
+  bool ExportWriter::WriteRow() {
+    if (format == ExportNdjson) {
+      rowWriter.WriteRow(buffer);
+      buffer.push_back('\n');
+    } else {
+      int columnCount = sqlite3_column_count(statement);
+      for (int i = 0; i < columnCount; ++i) {
+        if (i) {
+          buffer.push_back(',');
+        }
+        switch (sqlite3_column_type(statement, i)) {
+        case SQLITE_NULL:
+          break;
+        case SQLITE_BLOB:
+          {
+            auto data = static_cast<const unsigned char*>(sqlite3_column_blob(statement, i));
+            size_t length = static_cast<size_t>(sqlite3_column_bytes(statement, i));
+            // BASE64 never needs quoting
+            writeBase64(data, length, buffer);
+            break;
+          }
+        default:
+          {
+            auto text = reinterpret_cast<const char*>(sqlite3_column_text(statement, i));
+            writeCsvField(text, static_cast<size_t>(sqlite3_column_bytes(statement, i)));
+          }
+        }
+      }
+      buffer.append("\r\n");
+    }
+    ++rows;
+    return flushIfFull();
+  }
+
+  bool ExportWriter::Finish() {
+    bool written = buffer.empty() || sink.Write(buffer.data(), buffer.size());
+    buffer.clear();
+    return written;
+  }
+
+  long long ExportWriter::Rows() const {
+    return rows;
+  }
+
+  void ExportWriter::writeCsvField(const char* text, size_t length) {
+    // Empty text is quoted to tell it apart from NULL
+    bool quoted = length == 0;
+    for (size_t i = 0; i < length && !quoted; ++i) {
+      char c = text[i];
+      quoted = c == ',' || c == '"' || c == '\r' || c == '\n';
+    }
+    if (!quoted) {
+      buffer.append(text, length);
+      return;
+    }
+    buffer.push_back('"');
+    const char* runStart = text;
+    const char* end = text + length;
+    for (const char* i = text; i != end; ++i) {
+      if (*i == '"') {
+        buffer.append(runStart, i + 1);
+        runStart = i;
+      }
+    }
+    buffer.append(runStart, end);
+    buffer.push_back('"');
+  }
+
+  bool ExportWriter::flushIfFull() {
+    if (buffer.size() < chunkBytes) {
+      return true;
+    }
+    return Finish();
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+#include "sqlite3.h"
+#include "RowWriter.h"
+
+namespace SQLite3 {
+  enum ExportFormat {
+    ExportNdjson,
+    ExportCsv
+  };
+
+  class ExportSink {
+  public:
+    virtual ~ExportSink() {}
+    // Returns false when the data could not be written
+    virtual bool Write(const char* data, size_t size) = 0;
+  };
+
+  // Writes to a file opened by the caller, who also closes it
+  class FileExportSink : public ExportSink {
+  public:
+    explicit FileExportSink(std::FILE* file);
+
+    bool Write(const char* data, size_t size);
+
+  private:
+    std::FILE* file;
+  };
+
+  class ExportProgress {
+  public:
+    virtual ~ExportProgress() {}
+    // Returning false cancels the export
+    virtual bool Report(long long rows) = 0;
+  };
+
+  // Serializes the rows of a statement into a sink in chunks, so memory use
+  // does not depend on the size of the result. NDJSON rows are the objects
+  // RowWriter produces, CSV (RFC 4180) starts with the column names, writes
+  // NULL as an empty field, empty text as "" and blobs as BASE64.
+  class ExportWriter {
+  public:
+    ExportWriter(sqlite3_stmt* statement, ExportFormat format, ExportSink& sink);
+
+    // Appends the current row, returns false when the sink failed
+    bool WriteRow();
+    bool Finish();
+
+    long long Rows() const;
+
+  private:
+    void writeCsvField(const char* text, size_t length);
+    bool flushIfFull();
+
+    sqlite3_stmt* statement;
+    ExportFormat format;
+    ExportSink& sink;
+    RowWriter rowWriter;
+    std::string buffer;
+    long long rows;
+  };
+}
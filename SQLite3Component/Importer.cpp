@@ -0,0 +1,1015 @@
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SQLITE3_IMPORT_SSE2
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "Importer.h"
+#include "WriteCoordinator.h"
+
+namespace SQLite3 {
+  namespace {
+    const size_t readSize = 256 * 1024;
+    const size_t batchRows = 4096;
+    const size_t batchTextBytes = 1024 * 1024;
+    // Batches in flight between the tokenizer and the binder
+    const size_t queueDepth = 4;
+    const char* const savepoint = "sqlite3_import";
+
+    enum FieldType {
+      FieldNull,
+      FieldText,
+      FieldInteger,
+      FieldFloat
+    };
+
+    struct Field {
+      size_t offset;
+      size_t length;
+      int type;
+    };
+
+    // Rows of fields whose text is stored back to back in one string
+    struct RowBatch {
+      RowBatch() : rows(0) {}
+
+      bool Full() const {
+        return rows >= batchRows || text.size() >= batchTextBytes;
+      }
+
+      void Clear() {
+        text.clear();
+        fields.clear();
+        rows = 0;
+      }
+
+      std::string text;
+      std::vector<Field> fields;
+      size_t rows;
+    };
+
+    class BatchQueue {
+    public:
+      BatchQueue() : batches(queueDepth), finished(false), succeeded(false), aborted(false) {
+        for (size_t i = 0; i < batches.size(); ++i) {
+          available.push_back(&batches[i]);
+        }
+      }
+
+      // An empty batch for the tokenizer, nullptr once the import is aborted
+      RowBatch* Acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (available.empty() && !aborted) {
+          changed.wait(lock);
+        }
+        if (aborted) {
+          return nullptr;
+        }
+        RowBatch* batch = available.back();
+        available.pop_back();
+        return batch;
+      }
+
+      void Push(RowBatch* batch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.push_back(batch);
+        changed.notify_all();
+      }
+
+      // The next filled batch for the binder, nullptr at the end
+      RowBatch* Pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (ready.empty() && !finished && !aborted) {
+          changed.wait(lock);
+        }
+        if (aborted || ready.empty()) {
+          return nullptr;
+        }
+        RowBatch* batch = ready.front();
+        ready.pop_front();
+        return batch;
+      }
+
+      void Recycle(RowBatch* batch) {
+        batch->Clear();
+        std::lock_guard<std::mutex> lock(mutex);
+        available.push_back(batch);
+        changed.notify_all();
+      }
+
+      // No more batches. Unless the input was read completely the binder
+      // still binds them but rolls back the open transaction.
+      void Finish(bool complete) {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        succeeded = complete;
+        changed.notify_all();
+      }
+
+      bool Succeeded() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return succeeded && !aborted;
+      }
+
+      void Abort() {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborted = true;
+        changed.notify_all();
+      }
+
+    private:
+      std::vector<RowBatch> batches;
+      std::vector<RowBatch*> available;
+      std::deque<RowBatch*> ready;
+      std::mutex mutex;
+      std::condition_variable changed;
+      bool finished;
+      bool succeeded;
+      bool aborted;
+    };
+
+    inline unsigned lowestBit(unsigned mask) {
+#if defined(_MSC_VER)
+      unsigned long index;
+      _BitScanForward(&index, mask);
+      return index;
+#else
+      return __builtin_ctz(mask);
+#endif
+    }
+
+    // Position of the first a, b or c in [p, end), 16 bytes at a time where
+    // SSE2 is available and 8 bytes at a time otherwise
+    const char* findAny(const char* p, const char* end, char a, char b, char c) {
+#if defined(SQLITE3_IMPORT_SSE2)
+      const __m128i va = _mm_set1_epi8(a);
+      const __m128i vb = _mm_set1_epi8(b);
+      const __m128i vc = _mm_set1_epi8(c);
+      while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i matches = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)),
+                                       _mm_cmpeq_epi8(chunk, vc));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(matches));
+        if (mask) {
+          return p + lowestBit(mask);
+        }
+        p += 16;
+      }
+#else
+      const unsigned long long ones = 0x0101010101010101ULL;
+      const unsigned long long highs = 0x8080808080808080ULL;
+      while (end - p >= 8) {
+        unsigned long long word;
+        std::memcpy(&word, p, 8);
+        unsigned long long xa = word ^ (ones * static_cast<unsigned char>(a));
+        unsigned long long xb = word ^ (ones * static_cast<unsigned char>(b));
+        unsigned long long xc = word ^ (ones * static_cast<unsigned char>(c));
+        if ((((xa - ones) & ~xa) | ((xb - ones) & ~xb) | ((xc - ones) & ~xc)) & highs) {
+          break;
+        }
+        p += 8;
+      }
+#endif
+      for (; p < end; ++p) {
+        if (*p == a || *p == b || *p == c) {
+          return p;
+        }
+      }
+      return end;
+    }
+
+    enum ParseState {
+      Parsed,
+      NeedMore,
+      Finished,
+      Failed
+    };
+
+    class Tokenizer {
+    public:
+      Tokenizer() : columnCount(0), records(0) {}
+      virtual ~Tokenizer() {}
+
+      // Appends up to maxRows complete records to the batch and returns the
+      // number of bytes consumed. Stops early when the batch is full or the
+      // input ends in the middle of a record.
+      size_t Parse(const char* data, size_t size, bool last, RowBatch& batch, size_t maxRows) {
+        size_t position = 0;
+        while (batch.rows < maxRows && !batch.Full()) {
+          size_t textSize = batch.text.size();
+          size_t fieldCount = batch.fields.size();
+          size_t next = position;
+          ParseState state = ParseRecord(data, size, last, next, batch);
+          if (state == Parsed) {
+            ++records;
+            ++batch.rows;
+            position = next;
+          } else {
+            batch.text.resize(textSize);
+            batch.fields.resize(fieldCount);
+            if (state == Finished) {
+              position = next;
+            }
+            break;
+          }
+        }
+        return position;
+      }
+
+      void SetColumnCount(size_t count) {
+        columnCount = count;
+      }
+
+      const std::string& Error() const {
+        return error;
+      }
+
+    protected:
+      virtual ParseState ParseRecord(const char* data, size_t size, bool last, size_t& position, RowBatch& batch) = 0;
+
+      ParseState Fail(const std::string& message) {
+        std::ostringstream text;
+        text << "Record " << records + 1 << ": " << message;
+        error = text.str();
+        return Failed;
+      }
+
+      size_t columnCount;
+      long long records;
+      std::string error;
+    };
+
+    // RFC 4180: delimited fields, optionally enclosed in double quotes with
+    // "" as escape, records end with LF or CRLF. Blank lines are skipped.
+    class CsvTokenizer : public Tokenizer {
+    public:
+      explicit CsvTokenizer(char delimiter) : delimiter(delimiter) {}
+
+    protected:
+      ParseState ParseRecord(const char* data, size_t size, bool last, size_t& position, RowBatch& batch) {
+        size_t p = position;
+        while (p < size && (data[p] == '\n' || data[p] == '\r')) {
+          ++p;
+        }
+        if (p == size) {
+          position = p;
+          return last ? Finished : NeedMore;
+        }
+
+        size_t fields = 0;
+        for (;;) {
+          Field field;
+          field.offset = batch.text.size();
+          field.type = FieldText;
+          if (p < size && data[p] == '"') {
+            ++p;
+            for (;;) {
+              const char* quote = static_cast<const char*>(std::memchr(data + p, '"', size - p));
+              if (!quote) {
+                return last ? Fail("Unterminated quoted field") : NeedMore;
+              }
+              size_t q = quote - data;
+              batch.text.append(data + p, q - p);
+              if (q + 1 == size && !last) {
+                return NeedMore;
+              }
+              if (q + 1 < size && data[q + 1] == '"') {
+                batch.text.push_back('"');
+                p = q + 2;
+              } else {
+                p = q + 1;
+                break;
+              }
+            }
+          } else {
+            size_t q = findAny(data + p, data + size, delimiter, '\n', '\r') - data;
+            if (q == size && !last) {
+              return NeedMore;
+            }
+            batch.text.append(data + p, q - p);
+            p = q;
+          }
+          field.length = batch.text.size() - field.offset;
+          batch.fields.push_back(field);
+          ++fields;
+
+          if (p == size) {
+            break;
+          }
+          char c = data[p];
+          if (c == delimiter) {
+            ++p;
+          } else if (c == '\n') {
+            ++p;
+            break;
+          } else if (c == '\r') {
+            if (p + 1 == size && !last) {
+              return NeedMore;
+            }
+            p += p + 1 < size && data[p + 1] == '\n' ? 2 : 1;
+            break;
+          } else {
+            return Fail("Unexpected character after a quoted field");
+          }
+        }
+
+        if (columnCount && fields != columnCount) {
+          std::ostringstream message;
+          message << "Expected " << columnCount << " fields but found " << fields;
+          return Fail(message.str());
+        }
+        position = p;
+        return Parsed;
+      }
+
+    private:
+      char delimiter;
+    };
+
+    void appendUtf8(unsigned codePoint, std::string& out) {
+      if (codePoint < 0x80) {
+        out.push_back(static_cast<char>(codePoint));
+      } else if (codePoint < 0x800) {
+        out.push_back(static_cast<char>(0xc0 | (codePoint >> 6)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+      } else if (codePoint < 0x10000) {
+        out.push_back(static_cast<char>(0xe0 | (codePoint >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+      } else {
+        out.push_back(static_cast<char>(0xf0 | (codePoint >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+      }
+    }
+
+    bool readHex4(const char*& p, const char* end, unsigned& value) {
+      if (end - p < 4) {
+        return false;
+      }
+      value = 0;
+      for (int i = 0; i < 4; ++i, ++p) {
+        char c = *p;
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+          value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+          value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+          value |= c - 'A' + 10;
+        } else {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // One JSON object per line. Keys name the columns, unknown keys are
+    // ignored and missing ones are bound as NULL.
+    class NdjsonTokenizer : public Tokenizer {
+    public:
+      explicit NdjsonTokenizer(const std::vector<std::string>& columns) {
+        for (size_t i = 0; i < columns.size(); ++i) {
+          columnIndex[columns[i]] = i;
+        }
+        SetColumnCount(columns.size());
+      }
+
+    protected:
+      ParseState ParseRecord(const char* data, size_t size, bool last, size_t& position, RowBatch& batch) {
+        size_t p = position;
+        const char* newline;
+        for (;;) {
+          newline = static_cast<const char*>(std::memchr(data + p, '\n', size - p));
+          if (!newline && !last) {
+            return NeedMore;
+          }
+          const char* lineEnd = newline ? newline : data + size;
+          const char* start = data + p;
+          skipSpace(start, lineEnd);
+          if (start != lineEnd) {
+            break;
+          }
+          if (!newline) {
+            position = size;
+            return Finished;
+          }
+          p = newline - data + 1;
+        }
+
+        const char* cursor = data + p;
+        const char* end = newline ? newline : data + size;
+        size_t firstField = batch.fields.size();
+        Field null = { 0, 0, FieldNull };
+        batch.fields.resize(firstField + columnCount, null);
+
+        skipSpace(cursor, end);
+        if (cursor == end || *cursor != '{') {
+          return Fail("Expected a JSON object");
+        }
+        ++cursor;
+        skipSpace(cursor, end);
+        if (cursor < end && *cursor == '}') {
+          ++cursor;
+        } else {
+          for (;;) {
+            skipSpace(cursor, end);
+            key.clear();
+            if (cursor == end || *cursor != '"' || !parseString(cursor, end, key)) {
+              return Fail("Expected a quoted key");
+            }
+            skipSpace(cursor, end);
+            if (cursor == end || *cursor != ':') {
+              return Fail("Expected ':' after key \"" + key + "\"");
+            }
+            ++cursor;
+            skipSpace(cursor, end);
+
+            std::unordered_map<std::string, size_t>::const_iterator column = columnIndex.find(key);
+            Field field;
+            if (!parseValue(cursor, end, batch.text, field)) {
+              return Fail("Invalid value for key \"" + key + "\"");
+            }
+            if (column != columnIndex.end()) {
+              batch.fields[firstField + column->second] = field;
+            }
+
+            skipSpace(cursor, end);
+            if (cursor < end && *cursor == ',') {
+              ++cursor;
+            } else if (cursor < end && *cursor == '}') {
+              ++cursor;
+              break;
+            } else {
+              return Fail("Expected ',' or '}'");
+            }
+          }
+        }
+        skipSpace(cursor, end);
+        if (cursor != end) {
+          return Fail("Unexpected text after the object");
+        }
+
+        position = newline ? newline - data + 1 : size;
+        return Parsed;
+      }
+
+    private:
+      static void skipSpace(const char*& p, const char* end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+          ++p;
+        }
+      }
+
+      // Unescapes the string starting at the opening quote
+      static bool parseString(const char*& p, const char* end, std::string& out) {
+        ++p;
+        for (;;) {
+          const char* stop = findAny(p, end, '"', '\\', '"');
+          out.append(p, stop);
+          p = stop;
+          if (p == end) {
+            return false;
+          }
+          if (*p == '"') {
+            ++p;
+            return true;
+          }
+          if (++p == end) {
+            return false;
+          }
+          char escaped = *p++;
+          switch (escaped) {
+          case '"': out.push_back('"'); break;
+          case '\\': out.push_back('\\'); break;
+          case '/': out.push_back('/'); break;
+          case 'b': out.push_back('\b'); break;
+          case 'f': out.push_back('\f'); break;
+          case 'n': out.push_back('\n'); break;
+          case 'r': out.push_back('\r'); break;
+          case 't': out.push_back('\t'); break;
+          case 'u': {
+              unsigned codePoint;
+              if (!readHex4(p, end, codePoint)) {
+                return false;
+              }
+              if (codePoint >= 0xd800 && codePoint < 0xdc00) {
+                unsigned low;
+                if (end - p < 6 || p[0] != '\\' || p[1] != 'u') {
+                  return false;
+                }
+                p += 2;
+                if (!readHex4(p, end, low) || low < 0xdc00 || low > 0xdfff) {
+                  return false;
+                }
+                codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+              }
+              appendUtf8(codePoint, out);
+              break;
+            }
+          default:
+            return false;
+          }
+        }
+      }
+
+      // Skips a nested object or array, strings may contain brackets
+      static bool skipNested(const char*& p, const char* end) {
+        int depth = 0;
+        while (p < end) {
+          char c = *p;
+          if (c == '"') {
+            std::string ignored;
+            if (!parseString(p, end, ignored)) {
+              return false;
+            }
+            continue;
+          }
+          ++p;
+          if (c == '{' || c == '[') {
+            ++depth;
+          } else if (c == '}' || c == ']') {
+            if (--depth == 0) {
+              return true;
+            }
+          }
+        }
+        return false;
+      }
+
+      static bool matchLiteral(const char*& p, const char* end, const char* literal) {
+        size_t length = std::strlen(literal);
+        if (static_cast<size_t>(end - p) < length || std::memcmp(p, literal, length) != 0) {
+          return false;
+        }
+        p += length;
+        return true;
+      }
+
+      static bool parseValue(const char*& p, const char* end, std::string& text, Field& field) {
+        field.offset = text.size();
+        field.length = 0;
+        if (p == end) {
+          return false;
+        }
+
+        char c = *p;
+        if (c == '"') {
+          field.type = FieldText;
+          if (!parseString(p, end, text)) {
+            return false;
+          }
+        } else if (c == '{' || c == '[') {
+          const char* start = p;
+          field.type = FieldText;
+          if (!skipNested(p, end)) {
+            return false;
+          }
+          text.append(start, p);
+        } else if (c == 't' || c == 'f') {
+          field.type = FieldInteger;
+          if (!matchLiteral(p, end, c == 't' ? "true" : "false")) {
+            return false;
+          }
+          text.push_back(c == 't' ? '1' : '0');
+        } else if (c == 'n') {
+          field.type = FieldNull;
+          return matchLiteral(p, end, "null");
+        } else {
+          const char* start = p;
+          field.type = FieldInteger;
+          if (*p == '-') {
+            ++p;
+          }
+          const char* digits = p;
+          for (; p < end; ++p) {
+            if (*p == '.' || *p == 'e' || *p == 'E' || *p == '+' || (*p == '-' && p > digits)) {
+              field.type = FieldFloat;
+            } else if (*p < '0' || *p > '9') {
+              break;
+            }
+          }
+          if (p == digits) {
+            return false;
+          }
+          text.append(start, p);
+        }
+        field.length = text.size() - field.offset;
+        return true;
+      }
+
+      std::unordered_map<std::string, size_t> columnIndex;
+      std::string key;
+    };
+
+    std::string quoteIdentifier(const std::string& name) {
+      std::string quoted("\"");
+      for (size_t i = 0; i < name.size(); ++i) {
+        if (name[i] == '"') {
+          quoted.push_back('"');
+        }
+        quoted.push_back(name[i]);
+      }
+      quoted.push_back('"');
+      return quoted;
+    }
+
+    int prepare(sqlite3* db, UnlockWait* unlockWait, const std::string& sql, sqlite3_stmt** statement) {
+      return unlockWait ? unlockWait->Prepare(db, sql.c_str(), statement, nullptr)
+        : sqlite3_prepare_v2(db, sql.c_str(), -1, statement, nullptr);
+    }
+
+    // Waits for shared cache locks while no row was returned yet
+    int step(sqlite3_stmt* statement, UnlockWait* unlockWait, bool restartable) {
+      return unlockWait ? unlockWait->Step(statement, restartable) : sqlite3_step(statement);
+    }
+
+    int tableColumns(sqlite3* db, UnlockWait* unlockWait, const std::string& table, std::vector<std::string>& columns) {
+      sqlite3_stmt* statement = nullptr;
+      std::string sql = "PRAGMA table_info(" + quoteIdentifier(table) + ")";
+      int result = prepare(db, unlockWait, sql, &statement);
+      if (result != SQLITE_OK) {
+        return result;
+      }
+      while ((result = step(statement, unlockWait, columns.empty())) == SQLITE_ROW) {
+        columns.push_back(reinterpret_cast<const char*>(sqlite3_column_text(statement, 1)));
+      }
+      sqlite3_finalize(statement);
+      return result == SQLITE_DONE ? SQLITE_OK : result;
+    }
+
+    std::string insertStatement(const ImportOptions& options, const std::vector<std::string>& columns) {
+      std::string sql = "INSERT ";
+      if (!options.conflict.empty()) {
+        sql += "OR " + options.conflict + " ";
+      }
+      sql += "INTO " + quoteIdentifier(options.table) + " (";
+      for (size_t i = 0; i < columns.size(); ++i) {
+        sql += (i ? ", " : "") + quoteIdentifier(columns[i]);
+      }
+      sql += ") VALUES (";
+      for (size_t i = 0; i < columns.size(); ++i) {
+        sql += i ? ", ?" : "?";
+      }
+      sql += ")";
+      return sql;
+    }
+
+    // Integers are bound as 64-bit integers down to INT64_MIN and up to
+    // INT64_MAX, only larger ones become doubles
+    int bindNumber(sqlite3_stmt* statement, int index, const char* text, size_t length, bool integer) {
+      if (integer) {
+        const char* p = text;
+        const char* end = text + length;
+        bool negative = p < end && *p == '-';
+        if (negative || (p < end && *p == '+')) {
+          ++p;
+        }
+        const char* digits = p;
+        const sqlite3_uint64 largest = 0x7fffffffffffffffULL;
+        const sqlite3_uint64 limit = negative ? largest + 1 : largest;
+        sqlite3_uint64 magnitude = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+          unsigned digit = static_cast<unsigned>(*p - '0');
+          if (magnitude > (limit - digit) / 10) {
+            break;
+          }
+          magnitude = magnitude * 10 + digit;
+        }
+        if (p == end && p > digits) {
+          sqlite3_int64 value;
+          if (!negative) {
+            value = static_cast<sqlite3_int64>(magnitude);
+          } else if (magnitude == limit) {
+            value = -static_cast<sqlite3_int64>(largest) - 1;
+          } else {
+            value = -static_cast<sqlite3_int64>(magnitude);
+          }
+          return sqlite3_bind_int64(statement, index, value);
+        }
+      }
+      char buffer[64];
+      if (length >= sizeof(buffer)) {
+        return sqlite3_bind_text(statement, index, text, static_cast<int>(length), SQLITE_STATIC);
+      }
+      std::memcpy(buffer, text, length);
+      buffer[length] = '\0';
+      char* parsedEnd;
+      double value = std::strtod(buffer, &parsedEnd);
+      if (parsedEnd != buffer + length) {
+        return sqlite3_bind_text(statement, index, text, static_cast<int>(length), SQLITE_STATIC);
+      }
+      return sqlite3_bind_double(statement, index, value);
+    }
+
+    int execute(sqlite3* db, const std::string& sql) {
+      return sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr);
+    }
+
+    // Second pipeline stage, runs on its own thread
+    class Binder {
+    public:
+      Binder(sqlite3* db, sqlite3_stmt* insert, size_t columnCount, int batchSize, bool coordinateWrites, UnlockWait* unlockWait,
+        BatchQueue& queue, ImportProgress* progress)
+        : db(db)
+        , insert(insert)
+        , columnCount(columnCount)
+        , batchSize(batchSize > 0 ? batchSize : 1)
+        , coordinateWrites(coordinateWrites)
+        , unlockWait(unlockWait)
+        , write(db)
+        , queue(queue)
+        , progress(progress)
+        , committedRows(0)
+        , resultCode(SQLITE_OK)
+        , cancelled(false) {
+      }
+
+      void Run() {
+        long long pendingRows = 0;
+        resultCode = begin();
+        while (resultCode == SQLITE_OK) {
+          RowBatch* batch = queue.Pop();
+          if (!batch) {
+            break;
+          }
+          for (size_t row = 0; row < batch->rows && resultCode == SQLITE_OK; ++row) {
+            resultCode = bindRow(*batch, row);
+            if (resultCode == SQLITE_OK) {
+              resultCode = step(insert, unlockWait, true);
+              resultCode = resultCode == SQLITE_DONE ? SQLITE_OK : resultCode;
+            }
+            sqlite3_reset(insert);
+            if (resultCode != SQLITE_OK) {
+              std::ostringstream text;
+              text << "Row " << committedRows + pendingRows + 1 << ": " << sqlite3_errmsg(db);
+              message = text.str();
+            } else if (++pendingRows == batchSize) {
+              resultCode = commit();
+              pendingRows = 0;
+            }
+          }
+          sqlite3_clear_bindings(insert);
+          queue.Recycle(batch);
+        }
+
+        if (resultCode == SQLITE_OK && queue.Succeeded()) {
+          resultCode = release();
+          if (resultCode == SQLITE_OK) {
+            committedRows += pendingRows;
+            if (pendingRows && progress) {
+              progress->Report(committedRows);
+            }
+          }
+        } else {
+          execute(db, std::string("ROLLBACK TO ") + savepoint);
+          execute(db, std::string("RELEASE ") + savepoint);
+          write.Rollback();
+          queue.Abort();
+        }
+      }
+
+      long long CommittedRows() const {
+        return committedRows;
+      }
+
+      int ResultCode() const {
+        return resultCode;
+      }
+
+      const std::string& Message() const {
+        return message;
+      }
+
+      bool Cancelled() const {
+        return cancelled;
+      }
+
+    private:
+      int bindRow(const RowBatch& batch, size_t row) {
+        const Field* fields = &batch.fields[row * columnCount];
+        const char* text = batch.text.data();
+        for (size_t column = 0; column < columnCount; ++column) {
+          const Field& field = fields[column];
+          int index = static_cast<int>(column + 1);
+          int result;
+          switch (field.type) {
+          case FieldText:
+            result = sqlite3_bind_text(insert, index, text + field.offset, static_cast<int>(field.length), SQLITE_STATIC);
+            break;
+          case FieldInteger:
+          case FieldFloat:
+            result = bindNumber(insert, index, text + field.offset, field.length, field.type == FieldInteger);
+            break;
+          default:
+            result = sqlite3_bind_null(insert, index);
+          }
+          if (result != SQLITE_OK) {
+            return result;
+          }
+        }
+        return SQLITE_OK;
+      }
+
+      // Opens the savepoint of the next rows, inside a write transaction of
+      // their own when coordinated
+      int begin() {
+        if (coordinateWrites) {
+          int result = write.Begin();
+          if (result != SQLITE_OK) {
+            return result;
+          }
+        }
+        return execute(db, std::string("SAVEPOINT ") + savepoint);
+      }
+
+      int release() {
+        int result = execute(db, std::string("RELEASE ") + savepoint);
+        return result == SQLITE_OK ? write.Commit() : result;
+      }
+
+      int commit() {
+        int result = release();
+        if (result != SQLITE_OK) {
+          message = sqlite3_errmsg(db);
+          return result;
+        }
+        committedRows += batchSize;
+        if (progress && !progress->Report(committedRows)) {
+          cancelled = true;
+          message = "Import cancelled";
+          // Nothing to roll back, the savepoint for it is opened anyway
+          begin();
+          return SQLITE_INTERRUPT;
+        }
+        result = begin();
+        if (result != SQLITE_OK) {
+          message = sqlite3_errmsg(db);
+        }
+        return result;
+      }
+
+      sqlite3* db;
+      sqlite3_stmt* insert;
+      size_t columnCount;
+      long long batchSize;
+      bool coordinateWrites;
+      UnlockWait* unlockWait;
+      WriteTransaction write;
+      BatchQueue& queue;
+      ImportProgress* progress;
+      long long committedRows;
+      int resultCode;
+      std::string message;
+      bool cancelled;
+    };
+
+    ImportResult failure(int resultCode, const std::string& message) {
+      ImportResult result;
+      result.resultCode = resultCode;
+      result.message = message;
+      result.rows = 0;
+      return result;
+    }
+
+    bool fill(ImportSource& source, std::string& pending) {
+      size_t used = pending.size();
+      pending.resize(used + readSize);
+      size_t read = source.Read(&pending[used], readSize);
+      pending.resize(used + read);
+      return read > 0;
+    }
+  }
+
+  ImportOptions::ImportOptions()
+    : format(ImportCsv)
+    , header(true)
+    , delimiter(',')
+    , batchSize(10000)
+    , coordinateWrites(false)
+    , unlockWait(nullptr) {
+  }
+
+  ImportResult Import(sqlite3* db, const ImportOptions& options, ImportSource& source, ImportProgress* progress) {
+    if (options.conflict != "" && options.conflict != "REPLACE" && options.conflict != "IGNORE") {
+      return failure(SQLITE_MISUSE, "Unsupported conflict resolution " + options.conflict);
+    }
+
+    std::unique_ptr<Tokenizer> tokenizer;
+    std::string pending;
+    bool more = true;
+    std::vector<std::string> columns(options.columns);
+
+    if (options.format == ImportCsv) {
+      tokenizer.reset(new CsvTokenizer(options.delimiter));
+      if (options.header) {
+        RowBatch header;
+        size_t consumed = 0;
+        while (!header.rows && more) {
+          more = fill(source, pending);
+          consumed = tokenizer->Parse(pending.data(), pending.size(), !more, header, 1);
+          if (!tokenizer->Error().empty()) {
+            return failure(SQLITE_FORMAT, tokenizer->Error());
+          }
+        }
+        pending.erase(0, consumed);
+        if (columns.empty()) {
+          for (size_t i = 0; i < header.fields.size(); ++i) {
+            columns.push_back(header.text.substr(header.fields[i].offset, header.fields[i].length));
+          }
+        }
+      }
+    }
+
+    if (columns.empty()) {
+      int result = tableColumns(db, options.unlockWait, options.table, columns);
+      if (result != SQLITE_OK || columns.empty()) {
+        return failure(result != SQLITE_OK ? result : SQLITE_ERROR, "No columns found for table " + options.table);
+      }
+    }
+
+    if (options.format == ImportCsv) {
+      tokenizer->SetColumnCount(columns.size());
+    } else {
+      tokenizer.reset(new NdjsonTokenizer(columns));
+    }
+
+    sqlite3_stmt* insert = nullptr;
+    int prepared = prepare(db, options.unlockWait, insertStatement(options, columns), &insert);
+    if (prepared != SQLITE_OK) {
+      return failure(prepared, sqlite3_errmsg(db));
+    }
+
+    BatchQueue queue;
+    Binder binder(db, insert, columns.size(), options.batchSize, options.coordinateWrites, options.unlockWait, queue, progress);
+    std::thread binding(&Binder::Run, &binder);
+
+    // First stage: read and tokenize into batches for the binder. When the
+    // source throws, the binder is aborted and rolls back its open
+    // transaction before the exception leaves.
+    try {
+      RowBatch* batch = queue.Acquire();
+      while (batch) {
+        size_t position = 0;
+        for (;;) {
+          position += tokenizer->Parse(pending.data() + position, pending.size() - position, !more, *batch, batchRows);
+          if (!tokenizer->Error().empty() || !batch->Full()) {
+            break;
+          }
+          queue.Push(batch);
+          if (!(batch = queue.Acquire())) {
+            break;
+          }
+        }
+        pending.erase(0, position);
+
+        if (!batch) {
+          break;
+        }
+        if (!more || !tokenizer->Error().empty()) {
+          // The rows before a bad record are still bound
+          if (batch->rows) {
+            queue.Push(batch);
+          } else {
+            queue.Recycle(batch);
+          }
+          break;
+        }
+        more = fill(source, pending);
+      }
+    } catch (...) {
+      queue.Abort();
+      binding.join();
+      sqlite3_finalize(insert);
+      throw;
+    }
+
+    bool parsed = tokenizer->Error().empty() && pending.empty() && !more;
+    queue.Finish(parsed);
+    binding.join();
+    sqlite3_finalize(insert);
+
+    ImportResult result;
+    result.rows = binder.CommittedRows();
+    result.resultCode = binder.ResultCode();
+    result.message = binder.Message();
+    if (result.resultCode == SQLITE_OK && !parsed) {
+      result.resultCode = SQLITE_FORMAT;
+      result.message = tokenizer->Error().empty() ? "Unexpected end of input" : tokenizer->Error();
+    }
+    return result;
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "sqlite3.h"
+#include "UnlockWait.h"
+
+namespace SQLite3 {
+  enum ImportFormat {
+    ImportCsv,
+    ImportNdjson
+  };
+
+  struct ImportOptions {
+    ImportOptions();
+
+    ImportFormat format;
+    std::string table;
+    // Target columns. Empty means the CSV header or, without one, all
+    // columns of the table in declaration order.
+    std::vector<std::string> columns;
+    bool header;
+    char delimiter;
+    // Rows committed per transaction
+    int batchSize;
+    // Empty, "REPLACE" or "IGNORE"
+    std::string conflict;
+    // Commits every batch in its own WriteTransaction
+    bool coordinateWrites;
+    // Waits for the table locks of a shared cache when given
+    UnlockWait* unlockWait;
+  };
+
+  struct ImportResult {
+    int resultCode;
+    std::string message;
+    long long rows;
+  };
+
+  // Supplies the raw bytes, returns 0 at the end of the input
+  class ImportSource {
+  public:
+    virtual ~ImportSource() {}
+    virtual size_t Read(char* buffer, size_t size) = 0;
+  };
+
+  // Called from the binding thread after every committed transaction.
+  // Returning false cancels the import.
+  class ImportProgress {
+  public:
+    virtual ~ImportProgress() {}
+    virtual bool Report(long long rows) = 0;
+  };
+
+  // Bulk loads CSV (RFC 4180) or newline delimited JSON into a table. The
+  // calling thread reads and tokenizes the input into batches of rows, a
+  // second thread binds them to a single cached INSERT statement. Every
+  // batchSize rows are committed, so an import that fails or is cancelled
+  // keeps the rows of the transactions committed before.
+  //
+  // CSV fields are bound as text and converted by the column affinity, NDJSON
+  // numbers, booleans and nulls keep their type, nested objects and arrays
+  // are stored as JSON text.
+  ImportResult Import(sqlite3* db, const ImportOptions& options, ImportSource& source, ImportProgress* progress);
+}
@@ -0,0 +1,397 @@
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include "MemoryAllocator.h"
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#define SQLITE3_THREAD_LOCAL __declspec(thread)
+#else
+#include <pthread.h>
+#define SQLITE3_THREAD_LOCAL __thread
+#endif
+
+namespace SQLite3 {
+  namespace {
+    std::atomic<long long> allocationCount(0);
+    std::atomic<long long> poolByteCount(0);
+    std::atomic<bool> installed(false);
+    MemoryAllocator::Kind installedKind = MemoryAllocator::System;
+
+    // Every block starts with a header so that xSize and xFree know where
+    // it came from. Eight bytes keep the payload 8-byte aligned.
+    struct Header {
+      unsigned size;
+      unsigned sizeClass;
+    };
+
+    const size_t headerBytes = sizeof(Header);
+    const unsigned largeBlock = ~0u;
+    const size_t classCount = 20;
+    const size_t largestClass = 1024;
+    const size_t chunkBytes = 64 * 1024;
+    // Blocks moved between a thread cache and the shared list at a time
+    const int batchSize = 16;
+    const int threadCacheLimit = 64;
+
+    inline size_t classIndex(size_t size) {
+      if (size <= 128) {
+        return size == 0 ? 0 : (size - 1) / 16;
+      } else if (size <= 256) {
+        return 8 + (size - 129) / 32;
+      } else if (size <= 512) {
+        return 12 + (size - 257) / 64;
+      }
+      return 16 + (size - 513) / 128;
+    }
+
+    inline size_t classSize(size_t index) {
+      if (index < 8) {
+        return (index + 1) * 16;
+      } else if (index < 12) {
+        return 128 + (index - 7) * 32;
+      } else if (index < 16) {
+        return 256 + (index - 11) * 64;
+      }
+      return 512 + (index - 15) * 128;
+    }
+
+    inline size_t roundUp(size_t size) {
+      return (size + 7) & ~static_cast<size_t>(7);
+    }
+
+    inline Header* headerOf(void* memory) {
+      return reinterpret_cast<Header*>(static_cast<char*>(memory) - headerBytes);
+    }
+
+    inline void* payloadOf(Header* header) {
+      return reinterpret_cast<char*>(header) + headerBytes;
+    }
+
+    struct FreeBlock {
+      FreeBlock* next;
+    };
+
+    struct SharedList {
+      SharedList() : head(nullptr), cursor(nullptr), end(nullptr) {}
+
+      std::mutex lock;
+      FreeBlock* head;
+      char* cursor;
+      char* end;
+    };
+
+    SharedList sharedLists[classCount];
+
+    // Plain data so that it can live in thread local storage on both
+    // compilers. A thread that exits hands its blocks back, see
+    // flushOnExit.
+    struct ThreadCache {
+      FreeBlock* heads[classCount];
+      int counts[classCount];
+      bool registered;
+    };
+
+    SQLITE3_THREAD_LOCAL ThreadCache threadCache;
+
+    // Moves all blocks of a thread cache to the shared lists
+    void flush(ThreadCache* cache) {
+      for (size_t index = 0; index < classCount; ++index) {
+        FreeBlock* first = cache->heads[index];
+        if (!first) {
+          continue;
+        }
+        FreeBlock* last = first;
+        while (last->next) {
+          last = last->next;
+        }
+        cache->heads[index] = nullptr;
+        cache->counts[index] = 0;
+
+        SharedList& shared = sharedLists[index];
+        std::lock_guard<std::mutex> lock(shared.lock);
+        last->next = shared.head;
+        shared.head = first;
+      }
+      // Allocations by later thread exit callbacks register again
+      cache->registered = false;
+    }
+
+    // Called at the exit of every thread that used the pool, while its
+    // thread local storage still exists
+#if defined(_MSC_VER)
+    DWORD exitSlot = FLS_OUT_OF_INDEXES;
+
+    void WINAPI flushOnExit(void* cache) {
+      if (cache) {
+        flush(static_cast<ThreadCache*>(cache));
+      }
+    }
+
+    bool createExitCallback() {
+      exitSlot = FlsAlloc(flushOnExit);
+      return exitSlot != FLS_OUT_OF_INDEXES;
+    }
+
+    void registerThread() {
+      threadCache.registered = FlsSetValue(exitSlot, &threadCache) != FALSE;
+    }
+#else
+    pthread_key_t exitKey;
+
+    void flushOnExit(void* cache) {
+      flush(static_cast<ThreadCache*>(cache));
+    }
+
+    bool createExitCallback() {
+      return pthread_key_create(&exitKey, flushOnExit) == 0;
+    }
+
+    void registerThread() {
+      threadCache.registered = pthread_setspecific(exitKey, &threadCache) == 0;
+    }
+#endif
+
+    // Moves up to batchSize blocks of a size class into the thread cache
+    bool refill(size_t index) {
+      if (!threadCache.registered) {
+        registerThread();
+      }
+      SharedList& shared = sharedLists[index];
+      size_t blockBytes = headerBytes + classSize(index);
+      std::lock_guard<std::mutex> lock(shared.lock);
+      for (int i = 0; i < batchSize; ++i) {
+        FreeBlock* block = shared.head;
+        if (block) {
+          shared.head = block->next;
+        } else {
+          if (static_cast<size_t>(shared.end - shared.cursor) < blockBytes) {
+            if (i > 0) {
+              break;
+            }
+            char* chunk = static_cast<char*>(std::malloc(chunkBytes));
+            if (!chunk) {
+              return false;
+            }
+            poolByteCount += chunkBytes;
+            shared.cursor = chunk;
+            shared.end = chunk + chunkBytes;
+          }
+          block = reinterpret_cast<FreeBlock*>(shared.cursor);
+          shared.cursor += blockBytes;
+        }
+        block->next = threadCache.heads[index];
+        threadCache.heads[index] = block;
+        ++threadCache.counts[index];
+      }
+      return true;
+    }
+
+    // Hands half of an overfull thread cache back to the shared list
+    void release(size_t index) {
+      FreeBlock* first = threadCache.heads[index];
+      FreeBlock* last = first;
+      for (int i = 1; i < threadCacheLimit / 2; ++i) {
+        last = last->next;
+      }
+      threadCache.heads[index] = last->next;
+      threadCache.counts[index] -= threadCacheLimit / 2;
+
+      SharedList& shared = sharedLists[index];
+      std::lock_guard<std::mutex> lock(shared.lock);
+      last->next = shared.head;
+      shared.head = first;
+    }
+
+    void* poolMalloc(int requested) {
+      ++allocationCount;
+      size_t size = roundUp(requested > 0 ? requested : 1);
+      Header* header;
+      if (size > largestClass) {
+        header = static_cast<Header*>(std::malloc(headerBytes + size));
+        if (!header) {
+          return nullptr;
+        }
+        header->sizeClass = largeBlock;
+        header->size = static_cast<unsigned>(size);
+        return payloadOf(header);
+      }
+
+      size_t index = classIndex(size);
+      if (!threadCache.heads[index] && !refill(index)) {
+        return nullptr;
+      }
+      FreeBlock* block = threadCache.heads[index];
+      threadCache.heads[index] = block->next;
+      --threadCache.counts[index];
+
+      header = reinterpret_cast<Header*>(block);
+      header->sizeClass = static_cast<unsigned>(index);
+      header->size = static_cast<unsigned>(classSize(index));
+      return payloadOf(header);
+    }
+
+    void poolFree(void* memory) {
+      if (!memory) {
+        return;
+      }
+      Header* header = headerOf(memory);
+      if (header->sizeClass == largeBlock) {
+        std::free(header);
+        return;
+      }
+
+      // Threads that only free blocks allocated elsewhere cache them too
+      if (!threadCache.registered) {
+        registerThread();
+      }
+      size_t index = header->sizeClass;
+      FreeBlock* block = reinterpret_cast<FreeBlock*>(header);
+      block->next = threadCache.heads[index];
+      threadCache.heads[index] = block;
+      if (++threadCache.counts[index] > threadCacheLimit) {
+        release(index);
+      }
+    }
+
+    int poolSize(void* memory) {
+      return memory ? static_cast<int>(headerOf(memory)->size) : 0;
+    }
+
+    void* poolRealloc(void* memory, int requested) {
+      size_t size = roundUp(requested > 0 ? requested : 1);
+      Header* header = headerOf(memory);
+      if (header->sizeClass == largeBlock && size > largestClass) {
+        ++allocationCount;
+        header = static_cast<Header*>(std::realloc(header, headerBytes + size));
+        if (!header) {
+          return nullptr;
+        }
+        header->size = static_cast<unsigned>(size);
+        return payloadOf(header);
+      }
+      if (header->sizeClass != largeBlock && size <= header->size && classIndex(size) == header->sizeClass) {
+        return memory;
+      }
+
+      void* resized = poolMalloc(requested);
+      if (resized) {
+        std::memcpy(resized, memory, size < header->size ? size : header->size);
+        poolFree(memory);
+      }
+      return resized;
+    }
+
+    int poolRoundup(int requested) {
+      size_t size = roundUp(requested > 0 ? requested : 1);
+      return static_cast<int>(size > largestClass ? size : classSize(classIndex(size)));
+    }
+
+    int poolInit(void*) {
+      return SQLITE_OK;
+    }
+
+    void poolShutdown(void*) {
+    }
+
+    // The allocator SQLite was built with, wrapped to count the calls
+    sqlite3_mem_methods systemMethods;
+
+    void* systemMalloc(int size) {
+      ++allocationCount;
+      return systemMethods.xMalloc(size);
+    }
+
+    void* systemRealloc(void* memory, int size) {
+      ++allocationCount;
+      return systemMethods.xRealloc(memory, size);
+    }
+
+    void systemFree(void* memory) {
+      systemMethods.xFree(memory);
+    }
+
+    int systemSize(void* memory) {
+      return systemMethods.xSize(memory);
+    }
+
+    int systemRoundup(int size) {
+      return systemMethods.xRoundup(size);
+    }
+
+    int systemInit(void* data) {
+      return systemMethods.xInit(data);
+    }
+
+    void systemShutdown(void* data) {
+      systemMethods.xShutdown(data);
+    }
+
+    long long status(int operation, bool highWater) {
+      int current = 0;
+      int highest = 0;
+      sqlite3_status(operation, &current, &highest, 0);
+      return highWater ? highest : current;
+    }
+  }
+
+  int MemoryAllocator::Install(Kind kind) {
+    static sqlite3_mem_methods poolMethods = {
+      poolMalloc, poolFree, poolRealloc, poolSize, poolRoundup, poolInit, poolShutdown, nullptr
+    };
+    static sqlite3_mem_methods countingMethods = {
+      systemMalloc, systemFree, systemRealloc, systemSize, systemRoundup, systemInit, systemShutdown, nullptr
+    };
+
+    int result;
+    if (kind == Pool) {
+      static const bool exitCallback = createExitCallback();
+      if (!exitCallback) {
+        return SQLITE_NOMEM;
+      }
+      result = sqlite3_config(SQLITE_CONFIG_MALLOC, &poolMethods);
+    } else {
+      result = sqlite3_config(SQLITE_CONFIG_GETMALLOC, &systemMethods);
+      if (result == SQLITE_OK) {
+        countingMethods.pAppData = systemMethods.pAppData;
+        result = sqlite3_config(SQLITE_CONFIG_MALLOC, &countingMethods);
+      }
+    }
+    if (result == SQLITE_OK) {
+      installedKind = kind;
+      installed = true;
+    }
+    return result;
+  }
+
+  bool MemoryAllocator::Installed() {
+    return installed;
+  }
+
+  MemoryAllocator::Kind MemoryAllocator::InstalledKind() {
+    return installedKind;
+  }
+
+  MemoryCounters MemoryAllocator::Counters() {
+    MemoryCounters counters;
+    counters.statusAvailable = !sqlite3_compileoption_used("DEFAULT_MEMSTATUS=0");
+    counters.bytesInUse = status(SQLITE_STATUS_MEMORY_USED, false);
+    counters.bytesHighWater = status(SQLITE_STATUS_MEMORY_USED, true);
+    counters.allocationsInUse = status(SQLITE_STATUS_MALLOC_COUNT, false);
+    counters.allocationsHighWater = status(SQLITE_STATUS_MALLOC_COUNT, true);
+    counters.largestRequest = status(SQLITE_STATUS_MALLOC_SIZE, true);
+    counters.totalAllocations = allocationCount;
+    counters.poolBytes = poolByteCount;
+    return counters;
+  }
+
+  void MemoryAllocator::ResetHighWater() {
+    int current;
+    int highest;
+    sqlite3_status(SQLITE_STATUS_MEMORY_USED, &current, &highest, 1);
+    sqlite3_status(SQLITE_STATUS_MALLOC_COUNT, &current, &highest, 1);
+    sqlite3_status(SQLITE_STATUS_MALLOC_SIZE, &current, &highest, 1);
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  struct MemoryCounters {
+    // False when SQLite was built without memory status, the sqlite3_status
+    // counters below stay zero then
+    bool statusAvailable;
+    // Maintained by SQLite itself (sqlite3_status)
+    long long bytesInUse;
+    long long bytesHighWater;
+    long long allocationsInUse;
+    long long allocationsHighWater;
+    long long largestRequest;
+    // Maintained by the allocator
+    long long totalAllocations;
+    long long poolBytes;
+  };
+
+  // Installs the sqlite3_mem_methods SQLite allocates all of its memory with.
+  //
+  // System wraps the allocator SQLite was compiled with and only counts the
+  // calls. Pool serves requests up to 1KB from size classes carved out of
+  // 64KB chunks: every thread keeps a short free list per size class and
+  // only goes to the shared lists, under a lock, in batches. A thread that
+  // exits hands its free lists back. Chunks are kept for the lifetime of
+  // the process.
+  class MemoryAllocator {
+  public:
+    enum Kind {
+      System,
+      Pool
+    };
+
+    // Must run before SQLite is initialized, returns the sqlite3_config result
+    static int Install(Kind kind);
+    static bool Installed();
+    static Kind InstalledKind();
+
+    static MemoryCounters Counters();
+    static void ResetHighWater();
+  };
+}
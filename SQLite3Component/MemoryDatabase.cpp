@@ -0,0 +1,159 @@
+#include <chrono>
+#include <sstream>
+
+#include "Backup.h"
+#include "MemoryDatabase.h"
+
+namespace SQLite3 {
+  namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    long long queryInt(sqlite3* db, const char* sql) {
+      sqlite3_stmt* statement = nullptr;
+      long long value = 0;
+      if (sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK && sqlite3_step(statement) == SQLITE_ROW) {
+        value = sqlite3_column_int64(statement, 0);
+      }
+      sqlite3_finalize(statement);
+      return value;
+    }
+
+    long long databaseBytes(sqlite3* db) {
+      return queryInt(db, "PRAGMA page_count") * queryInt(db, "PRAGMA page_size");
+    }
+
+    long long microsecondsSince(Clock::time_point start) {
+      return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    }
+
+    // Copies all pages in one step, the source is only changed by the
+    // connection running the copy
+    int copyDatabase(Backup& backup) {
+      int result = backup.Step(-1);
+      if (result == SQLITE_DONE) {
+        return backup.Finish();
+      }
+      // Step leaves a locked database to the next call and there is none,
+      // finishing reports the lock and sets its error message
+      if (result == SQLITE_OK && backup.LockedSteps() > 0) {
+        result = backup.Finish();
+        return result == SQLITE_OK ? SQLITE_BUSY : result;
+      }
+      return result == SQLITE_OK ? SQLITE_INTERNAL : result;
+    }
+  }
+
+  MemoryDatabase::MemoryDatabase()
+    : totalChanges(0)
+    , schemaVersion(0) {
+    counters.loadMicroseconds = 0;
+    counters.bytes = 0;
+    counters.persists = 0;
+    counters.persistFailures = 0;
+    counters.persistMicroseconds = 0;
+    counters.lastPersistMicroseconds = 0;
+  }
+
+  int MemoryDatabase::Load(sqlite3* memory, const char* path) {
+    this->path = path;
+    Clock::time_point start = Clock::now();
+    sqlite3* file = nullptr;
+    // Created when missing, like any other database
+    int result = sqlite3_open_v2(path, &file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+    if (result != SQLITE_OK) {
+      errorMessage = sqlite3_errmsg(file);
+      sqlite3_close(file);
+      return result;
+    }
+
+    // An in-memory destination can not change its page size once the copy
+    // started
+    std::ostringstream pageSize;
+    pageSize << "PRAGMA page_size = " << queryInt(file, "PRAGMA page_size");
+    sqlite3_exec(memory, pageSize.str().c_str(), nullptr, nullptr, nullptr);
+
+    {
+      Backup backup;
+      result = backup.Open(memory, file);
+      if (result == SQLITE_OK) {
+        result = copyDatabase(backup);
+      }
+      if (result != SQLITE_OK) {
+        errorMessage = backup.ErrorMessage();
+      }
+    }
+    sqlite3_close(file);
+    if (result != SQLITE_OK) {
+      return result;
+    }
+
+    markClean(memory);
+    long long bytes = databaseBytes(memory);
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.loadMicroseconds = microsecondsSince(start);
+    counters.bytes = bytes;
+    return SQLITE_OK;
+  }
+
+  bool MemoryDatabase::Dirty(sqlite3* memory) {
+    return sqlite3_total_changes(memory) != totalChanges || queryInt(memory, "PRAGMA schema_version") != schemaVersion;
+  }
+
+  int MemoryDatabase::Persist(sqlite3* memory, int busyTimeoutMilliseconds) {
+    if (!sqlite3_get_autocommit(memory)) {
+      errorMessage = "Can not persist the database inside a transaction";
+      return SQLITE_BUSY;
+    }
+    if (!Dirty(memory)) {
+      return SQLITE_OK;
+    }
+
+    Clock::time_point start = Clock::now();
+    int result;
+    {
+      // The copy replaces the file in a single transaction of the
+      // destination, a failed copy leaves it unchanged
+      Backup backup;
+      result = backup.OpenFile(path.c_str(), memory, busyTimeoutMilliseconds);
+      if (result == SQLITE_OK) {
+        result = copyDatabase(backup);
+      }
+      if (result != SQLITE_OK) {
+        errorMessage = backup.ErrorMessage();
+      }
+    }
+    if (result != SQLITE_OK) {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++counters.persistFailures;
+      return result;
+    }
+
+    markClean(memory);
+    long long bytes = databaseBytes(memory);
+    long long elapsed = microsecondsSince(start);
+    std::lock_guard<std::mutex> lock(mutex);
+    ++counters.persists;
+    counters.persistMicroseconds += elapsed;
+    counters.lastPersistMicroseconds = elapsed;
+    counters.bytes = bytes;
+    return SQLITE_OK;
+  }
+
+  const std::string& MemoryDatabase::Path() const {
+    return path;
+  }
+
+  const std::string& MemoryDatabase::ErrorMessage() const {
+    return errorMessage;
+  }
+
+  MemoryDatabaseCounters MemoryDatabase::Counters() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+  }
+
+  void MemoryDatabase::markClean(sqlite3* memory) {
+    totalChanges = sqlite3_total_changes(memory);
+    schemaVersion = queryInt(memory, "PRAGMA schema_version");
+  }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  struct MemoryDatabaseCounters {
+    long long loadMicroseconds;
+    // Size of the database when it was last loaded or persisted
+    long long bytes;
+    long long persists;
+    long long persistFailures;
+    long long persistMicroseconds;
+    long long lastPersistMicroseconds;
+  };
+
+  // A file database loaded into an in-memory connection, so queries never
+  // go through the file system. Changes stay in memory until Persist writes
+  // the whole database back to the file in one transaction.
+  class MemoryDatabase {
+  public:
+    MemoryDatabase();
+
+    // Copies the file into the main database of the connection, which must
+    // be a fresh :memory: one
+    int Load(sqlite3* memory, const char* path);
+
+    // True when the connection changed the data or the schema since it was
+    // loaded or last persisted
+    bool Dirty(sqlite3* memory);
+    // Writes the database back to the file if it is dirty, waiting up to the
+    // timeout for other connections to release the file. Fails with
+    // SQLITE_BUSY inside a transaction of the connection or when the file
+    // stays locked.
+    int Persist(sqlite3* memory, int busyTimeoutMilliseconds);
+
+    const std::string& Path() const;
+    const std::string& ErrorMessage() const;
+    MemoryDatabaseCounters Counters() const;
+
+  private:
+    MemoryDatabase(const MemoryDatabase&);
+    MemoryDatabase& operator=(const MemoryDatabase&);
+
+    void markClean(sqlite3* memory);
+
+    std::string path;
+    std::string errorMessage;
+    int totalChanges;
+    long long schemaVersion;
+    mutable std::mutex mutex;
+    MemoryDatabaseCounters counters;
+  };
+}
@@ -0,0 +1,514 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+#include "PageCache.h"
+
+namespace SQLite3 {
+  namespace {
+    std::atomic<long long> hitCount(0);
+    std::atomic<long long> missCount(0);
+    std::atomic<long long> evictionCount(0);
+    std::atomic<long long> promotionCount(0);
+    std::atomic<long long> pageCount(0);
+    std::atomic<long long> slabCount(0);
+    std::atomic<long long> arenaByteCount(0);
+    std::atomic<bool> installed(false);
+
+    const size_t slabBytes = 256 * 1024;
+    const size_t minimumSlotsPerSlab = 8;
+    const size_t initialBuckets = 64;
+
+    enum PageState {
+      Pinned,
+      Recent,   // 2Q "A1in": referenced once, evicted first
+      Frequent  // 2Q "Am": referenced again after leaving A1in
+    };
+
+    struct Page {
+      sqlite3_pcache_page base;
+      unsigned key;
+      Page* hashNext;
+      Page* previous;
+      Page* next;
+      size_t slab;
+      unsigned char state;
+      bool frequent;
+      bool inUse;
+    };
+
+    inline size_t roundUp(size_t size) {
+      return (size + 15) & ~static_cast<size_t>(15);
+    }
+
+    struct PageList {
+      PageList() : head(nullptr), tail(nullptr), count(0) {}
+
+      void PushBack(Page* page) {
+        page->previous = tail;
+        page->next = nullptr;
+        if (tail) {
+          tail->next = page;
+        } else {
+          head = page;
+        }
+        tail = page;
+        ++count;
+      }
+
+      void Remove(Page* page) {
+        if (page->previous) {
+          page->previous->next = page->next;
+        } else {
+          head = page->next;
+        }
+        if (page->next) {
+          page->next->previous = page->previous;
+        } else {
+          tail = page->previous;
+        }
+        page->previous = page->next = nullptr;
+        --count;
+      }
+
+      Page* head;
+      Page* tail;
+      unsigned count;
+    };
+
+    struct Cache {
+      size_t pageSize;
+      size_t extraSize;
+      size_t slotSize;
+      size_t slotsPerSlab;
+      bool purgeable;
+      unsigned maxPages;
+      unsigned pageTotal;
+      unsigned pinned;
+
+      std::vector<Page*> buckets;
+      PageList recent;
+      PageList frequent;
+
+      std::vector<char*> slabs;
+      std::vector<size_t> slabUsed;
+      Page* freeList;
+
+      // 2Q "A1out": keys of pages recently evicted from A1in, mapped to their ring position
+      std::vector<unsigned> ghostRing;
+      size_t ghostNext;
+      std::unordered_map<unsigned, size_t> ghosts;
+    };
+
+    Page*& bucketFor(Cache* cache, unsigned key) {
+      return cache->buckets[key & (cache->buckets.size() - 1)];
+    }
+
+    Page* findPage(Cache* cache, unsigned key) {
+      for (Page* page = bucketFor(cache, key); page; page = page->hashNext) {
+        if (page->key == key) {
+          return page;
+        }
+      }
+      return nullptr;
+    }
+
+    void insertHash(Cache* cache, Page* page) {
+      Page*& bucket = bucketFor(cache, page->key);
+      page->hashNext = bucket;
+      bucket = page;
+    }
+
+    void removeHash(Cache* cache, Page* page) {
+      for (Page** link = &bucketFor(cache, page->key); *link; link = &(*link)->hashNext) {
+        if (*link == page) {
+          *link = page->hashNext;
+          return;
+        }
+      }
+    }
+
+    void growBuckets(Cache* cache) {
+      std::vector<Page*> old;
+      old.swap(cache->buckets);
+      cache->buckets.assign(old.size() * 2, nullptr);
+      for (size_t i = 0; i < old.size(); ++i) {
+        Page* page = old[i];
+        while (page) {
+          Page* next = page->hashNext;
+          insertHash(cache, page);
+          page = next;
+        }
+      }
+    }
+
+    void rememberGhost(Cache* cache, unsigned key) {
+      if (cache->ghostRing.empty()) {
+        return;
+      }
+      size_t position = cache->ghostNext;
+      unsigned& slot = cache->ghostRing[position];
+      auto previous = cache->ghosts.find(slot);
+      if (previous != cache->ghosts.end() && previous->second == position) {
+        cache->ghosts.erase(previous);
+      }
+      slot = key;
+      cache->ghosts[key] = position;
+      cache->ghostNext = (position + 1) % cache->ghostRing.size();
+    }
+
+    bool takeGhost(Cache* cache, unsigned key) {
+      auto ghost = cache->ghosts.find(key);
+      if (ghost == cache->ghosts.end()) {
+        return false;
+      }
+      cache->ghosts.erase(ghost);
+      return true;
+    }
+
+    void resizeGhosts(Cache* cache) {
+      cache->ghosts.clear();
+      cache->ghostRing.assign(std::max<unsigned>(cache->maxPages / 2, 8), 0);
+      cache->ghostNext = 0;
+    }
+
+    Page* allocateSlot(Cache* cache) {
+      if (!cache->freeList) {
+        size_t bytes = cache->slotSize * cache->slotsPerSlab;
+        char* slab = static_cast<char*>(sqlite3_malloc(static_cast<int>(bytes)));
+        if (!slab) {
+          return nullptr;
+        }
+        cache->slabs.push_back(slab);
+        cache->slabUsed.push_back(0);
+        size_t slabIndex = cache->slabs.size() - 1;
+        for (size_t i = cache->slotsPerSlab; i > 0; --i) {
+          Page* page = reinterpret_cast<Page*>(slab + (i - 1) * cache->slotSize);
+          page->slab = slabIndex;
+          page->inUse = false;
+          page->hashNext = cache->freeList;
+          cache->freeList = page;
+        }
+        ++slabCount;
+        arenaByteCount += bytes;
+      }
+
+      Page* page = cache->freeList;
+      cache->freeList = page->hashNext;
+      char* memory = reinterpret_cast<char*>(page);
+      page->base.pBuf = memory + roundUp(sizeof(Page));
+      page->base.pExtra = memory + roundUp(sizeof(Page)) + roundUp(cache->pageSize);
+      page->inUse = true;
+      ++cache->slabUsed[page->slab];
+      ++cache->pageTotal;
+      ++pageCount;
+      return page;
+    }
+
+    void releaseSlot(Cache* cache, Page* page) {
+      page->inUse = false;
+      page->hashNext = cache->freeList;
+      cache->freeList = page;
+      --cache->slabUsed[page->slab];
+      --cache->pageTotal;
+      --pageCount;
+    }
+
+    void unlinkUnpinned(Cache* cache, Page* page) {
+      if (page->state == Recent) {
+        cache->recent.Remove(page);
+      } else if (page->state == Frequent) {
+        cache->frequent.Remove(page);
+      }
+    }
+
+    // Detaches the page that 2Q evicts next. A1in gives up its oldest page
+    // while it holds more than a quarter of the cache, so a scan only ever
+    // displaces other pages that were referenced once.
+    Page* evictOne(Cache* cache) {
+      unsigned recentLimit = std::max<unsigned>(cache->maxPages / 4, 1);
+      Page* victim;
+      if (cache->recent.count > recentLimit || !cache->frequent.head) {
+        victim = cache->recent.head;
+        if (victim) {
+          rememberGhost(cache, victim->key);
+        }
+      } else {
+        victim = cache->frequent.head;
+      }
+      if (!victim) {
+        return nullptr;
+      }
+      unlinkUnpinned(cache, victim);
+      removeHash(cache, victim);
+      ++evictionCount;
+      return victim;
+    }
+
+    void evictExcess(Cache* cache) {
+      while (cache->purgeable && cache->pageTotal > cache->maxPages) {
+        Page* victim = evictOne(cache);
+        if (!victim) {
+          break;
+        }
+        releaseSlot(cache, victim);
+      }
+    }
+
+    void freeEmptySlabs(Cache* cache) {
+      bool freed = false;
+      for (size_t i = 0; i < cache->slabs.size(); ++i) {
+        if (cache->slabs[i] && cache->slabUsed[i] == 0) {
+          sqlite3_free(cache->slabs[i]);
+          cache->slabs[i] = nullptr;
+          --slabCount;
+          arenaByteCount -= cache->slotSize * cache->slotsPerSlab;
+          freed = true;
+        }
+      }
+      if (!freed) {
+        return;
+      }
+      cache->freeList = nullptr;
+      for (size_t i = 0; i < cache->slabs.size(); ++i) {
+        if (!cache->slabs[i]) {
+          continue;
+        }
+        for (size_t slot = 0; slot < cache->slotsPerSlab; ++slot) {
+          Page* page = reinterpret_cast<Page*>(cache->slabs[i] + slot * cache->slotSize);
+          if (!page->inUse) {
+            page->hashNext = cache->freeList;
+            cache->freeList = page;
+          }
+        }
+      }
+    }
+
+    int xInit(void*) {
+      return SQLITE_OK;
+    }
+
+    void xShutdown(void*) {
+    }
+
+    sqlite3_pcache* xCreate(int pageSize, int extraSize, int purgeable) {
+      Cache* cache = new (std::nothrow) Cache();
+      if (!cache) {
+        return nullptr;
+      }
+      try {
+        cache->pageSize = pageSize;
+        cache->extraSize = extraSize;
+        cache->slotSize = roundUp(sizeof(Page)) + roundUp(pageSize) + roundUp(extraSize);
+        cache->slotsPerSlab = std::max(slabBytes / cache->slotSize, minimumSlotsPerSlab);
+        cache->purgeable = purgeable != 0;
+        cache->maxPages = 100;
+        cache->pageTotal = 0;
+        cache->pinned = 0;
+        cache->buckets.assign(initialBuckets, nullptr);
+        cache->freeList = nullptr;
+        resizeGhosts(cache);
+      } catch (const std::bad_alloc&) {
+        delete cache;
+        return nullptr;
+      }
+      return reinterpret_cast<sqlite3_pcache*>(cache);
+    }
+
+    void xCachesize(sqlite3_pcache* pcache, int size) {
+      Cache* cache = reinterpret_cast<Cache*>(pcache);
+      cache->maxPages = size > 0 ? size : 0;
+      try {
+        resizeGhosts(cache);
+      } catch (const std::bad_alloc&) {
+        cache->ghostRing.clear();
+        cache->ghosts.clear();
+      }
+      evictExcess(cache);
+    }
+
+    int xPagecount(sqlite3_pcache* pcache) {
+      return reinterpret_cast<Cache*>(pcache)->pageTotal;
+    }
+
+    sqlite3_pcache_page* xFetch(sqlite3_pcache* pcache, unsigned key, int createFlag) {
+      Cache* cache = reinterpret_cast<Cache*>(pcache);
+      Page* page = findPage(cache, key);
+      if (page) {
+        ++hitCount;
+        if (page->state != Pinned) {
+          unlinkUnpinned(cache, page);
+          page->state = Pinned;
+          ++cache->pinned;
+        }
+        return &page->base;
+      }
+
+      if (createFlag == 0) {
+        return nullptr;
+      }
+
+      if (cache->purgeable) {
+        // With createFlag 1 SQLite only wants a page if it comes cheap, it
+        // spills dirty pages and asks again with 2 otherwise.
+        unsigned maxPinned = cache->maxPages - cache->maxPages / 10;
+        if (createFlag == 1 && cache->pinned >= maxPinned) {
+          return nullptr;
+        }
+        if (cache->pageTotal >= cache->maxPages) {
+          page = evictOne(cache);
+          if (!page && createFlag == 1) {
+            return nullptr;
+          }
+        }
+      }
+
+      try {
+        if (!page) {
+          page = allocateSlot(cache);
+          if (!page) {
+            return nullptr;
+          }
+        }
+        if (cache->pageTotal > cache->buckets.size()) {
+          growBuckets(cache);
+        }
+        page->frequent = takeGhost(cache, key);
+      } catch (const std::bad_alloc&) {
+        if (page) {
+          releaseSlot(cache, page);
+        }
+        return nullptr;
+      }
+
+      if (page->frequent) {
+        ++promotionCount;
+      }
+      ++missCount;
+      page->key = key;
+      page->state = Pinned;
+      page->previous = page->next = nullptr;
+      std::memset(page->base.pExtra, 0, cache->extraSize);
+      insertHash(cache, page);
+      ++cache->pinned;
+      return &page->base;
+    }
+
+    void xUnpin(sqlite3_pcache* pcache, sqlite3_pcache_page* base, int discard) {
+      Cache* cache = reinterpret_cast<Cache*>(pcache);
+      Page* page = reinterpret_cast<Page*>(base);
+      --cache->pinned;
+      if (discard) {
+        removeHash(cache, page);
+        releaseSlot(cache, page);
+        return;
+      }
+      if (page->frequent) {
+        page->state = Frequent;
+        cache->frequent.PushBack(page);
+      } else {
+        page->state = Recent;
+        cache->recent.PushBack(page);
+      }
+      evictExcess(cache);
+    }
+
+    void discardPage(Cache* cache, Page* page) {
+      if (page->state == Pinned) {
+        --cache->pinned;
+      } else {
+        unlinkUnpinned(cache, page);
+      }
+      removeHash(cache, page);
+      releaseSlot(cache, page);
+    }
+
+    void xRekey(sqlite3_pcache* pcache, sqlite3_pcache_page* base, unsigned, unsigned newKey) {
+      Cache* cache = reinterpret_cast<Cache*>(pcache);
+      Page* page = reinterpret_cast<Page*>(base);
+      Page* existing = findPage(cache, newKey);
+      if (existing && existing != page) {
+        discardPage(cache, existing);
+      }
+      removeHash(cache, page);
+      page->key = newKey;
+      insertHash(cache, page);
+    }
+
+    void xTruncate(sqlite3_pcache* pcache, unsigned limit) {
+      Cache* cache = reinterpret_cast<Cache*>(pcache);
+      for (size_t i = 0; i < cache->buckets.size(); ++i) {
+        Page* page = cache->buckets[i];
+        while (page) {
+          Page* next = page->hashNext;
+          if (page->key >= limit) {
+            discardPage(cache, page);
+          }
+          page = next;
+        }
+      }
+    }
+
+    void xDestroy(sqlite3_pcache* pcache) {
+      Cache* cache = reinterpret_cast<Cache*>(pcache);
+      pageCount -= cache->pageTotal;
+      for (size_t i = 0; i < cache->slabs.size(); ++i) {
+        if (cache->slabs[i]) {
+          sqlite3_free(cache->slabs[i]);
+          --slabCount;
+          arenaByteCount -= cache->slotSize * cache->slotsPerSlab;
+        }
+      }
+      delete cache;
+    }
+
+    void xShrink(sqlite3_pcache* pcache) {
+      Cache* cache = reinterpret_cast<Cache*>(pcache);
+      if (cache->purgeable) {
+        Page* victim;
+        while ((victim = evictOne(cache)) != nullptr) {
+          releaseSlot(cache, victim);
+        }
+      }
+      freeEmptySlabs(cache);
+    }
+  }
+
+  int PageCache::Install() {
+    static sqlite3_pcache_methods2 methods = {
+      1, nullptr, xInit, xShutdown, xCreate, xCachesize, xPagecount,
+      xFetch, xUnpin, xRekey, xTruncate, xDestroy, xShrink
+    };
+    int result = sqlite3_config(SQLITE_CONFIG_PCACHE2, &methods);
+    if (result == SQLITE_OK) {
+      installed = true;
+    }
+    return result;
+  }
+
+  bool PageCache::Installed() {
+    return installed;
+  }
+
+  PageCacheCounters PageCache::Counters() {
+    PageCacheCounters counters;
+    counters.hits = hitCount;
+    counters.misses = missCount;
+    counters.evictions = evictionCount;
+    counters.promotions = promotionCount;
+    counters.pages = pageCount;
+    counters.slabs = slabCount;
+    counters.arenaBytes = arenaByteCount;
+    return counters;
+  }
+
+  void PageCache::ResetCounters() {
+    hitCount = 0;
+    missCount = 0;
+    evictionCount = 0;
+    promotionCount = 0;
+  }
+}
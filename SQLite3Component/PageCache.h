@@ -0,0 +1,29 @@
+#pragma once
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  struct PageCacheCounters {
+    long long hits;
+    long long misses;
+    long long evictions;
+    long long promotions;
+    long long pages;
+    long long slabs;
+    long long arenaBytes;
+  };
+
+  // A sqlite3_pcache_methods2 implementation that carves pages out of large
+  // slabs and evicts with the 2Q policy: pages referenced once live in a
+  // FIFO that absorbs table scans, only pages referenced again after having
+  // been evicted from it enter the LRU that holds the hot working set.
+  class PageCache {
+  public:
+    // Must run before SQLite is initialized, returns the sqlite3_config result
+    static int Install();
+    static bool Installed();
+
+    static PageCacheCounters Counters();
+    static void ResetCounters();
+  };
+}
@@ -0,0 +1,570 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include "PageProfile.h"
+
+namespace SQLite3 {
+  const char* const PageProfile::VfsName = "pageprofile";
+
+  namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    const unsigned char profileMagic[4] = { 'S', 'Q', 'P', 'P' };
+    const unsigned profileVersion = 1;
+    const size_t profileHeaderBytes = 16;
+    // Pages closer together than this are read in one go together with the
+    // pages between them
+    const unsigned mergeGapPages = 8;
+    const size_t prefetchChunkBytes = 1024 * 1024;
+
+    sqlite3_vfs profileVfs;
+    sqlite3_vfs* baseVfs = nullptr;
+    // One table per version of the base file's io methods
+    sqlite3_io_methods methods[3];
+    std::mutex registerMutex;
+    std::atomic<bool> registered(false);
+
+    std::atomic<unsigned> recordMilliseconds(10000);
+    std::atomic<unsigned> maxPages(65536);
+
+    std::atomic<long long> recordedPageCount(0);
+    std::atomic<long long> profilesWrittenCount(0);
+    std::atomic<long long> prefetchCount(0);
+    std::atomic<long long> prefetchedPageCount(0);
+    std::atomic<long long> prefetchReadCount(0);
+    std::atomic<long long> prefetchByteCount(0);
+    std::atomic<long long> prefetchMicrosecondCount(0);
+
+    std::mutex prefetchMutex;
+    std::condition_variable prefetchDone;
+    int runningPrefetches = 0;
+
+    struct Recording {
+      Recording() : active(true), pageSize(0) {}
+
+      std::atomic<bool> active;
+      std::mutex mutex;
+      Clock::time_point deadline;
+      std::string profilePath;
+      unsigned pageSize;
+      std::vector<unsigned> pages;
+      std::unordered_set<unsigned> seen;
+    };
+
+    struct Prefetch {
+      Prefetch() : canceled(false) {}
+
+      std::atomic<bool> canceled;
+      std::thread thread;
+    };
+
+    struct ProfiledFile {
+      sqlite3_file base;
+      sqlite3_file* real;
+      Recording* recording;
+      Prefetch* prefetch;
+    };
+
+    inline sqlite3_file* realFile(sqlite3_file* file) {
+      return reinterpret_cast<ProfiledFile*>(file)->real;
+    }
+
+    // VFS implementations may look for URI parameters after the file name,
+    // and newer ones for the start of the name before it. The padding keeps
+    // both within the buffer, like sqlite3_create_filename does.
+    std::vector<char> vfsFilename(const std::string& path) {
+      std::vector<char> name(path.size() + 8, '\0');
+      std::copy(path.begin(), path.end(), name.begin() + 4);
+      return name;
+    }
+
+    void putBigEndian(unsigned char* out, unsigned value) {
+      out[0] = static_cast<unsigned char>(value >> 24);
+      out[1] = static_cast<unsigned char>(value >> 16);
+      out[2] = static_cast<unsigned char>(value >> 8);
+      out[3] = static_cast<unsigned char>(value);
+    }
+
+    unsigned getBigEndian(const unsigned char* in) {
+      return (static_cast<unsigned>(in[0]) << 24) | (static_cast<unsigned>(in[1]) << 16) |
+        (static_cast<unsigned>(in[2]) << 8) | in[3];
+    }
+
+    // Profiles are written through the base VFS so their paths are treated
+    // like the database's. The journal type gives them the permissions of
+    // the database file.
+    int writeProfile(const std::string& path, unsigned pageSize, const std::vector<unsigned>& pages) {
+      std::vector<unsigned char> data(profileHeaderBytes + pages.size() * 4);
+      std::copy(profileMagic, profileMagic + 4, data.begin());
+      putBigEndian(&data[4], profileVersion);
+      putBigEndian(&data[8], pageSize);
+      putBigEndian(&data[12], static_cast<unsigned>(pages.size()));
+      for (size_t i = 0; i < pages.size(); ++i) {
+        putBigEndian(&data[profileHeaderBytes + i * 4], pages[i]);
+      }
+
+      sqlite3_file* file = static_cast<sqlite3_file*>(std::calloc(1, baseVfs->szOsFile));
+      if (!file) {
+        return SQLITE_NOMEM;
+      }
+      std::vector<char> name = vfsFilename(path);
+      int outFlags = 0;
+      int result = baseVfs->xOpen(baseVfs, &name[4], file,
+        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_MAIN_JOURNAL, &outFlags);
+      if (result == SQLITE_OK) {
+        result = file->pMethods->xWrite(file, &data[0], static_cast<int>(data.size()), 0);
+        if (result == SQLITE_OK) {
+          result = file->pMethods->xTruncate(file, static_cast<sqlite3_int64>(data.size()));
+        }
+      }
+      if (file->pMethods) {
+        file->pMethods->xClose(file);
+      }
+      std::free(file);
+      return result;
+    }
+
+    void finishLocked(Recording& recording) {
+      recording.active = false;
+      if (!recording.pages.empty() && writeProfile(recording.profilePath, recording.pageSize, recording.pages) == SQLITE_OK) {
+        ++profilesWrittenCount;
+      }
+      recording.pages.clear();
+      recording.seen.clear();
+    }
+
+    void record(ProfiledFile* file, sqlite3_int64 offset, int amount) {
+      Recording* recording = file->recording;
+      if (!recording || !recording->active.load(std::memory_order_relaxed)) {
+        return;
+      }
+      // Pages are read whole, smaller reads are the header of the file
+      if (amount < 512 || (amount & (amount - 1)) != 0) {
+        return;
+      }
+      std::lock_guard<std::mutex> lock(recording->mutex);
+      if (!recording->active) {
+        return;
+      }
+      if (Clock::now() >= recording->deadline || recording->pages.size() >= maxPages) {
+        finishLocked(*recording);
+        return;
+      }
+      unsigned page = static_cast<unsigned>(offset / amount);
+      recording->pageSize = static_cast<unsigned>(amount);
+      if (recording->seen.insert(page).second) {
+        recording->pages.push_back(page);
+        ++recordedPageCount;
+      }
+    }
+
+    // Reads the pages in file order, neighbouring pages in a single read
+    void prefetchPages(std::string path, unsigned pageSize, std::vector<unsigned> pages, Prefetch* prefetch) {
+      Clock::time_point start = Clock::now();
+      std::sort(pages.begin(), pages.end());
+      sqlite3_file* file = static_cast<sqlite3_file*>(std::calloc(1, baseVfs->szOsFile));
+      std::vector<char> name = vfsFilename(path);
+      int outFlags = 0;
+      if (file && baseVfs->xOpen(baseVfs, &name[4], file, SQLITE_OPEN_READONLY | SQLITE_OPEN_MAIN_DB, &outFlags) == SQLITE_OK) {
+        unsigned chunkPages = std::max<unsigned>(1, static_cast<unsigned>(prefetchChunkBytes / pageSize));
+        std::vector<char> buffer(static_cast<size_t>(chunkPages) * pageSize);
+        size_t next = 0;
+        while (next < pages.size() && !prefetch->canceled) {
+          unsigned first = pages[next];
+          unsigned last = first;
+          size_t count = 1;
+          while (next + count < pages.size() && pages[next + count] <= last + mergeGapPages + 1 &&
+                 pages[next + count] - first < chunkPages) {
+            last = pages[next + count];
+            ++count;
+          }
+          int bytes = static_cast<int>((last - first + 1) * pageSize);
+          // Short reads at the end of a file that shrank are fine
+          file->pMethods->xRead(file, &buffer[0], bytes, static_cast<sqlite3_int64>(first) * pageSize);
+          ++prefetchReadCount;
+          prefetchByteCount += bytes;
+          prefetchedPageCount += count;
+          next += count;
+        }
+      }
+      if (file && file->pMethods) {
+        file->pMethods->xClose(file);
+      }
+      std::free(file);
+      prefetchMicrosecondCount += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+
+      std::lock_guard<std::mutex> lock(prefetchMutex);
+      --runningPrefetches;
+      prefetchDone.notify_all();
+    }
+
+    void startProfiling(ProfiledFile* file, const char* name) {
+      std::string path(name);
+      std::string profilePath = PageProfile::ProfilePath(path);
+
+      file->recording = new Recording();
+      file->recording->profilePath = profilePath;
+      file->recording->deadline = Clock::now() + std::chrono::milliseconds(recordMilliseconds.load());
+
+      unsigned pageSize = 0;
+      std::vector<unsigned> pages;
+      if (PageProfile::LoadProfile(profilePath, pageSize, pages) != SQLITE_OK || pages.empty()) {
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(prefetchMutex);
+        ++runningPrefetches;
+      }
+      ++prefetchCount;
+      file->prefetch = new Prefetch();
+      file->prefetch->thread = std::thread(prefetchPages, path, pageSize, std::move(pages), file->prefetch);
+    }
+
+    int profiledClose(sqlite3_file* file) {
+      ProfiledFile* profiled = reinterpret_cast<ProfiledFile*>(file);
+      if (profiled->prefetch) {
+        profiled->prefetch->canceled = true;
+        profiled->prefetch->thread.join();
+        delete profiled->prefetch;
+        profiled->prefetch = nullptr;
+      }
+      if (profiled->recording) {
+        {
+          std::lock_guard<std::mutex> lock(profiled->recording->mutex);
+          if (profiled->recording->active) {
+            finishLocked(*profiled->recording);
+          }
+        }
+        delete profiled->recording;
+        profiled->recording = nullptr;
+      }
+      return profiled->real->pMethods->xClose(profiled->real);
+    }
+
+    int profiledRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset) {
+      record(reinterpret_cast<ProfiledFile*>(file), offset, amount);
+      return realFile(file)->pMethods->xRead(realFile(file), buffer, amount, offset);
+    }
+
+    int profiledWrite(sqlite3_file* file, const void* buffer, int amount, sqlite3_int64 offset) {
+      return realFile(file)->pMethods->xWrite(realFile(file), buffer, amount, offset);
+    }
+
+    int profiledTruncate(sqlite3_file* file, sqlite3_int64 size) {
+      return realFile(file)->pMethods->xTruncate(realFile(file), size);
+    }
+
+    int profiledSync(sqlite3_file* file, int flags) {
+      return realFile(file)->pMethods->xSync(realFile(file), flags);
+    }
+
+    int profiledFileSize(sqlite3_file* file, sqlite3_int64* size) {
+      return realFile(file)->pMethods->xFileSize(realFile(file), size);
+    }
+
+    int profiledLock(sqlite3_file* file, int lock) {
+      return realFile(file)->pMethods->xLock(realFile(file), lock);
+    }
+
+    int profiledUnlock(sqlite3_file* file, int lock) {
+      return realFile(file)->pMethods->xUnlock(realFile(file), lock);
+    }
+
+    int profiledCheckReservedLock(sqlite3_file* file, int* reserved) {
+      return realFile(file)->pMethods->xCheckReservedLock(realFile(file), reserved);
+    }
+
+    int profiledFileControl(sqlite3_file* file, int op, void* argument) {
+      return realFile(file)->pMethods->xFileControl(realFile(file), op, argument);
+    }
+
+    int profiledSectorSize(sqlite3_file* file) {
+      return realFile(file)->pMethods->xSectorSize(realFile(file));
+    }
+
+    int profiledDeviceCharacteristics(sqlite3_file* file) {
+      return realFile(file)->pMethods->xDeviceCharacteristics(realFile(file));
+    }
+
+    int profiledShmMap(sqlite3_file* file, int region, int size, int extend, void volatile** memory) {
+      return realFile(file)->pMethods->xShmMap(realFile(file), region, size, extend, memory);
+    }
+
+    int profiledShmLock(sqlite3_file* file, int offset, int count, int flags) {
+      return realFile(file)->pMethods->xShmLock(realFile(file), offset, count, flags);
+    }
+
+    void profiledShmBarrier(sqlite3_file* file) {
+      realFile(file)->pMethods->xShmBarrier(realFile(file));
+    }
+
+    int profiledShmUnmap(sqlite3_file* file, int deleteFlag) {
+      return realFile(file)->pMethods->xShmUnmap(realFile(file), deleteFlag);
+    }
+
+    // Memory mapped pages are fetched instead of read
+    int profiledFetch(sqlite3_file* file, sqlite3_int64 offset, int amount, void** page) {
+      record(reinterpret_cast<ProfiledFile*>(file), offset, amount);
+      return realFile(file)->pMethods->xFetch(realFile(file), offset, amount, page);
+    }
+
+    int profiledUnfetch(sqlite3_file* file, sqlite3_int64 offset, void* page) {
+      return realFile(file)->pMethods->xUnfetch(realFile(file), offset, page);
+    }
+
+    void fillMethods() {
+      for (int i = 0; i < 3; ++i) {
+        sqlite3_io_methods& table = methods[i];
+        table.iVersion = i + 1;
+        table.xClose = profiledClose;
+        table.xRead = profiledRead;
+        table.xWrite = profiledWrite;
+        table.xTruncate = profiledTruncate;
+        table.xSync = profiledSync;
+        table.xFileSize = profiledFileSize;
+        table.xLock = profiledLock;
+        table.xUnlock = profiledUnlock;
+        table.xCheckReservedLock = profiledCheckReservedLock;
+        table.xFileControl = profiledFileControl;
+        table.xSectorSize = profiledSectorSize;
+        table.xDeviceCharacteristics = profiledDeviceCharacteristics;
+        table.xShmMap = i >= 1 ? profiledShmMap : nullptr;
+        table.xShmLock = i >= 1 ? profiledShmLock : nullptr;
+        table.xShmBarrier = i >= 1 ? profiledShmBarrier : nullptr;
+        table.xShmUnmap = i >= 1 ? profiledShmUnmap : nullptr;
+        table.xFetch = i >= 2 ? profiledFetch : nullptr;
+        table.xUnfetch = i >= 2 ? profiledUnfetch : nullptr;
+      }
+    }
+
+    int profiledOpen(sqlite3_vfs*, const char* name, sqlite3_file* file, int flags, int* outFlags) {
+      ProfiledFile* profiled = reinterpret_cast<ProfiledFile*>(file);
+      profiled->real = reinterpret_cast<sqlite3_file*>(profiled + 1);
+      profiled->recording = nullptr;
+      profiled->prefetch = nullptr;
+      int result = baseVfs->xOpen(baseVfs, name, profiled->real, flags, outFlags);
+      if (result != SQLITE_OK) {
+        if (profiled->real->pMethods) {
+          profiled->real->pMethods->xClose(profiled->real);
+        }
+        file->pMethods = nullptr;
+        return result;
+      }
+      int version = std::min(std::max(profiled->real->pMethods->iVersion, 1), 3);
+      file->pMethods = &methods[version - 1];
+      if (name && (flags & SQLITE_OPEN_MAIN_DB)) {
+        startProfiling(profiled, name);
+      }
+      return SQLITE_OK;
+    }
+
+    int profiledDelete(sqlite3_vfs*, const char* name, int syncDirectory) {
+      return baseVfs->xDelete(baseVfs, name, syncDirectory);
+    }
+
+    int profiledAccess(sqlite3_vfs*, const char* name, int flags, int* result) {
+      return baseVfs->xAccess(baseVfs, name, flags, result);
+    }
+
+    int profiledFullPathname(sqlite3_vfs*, const char* name, int size, char* out) {
+      return baseVfs->xFullPathname(baseVfs, name, size, out);
+    }
+
+    void* profiledDlOpen(sqlite3_vfs*, const char* path) {
+      return baseVfs->xDlOpen(baseVfs, path);
+    }
+
+    void profiledDlError(sqlite3_vfs*, int size, char* message) {
+      baseVfs->xDlError(baseVfs, size, message);
+    }
+
+    void (*profiledDlSym(sqlite3_vfs*, void* library, const char* symbol))(void) {
+      return baseVfs->xDlSym(baseVfs, library, symbol);
+    }
+
+    void profiledDlClose(sqlite3_vfs*, void* library) {
+      baseVfs->xDlClose(baseVfs, library);
+    }
+
+    int profiledRandomness(sqlite3_vfs*, int size, char* out) {
+      return baseVfs->xRandomness(baseVfs, size, out);
+    }
+
+    int profiledSleep(sqlite3_vfs*, int microseconds) {
+      return baseVfs->xSleep(baseVfs, microseconds);
+    }
+
+    int profiledCurrentTime(sqlite3_vfs*, double* now) {
+      return baseVfs->xCurrentTime(baseVfs, now);
+    }
+
+    int profiledGetLastError(sqlite3_vfs*, int size, char* message) {
+      return baseVfs->xGetLastError(baseVfs, size, message);
+    }
+
+    int profiledCurrentTimeInt64(sqlite3_vfs*, sqlite3_int64* now) {
+      return baseVfs->xCurrentTimeInt64(baseVfs, now);
+    }
+
+    int profiledSetSystemCall(sqlite3_vfs*, const char* name, sqlite3_syscall_ptr call) {
+      return baseVfs->xSetSystemCall(baseVfs, name, call);
+    }
+
+    sqlite3_syscall_ptr profiledGetSystemCall(sqlite3_vfs*, const char* name) {
+      return baseVfs->xGetSystemCall(baseVfs, name);
+    }
+
+    const char* profiledNextSystemCall(sqlite3_vfs*, const char* name) {
+      return baseVfs->xNextSystemCall(baseVfs, name);
+    }
+  }
+
+  int PageProfile::Register(const char* baseName) {
+    std::lock_guard<std::mutex> lock(registerMutex);
+    if (registered) {
+      return SQLITE_OK;
+    }
+    sqlite3_vfs* base = sqlite3_vfs_find(baseName);
+    if (!base) {
+      return SQLITE_ERROR;
+    }
+    baseVfs = base;
+    fillMethods();
+
+    profileVfs.iVersion = std::min(base->iVersion, 3);
+    profileVfs.szOsFile = static_cast<int>(sizeof(ProfiledFile)) + base->szOsFile;
+    profileVfs.mxPathname = base->mxPathname;
+    profileVfs.pNext = nullptr;
+    profileVfs.zName = VfsName;
+    profileVfs.pAppData = nullptr;
+    profileVfs.xOpen = profiledOpen;
+    profileVfs.xDelete = profiledDelete;
+    profileVfs.xAccess = profiledAccess;
+    profileVfs.xFullPathname = profiledFullPathname;
+    profileVfs.xDlOpen = base->xDlOpen ? profiledDlOpen : nullptr;
+    profileVfs.xDlError = base->xDlError ? profiledDlError : nullptr;
+    profileVfs.xDlSym = base->xDlSym ? profiledDlSym : nullptr;
+    profileVfs.xDlClose = base->xDlClose ? profiledDlClose : nullptr;
+    profileVfs.xRandomness = profiledRandomness;
+    profileVfs.xSleep = profiledSleep;
+    profileVfs.xCurrentTime = profiledCurrentTime;
+    profileVfs.xGetLastError = profiledGetLastError;
+    profileVfs.xCurrentTimeInt64 = base->iVersion >= 2 ? profiledCurrentTimeInt64 : nullptr;
+    profileVfs.xSetSystemCall = base->iVersion >= 3 ? profiledSetSystemCall : nullptr;
+    profileVfs.xGetSystemCall = base->iVersion >= 3 ? profiledGetSystemCall : nullptr;
+    profileVfs.xNextSystemCall = base->iVersion >= 3 ? profiledNextSystemCall : nullptr;
+
+    int result = sqlite3_vfs_register(&profileVfs, 0);
+    registered = result == SQLITE_OK;
+    return result;
+  }
+
+  bool PageProfile::Registered() {
+    return registered;
+  }
+
+  unsigned PageProfile::RecordMilliseconds() {
+    return recordMilliseconds;
+  }
+
+  void PageProfile::SetRecordMilliseconds(unsigned milliseconds) {
+    recordMilliseconds = milliseconds;
+  }
+
+  unsigned PageProfile::MaxPages() {
+    return maxPages;
+  }
+
+  void PageProfile::SetMaxPages(unsigned pages) {
+    maxPages = pages;
+  }
+
+  std::string PageProfile::ProfilePath(const std::string& databasePath) {
+    return databasePath + "-pages";
+  }
+
+  int PageProfile::LoadProfile(const std::string& profilePath, unsigned& pageSize, std::vector<unsigned>& pages) {
+    pages.clear();
+    if (!baseVfs) {
+      return SQLITE_MISUSE;
+    }
+    int exists = 0;
+    if (baseVfs->xAccess(baseVfs, profilePath.c_str(), SQLITE_ACCESS_EXISTS, &exists) != SQLITE_OK || !exists) {
+      return SQLITE_NOTFOUND;
+    }
+
+    sqlite3_file* file = static_cast<sqlite3_file*>(std::calloc(1, baseVfs->szOsFile));
+    if (!file) {
+      return SQLITE_NOMEM;
+    }
+    std::vector<char> name = vfsFilename(profilePath);
+    int outFlags = 0;
+    int result = baseVfs->xOpen(baseVfs, &name[4], file, SQLITE_OPEN_READONLY | SQLITE_OPEN_MAIN_JOURNAL, &outFlags);
+    sqlite3_int64 size = 0;
+    if (result == SQLITE_OK) {
+      result = file->pMethods->xFileSize(file, &size);
+    }
+    std::vector<unsigned char> data;
+    if (result == SQLITE_OK && size >= static_cast<sqlite3_int64>(profileHeaderBytes)) {
+      data.resize(static_cast<size_t>(size));
+      result = file->pMethods->xRead(file, &data[0], static_cast<int>(size), 0);
+    }
+    if (file->pMethods) {
+      file->pMethods->xClose(file);
+    }
+    std::free(file);
+    if (result != SQLITE_OK) {
+      return result;
+    }
+
+    if (data.size() < profileHeaderBytes || !std::equal(profileMagic, profileMagic + 4, data.begin()) ||
+        getBigEndian(&data[4]) != profileVersion) {
+      return SQLITE_CORRUPT;
+    }
+    pageSize = getBigEndian(&data[8]);
+    unsigned count = getBigEndian(&data[12]);
+    if (pageSize < 512 || data.size() != profileHeaderBytes + static_cast<size_t>(count) * 4) {
+      return SQLITE_CORRUPT;
+    }
+    pages.reserve(count);
+    for (unsigned i = 0; i < count; ++i) {
+      pages.push_back(getBigEndian(&data[profileHeaderBytes + i * 4]));
+    }
+    return SQLITE_OK;
+  }
+
+  void PageProfile::WaitForPrefetches() {
+    std::unique_lock<std::mutex> lock(prefetchMutex);
+    while (runningPrefetches > 0) {
+      prefetchDone.wait(lock);
+    }
+  }
+
+  PageProfileCounters PageProfile::Counters() {
+    PageProfileCounters counters;
+    counters.recordedPages = recordedPageCount;
+    counters.profilesWritten = profilesWrittenCount;
+    counters.prefetches = prefetchCount;
+    counters.prefetchedPages = prefetchedPageCount;
+    counters.prefetchReads = prefetchReadCount;
+    counters.prefetchBytes = prefetchByteCount;
+    counters.prefetchMicroseconds = prefetchMicrosecondCount;
+    return counters;
+  }
+
+  void PageProfile::ResetCounters() {
+    recordedPageCount = 0;
+    profilesWrittenCount = 0;
+    prefetchCount = 0;
+    prefetchedPageCount = 0;
+    prefetchReadCount = 0;
+    prefetchByteCount = 0;
+    prefetchMicrosecondCount = 0;
+  }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  struct PageProfileCounters {
+    long long recordedPages;
+    long long profilesWritten;
+    long long prefetches;
+    long long prefetchedPages;
+    long long prefetchReads;
+    long long prefetchBytes;
+    long long prefetchMicroseconds;
+  };
+
+  // A VFS on top of another one that records which pages of a database file
+  // are read during the first moments after it was opened, and writes them
+  // to a profile next to the file (see ProfilePath). When a file with a
+  // profile is opened again, a background thread reads the recorded pages in
+  // large sequential reads, so the reads of the connection find them in the
+  // cache of the operating system instead of going to the disk one page at a
+  // time.
+  class PageProfile {
+  public:
+    static const char* const VfsName;
+
+    // Registers the VFS on top of the named VFS, the default one when
+    // baseVfs is nullptr. Later calls keep the first registration.
+    static int Register(const char* baseVfs);
+    static bool Registered();
+
+    // Milliseconds after opening during which reads are recorded, 10000 by
+    // default. Applies to files opened afterwards.
+    static unsigned RecordMilliseconds();
+    static void SetRecordMilliseconds(unsigned milliseconds);
+    // Recording stops early once this many pages were recorded
+    static unsigned MaxPages();
+    static void SetMaxPages(unsigned pages);
+
+    static std::string ProfilePath(const std::string& databasePath);
+    // Reads a profile through the base VFS, the pages in the order they
+    // were first read
+    static int LoadProfile(const std::string& profilePath, unsigned& pageSize, std::vector<unsigned>& pages);
+
+    // Blocks until the prefetches of all open files are done
+    static void WaitForPrefetches();
+
+    static PageProfileCounters Counters();
+    static void ResetCounters();
+  };
+}
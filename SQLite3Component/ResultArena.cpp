@@ -0,0 +1,135 @@
+#include <cstring>
+
+#include "ResultArena.h"
+
+namespace SQLite3 {
+  namespace {
+    const size_t chunkBytes = 64 * 1024;
+    // Values above this size get a chunk of their own instead of wasting
+    // the rest of the current one
+    const size_t largeValueBytes = chunkBytes / 4;
+  }
+
+  ResultArena::ResultArena(sqlite3_stmt* statement)
+    : chunkPosition(nullptr)
+    , chunkRemaining(0)
+    , arenaBytes(0) {
+    int columnCount = sqlite3_column_count(statement);
+    names.reserve(columnCount);
+    for (int i = 0; i < columnCount; ++i) {
+      names.push_back(sqlite3_column_name(statement, i));
+    }
+  }
+
+  void ResultArena::AppendRow(sqlite3_stmt* statement) {
+    for (int i = 0; i < static_cast<int>(names.size()); ++i) {
+      Cell value;
+      value.type = sqlite3_column_type(statement, i);
+      value.length = 0;
+      switch (value.type) {
+      case SQLITE_INTEGER:
+        value.integer = sqlite3_column_int64(statement, i);
+        break;
+      case SQLITE_FLOAT:
+        value.real = sqlite3_column_double(statement, i);
+        break;
+      case SQLITE_TEXT:
+        {
+          const void* text = sqlite3_column_text(statement, i);
+          value.length = static_cast<unsigned int>(sqlite3_column_bytes(statement, i));
+          value.bytes = store(text, value.length);
+          break;
+        }
+      case SQLITE_BLOB:
+        {
+          const void* blob = sqlite3_column_blob(statement, i);
+          value.length = static_cast<unsigned int>(sqlite3_column_bytes(statement, i));
+          value.bytes = store(blob, value.length);
+          break;
+        }
+      default:
+        value.integer = 0;
+      }
+      cells.push_back(value);
+    }
+  }
+
+  size_t ResultArena::RowCount() const {
+    return names.empty() ? 0 : cells.size() / names.size();
+  }
+
+  int ResultArena::ColumnCount() const {
+    return static_cast<int>(names.size());
+  }
+
+  const std::string& ResultArena::ColumnName(int column) const {
+    return names[column];
+  }
+
+  int ResultArena::ColumnIndex(const char* name) const {
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (names[i] == name) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+  int ResultArena::Type(size_t row, int column) const {
+    return cell(row, column).type;
+  }
+
+  long long ResultArena::Int64(size_t row, int column) const {
+    const Cell& value = cell(row, column);
+    return value.type == SQLITE_FLOAT ? static_cast<long long>(value.real)
+         : value.type == SQLITE_INTEGER ? value.integer : 0;
+  }
+
+  double ResultArena::Double(size_t row, int column) const {
+    const Cell& value = cell(row, column);
+    return value.type == SQLITE_INTEGER ? static_cast<double>(value.integer)
+         : value.type == SQLITE_FLOAT ? value.real : 0.0;
+  }
+
+  const char* ResultArena::Bytes(size_t row, int column, size_t& length) const {
+    const Cell& value = cell(row, column);
+    if (value.type != SQLITE_TEXT && value.type != SQLITE_BLOB) {
+      length = 0;
+      return nullptr;
+    }
+    length = value.length;
+    return value.bytes;
+  }
+
+  size_t ResultArena::ArenaBytes() const {
+    return arenaBytes;
+  }
+
+  const ResultArena::Cell& ResultArena::cell(size_t row, int column) const {
+    return cells[row * names.size() + column];
+  }
+
+  const char* ResultArena::store(const void* data, size_t length) {
+    if (length == 0) {
+      return "";
+    }
+    char* target;
+    if (length > largeValueBytes) {
+      chunks.push_back(std::unique_ptr<char[]>(new char[length]));
+      arenaBytes += length;
+      target = chunks.back().get();
+    } else {
+      if (length > chunkRemaining) {
+        chunks.push_back(std::unique_ptr<char[]>(new char[chunkBytes]));
+        arenaBytes += chunkBytes;
+        chunkPosition = chunks.back().get();
+        chunkRemaining = chunkBytes;
+      }
+      target = chunkPosition;
+      chunkPosition += length;
+      chunkRemaining -= length;
+    }
+    std::memcpy(target, data, length);
+    return target;
+  }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  // The rows of a result kept as typed values. Text and blob bytes are copied
+  // once into large chunks and stay undecoded until a column is read, so
+  // neither JSON serialization nor a per value allocation is paid for
+  // columns nobody looks at. The copy is eager: the arena outlives the
+  // statement and is read on other threads, and most result columns have no
+  // table row that could be read back later.
+  class ResultArena {
+  public:
+    explicit ResultArena(sqlite3_stmt* statement);
+
+    // Copies the current row of the statement
+    void AppendRow(sqlite3_stmt* statement);
+
+    size_t RowCount() const;
+    int ColumnCount() const;
+    const std::string& ColumnName(int column) const;
+    // Returns -1 for unknown names
+    int ColumnIndex(const char* name) const;
+
+    // SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL
+    int Type(size_t row, int column) const;
+    long long Int64(size_t row, int column) const;
+    double Double(size_t row, int column) const;
+    // UTF-8 text or blob bytes, valid as long as the arena
+    const char* Bytes(size_t row, int column, size_t& length) const;
+
+    size_t ArenaBytes() const;
+
+  private:
+    struct Cell {
+      union {
+        long long integer;
+        double real;
+        const char* bytes;
+      };
+      unsigned int length;
+      int type;
+    };
+
+    ResultArena(const ResultArena&);
+    ResultArena& operator=(const ResultArena&);
+
+    const Cell& cell(size_t row, int column) const;
+    const char* store(const void* data, size_t length);
+
+    std::vector<std::string> names;
+    std::vector<Cell> cells;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char* chunkPosition;
+    size_t chunkRemaining;
+    size_t arenaBytes;
+  };
+}
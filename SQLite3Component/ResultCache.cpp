@@ -0,0 +1,364 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include "ResultCache.h"
+
+namespace SQLite3 {
+  namespace {
+    // Per entry bookkeeping on top of the key and the result
+    const size_t entryOverhead = 128;
+
+    // Functions whose result changes without any table changing
+    const char* const volatileFunctions[] = {
+      "random", "randomblob", "changes", "total_changes", "last_insert_rowid",
+      "date", "time", "datetime", "julianday", "strftime", "unixepoch", "sqlite_offset",
+      "current_timestamp", "current_date", "current_time"
+    };
+
+    std::string lower(const char* name) {
+      std::string result(name ? name : "");
+      std::transform(result.begin(), result.end(), result.begin(), ::tolower);
+      return result;
+    }
+
+    bool isVolatile(const char* function) {
+      std::string name = lower(function);
+      for (size_t i = 0; i < sizeof(volatileFunctions) / sizeof(volatileFunctions[0]); ++i) {
+        if (name == volatileFunctions[i]) {
+          return true;
+        }
+      }
+      return false;
+    }
+  }
+
+  ResultCache::ResultCache(size_t budgetBytes)
+    : db(nullptr)
+    , dataVersion(nullptr)
+    , lastDataVersion(-1)
+    , generation(0)
+    , clearedAt(0)
+    , budget(budgetBytes)
+    , bytes(0)
+    , hits(0)
+    , misses(0)
+    , insertions(0)
+    , invalidations(0)
+    , evictions(0) {
+  }
+
+  ResultCache::~ResultCache() {
+    Detach();
+  }
+
+  bool ResultCache::Attach(sqlite3* db, bool externalChanges) {
+    Detach();
+    if (externalChanges) {
+      // Older SQLite versions ignore the unknown pragma and return no row,
+      // the cache would never see the commits of other connections
+      sqlite3_stmt* version = nullptr;
+      bool known = sqlite3_prepare_v2(db, "PRAGMA data_version", -1, &version, nullptr) == SQLITE_OK &&
+        sqlite3_step(version) == SQLITE_ROW;
+      if (!known) {
+        sqlite3_finalize(version);
+        return false;
+      }
+      sqlite3_reset(version);
+      std::lock_guard<std::mutex> lock(dataVersionMutex);
+      dataVersion = version;
+    }
+    this->db = db;
+    sqlite3_set_authorizer(db, authorize, this);
+    sqlite3_commit_hook(db, onCommit, this);
+    sqlite3_rollback_hook(db, onRollback, this);
+    checkDataVersion();
+    return true;
+  }
+
+  void ResultCache::Detach() {
+    if (!db) {
+      return;
+    }
+    sqlite3_set_authorizer(db, nullptr, nullptr);
+    sqlite3_commit_hook(db, nullptr, nullptr);
+    sqlite3_rollback_hook(db, nullptr, nullptr);
+    {
+      std::lock_guard<std::mutex> lock(dataVersionMutex);
+      sqlite3_finalize(dataVersion);
+      dataVersion = nullptr;
+      lastDataVersion = -1;
+    }
+    db = nullptr;
+    Clear();
+  }
+
+  bool ResultCache::Attached() const {
+    return db != nullptr;
+  }
+
+  ResultCache::Collection::Collection(ResultCache& cache)
+    : cache(cache)
+    , lock(cache.collectionMutex) {
+    std::lock_guard<std::mutex> guard(cache.mutex);
+    cache.collectingThread = std::this_thread::get_id();
+    cache.collected = StatementTables();
+    cache.collected.generation = cache.generation;
+  }
+
+  ResultCache::Collection::~Collection() {
+    std::lock_guard<std::mutex> guard(cache.mutex);
+    cache.collectingThread = std::thread::id();
+  }
+
+  StatementTables ResultCache::Collection::Tables(bool readOnly) {
+    std::lock_guard<std::mutex> guard(cache.mutex);
+    StatementTables tables = cache.collected;
+    tables.cacheable = tables.cacheable && readOnly;
+    std::sort(tables.tables.begin(), tables.tables.end());
+    tables.tables.erase(std::unique(tables.tables.begin(), tables.tables.end()), tables.tables.end());
+    return tables;
+  }
+
+  std::shared_ptr<const CachedResult> ResultCache::Lookup(const std::string& key) {
+    checkDataVersion();
+    bool inTransaction = db && !sqlite3_get_autocommit(db);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = index.find(key);
+    if (found == index.end()) {
+      ++misses;
+      return nullptr;
+    }
+    EntryList::iterator entry = found->second;
+    if (inTransaction) {
+      // Statements of the open transaction may have changed the tables in
+      // ways the update hook does not report, e.g. DELETE without WHERE
+      for (size_t i = 0; i < entry->tables.size(); ++i) {
+        if (pendingWrites.count(entry->tables[i])) {
+          ++misses;
+          return nullptr;
+        }
+      }
+    }
+    entries.splice(entries.begin(), entries, entry);
+    ++hits;
+    return entry->result;
+  }
+
+  void ResultCache::Insert(const std::string& key, const StatementTables& tables, std::shared_ptr<const CachedResult> result, size_t resultBytes) {
+    if (!tables.cacheable || !result) {
+      return;
+    }
+    checkDataVersion();
+    // Results read inside a transaction may still be rolled back
+    if (db && !sqlite3_get_autocommit(db)) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t entryBytes = key.size() + resultBytes + entryOverhead;
+    if (entryBytes > budget || tables.generation < clearedAt) {
+      return;
+    }
+    // A table changed while the statement ran
+    for (size_t i = 0; i < tables.tables.size(); ++i) {
+      auto invalidated = invalidatedAt.find(tables.tables[i]);
+      if (invalidated != invalidatedAt.end() && invalidated->second > tables.generation) {
+        return;
+      }
+    }
+
+    auto existing = index.find(key);
+    if (existing != index.end()) {
+      removeLocked(existing->second);
+    }
+    evictLocked(budget - entryBytes);
+
+    Entry entry;
+    entry.key = key;
+    entry.tables = tables.tables;
+    entry.result = result;
+    entry.bytes = entryBytes;
+    entries.push_front(entry);
+    index[key] = entries.begin();
+    for (size_t i = 0; i < entry.tables.size(); ++i) {
+      tableKeys[entry.tables[i]].insert(key);
+    }
+    bytes += entryBytes;
+    ++insertions;
+  }
+
+  void ResultCache::OnRowChanged(const char* table) {
+    InvalidateTable(lower(table));
+  }
+
+  void ResultCache::InvalidateTable(const std::string& table) {
+    std::lock_guard<std::mutex> lock(mutex);
+    invalidateLocked(table);
+  }
+
+  void ResultCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    invalidations += static_cast<long long>(entries.size());
+    entries.clear();
+    index.clear();
+    tableKeys.clear();
+    invalidatedAt.clear();
+    pendingWrites.clear();
+    bytes = 0;
+    clearedAt = ++generation;
+  }
+
+  size_t ResultCache::Budget() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return budget;
+  }
+
+  void ResultCache::SetBudget(size_t budgetBytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = budgetBytes;
+    evictLocked(budget);
+  }
+
+  ResultCacheCounters ResultCache::Counters() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    ResultCacheCounters counters;
+    counters.hits = hits;
+    counters.misses = misses;
+    counters.insertions = insertions;
+    counters.invalidations = invalidations;
+    counters.evictions = evictions;
+    counters.entries = static_cast<long long>(entries.size());
+    counters.bytes = static_cast<long long>(bytes);
+    return counters;
+  }
+
+  int ResultCache::authorize(void* cache, int action, const char* argument1, const char* argument2,
+                             const char*, const char* trigger) {
+    return static_cast<ResultCache*>(cache)->authorize(action, argument1, argument2, trigger);
+  }
+
+  int ResultCache::authorize(int action, const char* argument1, const char* argument2, const char* trigger) {
+    std::lock_guard<std::mutex> lock(mutex);
+    bool collecting = collectingThread == std::this_thread::get_id();
+    switch (action) {
+    case SQLITE_READ:
+      if (collecting) {
+        collected.tables.push_back(lower(argument1));
+        // Views are recorded too, so dropping one invalidates its queries
+        if (trigger) {
+          collected.tables.push_back(lower(trigger));
+        }
+      }
+      break;
+    case SQLITE_INSERT:
+    case SQLITE_UPDATE:
+    case SQLITE_DELETE:
+    case SQLITE_DROP_TABLE:
+    case SQLITE_DROP_TEMP_TABLE:
+    case SQLITE_DROP_VIEW:
+    case SQLITE_DROP_TEMP_VIEW:
+      pendingWrites.insert(lower(argument1));
+      break;
+    case SQLITE_ALTER_TABLE:
+      pendingWrites.insert(lower(argument2));
+      break;
+    case SQLITE_FUNCTION:
+      if (collecting && isVolatile(argument2)) {
+        collected.cacheable = false;
+      }
+      break;
+    case SQLITE_PRAGMA:
+    case SQLITE_ATTACH:
+    case SQLITE_DETACH:
+      if (collecting) {
+        collected.cacheable = false;
+      }
+      break;
+    }
+    return SQLITE_OK;
+  }
+
+  int ResultCache::onCommit(void* cache) {
+    static_cast<ResultCache*>(cache)->flushPendingWrites();
+    return 0;
+  }
+
+  void ResultCache::onRollback(void* cache) {
+    static_cast<ResultCache*>(cache)->flushPendingWrites();
+  }
+
+  void ResultCache::flushPendingWrites() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unordered_set<std::string> tables;
+    tables.swap(pendingWrites);
+    for (auto table = tables.begin(); table != tables.end(); ++table) {
+      invalidateLocked(*table);
+    }
+  }
+
+  void ResultCache::checkDataVersion() {
+    long long version = -1;
+    {
+      std::lock_guard<std::mutex> lock(dataVersionMutex);
+      if (!dataVersion) {
+        return;
+      }
+      if (sqlite3_step(dataVersion) == SQLITE_ROW) {
+        version = sqlite3_column_int64(dataVersion, 0);
+      }
+      sqlite3_reset(dataVersion);
+      if (version == lastDataVersion) {
+        return;
+      }
+      bool first = lastDataVersion < 0;
+      lastDataVersion = version;
+      if (first) {
+        return;
+      }
+    }
+    // Another connection committed, its changes are not known table by table
+    Clear();
+  }
+
+  void ResultCache::invalidateLocked(const std::string& table) {
+    invalidatedAt[table] = ++generation;
+    auto keys = tableKeys.find(table);
+    if (keys == tableKeys.end()) {
+      return;
+    }
+    std::unordered_set<std::string> invalidated;
+    invalidated.swap(keys->second);
+    tableKeys.erase(keys);
+    for (auto key = invalidated.begin(); key != invalidated.end(); ++key) {
+      auto entry = index.find(*key);
+      if (entry != index.end()) {
+        removeLocked(entry->second);
+        ++invalidations;
+      }
+    }
+  }
+
+  void ResultCache::removeLocked(EntryList::iterator entry) {
+    for (size_t i = 0; i < entry->tables.size(); ++i) {
+      auto keys = tableKeys.find(entry->tables[i]);
+      if (keys != tableKeys.end()) {
+        keys->second.erase(entry->key);
+        if (keys->second.empty()) {
+          tableKeys.erase(keys);
+        }
+      }
+    }
+    bytes -= entry->bytes;
+    index.erase(entry->key);
+    entries.erase(entry);
+  }
+
+  void ResultCache::evictLocked(size_t budgetBytes) {
+    while (bytes > budgetBytes && !entries.empty()) {
+      removeLocked(--entries.end());
+      ++evictions;
+    }
+  }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  // The cached result, owned by the cache and shared with the callers that
+  // get it back from a lookup
+  class CachedResult {
+  public:
+    virtual ~CachedResult() {}
+  };
+
+  struct ResultCacheCounters {
+    long long hits;
+    long long misses;
+    long long insertions;
+    long long invalidations;
+    long long evictions;
+    long long entries;
+    long long bytes;
+  };
+
+  // The tables a statement depends on, collected while it is prepared
+  struct StatementTables {
+    StatementTables() : cacheable(true), generation(0) {}
+
+    std::vector<std::string> tables;
+    // False for statements whose result does not only depend on the tables,
+    // e.g. because they call random() or read a pragma
+    bool cacheable;
+    long long generation;
+  };
+
+  // Results of read only queries keyed by their SQL and parameters, each
+  // entry tagged with the tables the query reads. The tables are found by an
+  // authorizer while the statement is prepared, entries are invalidated when
+  // rows of those tables change (OnRowChanged, to be called from the update
+  // hook), when a statement writing them commits or rolls back and when
+  // another connection commits (PRAGMA data_version). Least recently used
+  // entries are evicted to stay within the memory budget.
+  class ResultCache {
+  public:
+    explicit ResultCache(size_t budgetBytes);
+    ~ResultCache();
+
+    // Installs the authorizer, commit and rollback hooks, the connection
+    // can not use them for anything else while attached. Without
+    // externalChanges, e.g. for an immutable database, lookups skip the
+    // check for commits of other connections. That check needs PRAGMA
+    // data_version (SQLite 3.8.4), without it the cache is not attached and
+    // false is returned when externalChanges is set.
+    bool Attach(sqlite3* db, bool externalChanges = true);
+    void Detach();
+    bool Attached() const;
+
+    // Collects the tables of the statements prepared on this thread during
+    // its lifetime, only results of read only statements are cached
+    class Collection {
+    public:
+      explicit Collection(ResultCache& cache);
+      ~Collection();
+
+      StatementTables Tables(bool readOnly);
+
+    private:
+      Collection(const Collection&);
+      Collection& operator=(const Collection&);
+
+      ResultCache& cache;
+      std::unique_lock<std::mutex> lock;
+    };
+
+    std::shared_ptr<const CachedResult> Lookup(const std::string& key);
+    void Insert(const std::string& key, const StatementTables& tables, std::shared_ptr<const CachedResult> result, size_t bytes);
+
+    void OnRowChanged(const char* table);
+    void InvalidateTable(const std::string& table);
+    void Clear();
+
+    size_t Budget() const;
+    void SetBudget(size_t budgetBytes);
+    ResultCacheCounters Counters() const;
+
+  private:
+    struct Entry {
+      std::string key;
+      std::vector<std::string> tables;
+      std::shared_ptr<const CachedResult> result;
+      size_t bytes;
+    };
+    typedef std::list<Entry> EntryList;
+
+    ResultCache(const ResultCache&);
+    ResultCache& operator=(const ResultCache&);
+
+    static int authorize(void* cache, int action, const char* argument1, const char* argument2,
+                         const char* database, const char* trigger);
+    static int onCommit(void* cache);
+    static void onRollback(void* cache);
+
+    int authorize(int action, const char* argument1, const char* argument2, const char* trigger);
+    void flushPendingWrites();
+    void checkDataVersion();
+    void invalidateLocked(const std::string& table);
+    void removeLocked(EntryList::iterator entry);
+    void evictLocked(size_t budgetBytes);
+
+    // Never held while calling into SQLite, the hooks take it from within
+    mutable std::mutex mutex;
+    std::mutex collectionMutex;
+    std::mutex dataVersionMutex;
+    sqlite3* db;
+    sqlite3_stmt* dataVersion;
+    long long lastDataVersion;
+
+    EntryList entries;
+    std::unordered_map<std::string, EntryList::iterator> index;
+    std::unordered_map<std::string, std::unordered_set<std::string>> tableKeys;
+    std::unordered_map<std::string, long long> invalidatedAt;
+    // Tables written by statements prepared since the last commit or
+    // rollback
+    std::unordered_set<std::string> pendingWrites;
+    long long generation;
+    long long clearedAt;
+    size_t budget;
+    size_t bytes;
+
+    std::thread::id collectingThread;
+    StatementTables collected;
+
+    long long hits;
+    long long misses;
+    long long insertions;
+    long long invalidations;
+    long long evictions;
+  };
+}
@@ -0,0 +1,123 @@
+#include <collection.h>
+
+#include <robuffer.h>
+
+#include "ResultSet.h"
+
+namespace SQLite3 {
+  Row::Row(std::shared_ptr<ResultArena> arena, size_t index)
+    : arena(arena)
+    , index(index) {
+  }
+
+  void Row::checkColumn(int column) {
+    if (column < 0 || column >= arena->ColumnCount()) {
+      throw ref new Platform::OutOfBoundsException(L"Column index out of range");
+    }
+  }
+
+  ColumnType Row::GetType(int column) {
+    checkColumn(column);
+    return static_cast<ColumnType>(arena->Type(index, column));
+  }
+
+  bool Row::IsNull(int column) {
+    return GetType(column) == ColumnType::Null;
+  }
+
+  int64 Row::GetInt64(int column) {
+    checkColumn(column);
+    return arena->Int64(index, column);
+  }
+
+  double Row::GetDouble(int column) {
+    checkColumn(column);
+    return arena->Double(index, column);
+  }
+
+  Platform::String^ Row::GetString(int column) {
+    checkColumn(column);
+    switch (arena->Type(index, column)) {
+    case SQLITE_NULL:
+      return nullptr;
+    case SQLITE_INTEGER:
+      return arena->Int64(index, column).ToString();
+    case SQLITE_FLOAT:
+      return arena->Double(index, column).ToString();
+    default:
+      {
+        size_t length;
+        const char* text = arena->Bytes(index, column, length);
+        return ToPlatformString(text, static_cast<unsigned int>(length));
+      }
+    }
+  }
+
+  Windows::Storage::Streams::IBuffer^ Row::GetBuffer(int column) {
+    checkColumn(column);
+    size_t length;
+    const char* data = arena->Bytes(index, column, length);
+    if (!data) {
+      return nullptr;
+    }
+    auto buffer = ref new Windows::Storage::Streams::Buffer(static_cast<unsigned int>(length));
+    byte* target;
+    winrt_as<Windows::Storage::Streams::IBufferByteAccess>(buffer)->Buffer(&target);
+    memcpy(target, data, length);
+    buffer->Length = static_cast<unsigned int>(length);
+    return buffer;
+  }
+
+  Platform::Object^ Row::GetValue(int column) {
+    switch (GetType(column)) {
+    case ColumnType::Integer:
+      return arena->Int64(index, column);
+    case ColumnType::Float:
+      return arena->Double(index, column);
+    case ColumnType::Text:
+      return GetString(column);
+    case ColumnType::Blob:
+      return GetBuffer(column);
+    default:
+      return nullptr;
+    }
+  }
+
+  Platform::Object^ Row::GetValueByName(Platform::String^ name) {
+    int column = arena->ColumnIndex(ToUtf8String(name).c_str());
+    if (column < 0) {
+      throw ref new Platform::InvalidArgumentException(L"Unknown column");
+    }
+    return GetValue(column);
+  }
+
+  ResultSet::ResultSet(std::shared_ptr<ResultArena> arena)
+    : arena(arena) {
+  }
+
+  // The Row objects only hold the arena and their index, they are created
+  // when the rows are first asked for
+  Windows::Foundation::Collections::IVectorView<Row^>^ ResultSet::Rows::get() {
+    if (!rows) {
+      auto vector = ref new Platform::Collections::Vector<Row^>();
+      for (size_t i = 0; i < arena->RowCount(); ++i) {
+        vector->Append(ref new Row(arena, i));
+      }
+      rows = vector->GetView();
+    }
+    return rows;
+  }
+
+  Windows::Foundation::Collections::IVectorView<Platform::String^>^ ResultSet::ColumnNames::get() {
+    auto names = ref new Platform::Collections::Vector<Platform::String^>();
+    for (int i = 0; i < arena->ColumnCount(); ++i) {
+      const std::string& name = arena->ColumnName(i);
+      names->Append(ToPlatformString(name.data(), static_cast<unsigned int>(name.size())));
+    }
+    return names->GetView();
+  }
+
+  int ResultSet::ColumnIndex(Platform::String^ name) {
+    return arena->ColumnIndex(ToUtf8String(name).c_str());
+  }
+}
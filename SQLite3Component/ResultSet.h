@@ -0,0 +1,68 @@
+#pragma once
+
+#include <memory>
+
+#include "Common.h"
+#include "ResultArena.h"
+
+namespace SQLite3 {
+  public enum class ColumnType {
+    Integer = SQLITE_INTEGER,
+    Float = SQLITE_FLOAT,
+    Text = SQLITE_TEXT,
+    Blob = SQLITE_BLOB,
+    Null = SQLITE_NULL
+  };
+
+  // A single row of a ResultSet. Values are decoded from the arena each time
+  // they are read, nothing is converted for columns that are never accessed.
+  public ref class Row sealed {
+  public:
+    ColumnType GetType(int column);
+    bool IsNull(int column);
+    int64 GetInt64(int column);
+    double GetDouble(int column);
+    Platform::String^ GetString(int column);
+    Windows::Storage::Streams::IBuffer^ GetBuffer(int column);
+    // The value as number, string, IBuffer or null
+    Platform::Object^ GetValue(int column);
+    Platform::Object^ GetValueByName(Platform::String^ name);
+
+  internal:
+    Row(std::shared_ptr<ResultArena> arena, size_t index);
+
+  private:
+    void checkColumn(int column);
+
+    std::shared_ptr<ResultArena> arena;
+    size_t index;
+  };
+
+  // The rows of a query kept natively instead of as JSON text
+  public ref class ResultSet sealed {
+  public:
+    property Windows::Foundation::Collections::IVectorView<Row^>^ Rows {
+      Windows::Foundation::Collections::IVectorView<Row^>^ get();
+    }
+
+    property Windows::Foundation::Collections::IVectorView<Platform::String^>^ ColumnNames {
+      Windows::Foundation::Collections::IVectorView<Platform::String^>^ get();
+    }
+
+    property unsigned int Size {
+      unsigned int get() {
+        return static_cast<unsigned int>(arena->RowCount());
+      };
+    }
+
+    // Returns -1 for unknown names
+    int ColumnIndex(Platform::String^ name);
+
+  internal:
+    explicit ResultSet(std::shared_ptr<ResultArena> arena);
+
+  private:
+    std::shared_ptr<ResultArena> arena;
+    Windows::Foundation::Collections::IVectorView<Row^>^ rows;
+  };
+}
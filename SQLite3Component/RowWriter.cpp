@@ -0,0 +1,124 @@
+#include <cstring>
+
+#include "RowWriter.h"
+
+namespace SQLite3 {
+  static const char hexDigits[] = "0123456789abcdef";
+  static const char base64Digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  void writeEscaped(const char* utf8String, size_t length, std::string& out) {
+    out.push_back('"');
+    const char* runStart = utf8String;
+    const char* end = utf8String + length;
+    for (const char* i = utf8String; i != end; ++i) {
+      unsigned char c = static_cast<unsigned char>(*i);
+      // Bytes of multi-byte UTF-8 sequences are >= 0x80 and can be copied verbatim
+      if (c >= 0x20 && c != '"' && c != '\\' && c != 0x7f) {
+        continue;
+      }
+      out.append(runStart, i);
+      runStart = i + 1;
+      out.push_back('\\');
+      switch (c) {
+      case '"':  out.push_back('"');  break;
+      case '\\': out.push_back('\\'); break;
+      case '\t': out.push_back('t');  break;
+      case '\r': out.push_back('r');  break;
+      case '\n': out.push_back('n');  break;
+      default:
+        out.append("u00");
+        out.push_back(hexDigits[c >> 4]);
+        out.push_back(hexDigits[c & 0xf]);
+      }
+    }
+    out.append(runStart, end);
+    out.push_back('"');
+  }
+
+  void writeBase64(const unsigned char* data, size_t length, std::string& out) {
+    size_t start = out.size();
+    out.resize(start + (length + 2) / 3 * 4);
+    char* output = &out[start];
+
+    size_t i = 0;
+    for (; i + 2 < length; i += 3) {
+      unsigned int triple = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+      *output++ = base64Digits[(triple >> 18) & 0x3f];
+      *output++ = base64Digits[(triple >> 12) & 0x3f];
+      *output++ = base64Digits[(triple >> 6) & 0x3f];
+      *output++ = base64Digits[triple & 0x3f];
+    }
+    if (i < length) {
+      unsigned int triple = data[i] << 16;
+      if (i + 1 < length) {
+        triple |= data[i + 1] << 8;
+      }
+      *output++ = base64Digits[(triple >> 18) & 0x3f];
+      *output++ = base64Digits[(triple >> 12) & 0x3f];
+      *output++ = (i + 1 < length) ? base64Digits[(triple >> 6) & 0x3f] : '=';
+      *output++ = '=';
+    }
+  }
+
+  static void writeInteger(sqlite3_int64 value, std::string& out) {
+    char buffer[24];
+    char* end = buffer + sizeof(buffer);
+    char* start = end;
+    // Work on the unsigned magnitude so that the smallest int64 does not overflow
+    sqlite3_uint64 magnitude = value < 0 ? 0 - static_cast<sqlite3_uint64>(value) : static_cast<sqlite3_uint64>(value);
+    do {
+      *--start = static_cast<char>('0' + magnitude % 10);
+      magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) {
+      *--start = '-';
+    }
+    out.append(start, end);
+  }
+
+  RowWriter::RowWriter(sqlite3_stmt* statement)
+    : statement(statement) {
+    int columnCount = sqlite3_column_count(statement);
+    keys.reserve(columnCount);
+    for (int i = 0; i < columnCount; ++i) {
+      const char* name = sqlite3_column_name(statement, i);
+      std::string key(i ? "," : "");
+      writeEscaped(name, strlen(name), key);
+      key.push_back(':');
+      keys.push_back(key);
+    }
+  }
+
+  void RowWriter::WriteRow(std::string& out) const {
+    out.push_back('{');
+    for (size_t i = 0; i < keys.size(); ++i) {
+      int column = static_cast<int>(i);
+      out.append(keys[i]);
+      switch (sqlite3_column_type(statement, column)) {
+      case SQLITE_TEXT: {
+          auto text = reinterpret_cast<const char*>(sqlite3_column_text(statement, column));
+          writeEscaped(text, sqlite3_column_bytes(statement, column), out);
+        }
+        break;
+      case SQLITE_INTEGER:
+        writeInteger(sqlite3_column_int64(statement, column), out);
+        break;
+      case SQLITE_FLOAT:
+        out.append(reinterpret_cast<const char*>(sqlite3_column_text(statement, column)));
+        break;
+      case SQLITE_BLOB: {
+          auto blob = static_cast<const unsigned char*>(sqlite3_column_blob(statement, column));
+          const int blobSize = sqlite3_column_bytes(statement, column);
+          out.push_back('"');
+          writeBase64(blob, blobSize, out);
+          out.push_back('"');
+        }
+        break;
+      case SQLITE_NULL:
+        out.append("null");
+        break;
+      }
+    }
+    out.push_back('}');
+  }
+}
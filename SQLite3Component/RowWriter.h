@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  void writeEscaped(const char* utf8String, size_t length, std::string& out);
+  void writeBase64(const unsigned char* data, size_t length, std::string& out);
+
+  // Serializes the current row of a statement as a JSON object. The escaped
+  // column names are computed once, so one writer should be reused for all
+  // rows of a statement. Text is written as UTF-8, blobs as BASE64 strings.
+  class RowWriter {
+  public:
+    explicit RowWriter(sqlite3_stmt* statement);
+
+    void WriteRow(std::string& out) const;
+
+  private:
+    sqlite3_stmt* statement;
+    std::vector<std::string> keys;
+  };
+}
@@ -0,0 +1,216 @@
+#include <algorithm>
+
+#include "Scheduler.h"
+
+namespace SQLite3 {
+  Scheduler::Scheduler(unsigned agingMilliseconds, ExecutionContext* context)
+    : state(std::make_shared<State>()) {
+    state->agingMilliseconds = agingMilliseconds;
+    state->context = context;
+    state->sequence = 0;
+    state->stopping = false;
+    state->dropping = false;
+    for (int i = 0; i < schedulerPriorities; ++i) {
+      state->completed[i] = 0;
+    }
+    state->aged = 0;
+    worker = std::thread(run, state);
+  }
+
+  Scheduler::~Scheduler() {
+    stop(false);
+  }
+
+  void Scheduler::Stop() {
+    stop(true);
+  }
+
+  void Scheduler::stop(bool drop) {
+    if (!worker.joinable()) {
+      return;
+    }
+    std::deque<Entry> dropped[schedulerPriorities];
+    std::deque<DelayedEntry> droppedDelayed;
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->stopping = true;
+      if (drop) {
+        state->dropping = true;
+        for (int i = 0; i < schedulerPriorities; ++i) {
+          dropped[i].swap(state->queues[i]);
+        }
+        droppedDelayed.swap(state->delayed);
+      }
+      if (worker.get_id() == std::this_thread::get_id()) {
+        // Stopped by a job, which leaves the context here because the
+        // context goes along with the owner before the job returns
+        if (state->context && state->context->HeldByCurrentThread()) {
+          state->context->Leave();
+        }
+        state->context = nullptr;
+      }
+    }
+    state->wake.notify_one();
+    if (worker.get_id() == std::this_thread::get_id()) {
+      worker.detach();
+    } else {
+      worker.join();
+    }
+    // Destroyed once the running job is done, since they may hold state
+    // their owner releases through the same connection
+    for (int i = 0; i < schedulerPriorities; ++i) {
+      dropped[i].clear();
+    }
+    droppedDelayed.clear();
+  }
+
+  void Scheduler::Submit(SchedulerPriority priority, Job job) {
+    Job dropped;
+    Entry entry;
+    entry.job = std::move(job);
+    entry.submitted = Clock::now();
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (state->dropping) {
+        // Destroyed after the lock is released
+        dropped = std::move(entry.job);
+      } else {
+        entry.sequence = state->sequence++;
+        state->queues[priority].push_back(std::move(entry));
+      }
+    }
+    state->wake.notify_one();
+  }
+
+  void Scheduler::SubmitAfter(SchedulerPriority priority, unsigned delayMilliseconds, Job job) {
+    Job dropped;
+    DelayedEntry entry;
+    entry.job = std::move(job);
+    entry.priority = priority;
+    entry.due = Clock::now() + std::chrono::milliseconds(delayMilliseconds);
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (state->dropping) {
+        dropped = std::move(entry.job);
+      } else {
+        // Sorted by due time, jobs due at the same time keep their order
+        auto position = state->delayed.begin();
+        while (position != state->delayed.end() && position->due <= entry.due) {
+          ++position;
+        }
+        state->delayed.insert(position, std::move(entry));
+      }
+    }
+    state->wake.notify_one();
+  }
+
+  unsigned Scheduler::Aging() const {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->agingMilliseconds;
+  }
+
+  void Scheduler::SetAging(unsigned agingMilliseconds) {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->agingMilliseconds = agingMilliseconds;
+  }
+
+  SchedulerCounters Scheduler::Counters() const {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    SchedulerCounters counters;
+    counters.pending = 0;
+    for (int i = 0; i < schedulerPriorities; ++i) {
+      counters.completed[i] = state->completed[i];
+      counters.pending += static_cast<long long>(state->queues[i].size());
+    }
+    counters.aged = state->aged;
+    counters.delayed = static_cast<long long>(state->delayed.size());
+    return counters;
+  }
+
+  void Scheduler::run(std::shared_ptr<State> state) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    for (;;) {
+      Clock::time_point now = Clock::now();
+      queueDelayed(*state, now);
+      int priority = next(*state, now);
+      if (priority < 0) {
+        if (state->stopping) {
+          return;
+        }
+        if (state->delayed.empty()) {
+          state->wake.wait(lock);
+        } else {
+          state->wake.wait_until(lock, state->delayed.front().due);
+        }
+        continue;
+      }
+      for (int i = 0; i < priority; ++i) {
+        if (!state->queues[i].empty()) {
+          ++state->aged;
+          break;
+        }
+      }
+      Job job = std::move(state->queues[priority].front().job);
+      state->queues[priority].pop_front();
+      ExecutionContext* context = state->context;
+
+      lock.unlock();
+      if (context) {
+        context->Enter();
+      }
+      try {
+        job();
+      } catch (...) {
+      }
+      lock.lock();
+      // Cleared, and left, if the job stopped the scheduler
+      if (state->context) {
+        state->context->Leave();
+      }
+      lock.unlock();
+      // The job may hold the last reference to the scheduler's owner
+      job = nullptr;
+      lock.lock();
+      ++state->completed[priority];
+    }
+  }
+
+  // Moves the delayed jobs that are due, or all of them when stopping, to
+  // the queues as if they were submitted when they became due
+  void Scheduler::queueDelayed(State& state, Clock::time_point now) {
+    while (!state.delayed.empty() && (state.stopping || state.delayed.front().due <= now)) {
+      DelayedEntry& delayed = state.delayed.front();
+      Entry entry;
+      entry.job = std::move(delayed.job);
+      entry.submitted = std::min(delayed.due, now);
+      entry.sequence = state.sequence++;
+      state.queues[delayed.priority].push_back(std::move(entry));
+      state.delayed.pop_front();
+    }
+  }
+
+  int Scheduler::next(const State& state, Clock::time_point now) {
+    // The front of every queue waited longest within its priority, so only
+    // the fronts compete
+    int best = -1;
+    long long bestRank = 0;
+    long long bestSequence = 0;
+    for (int priority = 0; priority < schedulerPriorities; ++priority) {
+      if (state.queues[priority].empty()) {
+        continue;
+      }
+      const Entry& front = state.queues[priority].front();
+      long long rank = priority;
+      if (state.agingMilliseconds) {
+        long long waited = std::chrono::duration_cast<std::chrono::milliseconds>(now - front.submitted).count();
+        rank -= waited / state.agingMilliseconds;
+      }
+      if (best < 0 || rank < bestRank || (rank == bestRank && front.sequence < bestSequence)) {
+        best = priority;
+        bestRank = rank;
+        bestSequence = front.sequence;
+      }
+    }
+    return best;
+  }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "ExecutionContext.h"
+
+namespace SQLite3 {
+  enum SchedulerPriority {
+    PriorityInteractive,
+    PriorityNormal,
+    PriorityBackground
+  };
+
+  const int schedulerPriorities = 3;
+
+  struct SchedulerCounters {
+    long long completed[schedulerPriorities];
+    // Jobs that ran before queued jobs of a higher priority because they
+    // had waited long enough
+    long long aged;
+    long long pending;
+    // Jobs submitted with a delay that has not passed yet
+    long long delayed;
+  };
+
+  // Runs the jobs of a connection one at a time on a worker thread, queued
+  // jobs of a higher priority first and jobs of the same priority in the
+  // order they were submitted. Every aging interval a job waits counts as one
+  // priority higher, so a steady stream of interactive work delays
+  // background work but does not starve it.
+  class Scheduler {
+  public:
+    typedef std::function<void()> Job;
+
+    // Zero disables aging. Jobs run inside the context when one is given,
+    // it has to outlive the scheduler.
+    explicit Scheduler(unsigned agingMilliseconds, ExecutionContext* context = nullptr);
+    // Runs the jobs still queued before the worker stops, unless Stop ran
+    // first. May be called from a job, the worker then stops after it
+    // instead of being joined.
+    ~Scheduler();
+
+    // Drops the queued and delayed jobs without running them and stops the
+    // worker once the running job is done. Jobs submitted later are dropped
+    // right away. Called from a job, the worker stops after it instead of
+    // being joined.
+    void Stop();
+
+    // Jobs report their own errors, exceptions they throw are dropped
+    void Submit(SchedulerPriority priority, Job job);
+    // Queues the job once the delay passed, without keeping the worker from
+    // running other jobs meanwhile. Delayed jobs are queued right away when
+    // the scheduler is destroyed.
+    void SubmitAfter(SchedulerPriority priority, unsigned delayMilliseconds, Job job);
+
+    unsigned Aging() const;
+    void SetAging(unsigned agingMilliseconds);
+
+    SchedulerCounters Counters() const;
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+      Job job;
+      Clock::time_point submitted;
+      long long sequence;
+    };
+
+    struct DelayedEntry {
+      Job job;
+      SchedulerPriority priority;
+      Clock::time_point due;
+    };
+
+    // Shared with the worker, which may outlive the scheduler when the last
+    // job destroys it
+    struct State {
+      std::mutex mutex;
+      std::condition_variable wake;
+      std::deque<Entry> queues[schedulerPriorities];
+      std::deque<DelayedEntry> delayed;
+      unsigned agingMilliseconds;
+      // Cleared when a job stops the scheduler, the detached worker then
+      // runs the remaining jobs without the context
+      ExecutionContext* context;
+      long long sequence;
+      bool stopping;
+      // Set by Stop, jobs are destroyed instead of queued
+      bool dropping;
+      long long completed[schedulerPriorities];
+      long long aged;
+    };
+
+    Scheduler(const Scheduler&);
+    Scheduler& operator=(const Scheduler&);
+
+    static void run(std::shared_ptr<State> state);
+    static int next(const State& state, Clock::time_point now);
+    static void queueDelayed(State& state, Clock::time_point now);
+
+    // Stops the worker, joins it unless called from a job
+    void stop(bool drop);
+
+    std::shared_ptr<State> state;
+    std::thread worker;
+  };
+}
@@ -0,0 +1,78 @@
+#include <sstream>
+
+#include "SlowQueryLog.h"
+#include "RowWriter.h"
+
+namespace SQLite3 {
+  static const char* DatatypeName(int type) {
+    switch (type) {
+    case SQLITE_INTEGER: return "integer";
+    case SQLITE_FLOAT: return "float";
+    case SQLITE_TEXT: return "text";
+    case SQLITE_BLOB: return "blob";
+    default: return "null";
+    }
+  }
+
+  SlowQueryLog::SlowQueryLog(size_t capacity)
+    : capacity(capacity) {
+  }
+
+  void SlowQueryLog::Add(const SlowQuery& query) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (capacity == 0) {
+      return;
+    }
+    while (entries.size() >= capacity) {
+      entries.pop_front();
+    }
+    entries.push_back(query);
+  }
+
+  void SlowQueryLog::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+  }
+
+  size_t SlowQueryLog::Capacity() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return capacity;
+  }
+
+  void SlowQueryLog::SetCapacity(size_t value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    capacity = value;
+    while (entries.size() > capacity) {
+      entries.pop_front();
+    }
+  }
+
+  void SlowQueryLog::ToJson(std::string& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream json;
+    json << '[';
+    for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+      std::string text;
+      if (entry != entries.begin()) {
+        json << ',';
+      }
+      writeEscaped(entry->sql.data(), entry->sql.size(), text);
+      json << "{\"sql\":" << text << ",\"parameterTypes\":[";
+      for (size_t i = 0; i < entry->parameterTypes.size(); ++i) {
+        json << (i ? ",\"" : "\"") << DatatypeName(entry->parameterTypes[i]) << '"';
+      }
+      json << "],\"rowCount\":" << entry->rowCount
+           << ",\"elapsed\":" << entry->elapsedMilliseconds
+           << ",\"timestamp\":" << entry->timestamp
+           << ",\"queryPlan\":[";
+      for (size_t i = 0; i < entry->queryPlan.size(); ++i) {
+        text.clear();
+        writeEscaped(entry->queryPlan[i].data(), entry->queryPlan[i].size(), text);
+        json << (i ? "," : "") << text;
+      }
+      json << "]}";
+    }
+    json << ']';
+    out.append(json.str());
+  }
+}
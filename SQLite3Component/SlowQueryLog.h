@@ -0,0 +1,38 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SQLite3 {
+  struct SlowQuery {
+    std::string sql;
+    std::vector<int> parameterTypes;
+    int rowCount;
+    double elapsedMilliseconds;
+    long long timestamp;
+    std::vector<std::string> queryPlan;
+  };
+
+  // Bounded ring of the most recent statements that exceeded the configured
+  // step time threshold. Entries are added from worker threads and read from
+  // the UI thread, so all access is serialized.
+  class SlowQueryLog {
+  public:
+    explicit SlowQueryLog(size_t capacity);
+
+    void Add(const SlowQuery& query);
+    void Clear();
+
+    size_t Capacity() const;
+    void SetCapacity(size_t capacity);
+
+    void ToJson(std::string& out) const;
+
+  private:
+    mutable std::mutex mutex;
+    std::deque<SlowQuery> entries;
+    size_t capacity;
+  };
+}
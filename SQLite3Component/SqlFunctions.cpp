@@ -0,0 +1,143 @@
+#include <cstdint>
+#include <regex>
+#include <vector>
+
+#include "SqlFunctions.h"
+
+namespace SQLite3 {
+  static const unsigned int replacementCharacter = 0xfffd;
+
+  static unsigned int decodeUtf8(const unsigned char*& current, const unsigned char* end) {
+    unsigned int codePoint = *current++;
+    if (codePoint < 0x80) {
+      return codePoint;
+    }
+
+    int continuationBytes;
+    unsigned int minimum;
+    if ((codePoint & 0xe0) == 0xc0) {
+      continuationBytes = 1;
+      codePoint &= 0x1f;
+      minimum = 0x80;
+    } else if ((codePoint & 0xf0) == 0xe0) {
+      continuationBytes = 2;
+      codePoint &= 0x0f;
+      minimum = 0x800;
+    } else if ((codePoint & 0xf8) == 0xf0) {
+      continuationBytes = 3;
+      codePoint &= 0x07;
+      minimum = 0x10000;
+    } else {
+      return replacementCharacter;
+    }
+
+    for (; continuationBytes; --continuationBytes) {
+      if (current == end || (*current & 0xc0) != 0x80) {
+        return replacementCharacter;
+      }
+      codePoint = (codePoint << 6) | (*current++ & 0x3f);
+    }
+
+    if (codePoint < minimum || codePoint > 0x10ffff || (codePoint >= 0xd800 && codePoint <= 0xdfff)) {
+      return replacementCharacter;
+    }
+    return codePoint;
+  }
+
+  // Never produces more UTF-16 code units than there are UTF-8 bytes
+  template <typename Unit>
+  static size_t utf8ToUtf16(const char* utf8String, size_t length, Unit* out) {
+    auto current = reinterpret_cast<const unsigned char*>(utf8String);
+    auto end = current + length;
+    Unit* start = out;
+    while (current != end) {
+      unsigned int codePoint = decodeUtf8(current, end);
+      if (codePoint >= 0x10000) {
+        codePoint -= 0x10000;
+        *out++ = static_cast<Unit>(0xd800 + (codePoint >> 10));
+        *out++ = static_cast<Unit>(0xdc00 + (codePoint & 0x3ff));
+      } else {
+        *out++ = static_cast<Unit>(codePoint);
+      }
+    }
+    return out - start;
+  }
+
+  std::wstring Utf8ToWString(const char* utf8String, size_t length) {
+    std::wstring result;
+    if (!length) {
+      return result;
+    }
+    result.resize(length);
+    if (sizeof(wchar_t) == 2) {
+      result.resize(utf8ToUtf16(utf8String, length, &result[0]));
+    } else {
+      auto current = reinterpret_cast<const unsigned char*>(utf8String);
+      auto end = current + length;
+      size_t count = 0;
+      while (current != end) {
+        result[count++] = static_cast<wchar_t>(decodeUtf8(current, end));
+      }
+      result.resize(count);
+    }
+    return result;
+  }
+
+  int CollateUtf8AsUtf16(Utf16Collation collation, void* data, int str1Length, const void* str1Data, int str2Length, const void* str2Data) {
+    const int stackUnits = 256;
+    uint16_t stackBuffer1[stackUnits];
+    uint16_t stackBuffer2[stackUnits];
+    std::vector<uint16_t> heapBuffer1;
+    std::vector<uint16_t> heapBuffer2;
+
+    uint16_t* buffer1 = stackBuffer1;
+    if (str1Length > stackUnits) {
+      heapBuffer1.resize(str1Length);
+      buffer1 = &heapBuffer1[0];
+    }
+    uint16_t* buffer2 = stackBuffer2;
+    if (str2Length > stackUnits) {
+      heapBuffer2.resize(str2Length);
+      buffer2 = &heapBuffer2[0];
+    }
+
+    size_t units1 = utf8ToUtf16(static_cast<const char*>(str1Data), str1Length, buffer1);
+    size_t units2 = utf8ToUtf16(static_cast<const char*>(str2Data), str2Length, buffer2);
+    // SQLite limits strings to 2 GB, so the byte counts fit into an int
+    return collation(data, static_cast<int>(units1 * sizeof(uint16_t)), buffer1, static_cast<int>(units2 * sizeof(uint16_t)), buffer2);
+  }
+
+  static void deleteRegex(void* regex) {
+    delete static_cast<std::wregex*>(regex);
+  }
+
+  void SqliteRegexUtf8(sqlite3_context* context, int, sqlite3_value** argv) {
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL || sqlite3_value_type(argv[1]) == SQLITE_NULL) {
+      sqlite3_result_null(context);
+      return;
+    }
+
+    auto regex = static_cast<std::wregex*>(sqlite3_get_auxdata(context, 0));
+    if (!regex) {
+      auto patternText = reinterpret_cast<const char*>(sqlite3_value_text(argv[0]));
+      std::wstring pattern = Utf8ToWString(patternText, sqlite3_value_bytes(argv[0]));
+      try {
+        regex = new std::wregex(pattern);
+      } catch (const std::regex_error& e) {
+        sqlite3_result_error(context, e.what(), -1);
+        return;
+      }
+      sqlite3_set_auxdata(context, 0, regex, deleteRegex);
+      // SQLite deletes the auxiliary data right away if it could not be stored
+      regex = static_cast<std::wregex*>(sqlite3_get_auxdata(context, 0));
+      if (!regex) {
+        sqlite3_result_error_nomem(context);
+        return;
+      }
+    }
+
+    auto searchText = reinterpret_cast<const char*>(sqlite3_value_text(argv[1]));
+    std::wstring text = Utf8ToWString(searchText, sqlite3_value_bytes(argv[1]));
+    sqlite3_result_int(context, std::regex_search(text.begin(), text.end(), *regex) ? 1 : 0);
+  }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  typedef int (*Utf16Collation)(void* data, int str1Length, const void* str1Data, int str2Length, const void* str2Data);
+
+  // Decodes UTF-8 into a wide string: UTF-16 where wchar_t has 16 bits,
+  // UTF-32 otherwise. Invalid sequences become U+FFFD.
+  std::wstring Utf8ToWString(const char* utf8String, size_t length);
+
+  // Calls a collation that expects UTF-16 operands (lengths in bytes) with
+  // UTF-8 operands. Short strings are converted on the stack.
+  int CollateUtf8AsUtf16(Utf16Collation collation, void* data, int str1Length, const void* str1Data, int str2Length, const void* str2Data);
+
+  // REGEXP(pattern, text) for UTF-8 connections. The compiled pattern is kept
+  // as auxiliary data so that it is compiled once per statement instead of once per row.
+  void SqliteRegexUtf8(sqlite3_context* context, int argc, sqlite3_value** argv);
+}
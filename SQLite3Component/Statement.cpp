@@ -1,7 +1,6 @@
 #include <assert.h>
 #include <collection.h>
 #include <sstream>
-#include <iomanip>
 
 #include <ppl.h>
 #include <ppltasks.h>
@@ -11,26 +10,61 @@
 
 #include "Statement.h"
 #include "Database.h"
+#include "BlobStream.h"
+#include "RowWriter.h"
 
 namespace SQLite3 {
-  StatementPtr Statement::Prepare(sqlite3* sqlite, Platform::String^ sql) {
-    sqlite3_stmt* statement;
-    int ret = sqlite3_prepare16(sqlite, sql->Data(), -1, &statement, 0);
+  StatementPtr Statement::Prepare(sqlite3* sqlite, Platform::String^ sql, UnlockWait* unlockWait) {
+    return StatementPtr(new Statement(PrepareStatement(sqlite, sql, unlockWait), true, unlockWait));
+  }
+
+  StatementPtr Statement::Prepare(sqlite3* sqlite, Platform::String^ sql, UnlockWait* unlockWait, StatementCache* cache) {
+    if (!cache) {
+      return Prepare(sqlite, sql, unlockWait);
+    }
+    std::string key = ToUtf8String(sql);
+    sqlite3_stmt* statement = cache->Acquire(key);
+    if (!statement) {
+      statement = PrepareStatement(sqlite, sql, unlockWait);
+    }
+    StatementPtr prepared(new Statement(statement, true, unlockWait));
+    prepared->cache = cache;
+    prepared->cacheKey = std::move(key);
+    return prepared;
+  }
+
+  sqlite3_stmt* Statement::PrepareStatement(sqlite3* sqlite, Platform::String^ sql, UnlockWait* unlockWait) {
+    sqlite3_stmt* statement = nullptr;
+    int ret = unlockWait ? unlockWait->Prepare16(sqlite, sql->Data(), &statement)
+                         : sqlite3_prepare16_v2(sqlite, sql->Data(), -1, &statement, 0);
 
     if (ret != SQLITE_OK) {
       sqlite3_finalize(statement);
       throwSQLiteError(ret, sql);
     }
+    return statement;
+  }
 
-    return StatementPtr(new Statement(statement));
+  StatementPtr Statement::Borrow(sqlite3_stmt* statement) {
+    return StatementPtr(new Statement(statement, false, nullptr));
   }
 
-  Statement::Statement(sqlite3_stmt* statement)
-    : statement(statement) {
+  Statement::Statement(sqlite3_stmt* statement, bool owned, UnlockWait* unlockWait)
+    : statement(statement)
+    , owned(owned)
+    , unlockWait(unlockWait)
+    , cache(nullptr)
+    , profiling(false)
+    , stepTicks(0)
+    , rowCount(0) {
   }
 
   Statement::~Statement() {
-    sqlite3_finalize(statement);
+    if (owned && cache) {
+      cache->Release(cacheKey, statement);
+    } else if (owned) {
+      sqlite3_finalize(statement);
+    }
   }
 
   void Statement::Bind(const SafeParameterVector& params) {
@@ -60,6 +94,7 @@ namespace SQLite3 {
 
   void Statement::BindParameter(int index, Platform::Object^ value) {
     int result;
+    int boundType = SQLITE_NULL;
     if (value == nullptr) {
       result = sqlite3_bind_null(statement, index);
     } else {
@@ -67,15 +102,19 @@ namespace SQLite3 {
       switch (typeCode) {
       case Platform::TypeCode::DateTime:
         result = sqlite3_bind_int64(statement, index, FoundationTimeToUnixCompatible(static_cast<Windows::Foundation::DateTime>(value)));
+        boundType = SQLITE_INTEGER;
         break;
       case Platform::TypeCode::Double:
         result = sqlite3_bind_double(statement, index, static_cast<double>(value));
+        boundType = SQLITE_FLOAT;
         break;
       case Platform::TypeCode::String:
         result = sqlite3_bind_text16(statement, index, static_cast<Platform::String^>(value)->Data(), -1, SQLITE_TRANSIENT);
+        boundType = SQLITE_TEXT;
         break;
       case Platform::TypeCode::Boolean:
         result = sqlite3_bind_int(statement, index, static_cast<Platform::Boolean>(value) ? 1 : 0);
+        boundType = SQLITE_INTEGER;
         break;
       case Platform::TypeCode::Int8:
       case Platform::TypeCode::Int16:
@@ -84,20 +123,27 @@ namespace SQLite3 {
       case Platform::TypeCode::UInt16:
       case Platform::TypeCode::UInt32:
         result = sqlite3_bind_int(statement, index, static_cast<int>(value));
+        boundType = SQLITE_INTEGER;
         break;
       case Platform::TypeCode::Int64:
       case Platform::TypeCode::UInt64:
         result = sqlite3_bind_int64(statement, index, static_cast<int64>(value));
+        boundType = SQLITE_INTEGER;
         break;
       case Platform::TypeCode::Object: {
+          auto zeroBlob = dynamic_cast<ZeroBlob^>(value);
           auto buffer= winrt_as<ABI::Windows::Storage::Streams::IBuffer>(value);
-          if (buffer) {
+          if (zeroBlob) {
+            result = sqlite3_bind_zeroblob(statement, index, zeroBlob->Size);
+            boundType = SQLITE_BLOB;
+          } else if (buffer) {
             auto byteBuffer= winrt_as<Windows::Storage::Streams::IBufferByteAccess>(value);
             byte* blob;
             byteBuffer->Buffer(&blob);
             uint32 length;
             buffer->get_Length(&length);
             result = sqlite3_bind_blob(statement, index, blob, length, 0);
+            boundType = SQLITE_BLOB;
           } else {
             result = SQLITE_MISMATCH;
           }
@@ -117,6 +163,12 @@ namespace SQLite3 {
               << value->GetType()->FullName->Data();
       throwSQLiteError(result, ref new Platform::String(message.str().c_str()));
     }
+    if (profiling) {
+      if (parameterTypes.size() < static_cast<size_t>(index)) {
+        parameterTypes.resize(index, SQLITE_NULL);
+      }
+      parameterTypes[index - 1] = boundType;
+    }
   }
 
   int Statement::BindParameterCount() {
@@ -132,38 +184,43 @@ namespace SQLite3 {
   }
 
   Platform::String^ Statement::One() {
-    std::wostringstream result;
     if (Step() == SQLITE_ROW) {
-      GetRow(result);
-      return ref new Platform::String(result.str().c_str());
+      std::string result;
+      RowWriter(statement).WriteRow(result);
+      return ToPlatformString(result.data(), static_cast<unsigned int>(result.size()));
     } else {
       return nullptr;
     }
   }
 
   Platform::String^ Statement::All() {
-    std::wostringstream result;
-    result << L"[";
-    auto stepResult = Step();
-    bool hasData = (stepResult == SQLITE_ROW);
-    while (stepResult == SQLITE_ROW) {
-      GetRow(result);
-      result << L",";
-      stepResult = Step();
+    RowWriter writer(statement);
+    std::string result("[");
+    for (auto stepResult = Step(); stepResult == SQLITE_ROW; stepResult = Step()) {
+      if (result.size() > 1) {
+        result.push_back(',');
+      }
+      writer.WriteRow(result);
     }
-    if (hasData) {
-      std::streamoff pos = result.tellp();
-      result.seekp(pos-1);
+    result.push_back(']');
+    return ToPlatformString(result.data(), static_cast<unsigned int>(result.size()));
+  }
+
+  std::shared_ptr<ResultArena> Statement::Collect() {
+    std::shared_ptr<ResultArena> arena(new ResultArena(statement));
+    while (Step() == SQLITE_ROW) {
+      arena->AppendRow(statement);
     }
-    result << L"]";
-    return ref new Platform::String(result.str().c_str());
+    return arena;
   }
 
   void Statement::Each(EachCallback^ callback, Windows::UI::Core::CoreDispatcher^ dispatcher) {
+    RowWriter writer(statement);
+    std::string output;
     while (Step() == SQLITE_ROW) {
-      std::wostringstream output;
-      GetRow(output);
-      auto row = ref new Platform::String(output.str().c_str());
+      output.clear();
+      writer.WriteRow(output);
+      auto row = ToPlatformString(output.data(), static_cast<unsigned int>(output.size()));
       auto callbackTask = Concurrency::task<void>(
         dispatcher->RunAsync(Windows::UI::Core::CoreDispatcherPriority::Normal, 
         ref new Windows::UI::Core::DispatchedHandler([row, callback]() {
@@ -174,9 +231,42 @@ namespace SQLite3 {
     }
   }
 
+  long long Statement::Export(ExportFormat format, ExportSink& sink, ExportProgress* progress) {
+    const long long reportInterval = 10000;
+    ExportWriter writer(statement, format, sink);
+    while (Step() == SQLITE_ROW) {
+      if (!writer.WriteRow()) {
+        throwSQLiteError(SQLITE_IOERR, ref new Platform::String(L"Could not write export file"));
+      }
+      if (progress && writer.Rows() % reportInterval == 0 && !progress->Report(writer.Rows())) {
+        return -1;
+      }
+    }
+    if (!writer.Finish()) {
+      throwSQLiteError(SQLITE_IOERR, ref new Platform::String(L"Could not write export file"));
+    }
+    if (progress && writer.Rows() % reportInterval != 0) {
+      progress->Report(writer.Rows());
+    }
+    return writer.Rows();
+  }
 
   int Statement::Step() {
-    int ret = sqlite3_step(statement);
+    LARGE_INTEGER start, end;
+    if (profiling) {
+      QueryPerformanceCounter(&start);
+    }
+
+    // A statement that returned rows can not start over after waiting
+    int ret = unlockWait ? unlockWait->Step(statement, rowCount == 0) : sqlite3_step(statement);
+
+    if (profiling) {
+      QueryPerformanceCounter(&end);
+      stepTicks += end.QuadPart - start.QuadPart;
+    }
+    if (ret == SQLITE_ROW) {
+      ++rowCount;
+    }
   
     if (ret != SQLITE_ROW && ret != SQLITE_DONE) {
       throwSQLiteError(ret, ref new Platform::String(L"Could not step statement"));
@@ -189,67 +279,53 @@ namespace SQLite3 {
     return sqlite3_stmt_readonly(statement) != 0;
   }
 
-  void writeEscaped(const std::wstring& s, std::wostringstream& out) {
-    out << L'"';
-    for (std::wstring::const_iterator i = s.begin(), end = s.end(); i != end; ++i) {
-      wchar_t c = *i;
-      if (L' ' <= c && c <= L'~' && c != L'\\' && c != L'"') {
-        out << *i;
-      }
-      else {
-        out << L'\\';
-        switch(c) {
-        case L'"':  out << L'"';  break;
-        case L'\\': out << L'\\'; break;
-        case L'\t': out << L't';  break;
-        case L'\r': out << L'r';  break;
-        case L'\n': out << L'n';  break;
-        default:
-          out << L'u';
-          out << std::setw(4) << std::setfill(L'0') << std::hex << (WORD)c;
-        }
-      }
-    }
-    out << L'"';
+  void Statement::EnableProfiling() {
+    profiling = true;
   }
 
-  void Statement::GetRow(std::wostringstream& outstream) {
-    outstream << L'{';
-    int columnCount = ColumnCount();
-    for (int i = 0; i < columnCount; ++i) {
-      auto colName = static_cast<const wchar_t*>(sqlite3_column_name16(statement, i));
-      auto colType = ColumnType(i);      
-      outstream << L'"' << colName  << L"\":";
-      switch (colType) {
-      case SQLITE_TEXT: {
-          auto colValue = static_cast<const wchar_t*>(sqlite3_column_text16(statement, i));      
-          writeEscaped(colValue, outstream);
-        }
-        break;
-      case SQLITE_INTEGER:
-      case SQLITE_FLOAT: {
-          auto colValue = static_cast<const wchar_t*>(sqlite3_column_text16(statement, i));      
-          outstream << colValue;
-        }
-        break;
-      case SQLITE_BLOB: {
-          auto blob = (byte*)sqlite3_column_blob(statement, i);
-          const int blobSize = sqlite3_column_bytes(statement, i);
-          Platform::ArrayReference<uint8> blobArray(blob, blobSize);
-          using Windows::Security::Cryptography::CryptographicBuffer;
-          auto base64Text = CryptographicBuffer::EncodeToBase64String(CryptographicBuffer::CreateFromByteArray(blobArray));    
-          outstream << L'"' << base64Text->Data() << L'"';
+  double Statement::StepMilliseconds() const {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return stepTicks * 1000.0 / frequency.QuadPart;
+  }
+
+  int Statement::RowCount() const {
+    return rowCount;
+  }
+
+  const std::vector<int>& Statement::ParameterTypes() const {
+    return parameterTypes;
+  }
+
+  // Statements prepared without _v2 keep no SQL text
+  std::string Statement::Sql() const {
+    const char* sql = sqlite3_sql(statement);
+    return sql ? sql : "";
+  }
+
+  // Runs EXPLAIN QUERY PLAN for this statement's SQL through a separate
+  // statement so the state and bindings of this one are left untouched.
+  // Failures are swallowed, the plan is diagnostic only.
+  std::vector<std::string> Statement::QueryPlan() const {
+    std::vector<std::string> plan;
+    const char* text = sqlite3_sql(statement);
+    if (!text) {
+      return plan;
+    }
+    std::string sql("EXPLAIN QUERY PLAN ");
+    sql += text;
+
+    sqlite3_stmt* explain;
+    if (sqlite3_prepare_v2(sqlite3_db_handle(statement), sql.c_str(), -1, &explain, nullptr) == SQLITE_OK) {
+      while (sqlite3_step(explain) == SQLITE_ROW) {
+        auto detail = reinterpret_cast<const char*>(sqlite3_column_text(explain, 3));
+        if (detail) {
+          plan.push_back(detail);
         }
-        break;
-      case SQLITE_NULL:
-        outstream << L"null";
-        break;
       }
-      outstream << L',';
     }
-    std::streamoff pos = outstream.tellp();
-    outstream.seekp(pos - 1l);
-    outstream << L'}';
+    sqlite3_finalize(explain);
+    return plan;
   }
 
   int Statement::ColumnCount() {
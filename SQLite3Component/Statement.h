@@ -2,11 +2,22 @@
 
 #include "sqlite3.h"
 #include "Common.h"
+#include "Exporter.h"
+#include "ResultArena.h"
+#include "StatementCache.h"
+#include "UnlockWait.h"
 
 namespace SQLite3 {
   class Statement {
   public:
-    static StatementPtr Prepare(sqlite3* sqlite, Platform::String^ sql);
+    // Statements prepared with an UnlockWait wait for the table locks of
+    // other connections of a shared cache instead of failing
+    static StatementPtr Prepare(sqlite3* sqlite, Platform::String^ sql, UnlockWait* unlockWait);
+    // Takes the statement from the cache when it holds one for the SQL and
+    // hands it back there instead of finalizing it
+    static StatementPtr Prepare(sqlite3* sqlite, Platform::String^ sql, UnlockWait* unlockWait, StatementCache* cache);
+    // Wraps a statement that stays owned by the caller, e.g. to bind it
+    static StatementPtr Borrow(sqlite3_stmt* statement);
     ~Statement();
 
     void Bind(const SafeParameterVector& params);
@@ -15,19 +26,31 @@ namespace SQLite3 {
     void Run();
     Platform::String^ One();
     Platform::String^ All();
+    std::shared_ptr<ResultArena> Collect();
     void Each(EachCallback^ callback, Windows::UI::Core::CoreDispatcher^ dispatcher);
+    // Returns the number of rows written, or -1 when the progress canceled
+    // the export
+    long long Export(ExportFormat format, ExportSink& sink, ExportProgress* progress);
 
     bool ReadOnly() const;
 
+    void EnableProfiling();
+    double StepMilliseconds() const;
+    int RowCount() const;
+    const std::vector<int>& ParameterTypes() const;
+    std::string Sql() const;
+    std::vector<std::string> QueryPlan() const;
+
   private:
-    Statement(sqlite3_stmt* statement);
+    Statement(sqlite3_stmt* statement, bool owned, UnlockWait* unlockWait);
+
+    static sqlite3_stmt* PrepareStatement(sqlite3* sqlite, Platform::String^ sql, UnlockWait* unlockWait);
 
     void BindParameter(int index, Platform::Object^ value);
     int BindParameterCount();
     std::wstring BindParameterName(int index);
     
     int Step();
-    void GetRow(std::wostringstream& row);
     
     int ColumnCount();
     int ColumnType(int index);
@@ -35,5 +58,14 @@ namespace SQLite3 {
   private:
     HANDLE dbLockMutex;
     sqlite3_stmt* statement;
+    bool owned;
+    UnlockWait* unlockWait;
+    StatementCache* cache;
+    std::string cacheKey;
+
+    bool profiling;
+    long long stepTicks;
+    int rowCount;
+    std::vector<int> parameterTypes;
   };
 }
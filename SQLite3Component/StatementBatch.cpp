@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <collection.h>
+#include <iterator>
+
+#include "StatementBatch.h"
+#include "Statement.h"
+
+namespace SQLite3 {
+  StatementBatch::StatementBatch()
+    : entries(std::make_shared<Entries>()) {
+  }
+
+  void StatementBatch::AddVector(Platform::String^ sql, ParameterVector^ params) {
+    SafeParameterVector values;
+    if (params) {
+      std::copy(begin(params), end(params), std::back_inserter(values));
+    }
+    entries->sql.push_back(ToUtf8String(sql));
+    entries->vectors.push_back(values);
+    entries->maps.push_back(nullptr);
+  }
+
+  void StatementBatch::AddMap(Platform::String^ sql, ParameterMap^ params) {
+    entries->sql.push_back(ToUtf8String(sql));
+    entries->vectors.push_back(SafeParameterVector());
+    entries->maps.push_back(params);
+  }
+
+  std::shared_ptr<StatementBatch::Entries> StatementBatch::Snapshot() {
+    return std::make_shared<Entries>(*entries);
+  }
+
+  StatementBatchBinder::StatementBatchBinder(std::shared_ptr<StatementBatch::Entries> entries)
+    : entries(entries) {
+  }
+
+  int StatementBatchBinder::Bind(size_t entry, int offset, sqlite3_stmt* statement) {
+    StatementPtr borrowed = Statement::Borrow(statement);
+    ParameterMap^ map = entries->maps[entry];
+    if (map) {
+      borrowed->Bind(map);
+    } else {
+      // Every statement of the entry takes the next of its positional values
+      const SafeParameterVector& values = entries->vectors[entry];
+      size_t first = std::min(static_cast<size_t>(offset), values.size());
+      size_t last = std::min(first + sqlite3_bind_parameter_count(statement), values.size());
+      borrowed->Bind(SafeParameterVector(values.begin() + first, values.begin() + last));
+    }
+    return SQLITE_OK;
+  }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Batch.h"
+#include "Common.h"
+
+namespace SQLite3 {
+  // Statements and their parameters collected for Database::ExecuteManyAsync
+  public ref class StatementBatch sealed {
+  public:
+    StatementBatch();
+
+    void AddVector(Platform::String^ sql, ParameterVector^ params);
+    void AddMap(Platform::String^ sql, ParameterMap^ params);
+
+    property unsigned int Size {
+      unsigned int get() {
+        return static_cast<unsigned int>(entries->sql.size());
+      };
+    }
+
+  internal:
+    struct Entries {
+      std::vector<std::string> sql;
+      std::vector<SafeParameterVector> vectors;
+      std::vector<ParameterMap^> maps;
+    };
+
+    // A copy of the entries, later additions do not affect a running batch
+    std::shared_ptr<Entries> Snapshot();
+
+  private:
+    std::shared_ptr<Entries> entries;
+  };
+
+  // Binds the parameters of a StatementBatch entry by position or by name
+  class StatementBatchBinder : public BatchBinder {
+  public:
+    explicit StatementBatchBinder(std::shared_ptr<StatementBatch::Entries> entries);
+
+    int Bind(size_t entry, int offset, sqlite3_stmt* statement);
+
+  private:
+    std::shared_ptr<StatementBatch::Entries> entries;
+  };
+}
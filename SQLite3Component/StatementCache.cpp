@@ -0,0 +1,105 @@
+#include "StatementCache.h"
+
+namespace SQLite3 {
+  StatementCache::StatementCache(size_t capacity)
+    : capacity(capacity)
+    , cacheWrites(true)
+    , hits(0)
+    , misses(0)
+    , evictions(0) {
+  }
+
+  StatementCache::~StatementCache() {
+    Clear();
+  }
+
+  sqlite3_stmt* StatementCache::Acquire(const std::string& sql) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = index.find(sql);
+    if (found == index.end()) {
+      ++misses;
+      return nullptr;
+    }
+    ++hits;
+    sqlite3_stmt* statement = found->second->second;
+    entries.erase(found->second);
+    index.erase(found);
+    return statement;
+  }
+
+  void StatementCache::Release(const std::string& sql, sqlite3_stmt* statement) {
+    // The result of the reset is the error of the last step, which the
+    // caller already saw
+    sqlite3_reset(statement);
+    sqlite3_clear_bindings(statement);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      bool keep = cacheWrites || sqlite3_stmt_readonly(statement);
+      if (keep && capacity > 0 && index.find(sql) == index.end()) {
+        entries.push_front(std::make_pair(sql, statement));
+        index[sql] = entries.begin();
+        evictLocked();
+        return;
+      }
+    }
+    // Disabled, a write that is not cached or another use of the same SQL
+    // was released first
+    sqlite3_finalize(statement);
+  }
+
+  void StatementCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+      sqlite3_finalize(entry->second);
+    }
+    entries.clear();
+    index.clear();
+  }
+
+  size_t StatementCache::Capacity() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return capacity;
+  }
+
+  void StatementCache::SetCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->capacity = capacity;
+    evictLocked();
+  }
+
+  void StatementCache::SetCacheWrites(bool cacheWrites) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->cacheWrites = cacheWrites;
+    if (cacheWrites) {
+      return;
+    }
+    for (auto entry = entries.begin(); entry != entries.end();) {
+      if (sqlite3_stmt_readonly(entry->second)) {
+        ++entry;
+        continue;
+      }
+      sqlite3_finalize(entry->second);
+      index.erase(entry->first);
+      entry = entries.erase(entry);
+    }
+  }
+
+  StatementCacheCounters StatementCache::Counters() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    StatementCacheCounters counters;
+    counters.hits = hits;
+    counters.misses = misses;
+    counters.evictions = evictions;
+    counters.entries = static_cast<long long>(entries.size());
+    return counters;
+  }
+
+  void StatementCache::evictLocked() {
+    while (entries.size() > capacity) {
+      sqlite3_finalize(entries.back().second);
+      index.erase(entries.back().first);
+      entries.pop_back();
+      ++evictions;
+    }
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  struct StatementCacheCounters {
+    long long hits;
+    long long misses;
+    long long evictions;
+    long long entries;
+  };
+
+  // Prepared statements of one connection kept for reuse, keyed by their
+  // SQL. A statement is taken out of the cache while it is in use, so the
+  // same SQL running twice at the same time gets a statement of its own.
+  // Least recently used statements are finalized once the cache is full.
+  class StatementCache {
+  public:
+    explicit StatementCache(size_t capacity);
+    ~StatementCache();
+
+    // Returns the cached statement for the SQL, or nullptr if there is none
+    sqlite3_stmt* Acquire(const std::string& sql);
+    // Resets the statement and keeps it for the next Acquire of the SQL
+    void Release(const std::string& sql, sqlite3_stmt* statement);
+    // Finalizes all statements, the connection can only be closed once
+    // they are gone
+    void Clear();
+
+    size_t Capacity() const;
+    void SetCapacity(size_t capacity);
+
+    // Off while a ResultCache is attached: it learns the tables a statement
+    // writes only while the statement is prepared, so a reused write would
+    // not invalidate the results. Turning it off finalizes the cached
+    // writes, later ones are finalized on Release.
+    void SetCacheWrites(bool cacheWrites);
+
+    StatementCacheCounters Counters() const;
+
+  private:
+    StatementCache(const StatementCache&);
+    StatementCache& operator=(const StatementCache&);
+
+    typedef std::list<std::pair<std::string, sqlite3_stmt*>> Entries;
+
+    void evictLocked();
+
+    mutable std::mutex mutex;
+    // Most recently used first
+    Entries entries;
+    std::unordered_map<std::string, Entries::iterator> index;
+    size_t capacity;
+    bool cacheWrites;
+    long long hits;
+    long long misses;
+    long long evictions;
+  };
+}
@@ -0,0 +1,319 @@
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <sstream>
+
+#include "TempStore.h"
+
+namespace SQLite3 {
+  const char* const TempStore::VfsName = "tempstore";
+
+  namespace {
+    const int temporaryFiles = SQLITE_OPEN_TEMP_DB | SQLITE_OPEN_TEMP_JOURNAL | SQLITE_OPEN_SUBJOURNAL | SQLITE_OPEN_TRANSIENT_DB;
+
+    sqlite3_vfs tempVfs;
+    sqlite3_vfs* baseVfs = nullptr;
+    // One table per version of the base file's io methods
+    sqlite3_io_methods methods[3];
+    std::mutex installMutex;
+    std::atomic<bool> installed(false);
+
+    std::atomic<long long> spillCount(0);
+    std::atomic<long long> spilledByteCount(0);
+    std::mutex sizeMutex;
+    long long liveByteCount = 0;
+    long long peakByteCount = 0;
+
+    struct TempFile {
+      sqlite3_file base;
+      sqlite3_file* real;
+      sqlite3_int64 size;
+      bool written;
+    };
+
+    inline sqlite3_file* realFile(sqlite3_file* file) {
+      return reinterpret_cast<TempFile*>(file)->real;
+    }
+
+    void resize(TempFile* file, sqlite3_int64 size) {
+      std::lock_guard<std::mutex> lock(sizeMutex);
+      liveByteCount += size - file->size;
+      peakByteCount = std::max(peakByteCount, liveByteCount);
+      file->size = size;
+    }
+
+    int tempClose(sqlite3_file* file) {
+      TempFile* temp = reinterpret_cast<TempFile*>(file);
+      resize(temp, 0);
+      return temp->real->pMethods->xClose(temp->real);
+    }
+
+    int tempRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset) {
+      return realFile(file)->pMethods->xRead(realFile(file), buffer, amount, offset);
+    }
+
+    int tempWrite(sqlite3_file* file, const void* buffer, int amount, sqlite3_int64 offset) {
+      TempFile* temp = reinterpret_cast<TempFile*>(file);
+      int result = temp->real->pMethods->xWrite(temp->real, buffer, amount, offset);
+      if (result != SQLITE_OK) {
+        return result;
+      }
+      // SQLite opens temporary files lazily, the first write is the spill
+      if (!temp->written) {
+        temp->written = true;
+        ++spillCount;
+      }
+      spilledByteCount += amount;
+      if (offset + amount > temp->size) {
+        resize(temp, offset + amount);
+      }
+      return SQLITE_OK;
+    }
+
+    int tempTruncate(sqlite3_file* file, sqlite3_int64 size) {
+      TempFile* temp = reinterpret_cast<TempFile*>(file);
+      int result = temp->real->pMethods->xTruncate(temp->real, size);
+      if (result == SQLITE_OK && size < temp->size) {
+        resize(temp, size);
+      }
+      return result;
+    }
+
+    int tempSync(sqlite3_file* file, int flags) {
+      return realFile(file)->pMethods->xSync(realFile(file), flags);
+    }
+
+    int tempFileSize(sqlite3_file* file, sqlite3_int64* size) {
+      return realFile(file)->pMethods->xFileSize(realFile(file), size);
+    }
+
+    int tempLock(sqlite3_file* file, int lock) {
+      return realFile(file)->pMethods->xLock(realFile(file), lock);
+    }
+
+    int tempUnlock(sqlite3_file* file, int lock) {
+      return realFile(file)->pMethods->xUnlock(realFile(file), lock);
+    }
+
+    int tempCheckReservedLock(sqlite3_file* file, int* reserved) {
+      return realFile(file)->pMethods->xCheckReservedLock(realFile(file), reserved);
+    }
+
+    int tempFileControl(sqlite3_file* file, int op, void* argument) {
+      return realFile(file)->pMethods->xFileControl(realFile(file), op, argument);
+    }
+
+    int tempSectorSize(sqlite3_file* file) {
+      return realFile(file)->pMethods->xSectorSize(realFile(file));
+    }
+
+    int tempDeviceCharacteristics(sqlite3_file* file) {
+      return realFile(file)->pMethods->xDeviceCharacteristics(realFile(file));
+    }
+
+    int tempShmMap(sqlite3_file* file, int region, int size, int extend, void volatile** memory) {
+      return realFile(file)->pMethods->xShmMap(realFile(file), region, size, extend, memory);
+    }
+
+    int tempShmLock(sqlite3_file* file, int offset, int count, int flags) {
+      return realFile(file)->pMethods->xShmLock(realFile(file), offset, count, flags);
+    }
+
+    void tempShmBarrier(sqlite3_file* file) {
+      realFile(file)->pMethods->xShmBarrier(realFile(file));
+    }
+
+    int tempShmUnmap(sqlite3_file* file, int deleteFlag) {
+      return realFile(file)->pMethods->xShmUnmap(realFile(file), deleteFlag);
+    }
+
+    int tempFetch(sqlite3_file* file, sqlite3_int64 offset, int amount, void** page) {
+      return realFile(file)->pMethods->xFetch(realFile(file), offset, amount, page);
+    }
+
+    int tempUnfetch(sqlite3_file* file, sqlite3_int64 offset, void* page) {
+      return realFile(file)->pMethods->xUnfetch(realFile(file), offset, page);
+    }
+
+    void fillMethods() {
+      for (int i = 0; i < 3; ++i) {
+        sqlite3_io_methods& table = methods[i];
+        table.iVersion = i + 1;
+        table.xClose = tempClose;
+        table.xRead = tempRead;
+        table.xWrite = tempWrite;
+        table.xTruncate = tempTruncate;
+        table.xSync = tempSync;
+        table.xFileSize = tempFileSize;
+        table.xLock = tempLock;
+        table.xUnlock = tempUnlock;
+        table.xCheckReservedLock = tempCheckReservedLock;
+        table.xFileControl = tempFileControl;
+        table.xSectorSize = tempSectorSize;
+        table.xDeviceCharacteristics = tempDeviceCharacteristics;
+        table.xShmMap = i >= 1 ? tempShmMap : nullptr;
+        table.xShmLock = i >= 1 ? tempShmLock : nullptr;
+        table.xShmBarrier = i >= 1 ? tempShmBarrier : nullptr;
+        table.xShmUnmap = i >= 1 ? tempShmUnmap : nullptr;
+        table.xFetch = i >= 2 ? tempFetch : nullptr;
+        table.xUnfetch = i >= 2 ? tempUnfetch : nullptr;
+      }
+    }
+
+    int tempOpen(sqlite3_vfs*, const char* name, sqlite3_file* file, int flags, int* outFlags) {
+      // Other files are opened by the base VFS in place, its methods are
+      // called without going through this VFS
+      if (!(flags & temporaryFiles)) {
+        return baseVfs->xOpen(baseVfs, name, file, flags, outFlags);
+      }
+      TempFile* temp = reinterpret_cast<TempFile*>(file);
+      temp->real = reinterpret_cast<sqlite3_file*>(temp + 1);
+      temp->size = 0;
+      temp->written = false;
+      int result = baseVfs->xOpen(baseVfs, name, temp->real, flags, outFlags);
+      if (result != SQLITE_OK) {
+        if (temp->real->pMethods) {
+          temp->real->pMethods->xClose(temp->real);
+        }
+        file->pMethods = nullptr;
+        return result;
+      }
+      int version = std::min(std::max(temp->real->pMethods->iVersion, 1), 3);
+      file->pMethods = &methods[version - 1];
+      return SQLITE_OK;
+    }
+
+    int tempDelete(sqlite3_vfs*, const char* name, int syncDirectory) {
+      return baseVfs->xDelete(baseVfs, name, syncDirectory);
+    }
+
+    int tempAccess(sqlite3_vfs*, const char* name, int flags, int* result) {
+      return baseVfs->xAccess(baseVfs, name, flags, result);
+    }
+
+    int tempFullPathname(sqlite3_vfs*, const char* name, int size, char* out) {
+      return baseVfs->xFullPathname(baseVfs, name, size, out);
+    }
+
+    void* tempDlOpen(sqlite3_vfs*, const char* path) {
+      return baseVfs->xDlOpen(baseVfs, path);
+    }
+
+    void tempDlError(sqlite3_vfs*, int size, char* message) {
+      baseVfs->xDlError(baseVfs, size, message);
+    }
+
+    void (*tempDlSym(sqlite3_vfs*, void* library, const char* symbol))(void) {
+      return baseVfs->xDlSym(baseVfs, library, symbol);
+    }
+
+    void tempDlClose(sqlite3_vfs*, void* library) {
+      baseVfs->xDlClose(baseVfs, library);
+    }
+
+    int tempRandomness(sqlite3_vfs*, int size, char* out) {
+      return baseVfs->xRandomness(baseVfs, size, out);
+    }
+
+    int tempSleep(sqlite3_vfs*, int microseconds) {
+      return baseVfs->xSleep(baseVfs, microseconds);
+    }
+
+    int tempCurrentTime(sqlite3_vfs*, double* now) {
+      return baseVfs->xCurrentTime(baseVfs, now);
+    }
+
+    int tempGetLastError(sqlite3_vfs*, int size, char* message) {
+      return baseVfs->xGetLastError(baseVfs, size, message);
+    }
+
+    int tempCurrentTimeInt64(sqlite3_vfs*, sqlite3_int64* now) {
+      return baseVfs->xCurrentTimeInt64(baseVfs, now);
+    }
+
+    int tempSetSystemCall(sqlite3_vfs*, const char* name, sqlite3_syscall_ptr call) {
+      return baseVfs->xSetSystemCall(baseVfs, name, call);
+    }
+
+    sqlite3_syscall_ptr tempGetSystemCall(sqlite3_vfs*, const char* name) {
+      return baseVfs->xGetSystemCall(baseVfs, name);
+    }
+
+    const char* tempNextSystemCall(sqlite3_vfs*, const char* name) {
+      return baseVfs->xNextSystemCall(baseVfs, name);
+    }
+  }
+
+  int ApplyTempStoreBudget(sqlite3* db, long long budgetBytes) {
+    if (budgetBytes <= 0) {
+      return sqlite3_exec(db, "PRAGMA temp_store = MEMORY", nullptr, nullptr, nullptr);
+    }
+    // The temporary database's cache holds the pages of temporary tables
+    // and indexes until it is full. Sorts write their runs to files once
+    // they outgrow the main database's cache.
+    std::ostringstream pragmas;
+    pragmas << "PRAGMA temp_store = FILE; PRAGMA temp.cache_size = -" << std::max(1LL, budgetBytes / 1024);
+    return sqlite3_exec(db, pragmas.str().c_str(), nullptr, nullptr, nullptr);
+  }
+
+  int TempStore::Install() {
+    std::lock_guard<std::mutex> lock(installMutex);
+    if (installed) {
+      return SQLITE_OK;
+    }
+    sqlite3_vfs* base = sqlite3_vfs_find(nullptr);
+    if (!base) {
+      return SQLITE_ERROR;
+    }
+    baseVfs = base;
+    fillMethods();
+
+    tempVfs.iVersion = std::min(base->iVersion, 3);
+    tempVfs.szOsFile = static_cast<int>(sizeof(TempFile)) + base->szOsFile;
+    tempVfs.mxPathname = base->mxPathname;
+    tempVfs.pNext = nullptr;
+    tempVfs.zName = VfsName;
+    tempVfs.pAppData = nullptr;
+    tempVfs.xOpen = tempOpen;
+    tempVfs.xDelete = tempDelete;
+    tempVfs.xAccess = tempAccess;
+    tempVfs.xFullPathname = tempFullPathname;
+    tempVfs.xDlOpen = base->xDlOpen ? tempDlOpen : nullptr;
+    tempVfs.xDlError = base->xDlError ? tempDlError : nullptr;
+    tempVfs.xDlSym = base->xDlSym ? tempDlSym : nullptr;
+    tempVfs.xDlClose = base->xDlClose ? tempDlClose : nullptr;
+    tempVfs.xRandomness = tempRandomness;
+    tempVfs.xSleep = tempSleep;
+    tempVfs.xCurrentTime = tempCurrentTime;
+    tempVfs.xGetLastError = tempGetLastError;
+    tempVfs.xCurrentTimeInt64 = base->iVersion >= 2 ? tempCurrentTimeInt64 : nullptr;
+    tempVfs.xSetSystemCall = base->iVersion >= 3 ? tempSetSystemCall : nullptr;
+    tempVfs.xGetSystemCall = base->iVersion >= 3 ? tempGetSystemCall : nullptr;
+    tempVfs.xNextSystemCall = base->iVersion >= 3 ? tempNextSystemCall : nullptr;
+
+    int result = sqlite3_vfs_register(&tempVfs, 1);
+    installed = result == SQLITE_OK;
+    return result;
+  }
+
+  bool TempStore::Installed() {
+    return installed;
+  }
+
+  TempStoreCounters TempStore::Counters() {
+    TempStoreCounters counters;
+    counters.spills = spillCount;
+    counters.spilledBytes = spilledByteCount;
+    std::lock_guard<std::mutex> lock(sizeMutex);
+    counters.liveBytes = liveByteCount;
+    counters.peakBytes = peakByteCount;
+    return counters;
+  }
+
+  void TempStore::ResetCounters() {
+    spillCount = 0;
+    spilledByteCount = 0;
+    std::lock_guard<std::mutex> lock(sizeMutex);
+    peakByteCount = liveByteCount;
+  }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  struct TempStoreCounters {
+    // Temporary files SQLite wrote to because a sort, a temporary table or a
+    // statement journal outgrew memory
+    long long spills;
+    long long spilledBytes;
+    // Size of the temporary files that are open right now, and the most
+    // they held at once
+    long long liveBytes;
+    long long peakBytes;
+  };
+
+  // Keeps temporary data of a connection in memory up to budgetBytes and
+  // spills the rest to temporary files. A budget of zero keeps everything
+  // in memory, which is also the default of the component's build. Like any
+  // change of PRAGMA temp_store, this drops the temporary tables of the
+  // connection and fails inside a transaction once it has some.
+  int ApplyTempStoreBudget(sqlite3* db, long long budgetBytes);
+
+  // A VFS that counts what the temporary files of all connections hold.
+  // It becomes the default VFS on top of the previous default one and
+  // passes all other files straight through.
+  class TempStore {
+  public:
+    static const char* const VfsName;
+
+    // Must run after the library was configured, returns the
+    // sqlite3_vfs_register result
+    static int Install();
+    static bool Installed();
+
+    static TempStoreCounters Counters();
+    static void ResetCounters();
+  };
+}
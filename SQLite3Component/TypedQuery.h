@@ -0,0 +1,305 @@
+#pragma once
+
+// Typed C++17 access to a connection for native consumers that do not want
+// to go through the C++/CX surface and its JSON rows:
+//
+//   SQLite3::TypedDatabase db(sqlite);
+//   for (auto [id, name, price] : db.Query<int64_t, std::string_view, double>(
+//          "SELECT id, name, price FROM item WHERE price > ?", 2.5)) {
+//     ...
+//   }
+//
+// Header only and independent of the rest of the component, which is built
+// with the Visual Studio 2012 toolset and can not include it.
+
+#include <climits>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  class QueryError : public std::runtime_error {
+  public:
+    QueryError(int resultCode, const std::string& message)
+      : std::runtime_error(message)
+      , resultCode(resultCode) {
+    }
+
+    int ResultCode() const {
+      return resultCode;
+    }
+
+  private:
+    int resultCode;
+  };
+
+  // Bytes of a BLOB, bound as is and read without copying. Read values are
+  // valid until the statement steps to the next row.
+  struct BlobView {
+    const void* data;
+    size_t size;
+  };
+
+  // Owns a prepared statement, can be moved but not copied
+  class StatementHandle {
+  public:
+    StatementHandle() noexcept : statement(nullptr) {}
+    explicit StatementHandle(sqlite3_stmt* statement) noexcept : statement(statement) {}
+    StatementHandle(StatementHandle&& other) noexcept : statement(std::exchange(other.statement, nullptr)) {}
+    StatementHandle& operator=(StatementHandle&& other) noexcept {
+      if (this != &other) {
+        sqlite3_finalize(statement);
+        statement = std::exchange(other.statement, nullptr);
+      }
+      return *this;
+    }
+    StatementHandle(const StatementHandle&) = delete;
+    StatementHandle& operator=(const StatementHandle&) = delete;
+    ~StatementHandle() {
+      sqlite3_finalize(statement);
+    }
+
+    sqlite3_stmt* Get() const noexcept {
+      return statement;
+    }
+
+  private:
+    sqlite3_stmt* statement;
+  };
+
+  namespace Typed {
+    template <typename T>
+    struct IsOptional : std::false_type {};
+    template <typename T>
+    struct IsOptional<std::optional<T>> : std::true_type {};
+
+    template <typename T>
+    constexpr bool alwaysFalse = false;
+
+    // Column types that point into the statement instead of owning the value
+    template <typename T>
+    struct IsView : std::bool_constant<std::is_same_v<T, std::string_view> || std::is_same_v<T, BlobView>> {};
+    template <typename T>
+    struct IsView<std::optional<T>> : IsView<T> {};
+
+    [[noreturn]] inline void throwError(sqlite3* db, int resultCode) {
+      throw QueryError(resultCode, sqlite3_errmsg(db));
+    }
+
+    template <typename T>
+    int bindValue(sqlite3_stmt* statement, int index, const T& value) {
+      using Type = std::decay_t<T>;
+      if constexpr (std::is_same_v<Type, std::nullptr_t> || std::is_same_v<Type, std::nullopt_t>) {
+        return sqlite3_bind_null(statement, index);
+      } else if constexpr (IsOptional<Type>::value) {
+        return value ? bindValue(statement, index, *value) : sqlite3_bind_null(statement, index);
+      } else if constexpr (std::is_same_v<Type, bool>) {
+        return sqlite3_bind_int(statement, index, value ? 1 : 0);
+      } else if constexpr (std::is_integral_v<Type> || std::is_enum_v<Type>) {
+        return sqlite3_bind_int64(statement, index, static_cast<sqlite3_int64>(value));
+      } else if constexpr (std::is_floating_point_v<Type>) {
+        return sqlite3_bind_double(statement, index, static_cast<double>(value));
+      } else if constexpr (std::is_convertible_v<const Type&, std::string_view>) {
+        // Copied, the arguments are gone by the time the rows are stepped
+        std::string_view text(value);
+        if (text.size() > static_cast<size_t>(INT_MAX)) {
+          return SQLITE_TOOBIG;
+        }
+        return sqlite3_bind_text(statement, index, text.data(), static_cast<int>(text.size()), SQLITE_TRANSIENT);
+      } else if constexpr (std::is_same_v<Type, BlobView>) {
+        if (value.size > static_cast<size_t>(INT_MAX)) {
+          return SQLITE_TOOBIG;
+        }
+        return sqlite3_bind_blob(statement, index, value.data, static_cast<int>(value.size), SQLITE_TRANSIENT);
+      } else {
+        static_assert(alwaysFalse<Type>, "Unsupported parameter type");
+      }
+    }
+
+    template <typename T>
+    T columnValue(sqlite3_stmt* statement, int index) {
+      if constexpr (IsOptional<T>::value) {
+        if (sqlite3_column_type(statement, index) == SQLITE_NULL) {
+          return std::nullopt;
+        }
+        return columnValue<typename T::value_type>(statement, index);
+      } else if constexpr (std::is_same_v<T, bool>) {
+        return sqlite3_column_int64(statement, index) != 0;
+      } else if constexpr (std::is_integral_v<T>) {
+        return static_cast<T>(sqlite3_column_int64(statement, index));
+      } else if constexpr (std::is_floating_point_v<T>) {
+        return static_cast<T>(sqlite3_column_double(statement, index));
+      } else if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>) {
+        auto text = reinterpret_cast<const char*>(sqlite3_column_text(statement, index));
+        size_t length = static_cast<size_t>(sqlite3_column_bytes(statement, index));
+        return text ? T(text, length) : T();
+      } else if constexpr (std::is_same_v<T, BlobView>) {
+        const void* data = sqlite3_column_blob(statement, index);
+        return BlobView{ data, static_cast<size_t>(sqlite3_column_bytes(statement, index)) };
+      } else {
+        static_assert(alwaysFalse<T>, "Unsupported column type");
+      }
+    }
+
+    template <typename... Columns, size_t... Indexes>
+    std::tuple<Columns...> readRow(sqlite3_stmt* statement, std::index_sequence<Indexes...>) {
+      return std::tuple<Columns...>(columnValue<Columns>(statement, static_cast<int>(Indexes))...);
+    }
+  }
+
+  // The rows of a query as a single pass range of tuples. Rows are decoded
+  // straight from the statement, nothing is allocated per row unless a
+  // column is read as std::string.
+  template <typename... Columns>
+  class Rows {
+  public:
+    using value_type = std::tuple<Columns...>;
+
+    class iterator {
+    public:
+      using iterator_category = std::input_iterator_tag;
+      using value_type = std::tuple<Columns...>;
+      using difference_type = std::ptrdiff_t;
+      using pointer = void;
+      using reference = value_type;
+
+      iterator() noexcept : rows(nullptr) {}
+      explicit iterator(Rows* rows) noexcept : rows(rows) {}
+
+      value_type operator*() const {
+        return Typed::readRow<Columns...>(rows->statement.Get(), std::index_sequence_for<Columns...>());
+      }
+
+      iterator& operator++() {
+        if (!rows->step()) {
+          rows = nullptr;
+        }
+        return *this;
+      }
+
+      bool operator==(const iterator& other) const noexcept {
+        return rows == other.rows;
+      }
+
+      bool operator!=(const iterator& other) const noexcept {
+        return rows != other.rows;
+      }
+
+    private:
+      Rows* rows;
+    };
+
+    explicit Rows(StatementHandle statement) : statement(std::move(statement)), started(false) {
+      if (sqlite3_column_count(this->statement.Get()) < static_cast<int>(sizeof...(Columns))) {
+        throw QueryError(SQLITE_RANGE, "The query has fewer columns than requested");
+      }
+    }
+
+    // The range can only be iterated once
+    iterator begin() {
+      if (started) {
+        throw QueryError(SQLITE_MISUSE, "Rows can only be iterated once");
+      }
+      started = true;
+      return step() ? iterator(this) : iterator();
+    }
+
+    iterator end() noexcept {
+      return iterator();
+    }
+
+    StatementHandle Release() noexcept {
+      return std::move(statement);
+    }
+
+  private:
+    bool step() {
+      int result = sqlite3_step(statement.Get());
+      if (result == SQLITE_ROW) {
+        return true;
+      }
+      if (result != SQLITE_DONE) {
+        Typed::throwError(sqlite3_db_handle(statement.Get()), result);
+      }
+      return false;
+    }
+
+    StatementHandle statement;
+    bool started;
+  };
+
+  // Borrows a connection, which stays owned by the caller
+  class TypedDatabase {
+  public:
+    explicit TypedDatabase(sqlite3* db) noexcept : db(db) {}
+
+    // Prepares the statement and binds the arguments to its parameters in
+    // order
+    template <typename... Args>
+    StatementHandle Prepare(std::string_view sql, const Args&... args) {
+      sqlite3_stmt* statement = nullptr;
+      int result = sqlite3_prepare_v2(db, sql.data(), static_cast<int>(sql.size()), &statement, nullptr);
+      StatementHandle handle(statement);
+      if (result != SQLITE_OK) {
+        Typed::throwError(db, result);
+      }
+      if (sizeof...(Args) != static_cast<size_t>(sqlite3_bind_parameter_count(statement))) {
+        throw QueryError(SQLITE_RANGE, "Wrong number of parameters");
+      }
+      int index = 0;
+      int results[] = { SQLITE_OK, Typed::bindValue(statement, ++index, args)... };
+      for (int bound : results) {
+        if (bound != SQLITE_OK) {
+          Typed::throwError(db, bound);
+        }
+      }
+      return handle;
+    }
+
+    template <typename... Columns, typename... Args>
+    Rows<Columns...> Query(std::string_view sql, const Args&... args) {
+      return Rows<Columns...>(Prepare(sql, args...));
+    }
+
+    // The first row, if there is one. The statement is finalized before
+    // returning, so the columns must own their values.
+    template <typename... Columns, typename... Args>
+    std::optional<std::tuple<Columns...>> QueryOne(std::string_view sql, const Args&... args) {
+      static_assert(!(Typed::IsView<Columns>::value || ...), "QueryOne finalizes the statement, read text as std::string");
+      Rows<Columns...> rows(Prepare(sql, args...));
+      auto row = rows.begin();
+      if (row == rows.end()) {
+        return std::nullopt;
+      }
+      return *row;
+    }
+
+    // Runs a statement that returns no rows, returns the number of changed
+    // rows
+    template <typename... Args>
+    int Execute(std::string_view sql, const Args&... args) {
+      StatementHandle statement = Prepare(sql, args...);
+      int result;
+      while ((result = sqlite3_step(statement.Get())) == SQLITE_ROW) {
+      }
+      if (result != SQLITE_DONE) {
+        Typed::throwError(db, result);
+      }
+      return sqlite3_changes(db);
+    }
+
+    sqlite3* Handle() const noexcept {
+      return db;
+    }
+
+  private:
+    sqlite3* db;
+  };
+}
@@ -0,0 +1,130 @@
+#include <condition_variable>
+
+#include "UnlockWait.h"
+
+namespace SQLite3 {
+  namespace {
+    struct Notification {
+      std::mutex mutex;
+      std::condition_variable fired;
+      bool unlocked;
+    };
+
+    // Called by the connection releasing the lock, or right away when it
+    // is already gone. SQLite holds its own mutex while calling, so the
+    // notification can not go away during the call.
+    void onUnlock(void** arguments, int count) {
+      for (int i = 0; i < count; ++i) {
+        Notification* notification = static_cast<Notification*>(arguments[i]);
+        std::lock_guard<std::mutex> lock(notification->mutex);
+        notification->unlocked = true;
+        notification->fired.notify_all();
+      }
+    }
+  }
+
+  UnlockWait::UnlockWait(unsigned timeoutMilliseconds)
+    : timeoutMilliseconds(timeoutMilliseconds) {
+    counters.waits = 0;
+    counters.timeouts = 0;
+    counters.deadlocks = 0;
+    counters.waitMicroseconds = 0;
+    counters.longestWaitMicroseconds = 0;
+  }
+
+  unsigned UnlockWait::Timeout() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return timeoutMilliseconds;
+  }
+
+  void UnlockWait::SetTimeout(unsigned timeoutMilliseconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->timeoutMilliseconds = timeoutMilliseconds;
+  }
+
+  int UnlockWait::Prepare16(sqlite3* db, const void* sql, sqlite3_stmt** statement) {
+    for (;;) {
+      int result = sqlite3_prepare16_v2(db, sql, -1, statement, nullptr);
+      // The schema of a shared cache is locked while another connection
+      // changes it
+      if (!lockedBySharedCache(db, result) || Wait(db) != SQLITE_OK) {
+        return result;
+      }
+    }
+  }
+
+  int UnlockWait::Prepare(sqlite3* db, const char* sql, sqlite3_stmt** statement, const char** tail) {
+    for (;;) {
+      int result = sqlite3_prepare_v2(db, sql, -1, statement, tail);
+      if (!lockedBySharedCache(db, result) || Wait(db) != SQLITE_OK) {
+        return result;
+      }
+    }
+  }
+
+  int UnlockWait::Step(sqlite3_stmt* statement, bool restartable) {
+    sqlite3* db = sqlite3_db_handle(statement);
+    for (;;) {
+      int result = sqlite3_step(statement);
+      if (!restartable || !lockedBySharedCache(db, result) || Wait(db) != SQLITE_OK) {
+        return result;
+      }
+      sqlite3_reset(statement);
+    }
+  }
+
+  int UnlockWait::Wait(sqlite3* db) {
+    unsigned timeout = Timeout();
+    if (!timeout) {
+      return SQLITE_BUSY;
+    }
+
+    Notification notification;
+    notification.unlocked = false;
+    Clock::time_point start = Clock::now();
+    if (sqlite3_unlock_notify(db, onUnlock, &notification) != SQLITE_OK) {
+      // The blocking connection waits for this one, directly or not
+      record(Clock::duration::zero(), SQLITE_LOCKED);
+      return SQLITE_LOCKED;
+    }
+
+    bool unlocked;
+    {
+      std::unique_lock<std::mutex> lock(notification.mutex);
+      unlocked = notification.fired.wait_for(lock, std::chrono::milliseconds(timeout), [&notification]() {
+        return notification.unlocked;
+      });
+    }
+    if (!unlocked) {
+      // Cancels the callback, which can not run anymore afterwards
+      sqlite3_unlock_notify(db, nullptr, nullptr);
+    }
+    int result = unlocked ? SQLITE_OK : SQLITE_BUSY;
+    record(Clock::now() - start, result);
+    return result;
+  }
+
+  UnlockWaitCounters UnlockWait::Counters() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+  }
+
+  bool UnlockWait::lockedBySharedCache(sqlite3* db, int result) {
+    return (result & 0xff) == SQLITE_LOCKED && sqlite3_extended_errcode(db) == SQLITE_LOCKED_SHAREDCACHE;
+  }
+
+  void UnlockWait::record(Clock::duration waited, int result) {
+    long long microseconds = std::chrono::duration_cast<std::chrono::microseconds>(waited).count();
+    std::lock_guard<std::mutex> lock(mutex);
+    ++counters.waits;
+    if (result == SQLITE_LOCKED) {
+      ++counters.deadlocks;
+    } else if (result == SQLITE_BUSY) {
+      ++counters.timeouts;
+    }
+    counters.waitMicroseconds += microseconds;
+    if (microseconds > counters.longestWaitMicroseconds) {
+      counters.longestWaitMicroseconds = microseconds;
+    }
+  }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  struct UnlockWaitCounters {
+    long long waits;
+    long long timeouts;
+    long long deadlocks;
+    long long waitMicroseconds;
+    long long longestWaitMicroseconds;
+  };
+
+  // Blocks a connection of a shared cache that ran into a table another
+  // connection locked (SQLITE_LOCKED_SHAREDCACHE) until sqlite3_unlock_notify
+  // reports the lock was released, then retries. Gives up after the timeout
+  // or right away when waiting would deadlock. The waits of all statements of
+  // a connection are counted here.
+  class UnlockWait {
+  public:
+    // Zero disables waiting
+    explicit UnlockWait(unsigned timeoutMilliseconds);
+
+    unsigned Timeout() const;
+    void SetTimeout(unsigned timeoutMilliseconds);
+
+    // sqlite3_prepare16_v2 of a NUL terminated statement
+    int Prepare16(sqlite3* db, const void* sql, sqlite3_stmt** statement);
+    // sqlite3_prepare_v2 of the first statement of a NUL terminated string,
+    // the tail points past it
+    int Prepare(sqlite3* db, const char* sql, sqlite3_stmt** statement, const char** tail);
+    // Only statements that did not return a row yet can be reset and
+    // retried, the others fail like sqlite3_step
+    int Step(sqlite3_stmt* statement, bool restartable);
+
+    // Returns SQLITE_OK once the blocking connection released its locks,
+    // SQLITE_LOCKED when waiting would deadlock and SQLITE_BUSY on timeout
+    int Wait(sqlite3* db);
+
+    UnlockWaitCounters Counters() const;
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    UnlockWait(const UnlockWait&);
+    UnlockWait& operator=(const UnlockWait&);
+
+    static bool lockedBySharedCache(sqlite3* db, int result);
+    void record(Clock::duration waited, int result);
+
+    mutable std::mutex mutex;
+    unsigned timeoutMilliseconds;
+    UnlockWaitCounters counters;
+  };
+}
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cstring>
+
+#include "WalCheckpointer.h"
+
+namespace SQLite3 {
+  // The SQLite the component bundles predates TRUNCATE, RESTART also keeps
+  // the WAL from growing, it just does not give back the disk space
+#ifdef SQLITE_CHECKPOINT_TRUNCATE
+  static const int truncateMode = SQLITE_CHECKPOINT_TRUNCATE;
+#else
+  static const int truncateMode = SQLITE_CHECKPOINT_RESTART;
+#endif
+
+  CheckpointPolicy::CheckpointPolicy()
+    : passiveFrames(1000)
+    , restartFrames(4000)
+    , truncateFrames(16000)
+    , restartAgeMilliseconds(30000)
+    , retryMilliseconds(1000)
+    , busyMilliseconds(100) {
+  }
+
+  WalCheckpointer::WalCheckpointer()
+    : frames(0)
+    , backfilled(0)
+    , pending(false)
+    , queued(false) {
+    counters.passive = 0;
+    counters.restart = 0;
+    counters.truncate = 0;
+    counters.busy = 0;
+    counters.walFrames = 0;
+    counters.framesCheckpointed = 0;
+    counters.framesRemaining = 0;
+    counters.latencyMicroseconds = 0;
+    counters.longestLatencyMicroseconds = 0;
+  }
+
+  void WalCheckpointer::Install(sqlite3* db) {
+    sqlite3_wal_hook(db, onWal, this);
+  }
+
+  CheckpointPolicy WalCheckpointer::Policy() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return policy;
+  }
+
+  void WalCheckpointer::SetPolicy(const CheckpointPolicy& policy) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->policy = policy;
+  }
+
+  bool WalCheckpointer::Due() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (queued || modeLocked(Clock::now()) < 0) {
+      return false;
+    }
+    queued = true;
+    return true;
+  }
+
+  int WalCheckpointer::Run(sqlite3* db) {
+    // The connection's own transaction would keep the checkpoint from
+    // finishing, it is due again after the transaction
+    bool idle = sqlite3_get_autocommit(db) != 0;
+    int mode;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queued = false;
+      mode = idle ? modeLocked(Clock::now()) : -1;
+      if (mode < 0) {
+        return SQLITE_OK;
+      }
+    }
+
+    int log = -1;
+    int checkpointed = -1;
+    Clock::time_point start = Clock::now();
+    int result = sqlite3_wal_checkpoint_v2(db, "main", mode, &log, &checkpointed);
+    Clock::time_point end = Clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    long long latency = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    counters.latencyMicroseconds += latency;
+    counters.longestLatencyMicroseconds = std::max(counters.longestLatencyMicroseconds, latency);
+    if (mode == SQLITE_CHECKPOINT_PASSIVE) {
+      ++counters.passive;
+    } else if (mode == SQLITE_CHECKPOINT_RESTART) {
+      ++counters.restart;
+    } else {
+      ++counters.truncate;
+    }
+    if (result == SQLITE_BUSY) {
+      ++counters.busy;
+      retryRestartAt = end + std::chrono::milliseconds(policy.retryMilliseconds);
+    } else if (result != SQLITE_OK) {
+      return result;
+    }
+
+    // Not in WAL mode
+    if (log < 0) {
+      return result;
+    }
+    if (checkpointed > backfilled) {
+      counters.framesCheckpointed += checkpointed - backfilled;
+    }
+    counters.framesRemaining = log - checkpointed;
+    pending = checkpointed < log;
+    if (result == SQLITE_OK && mode != SQLITE_CHECKPOINT_PASSIVE) {
+      // The next commit starts over at the beginning of the WAL
+      frames = 0;
+      backfilled = 0;
+    } else {
+      frames = log;
+      backfilled = checkpointed;
+    }
+    bool truncated = result == SQLITE_OK && mode != SQLITE_CHECKPOINT_PASSIVE && mode != SQLITE_CHECKPOINT_RESTART;
+    counters.walFrames = truncated ? 0 : log;
+    return result;
+  }
+
+  CheckpointCounters WalCheckpointer::Counters() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+  }
+
+  int WalCheckpointer::onWal(void* checkpointer, sqlite3*, const char* database, int frames) {
+    if (std::strcmp(database, "main") == 0) {
+      static_cast<WalCheckpointer*>(checkpointer)->wal(frames);
+    }
+    return SQLITE_OK;
+  }
+
+  // Called after every commit with the number of frames in the WAL, must not
+  // do more than take note
+  void WalCheckpointer::wal(int frames) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // A smaller WAL means it was restarted, by us or another connection
+    if (frames < this->frames) {
+      backfilled = 0;
+    }
+    this->frames = frames;
+    counters.walFrames = frames;
+    if (!pending && frames > backfilled) {
+      pending = true;
+      oldestFrame = Clock::now();
+    }
+  }
+
+  // The checkpoint mode the state of the WAL calls for, -1 when none is due
+  int WalCheckpointer::modeLocked(Clock::time_point now) const {
+    if (now >= retryRestartAt) {
+      if (frames >= policy.truncateFrames) {
+        return truncateMode;
+      }
+      if (frames >= policy.restartFrames || (pending && policy.restartAgeMilliseconds &&
+          now - oldestFrame >= std::chrono::milliseconds(policy.restartAgeMilliseconds))) {
+        return SQLITE_CHECKPOINT_RESTART;
+      }
+    }
+    if (pending && frames - backfilled >= std::max<long long>(policy.passiveFrames, 1)) {
+      return SQLITE_CHECKPOINT_PASSIVE;
+    }
+    return -1;
+  }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  struct CheckpointPolicy {
+    CheckpointPolicy();
+
+    // Frames written since the last checkpoint before a passive checkpoint
+    // is due, zero checkpoints after every commit
+    unsigned passiveFrames;
+    // WAL size in frames from which a checkpoint also waits for the readers
+    // and restarts the WAL, or truncates the file
+    unsigned restartFrames;
+    unsigned truncateFrames;
+    // Age of the oldest frame not yet checkpointed from which a checkpoint
+    // restarts the WAL, zero disables it
+    unsigned restartAgeMilliseconds;
+    // A restart that gave up waiting for the readers is not tried again for
+    // this long, passive checkpoints still run
+    unsigned retryMilliseconds;
+    // Longest a restart or truncate waits for the readers through the busy
+    // handler before it gives up, so it does not hold up the connection for
+    // the whole busy timeout
+    unsigned busyMilliseconds;
+  };
+
+  struct CheckpointCounters {
+    long long passive;
+    long long restart;
+    long long truncate;
+    // Restart or truncate checkpoints that gave up waiting for the readers
+    long long busy;
+    // Frames in the WAL when it was last checkpointed or written
+    long long walFrames;
+    long long framesCheckpointed;
+    // Frames the last checkpoint could not copy to the database, because
+    // readers still needed them
+    long long framesRemaining;
+    long long latencyMicroseconds;
+    long long longestLatencyMicroseconds;
+  };
+
+  // Checkpoints the main database of a connection in WAL mode instead of
+  // the automatic checkpoint, which runs inside the commit that crosses the
+  // threshold. The WAL hook only records the size of the WAL, the owner
+  // asks Due() when the connection is idle and then calls Run(), which
+  // picks a passive checkpoint or, when the WAL grew too large or old, one
+  // that waits for the readers (through the busy handler, which the owner
+  // limits to busyMilliseconds) and restarts or truncates it.
+  class WalCheckpointer {
+  public:
+    WalCheckpointer();
+
+    // Replaces the WAL hook, and with it the automatic checkpoint. Setting
+    // PRAGMA wal_autocheckpoint afterwards replaces the hook in turn.
+    void Install(sqlite3* db);
+
+    CheckpointPolicy Policy() const;
+    void SetPolicy(const CheckpointPolicy& policy);
+
+    // True when a checkpoint should run, then false until Run was called
+    bool Due();
+    // Runs the checkpoint on the thread that owns the connection, returns
+    // the result of sqlite3_wal_checkpoint_v2. Does nothing inside a
+    // transaction of the connection.
+    int Run(sqlite3* db);
+
+    CheckpointCounters Counters() const;
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    WalCheckpointer(const WalCheckpointer&);
+    WalCheckpointer& operator=(const WalCheckpointer&);
+
+    static int onWal(void* checkpointer, sqlite3* db, const char* database, int frames);
+    void wal(int frames);
+    int modeLocked(Clock::time_point now) const;
+
+    mutable std::mutex mutex;
+    CheckpointPolicy policy;
+    // Frames in the WAL and how many of them are already in the database
+    long long frames;
+    long long backfilled;
+    bool pending;
+    Clock::time_point oldestFrame;
+    Clock::time_point retryRestartAt;
+    bool queued;
+    CheckpointCounters counters;
+  };
+}
@@ -0,0 +1,63 @@
+#include <chrono>
+
+#include "WarmUp.h"
+
+namespace SQLite3 {
+  namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    long long microsecondsSince(Clock::time_point start) {
+      return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    }
+  }
+
+  WarmUp::WarmUp() {
+    counters.schemaMicroseconds = 0;
+    counters.prepareMicroseconds = 0;
+    counters.statements = 0;
+  }
+
+  int WarmUp::LoadSchema(sqlite3* db) {
+    Clock::time_point start = Clock::now();
+    // Preparing any statement that reads a table parses the whole schema,
+    // the step also brings the schema pages into the page cache
+    sqlite3_stmt* statement = nullptr;
+    int result = sqlite3_prepare_v2(db, "SELECT count(*) FROM sqlite_master", -1, &statement, nullptr);
+    if (result == SQLITE_OK) {
+      result = sqlite3_step(statement);
+      result = result == SQLITE_ROW ? SQLITE_OK : result;
+    }
+    sqlite3_finalize(statement);
+    counters.schemaMicroseconds = microsecondsSince(start);
+    return result;
+  }
+
+  int WarmUp::Prepare(sqlite3* db, const std::vector<std::string>& statements, StatementCache& cache) {
+    Clock::time_point start = Clock::now();
+    if (statements.size() > cache.Capacity()) {
+      cache.SetCapacity(statements.size());
+    }
+    int result = SQLITE_OK;
+    for (auto sql = statements.begin(); sql != statements.end(); ++sql) {
+      sqlite3_stmt* statement = nullptr;
+      result = sqlite3_prepare_v2(db, sql->c_str(), -1, &statement, nullptr);
+      if (result != SQLITE_OK) {
+        sqlite3_finalize(statement);
+        failedSql = *sql;
+        break;
+      }
+      cache.Release(*sql, statement);
+      ++counters.statements;
+    }
+    counters.prepareMicroseconds = microsecondsSince(start);
+    return result;
+  }
+
+  const std::string& WarmUp::FailedSql() const {
+    return failedSql;
+  }
+
+  WarmUpCounters WarmUp::Counters() const {
+    return counters;
+  }
+}
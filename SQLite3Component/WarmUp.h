@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "sqlite3.h"
+#include "StatementCache.h"
+
+namespace SQLite3 {
+  struct WarmUpCounters {
+    long long schemaMicroseconds;
+    long long prepareMicroseconds;
+    long long statements;
+  };
+
+  // Work the first queries of a freshly opened connection would otherwise
+  // pay for: SQLite parses the schema on the first prepare, and every
+  // statement is compiled on its first run.
+  class WarmUp {
+  public:
+    WarmUp();
+
+    // Reads and parses the schema of all attached databases
+    int LoadSchema(sqlite3* db);
+    // Prepares the statements into the cache, which grows to hold all of
+    // them. Stops at the first statement that fails, see FailedSql.
+    int Prepare(sqlite3* db, const std::vector<std::string>& statements, StatementCache& cache);
+
+    const std::string& FailedSql() const;
+    WarmUpCounters Counters() const;
+
+  private:
+    WarmUp(const WarmUp&);
+    WarmUp& operator=(const WarmUp&);
+
+    std::string failedSql;
+    WarmUpCounters counters;
+  };
+}
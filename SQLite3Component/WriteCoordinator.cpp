@@ -0,0 +1,149 @@
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "WriteCoordinator.h"
+
+namespace SQLite3 {
+  namespace {
+    // Tickets are served in the order they were drawn
+    struct Queue {
+      Queue() : next(0), serving(0), users(0) {}
+
+      std::condition_variable turn;
+      unsigned long long next;
+      unsigned long long serving;
+      // The writer whose turn it is plus the waiting ones, the queue goes
+      // away with the last of them
+      int users;
+    };
+
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<Queue>> queues;
+    WriteCoordinatorCounters counters = { 0, 0, 0, 0 };
+  }
+
+  WriteCoordinatorCounters WriteCoordinator::Counters() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+  }
+
+  void WriteCoordinator::ResetCounters() {
+    std::lock_guard<std::mutex> lock(mutex);
+    WriteCoordinatorCounters reset = { 0, 0, 0, 0 };
+    counters = reset;
+  }
+
+  int WriteCoordinator::Waiting(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = queues.find(path);
+    return found == queues.end() ? 0 : static_cast<int>(found->second->next - found->second->serving) - 1;
+  }
+
+  WriteSlot::WriteSlot()
+    : held(false) {
+  }
+
+  WriteSlot::~WriteSlot() {
+    Release();
+  }
+
+  void WriteSlot::Acquire(const std::string& path) {
+    Release();
+    std::unique_lock<std::mutex> lock(mutex);
+    std::unique_ptr<Queue>& entry = queues[path];
+    if (!entry) {
+      entry.reset(new Queue());
+    }
+    Queue& queue = *entry;
+    ++queue.users;
+    unsigned long long ticket = queue.next++;
+    if (ticket != queue.serving) {
+      auto started = std::chrono::steady_clock::now();
+      while (ticket != queue.serving) {
+        queue.turn.wait(lock);
+      }
+      long long waited = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count();
+      ++counters.contended;
+      counters.waitMicroseconds += waited;
+      if (waited > counters.longestWaitMicroseconds) {
+        counters.longestWaitMicroseconds = waited;
+      }
+    }
+    ++counters.acquisitions;
+    this->path = path;
+    held = true;
+  }
+
+  void WriteSlot::Release() {
+    if (!held) {
+      return;
+    }
+    held = false;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = queues.find(path);
+    Queue& queue = *found->second;
+    ++queue.serving;
+    if (--queue.users == 0) {
+      queues.erase(found);
+    } else {
+      // Every waiter checks whether its ticket is served now
+      queue.turn.notify_all();
+    }
+  }
+
+  bool WriteSlot::Held() const {
+    return held;
+  }
+
+  WriteTransaction::WriteTransaction(sqlite3* db)
+    : db(db)
+    , open(false) {
+  }
+
+  WriteTransaction::~WriteTransaction() {
+    Rollback();
+  }
+
+  int WriteTransaction::Begin() {
+    if (open || !sqlite3_get_autocommit(db)) {
+      return SQLITE_OK;
+    }
+    const char* path = sqlite3_db_filename(db, "main");
+    if (path && *path) {
+      slot.Acquire(path);
+    }
+    int result = sqlite3_exec(db, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr);
+    open = result == SQLITE_OK;
+    if (!open) {
+      slot.Release();
+    }
+    return result;
+  }
+
+  int WriteTransaction::Commit() {
+    if (!open) {
+      return SQLITE_OK;
+    }
+    int result = sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+    if (result == SQLITE_OK) {
+      open = false;
+      slot.Release();
+    }
+    return result;
+  }
+
+  int WriteTransaction::Rollback() {
+    if (!open) {
+      return SQLITE_OK;
+    }
+    open = false;
+    // Fails harmlessly when an error already rolled the transaction back
+    int result = sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+    slot.Release();
+    return result;
+  }
+}
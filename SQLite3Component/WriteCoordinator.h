@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+
+#include "sqlite3.h"
+
+namespace SQLite3 {
+  struct WriteCoordinatorCounters {
+    // Slots handed out, and those that had to queue behind another writer
+    long long acquisitions;
+    long long contended;
+    long long waitMicroseconds;
+    long long longestWaitMicroseconds;
+  };
+
+  // Lets the write transactions of all connections of the process on one
+  // database file take turns in the order they asked. A writer that waits
+  // here instead of in BEGIN IMMEDIATE neither spins in the busy handler
+  // nor gets overtaken by one that asked later. Readers never take a slot.
+  class WriteCoordinator {
+  public:
+    static WriteCoordinatorCounters Counters();
+    static void ResetCounters();
+    // Writers queued for the file right now, not counting the one whose
+    // turn it is
+    static int Waiting(const std::string& path);
+  };
+
+  // The turn of one writer on a database file, released on destruction
+  class WriteSlot {
+  public:
+    WriteSlot();
+    ~WriteSlot();
+
+    // Waits until all writers that asked for the same path before are done
+    void Acquire(const std::string& path);
+    void Release();
+    bool Held() const;
+
+  private:
+    WriteSlot(const WriteSlot&);
+    WriteSlot& operator=(const WriteSlot&);
+
+    std::string path;
+    bool held;
+  };
+
+  // BEGIN IMMEDIATE once it is the connection's turn on its main database
+  // file. Inside a transaction of the connection it neither waits nor begins
+  // anything, the outer transaction commits the changes. Connections to
+  // in-memory and temporary databases have nobody to wait for and begin
+  // right away. Rolls back on destruction unless committed.
+  class WriteTransaction {
+  public:
+    explicit WriteTransaction(sqlite3* db);
+    ~WriteTransaction();
+
+    int Begin();
+    // Keeps the slot when the commit fails, e.g. with SQLITE_BUSY, so it can
+    // be retried or rolled back
+    int Commit();
+    int Rollback();
+
+  private:
+    WriteTransaction(const WriteTransaction&);
+    WriteTransaction& operator=(const WriteTransaction&);
+
+    sqlite3* db;
+    WriteSlot slot;
+    bool open;
+  };
+}
@@ -14,75 +14,25 @@
     }
   };
 
-  function PromiseQueue() {
-    this._items = [];
-    this._busy = false;
-  }
+  function toPropertySet(object) {
+    var key, propertySet = new Windows.Foundation.Collections.PropertySet();
 
-  PromiseQueue.prototype.append = function (createPromise) {
-    var wrappingPromise,
-        queueItem = { createPromise: createPromise },
-        _this = this;
-
-    wrappingPromise = new WinJS.Promise(function (complete, error) {
-      queueItem.complete = complete;
-      queueItem.error = error;
-    }, function () {
-      if (queueItem.promise) {
-        queueItem.promise.cancel();
-      } else {
-        queueItem.cancelled = true;
+    for (key in object) {
+      if (object.hasOwnProperty(key)) {
+        propertySet.insert(key, object[key]);
       }
-
-      _this._handleNext();
-    });
-
-    this._items.push(queueItem);
-    if (!this._busy) {
-      this._handleNext();
     }
 
-    return wrappingPromise;
-  };
-
-  PromiseQueue.prototype._handleNext = function () {
-    var _this = this;
-    /* shorten call stack */
-    this._busy = true;
-    setImmediate(function () {
-      if (_this._items.length > 0) {
-        var nextItem = _this._items[0];
-        _this._items = _this._items.slice(1);
-        _this._handleItem(nextItem);
-      } else {
-        _this._busy = false;
-      }
-    });
-  };
-
-  PromiseQueue.prototype._handleItem = function (queueItem) {
-    var _this = this;
-
-    if (!queueItem.cancelled) {
-      queueItem.promise = queueItem.createPromise();
-      queueItem.promise.done(function (result) {
-        _this._handleNext();
-        queueItem.complete(result);
-      }, function (error) {
-        _this._handleNext();
-        queueItem.error(error);
-      });
-    } else {
-      this._handleNext();
-    }
-  };
+    return propertySet;
+  }
 
-  function toPropertySet(object) {
+  function toConnectionOptions(options) {
     var key, propertySet = new Windows.Foundation.Collections.PropertySet();
 
-    for (key in object) {
-      if (object.hasOwnProperty(key)) {
-        propertySet.insert(key, object[key]);
+    for (key in options) {
+      if (options.hasOwnProperty(key)) {
+        // Arrays can not be stored in a property set
+        propertySet.insert(key, options[key] instanceof Array ? JSON.stringify(options[key]) : options[key]);
       }
     }
 
@@ -133,24 +83,24 @@
   }
 
   function wrapDatabase(connection) {
-    var that, queue = new PromiseQueue();
+    var that;
 
+    // The connection queues the operations itself and runs them one at a time
+    // in the order of their priority, see withPriority
     function callNativeAsync(funcName, sql, args, callback) {
-      var argString, preparedArgs, fullFuncName;
+      var preparedArgs, fullFuncName;
 
-      return queue.append(function () {
-        if (SQLite3JS.debug) {
-          SQLite3JS.logger.trace(funcName + ': ' + formatStatementAndArgs(sql, args));
-        }
-        preparedArgs = prepareArgs(args);
-        fullFuncName =
-          preparedArgs instanceof Windows.Foundation.Collections.PropertySet
-          ? funcName + "Map"
-          : funcName + "Vector";
-
-        return connection[fullFuncName](sql, preparedArgs, callback).then(null, function (error) {
-          return wrapException(error, that.lastError, funcName, sql, args);
-        });
+      if (SQLite3JS.debug) {
+        SQLite3JS.logger.trace(funcName + ': ' + formatStatementAndArgs(sql, args));
+      }
+      preparedArgs = prepareArgs(args);
+      fullFuncName =
+        preparedArgs instanceof Windows.Foundation.Collections.PropertySet
+        ? funcName + "Map"
+        : funcName + "Vector";
+
+      return connection[fullFuncName](sql, preparedArgs, callback).then(null, function (error) {
+        return wrapException(error, that.lastError, funcName, sql, args);
       });
     }
 
@@ -170,6 +120,40 @@
           return rows ? JSON.parse(rows) : null;
         });
       },
+      queryAsync: function (sql, args) {
+        /// <summary>
+        /// Like allAsync but completes with a native SQLite3.ResultSet instead of parsed JSON.
+        /// Column values are only decoded when read, e.g. resultSet.rows[0].getValue(2) or
+        /// getValueByName('name'), which saves the serialization of columns that are not shown.
+        /// </summary>
+        return callNativeAsync('queryAsync', sql, args);
+      },
+      executeManyAsync: function (statements, options) {
+        /// <summary>
+        /// Runs several statements in a single native call, by default inside one transaction
+        /// that is rolled back if one of them fails. statements is an array of SQL strings or
+        /// { sql: ..., args: ... } objects. Completes with one result per statement, { rows: [...] }
+        /// for queries and { changes: n, lastInsertRowId: id } otherwise.
+        /// </summary>
+        var batch = new SQLite3.StatementBatch(),
+            transactional = !options || options.transactional !== false;
+
+        statements.forEach(function (statement) {
+          var sql = typeof statement === 'string' ? statement : statement.sql,
+              preparedArgs = prepareArgs(typeof statement === 'string' ? null : statement.args);
+          if (preparedArgs instanceof Windows.Foundation.Collections.PropertySet) {
+            batch.addMap(sql, preparedArgs);
+          } else {
+            batch.addVector(sql, preparedArgs);
+          }
+        });
+
+        return connection.executeManyAsync(batch, transactional).then(function (results) {
+          return JSON.parse(results);
+        }, function (error) {
+          return wrapException(error, that.lastError, 'executeManyAsync');
+        });
+      },
       eachAsync: function (sql, args, callback) {
         if (!callback && typeof args === 'function') {
           callback = args;
@@ -217,12 +201,145 @@
       close: function () {
         connection.close();
       },
+      importAsync: function (file, format, table, options) {
+        /// <summary>
+        /// Loads a CSV or newline delimited JSON file into an existing table. Reports the number of
+        /// committed rows as progress and completes with the number of imported rows.
+        /// </summary>
+        var nativeOptions = {}, key;
+        options = options || {};
+        for (key in options) {
+          if (options.hasOwnProperty(key)) {
+            nativeOptions[key] = key === 'columns' ? options.columns.join(',') : options[key];
+          }
+        }
+
+        return connection.importAsync(file, format, table, toPropertySet(nativeOptions)).then(null, function (error) {
+          return wrapException(error, that.lastError, 'importAsync');
+        });
+      },
+      exportAsync: function (sql, args, path, format) {
+        /// <summary>
+        /// Writes the rows of a query to a file as newline delimited JSON ("ndjson") or CSV
+        /// without loading them into memory. Reports the number of written rows as progress
+        /// and completes with the number of exported rows.
+        /// </summary>
+        if (typeof args === 'string') {
+          format = path;
+          path = args;
+          args = undefined;
+        }
+
+        var preparedArgs = prepareArgs(args),
+            funcName = preparedArgs instanceof Windows.Foundation.Collections.PropertySet
+              ? 'exportAsyncMap'
+              : 'exportAsyncVector';
+
+        return connection[funcName](sql, preparedArgs, path, format || 'ndjson').then(null, function (error) {
+          return wrapException(error, that.lastError, 'exportAsync', sql, args);
+        });
+      },
+      persistAsync: function () {
+        /// <summary>
+        /// Writes a database opened with the loadIntoMemory option back to its file, if it
+        /// changed since it was loaded or last persisted.
+        /// </summary>
+        return connection.persistAsync().then(null, function (error) {
+          return wrapException(error, that.lastError, 'persistAsync');
+        });
+      },
+      backupAsync: function (path, options) {
+        /// <summary>
+        /// Copies the database to a file while it stays in use, options.pagesPerStep pages (100)
+        /// at a time with options.pause milliseconds (0) between the steps. Other operations run
+        /// between the steps. Reports { pagesCopied, pageCount, restarts } as progress and
+        /// completes with the number of pages copied.
+        /// </summary>
+        options = options || {};
+        var pagesPerStep = options.pagesPerStep === undefined ? 100 : options.pagesPerStep,
+            pause = options.pause === undefined ? 0 : options.pause;
+
+        return connection.backupAsync(path, pagesPerStep, pause).then(null, function (error) {
+          return wrapException(error, that.lastError, 'backupAsync');
+        });
+      },
+      openBlobAsync: function (table, column, rowId, writable) {
+        /// <summary>
+        /// Opens a single BLOB value for reading and writing in chunks. Completes with a
+        /// SQLite3.BlobStream offering readAsync(offset, count), writeAsync(offset, buffer),
+        /// reopenAsync(rowId), size and close(). Insert a new SQLite3.ZeroBlob(size) to
+        /// preallocate a BLOB that is then written through the stream.
+        /// </summary>
+        return connection.openBlobAsync(table, column, rowId, !!writable).then(null, function (error) {
+          return wrapException(error, that.lastError, 'openBlobAsync');
+        });
+      },
+      withPriority: function (priority, callback) {
+        /// <summary>
+        /// Calls callback(db) and gives the operations it starts synchronously the priority
+        /// "interactive", "normal" (the default) or "background". Queued operations of a higher
+        /// priority run first, operations waiting longer than priorityAging milliseconds move up
+        /// one priority. Returns the result of the callback.
+        /// </summary>
+        var previous = connection.priority,
+            value = typeof priority === 'string' ? SQLite3.OperationPriority[priority] : priority;
+
+        if (value === undefined) {
+          throw new WinJS.ErrorFromName("SQLiteError", "Unknown priority " + priority);
+        }
+        connection.priority = value;
+        try {
+          return callback(that);
+        } finally {
+          connection.priority = previous;
+        }
+      },
       vacuumAsync: function () {
         return new WinJS.Promise( function(complete) {
           connection.vacuumAsync();
           complete();
         });
       },
+      getSlowQueries: function () {
+        return JSON.parse(connection.getSlowQueries());
+      },
+      clearSlowQueries: function () {
+        connection.clearSlowQueries();
+      },
+      getLookasideStatistics: function () {
+        return connection.getLookasideStatistics();
+      },
+      getBusyStatistics: function () {
+        return connection.getBusyStatistics();
+      },
+      getExecutionContextStatistics: function () {
+        return connection.getExecutionContextStatistics();
+      },
+      getLockWaitStatistics: function () {
+        return connection.getLockWaitStatistics();
+      },
+      getMemoryDatabaseStatistics: function () {
+        return connection.getMemoryDatabaseStatistics();
+      },
+      getCheckpointStatistics: function () {
+        return connection.getCheckpointStatistics();
+      },
+      getResultCacheStatistics: function () {
+        return connection.getResultCacheStatistics();
+      },
+      clearResultCache: function () {
+        connection.clearResultCache();
+      },
+      getStatementCacheStatistics: function () {
+        return connection.getStatementCacheStatistics();
+      },
+      getOpenStatistics: function () {
+        /// <summary>
+        /// Returns the milliseconds openAsync spent opening the file, loading the schema and
+        /// preparing the statements of the prepare option, and in total.
+        /// </summary>
+        return connection.getOpenStatistics();
+      },
       addEventListener: connection.addEventListener.bind(connection),
       removeEventListener: connection.removeEventListener.bind(connection)
     };
@@ -243,6 +360,88 @@
         get: function () { return connection.fireEvents; },
         enumerable: true
       },
+      "slowQueryThreshold": {
+        set: function (value) { connection.slowQueryThreshold = value; },
+        get: function () { return connection.slowQueryThreshold; },
+        enumerable: true
+      },
+      "slowQueryLogCapacity": {
+        set: function (value) { connection.slowQueryLogCapacity = value; },
+        get: function () { return connection.slowQueryLogCapacity; },
+        enumerable: true
+      },
+      "busyWait": {
+        set: function (value) { connection.busyWait = value; },
+        get: function () { return connection.busyWait; },
+        enumerable: true
+      },
+      "busyTimeout": {
+        set: function (value) { connection.busyTimeout = value; },
+        get: function () { return connection.busyTimeout; },
+        enumerable: true
+      },
+      "lockTimeout": {
+        set: function (value) { connection.lockTimeout = value; },
+        get: function () { return connection.lockTimeout; },
+        enumerable: true
+      },
+      "priorityAging": {
+        set: function (value) { connection.priorityAging = value; },
+        get: function () { return connection.priorityAging; },
+        enumerable: true
+      },
+      "checkpointFrames": {
+        set: function (value) { connection.checkpointFrames = value; },
+        get: function () { return connection.checkpointFrames; },
+        enumerable: true
+      },
+      "checkpointRestartFrames": {
+        set: function (value) { connection.checkpointRestartFrames = value; },
+        get: function () { return connection.checkpointRestartFrames; },
+        enumerable: true
+      },
+      "checkpointTruncateFrames": {
+        set: function (value) { connection.checkpointTruncateFrames = value; },
+        get: function () { return connection.checkpointTruncateFrames; },
+        enumerable: true
+      },
+      "checkpointRestartAge": {
+        set: function (value) { connection.checkpointRestartAge = value; },
+        get: function () { return connection.checkpointRestartAge; },
+        enumerable: true
+      },
+      "resultCacheBudget": {
+        set: function (value) { connection.resultCacheBudget = value; },
+        get: function () { return connection.resultCacheBudget; },
+        enumerable: true
+      },
+      "tempStoreBudget": {
+        set: function (value) { connection.tempStoreBudget = value; },
+        get: function () { return connection.tempStoreBudget; },
+        enumerable: true
+      },
+      "workerThreads": {
+        set: function (value) { connection.workerThreads = value; },
+        get: function () { return connection.workerThreads; },
+        enumerable: true
+      },
+      "statementCacheCapacity": {
+        set: function (value) { connection.statementCacheCapacity = value; },
+        get: function () { return connection.statementCacheCapacity; },
+        enumerable: true
+      },
+      "immutable": {
+        get: function () { return connection.immutable; },
+        enumerable: true
+      },
+      "noMutex": {
+        get: function () { return connection.noMutex; },
+        enumerable: true
+      },
+      "coordinateWrites": {
+        get: function () { return connection.coordinateWrites; },
+        enumerable: true
+      },
       "lastError": {
         get: function () { return connection.lastError; },
         enumerable: true
@@ -389,7 +588,7 @@
     }
   );
 
-  SQLite3JS.openAsync = function (dbPath) {
+  SQLite3JS.openAsync = function (dbPath, options) {
     /// <summary>
     /// Opens a database from disk or in memory.
     /// </summary>
@@ -397,18 +596,31 @@
     /// Path to a file that is located in your apps local/temp/roaming storage or the string ":memory:" 
     /// to create a database in memory
     /// </param>
+    /// <param name="options" type="Object" optional="true">
+    /// Connection settings, e.g. { lookasideSlotSize: 256, lookasideSlotCount: 512 }. With
+    /// { loadIntoMemory: true } the file is loaded into memory and changes are written back by
+    /// persistAsync(), every persistInterval milliseconds if given and on close. With
+    /// { immutable: true } a file that never changes is opened read only, without locking and
+    /// memory mapped up to mmapSize bytes (256 MB). The schema is loaded before the database is
+    /// returned, as are the SQL strings of { prepare: [...] } into the statement cache. With
+    /// { pageProfile: true } the pages read during the first SQLite3.Database.pageProfileDuration
+    /// milliseconds are recorded and prefetched in the background on the next open. { threads: n }
+    /// lets large sorts and index builds use up to n worker threads. With { noMutex: true } SQLite
+    /// takes no lock per call and the connection's operations keep to one thread at a time instead.
+    /// With { coordinateWrites: true } transactional batches and imports queue behind the ones of
+    /// other such connections to the file, see SQLite3.Database.getWriteCoordinatorStatistics().
+    /// </param>
     /// <returns>Database object upon completion of the promise</returns>
-    return SQLite3.Database.openAsync(dbPath)
+    var openPromise = options ?
+      SQLite3.Database.openWithOptionsAsync(dbPath, toConnectionOptions(options)) :
+      SQLite3.Database.openAsync(dbPath);
+
+    return openPromise
     .then(function opened(connection) {
-      var db = wrapDatabase(connection);
-      if (SQLite3JS.version) {
-        return db;
+      if (!SQLite3JS.version) {
+        SQLite3JS.logger.info("SQLite3 version: " + (SQLite3JS.version = SQLite3.Database.version));
       }
-      return db.oneAsync("SELECT sqlite_version() || ' (' || sqlite_source_id() || ')' as version")
-      .then(function (result) {
-        SQLite3JS.logger.info("SQLite3 version: " + (SQLite3JS.version = result.version));
-        return db;
-      });
+      return wrapDatabase(connection);
     }, function onerror(error) {
       return wrapException(error, 'Could not open database "' + dbPath + '"', "openAsync");
     });
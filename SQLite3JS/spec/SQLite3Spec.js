@@ -393,6 +393,393 @@
       });
     });
 
+    describe('Slow query log', function () {
+      afterEach(function () {
+        db.slowQueryThreshold = 0;
+        db.clearSlowQueries();
+      });
+
+      it('should record statements exceeding the threshold', function () {
+        db.slowQueryThreshold = 0.000001;
+        spec.async(
+          db.allAsync('SELECT * FROM Item WHERE price > ?', [2]).then(function () {
+            var queries = db.getSlowQueries();
+            expect(queries.length).toEqual(1);
+            expect(queries[0].sql).toEqual('SELECT * FROM Item WHERE price > ?');
+            expect(queries[0].parameterTypes).toEqual(['integer']);
+            expect(queries[0].rowCount).toEqual(2);
+            expect(queries[0].queryPlan.length).toBeGreaterThan(0);
+          })
+        );
+      });
+
+      it('should not record anything when disabled', function () {
+        spec.async(
+          db.allAsync('SELECT * FROM Item').then(function () {
+            expect(db.getSlowQueries().length).toEqual(0);
+          })
+        );
+      });
+
+      it('should keep only the most recent entries', function () {
+        db.slowQueryThreshold = 0.000001;
+        db.slowQueryLogCapacity = 2;
+        spec.async(
+          db.oneAsync('SELECT 1 AS a').then(function () {
+            return db.oneAsync('SELECT 2 AS a');
+          }).then(function () {
+            return db.oneAsync('SELECT 3 AS a');
+          }).then(function () {
+            var queries = db.getSlowQueries();
+            expect(queries.length).toEqual(2);
+            expect(queries[0].sql).toEqual('SELECT 2 AS a');
+            expect(queries[1].sql).toEqual('SELECT 3 AS a');
+          })
+        );
+      });
+    });
+
+    describe('withPriority()', function () {
+      var slowQuery = 'WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 1000000) SELECT COUNT(*) AS count FROM n';
+
+      it('should run queued interactive operations before background ones', function () {
+        var order = [];
+        spec.async(
+          WinJS.Promise.join([
+            db.oneAsync(slowQuery),
+            db.withPriority('background', function () {
+              return db.oneAsync('SELECT 1 AS a').then(function () {
+                order.push('background');
+              });
+            }),
+            db.withPriority('interactive', function () {
+              return db.oneAsync('SELECT 2 AS a').then(function () {
+                order.push('interactive');
+              });
+            })
+          ]).then(function () {
+            expect(order).toEqual(['interactive', 'background']);
+          })
+        );
+      });
+
+      it('should keep the order of operations with the same priority', function () {
+        spec.async(
+          WinJS.Promise.join([
+            db.runAsync('UPDATE Item SET price = 10 WHERE id = 1'),
+            db.runAsync('UPDATE Item SET price = price * 2 WHERE id = 1'),
+            db.oneAsync('SELECT price FROM Item WHERE id = 1')
+          ]).then(function (results) {
+            expect(results[2].price).toEqual(20);
+          })
+        );
+      });
+
+      it('should reject unknown priorities', function () {
+        expect(function () {
+          db.withPriority('urgent', function () {});
+        }).toThrow();
+      });
+    });
+
+    describe('Result cache', function () {
+      beforeEach(function () {
+        db.resultCacheBudget = 1024 * 1024;
+      });
+
+      afterEach(function () {
+        db.resultCacheBudget = 0;
+      });
+
+      it('should answer repeated queries from the cache', function () {
+        spec.async(
+          db.allAsync('SELECT * FROM Item WHERE price > ?', [2]).then(function () {
+            return db.allAsync('SELECT * FROM Item WHERE price > ?', [2]);
+          }).then(function (rows) {
+            expect(rows.length).toEqual(2);
+            expect(db.getResultCacheStatistics().hits).toEqual(1);
+          })
+        );
+      });
+
+      it('should not return results of changed tables', function () {
+        spec.async(
+          db.oneAsync('SELECT COUNT(*) AS count FROM Item').then(function () {
+            return db.runAsync('DELETE FROM Item');
+          }).then(function () {
+            return db.oneAsync('SELECT COUNT(*) AS count FROM Item');
+          }).then(function (row) {
+            expect(row.count).toEqual(0);
+            expect(db.getResultCacheStatistics().hits).toEqual(0);
+          })
+        );
+      });
+
+      it('should not cache queries using random()', function () {
+        spec.async(
+          db.oneAsync('SELECT random() AS value').then(function () {
+            expect(db.getResultCacheStatistics().entries).toEqual(0);
+          })
+        );
+      });
+    });
+
+    describe('Page cache', function () {
+      it('should count hits and misses', function () {
+        var before = SQLite3.Database.getPageCacheStatistics();
+        spec.async(
+          db.allAsync('SELECT * FROM Item').then(function () {
+            var after = SQLite3.Database.getPageCacheStatistics();
+            expect(after.hits + after.misses).toBeGreaterThan(before.hits + before.misses);
+            expect(after.slabs).toBeGreaterThan(0);
+          })
+        );
+      });
+    });
+
+    describe('Memory', function () {
+      it('should report the memory in use', function () {
+        var statistics = SQLite3.Database.getMemoryStatistics();
+        if (statistics.statusAvailable) {
+          expect(statistics.bytesInUse).toBeGreaterThan(0);
+          expect(statistics.bytesHighWater).not.toBeLessThan(statistics.bytesInUse);
+        }
+        expect(statistics.totalAllocations).toBeGreaterThan(0);
+      });
+
+      it('should not allow changing the allocator after opening a database', function () {
+        expect(function () {
+          SQLite3.Database.allocator = SQLite3.AllocatorKind.pool;
+        }).toThrow();
+      });
+
+      it('should open with lookaside options', function () {
+        spec.async(
+          SQLite3JS.openAsync(':memory:', { lookasideSlotSize: 128, lookasideSlotCount: 32 }).then(function (lookasideDb) {
+            return lookasideDb.runAsync('CREATE TABLE t (a)').then(function () {
+              var statistics = lookasideDb.getLookasideStatistics();
+              expect(statistics.slotsHighWater).not.toBeGreaterThan(32);
+              lookasideDb.close();
+            });
+          })
+        );
+      });
+    });
+
+    describe('importAsync()', function () {
+      function writeFileAsync(name, text) {
+        var tempFolder = Windows.Storage.ApplicationData.current.temporaryFolder;
+        return tempFolder.createFileAsync(name, Windows.Storage.CreationCollisionOption.replaceExisting)
+        .then(function (file) {
+          return Windows.Storage.FileIO.writeTextAsync(file, text).then(function () {
+            return file;
+          });
+        });
+      }
+
+      it('should import CSV files', function () {
+        spec.async(
+          writeFileAsync('import.csv', 'id,name,price\n4,"Kiwi, green",0.5\n5,Lime,0.7\n').then(function (file) {
+            return db.importAsync(file, 'csv', 'Item');
+          }).then(function (rows) {
+            expect(rows).toEqual(2);
+            return db.oneAsync('SELECT name, price FROM Item WHERE id = 4');
+          }).then(function (row) {
+            expect(row.name).toEqual('Kiwi, green');
+            expect(row.price).toEqual(0.5);
+          })
+        );
+      });
+
+      it('should import NDJSON files and report progress', function () {
+        var progress = [];
+        spec.async(
+          writeFileAsync('import.ndjson', '{"id": 6, "name": "Plum"}\n{"id": 7, "name": "Fig", "price": 2}\n').then(function (file) {
+            return db.importAsync(file, 'ndjson', 'Item', { batchSize: 1 }).then(null, null, function (rows) {
+              progress.push(rows);
+            });
+          }).then(function (rows) {
+            expect(rows).toEqual(2);
+            expect(progress).toEqual([1, 2]);
+            return db.oneAsync('SELECT COUNT(*) AS count FROM Item');
+          }).then(function (row) {
+            expect(row.count).toEqual(5);
+          })
+        );
+      });
+
+      it('should report malformed records', function () {
+        spec.async(
+          writeFileAsync('broken.csv', 'id,name\n8,"unterminated\n').then(function (file) {
+            return db.importAsync(file, 'csv', 'Item');
+          }).then(function () {
+            expect('the import').toBe('failing');
+          }, function (error) {
+            expect(error.message).toContain('Unterminated quoted field');
+          })
+        );
+      });
+    });
+
+    describe('executeManyAsync()', function () {
+      it('should run several statements in one call', function () {
+        spec.async(
+          db.executeManyAsync([
+            { sql: 'INSERT INTO Item (name, price, id) VALUES (?, ?, ?)', args: ['Kiwi', 0.5, 4] },
+            { sql: 'UPDATE Item SET price = :price WHERE id = :id', args: { price: 1.5, id: 4 } },
+            'DELETE FROM Item WHERE id = 1; DELETE FROM Item WHERE id = 2',
+            { sql: 'SELECT name FROM Item WHERE price < ? ORDER BY id', args: [2] }
+          ]).then(function (results) {
+            expect(results.length).toEqual(4);
+            expect(results[0]).toEqual({ changes: 1, lastInsertRowId: 4 });
+            expect(results[1].changes).toEqual(1);
+            expect(results[2].changes).toEqual(1);
+            expect(results[3].rows).toEqual([{ name: 'Kiwi' }]);
+          })
+        );
+      });
+
+      it('should roll back all statements when one fails', function () {
+        spec.async(
+          db.executeManyAsync([
+            { sql: 'DELETE FROM Item WHERE id = ?', args: [3] },
+            'INSERT INTO Item (id) VALUES (1)'
+          ]).then(function () {
+            expect('the batch').toBe('failing');
+          }, function (error) {
+            expect(error.message).toContain('Statement 2');
+            return db.oneAsync('SELECT COUNT(*) AS count FROM Item');
+          }).then(function (row) {
+            expect(row.count).toEqual(3);
+          })
+        );
+      });
+    });
+
+    describe('queryAsync()', function () {
+      it('should return typed native rows', function () {
+        spec.async(
+          db.queryAsync('SELECT id, name, price, dateBought, x\'0102\' AS data FROM Item ORDER BY id').then(function (resultSet) {
+            var row = resultSet.rows[1];
+            expect(resultSet.size).toEqual(3);
+            expect(resultSet.columnNames.length).toEqual(5);
+            expect(resultSet.columnIndex('price')).toEqual(2);
+            expect(row.getType(0)).toEqual(SQLite3.ColumnType.integer);
+            expect(row.getValue(0)).toEqual(2);
+            expect(row.getValueByName('name')).toEqual('Orange');
+            expect(row.getDouble(2)).toEqual(2.5);
+            expect(row.isNull(3)).toBeTruthy();
+            expect(row.getValue(3)).toBeNull();
+            expect(Windows.Security.Cryptography.CryptographicBuffer.encodeToHexString(row.getValue(4))).toEqual('0102');
+          })
+        );
+      });
+
+      it('should return an empty result set', function () {
+        spec.async(
+          db.queryAsync('SELECT * FROM Item WHERE id = ?', [42]).then(function (resultSet) {
+            expect(resultSet.size).toEqual(0);
+            expect(resultSet.rows.length).toEqual(0);
+          })
+        );
+      });
+    });
+
+    describe('openBlobAsync()', function () {
+      var CryptographicBuffer = Windows.Security.Cryptography.CryptographicBuffer;
+
+      beforeEach(function () {
+        spec.async(
+          db.runAsync('CREATE TABLE Media (id INTEGER PRIMARY KEY, data BLOB)').then(function () {
+            return db.runAsync('INSERT INTO Media (id, data) VALUES (?, ?)', [1, new SQLite3.ZeroBlob(8)]);
+          })
+        );
+      });
+
+      it('should write and read a blob in chunks', function () {
+        var blob;
+        spec.async(
+          db.openBlobAsync('Media', 'data', 1, true).then(function (stream) {
+            blob = stream;
+            expect(blob.size).toEqual(8);
+            return blob.writeAsync(0, CryptographicBuffer.decodeFromHexString('01020304'));
+          }).then(function () {
+            return blob.writeAsync(4, CryptographicBuffer.decodeFromHexString('05060708'));
+          }).then(function () {
+            return blob.readAsync(6, 10);
+          }).then(function (buffer) {
+            expect(CryptographicBuffer.encodeToHexString(buffer)).toEqual('0708');
+            blob.close();
+            return db.oneAsync('SELECT data FROM Media WHERE id = 1');
+          }).then(function (row) {
+            expect(row.data).toEqual('AQIDBAUGBwg=');
+          })
+        );
+      });
+
+      it('should not write past the end of a blob', function () {
+        var blob;
+        spec.async(
+          db.openBlobAsync('Media', 'data', 1, true).then(function (stream) {
+            blob = stream;
+            return blob.writeAsync(6, CryptographicBuffer.decodeFromHexString('010203'));
+          }).then(function () {
+            expect('the write').toBe('failing');
+          }, function (error) {
+            expect(error).toBeDefined();
+          }).then(function () {
+            blob.close();
+          })
+        );
+      });
+    });
+
+    describe('exportAsync()', function () {
+      function readFileAsync(path) {
+        return Windows.Storage.StorageFile.getFileFromPathAsync(path).then(function (file) {
+          return Windows.Storage.FileIO.readTextAsync(file);
+        });
+      }
+
+      it('should export NDJSON files', function () {
+        var path = Windows.Storage.ApplicationData.current.temporaryFolder.path + '\\export.ndjson';
+        spec.async(
+          db.exportAsync('SELECT name, price FROM Item WHERE price > ? ORDER BY id', [2], path, 'ndjson').then(function (rows) {
+            expect(rows).toEqual(2);
+            return readFileAsync(path);
+          }).then(function (text) {
+            expect(text).toEqual('{"name":"Orange","price":2.5}\n{"name":"Banana","price":3.0}\n');
+          })
+        );
+      });
+
+      it('should export CSV files and report progress', function () {
+        var path = Windows.Storage.ApplicationData.current.temporaryFolder.path + '\\export.csv',
+            progress = [];
+        spec.async(
+          db.exportAsync('SELECT id, name FROM Item ORDER BY id', path, 'csv').then(null, null, function (rows) {
+            progress.push(rows);
+          }).then(function (rows) {
+            expect(rows).toEqual(3);
+            expect(progress).toEqual([3]);
+            return readFileAsync(path);
+          }).then(function (text) {
+            expect(text).toEqual('id,name\r\n1,Apple\r\n2,Orange\r\n3,Banana\r\n');
+          })
+        );
+      });
+
+      it('should reject unknown formats', function () {
+        spec.async(
+          db.exportAsync('SELECT * FROM Item', 'export.xml', 'xml').then(function () {
+            expect('the export').toBe('failing');
+          }, function (error) {
+            expect(error).toBeDefined();
+          })
+        );
+      });
+    });
+
     describe('Concurrency Handling', function () {
       it('should support two concurrent connections', function () {
         var tempFolder = Windows.Storage.ApplicationData.current.temporaryFolder,
@@ -432,6 +819,632 @@
       });
     });
 
+    describe('Busy handling', function () {
+      var tempFolder = Windows.Storage.ApplicationData.current.temporaryFolder,
+          dbFilename = tempFolder.path + "\\busyTest.sqlite";
+
+      function lockAndWrite(configure) {
+        var holder = null, waiter = null;
+        return WinJS.Promise.join([SQLite3JS.openAsync(dbFilename), SQLite3JS.openAsync(dbFilename)]).then(function (dbs) {
+          holder = dbs[0];
+          waiter = dbs[1];
+          configure(waiter);
+          return holder.runAsync("CREATE TABLE IF NOT EXISTS BusyData (id INTEGER PRIMARY KEY)");
+        }).then(function () {
+          return holder.runAsync("BEGIN IMMEDIATE");
+        }).then(function () {
+          var write = waiter.runAsync("INSERT INTO BusyData DEFAULT VALUES").then(function () {
+            return true;
+          }, function (error) {
+            expect(error.resultCode).toEqual(SQLite3.ResultCode.busy);
+            return false;
+          });
+          return WinJS.Promise.timeout(200).then(function () {
+            return holder.runAsync("ROLLBACK");
+          }).then(function () {
+            return write;
+          });
+        }).then(function (written) {
+          var statistics = waiter.getBusyStatistics();
+          holder.close();
+          waiter.close();
+          return { written: written, statistics: statistics };
+        });
+      }
+
+      it('should wait for the lock of another connection', function () {
+        spec.async(
+          lockAndWrite(function (waiter) {
+            expect(waiter.busyWait).toEqual(SQLite3.BusyWaitPolicy.backoff);
+          }).then(function (result) {
+            expect(result.written).toEqual(true);
+            expect(result.statistics.waits).toEqual(1);
+            expect(result.statistics.failures).toEqual(0);
+            expect(result.statistics.longestWaitMilliseconds).toBeGreaterThan(0);
+          })
+        );
+      });
+
+      it('should fail when the timeout elapsed', function () {
+        spec.async(
+          lockAndWrite(function (waiter) {
+            waiter.busyWait = SQLite3.BusyWaitPolicy.timeout;
+            waiter.busyTimeout = 50;
+          }).then(function (result) {
+            expect(result.written).toEqual(false);
+            expect(result.statistics.failures).toEqual(1);
+          })
+        );
+      });
+    });
+
+    describe('Shared cache locks', function () {
+      it('should wait for the lock of another connection', function () {
+        var tempFolder = Windows.Storage.ApplicationData.current.temporaryFolder,
+            dbFilename = tempFolder.path + "\\lockTest.sqlite",
+            writer = null, reader = null;
+
+        SQLite3.Database.sharedCache = true;
+
+        spec.async(
+          WinJS.Promise.join([SQLite3JS.openAsync(dbFilename), SQLite3JS.openAsync(dbFilename)]).then(function (dbs) {
+            writer = dbs[0];
+            reader = dbs[1];
+            return writer.runAsync("CREATE TABLE IF NOT EXISTS LockData (id INTEGER PRIMARY KEY)");
+          }).then(function () {
+            return writer.runAsync("DELETE FROM LockData");
+          }).then(function () {
+            return writer.runAsync("BEGIN");
+          }).then(function () {
+            return writer.runAsync("INSERT INTO LockData (id) VALUES (1)");
+          }).then(function () {
+            var read = reader.oneAsync("SELECT COUNT(*) AS count FROM LockData");
+            return WinJS.Promise.timeout(100).then(function () {
+              return writer.runAsync("COMMIT");
+            }).then(function () {
+              return read;
+            });
+          }).then(function (row) {
+            expect(row.count).toEqual(1);
+            var statistics = reader.getLockWaitStatistics();
+            expect(statistics.waits).toEqual(1);
+            expect(statistics.timeouts).toEqual(0);
+            expect(statistics.longestWaitMilliseconds).toBeGreaterThan(0);
+          }).then(function () {
+            writer.close();
+            reader.close();
+          })
+        );
+      });
+
+      it('should let the timeout be configured', function () {
+        db.lockTimeout = 0;
+        expect(db.lockTimeout).toEqual(0);
+        expect(db.getLockWaitStatistics().waits).toEqual(0);
+      });
+    });
+
+    describe('Backup', function () {
+      var tempFolder = Windows.Storage.ApplicationData.current.temporaryFolder,
+          backupFilename = tempFolder.path + "\\backupTest.sqlite";
+
+      it('should copy the database in steps while it is in use', function () {
+        var progress = [];
+
+        spec.async(
+          db.runAsync("CREATE TABLE Filler (data BLOB)").then(function () {
+            return db.runAsync("INSERT INTO Filler VALUES (zeroblob(100000))");
+          }).then(function () {
+            var backup = db.backupAsync(backupFilename, { pagesPerStep: 5, pause: 1 }).then(null, null, function (step) {
+              progress.push(step);
+            });
+            // Runs between the steps of the backup
+            var read = db.oneAsync("SELECT COUNT(*) AS count FROM Item");
+            return WinJS.Promise.join([backup, read]);
+          }).then(function (results) {
+            expect(results[1].count).toEqual(3);
+            expect(results[0]).toBeGreaterThan(5);
+            expect(progress.length).toBeGreaterThan(1);
+            expect(progress[progress.length - 1].pagesCopied).toEqual(results[0]);
+            expect(progress[progress.length - 1].pageCount).toEqual(results[0]);
+            return SQLite3JS.openAsync(backupFilename);
+          }).then(function (copy) {
+            return copy.allAsync("SELECT name FROM Item ORDER BY id").then(function (rows) {
+              expect(rows.map(function (row) { return row.name; })).toEqual(["Apple", "Orange", "Banana"]);
+              copy.close();
+            });
+          })
+        );
+      });
+
+      it('should stop when canceled', function () {
+        var thisSpec = this;
+
+        spec.async(
+          db.runAsync("CREATE TABLE Filler (data BLOB)").then(function () {
+            return db.runAsync("INSERT INTO Filler VALUES (zeroblob(1000000))");
+          }).then(function () {
+            var backup = db.backupAsync(backupFilename, { pagesPerStep: 1, pause: 10 });
+            backup.cancel();
+            return backup;
+          }).then(function () {
+            thisSpec.fail('The backup was not canceled.');
+          }, function (error) {
+            expect(error.message).toEqual('Canceled');
+          })
+        );
+      });
+
+      it('should reject an invalid step size', function () {
+        expect(function () { db.backupAsync(backupFilename, { pagesPerStep: 0 }); }).toThrow();
+      });
+    });
+
+    describe('Loading into memory', function () {
+      var tempFolder = Windows.Storage.ApplicationData.current.temporaryFolder,
+          dbFilename = tempFolder.path + "\\memoryTest.sqlite";
+
+      beforeEach(function () {
+        spec.async(
+          SQLite3JS.openAsync(dbFilename).then(function (fileDb) {
+            return fileDb.runAsync("DROP TABLE IF EXISTS Fruit").then(function () {
+              return fileDb.runAsync("CREATE TABLE Fruit (name TEXT)");
+            }).then(function () {
+              return fileDb.runAsync("INSERT INTO Fruit VALUES ('Apple')");
+            }).then(function () {
+              fileDb.close();
+            });
+          })
+        );
+      });
+
+      function count(path) {
+        return SQLite3JS.openAsync(path).then(function (fileDb) {
+          return fileDb.oneAsync("SELECT COUNT(*) AS count FROM Fruit").then(function (row) {
+            fileDb.close();
+            return row.count;
+          });
+        });
+      }
+
+      it('should keep changes in memory until persisted', function () {
+        var memoryDb = null;
+
+        spec.async(
+          SQLite3JS.openAsync(dbFilename, { loadIntoMemory: true }).then(function (opened) {
+            memoryDb = opened;
+            var statistics = memoryDb.getMemoryDatabaseStatistics();
+            expect(statistics.loaded).toEqual(true);
+            expect(statistics.databaseBytes).toBeGreaterThan(0);
+            return memoryDb.runAsync("INSERT INTO Fruit VALUES ('Orange')");
+          }).then(function () {
+            return count(dbFilename);
+          }).then(function (fileCount) {
+            expect(fileCount).toEqual(1);
+            return memoryDb.persistAsync();
+          }).then(function () {
+            expect(memoryDb.getMemoryDatabaseStatistics().persists).toEqual(1);
+            memoryDb.close();
+            return count(dbFilename);
+          }).then(function (fileCount) {
+            expect(fileCount).toEqual(2);
+          })
+        );
+      });
+
+      it('should persist on a timer', function () {
+        var memoryDb = null;
+
+        spec.async(
+          SQLite3JS.openAsync(dbFilename, { loadIntoMemory: true, persistInterval: 50 }).then(function (opened) {
+            memoryDb = opened;
+            return memoryDb.runAsync("INSERT INTO Fruit VALUES ('Orange')");
+          }).then(function () {
+            return WinJS.Promise.timeout(200);
+          }).then(function () {
+            expect(memoryDb.getMemoryDatabaseStatistics().persists).toEqual(1);
+            return count(dbFilename);
+          }).then(function (fileCount) {
+            expect(fileCount).toEqual(2);
+            memoryDb.close();
+          })
+        );
+      });
+
+      it('should not persist a database that was opened from the file', function () {
+        var thisSpec = this;
+
+        expect(db.getMemoryDatabaseStatistics().loaded).toEqual(false);
+        spec.async(
+          db.persistAsync().then(function () {
+            thisSpec.fail('The error handler was not called.');
+          }, function (error) {
+            expect(error.resultCode).toEqual(SQLite3.ResultCode.misuse);
+          })
+        );
+      });
+    });
+
+    describe('Statement cache', function () {
+      it('should reuse prepared statements', function () {
+        var before = db.getStatementCacheStatistics();
+
+        expect(db.statementCacheCapacity).toEqual(16);
+        spec.async(
+          db.oneAsync("SELECT name FROM Item WHERE id = ?", [1]).then(function () {
+            return db.oneAsync("SELECT name FROM Item WHERE id = ?", [2]);
+          }).then(function (row) {
+            expect(row.name).toEqual("Orange");
+            var statistics = db.getStatementCacheStatistics();
+            expect(statistics.misses - before.misses).toEqual(1);
+            expect(statistics.hits - before.hits).toEqual(1);
+          })
+        );
+      });
+
+      it('should finalize statements without capacity', function () {
+        db.statementCacheCapacity = 0;
+        spec.async(
+          db.oneAsync("SELECT COUNT(*) AS count FROM Item").then(function () {
+            expect(db.getStatementCacheStatistics().entries).toEqual(0);
+          })
+        );
+      });
+    });
+
+    describe('Coordinated writes', function () {
+      var tempFolder = Windows.Storage.ApplicationData.current.temporaryFolder,
+          dbFilename = tempFolder.path + "\\coordinated test.sqlite";
+
+      function increment(writerDb) {
+        return writerDb.executeManyAsync([
+          "CREATE TABLE IF NOT EXISTS Counter (value INTEGER)",
+          "INSERT INTO Counter SELECT 0 WHERE NOT EXISTS (SELECT * FROM Counter)",
+          "UPDATE Counter SET value = (SELECT value FROM Counter) + 1"
+        ]);
+      }
+
+      it('should not coordinate writes by default', function () {
+        expect(db.coordinateWrites).toEqual(false);
+      });
+
+      it('should let batches of several connections take turns', function () {
+        var before = SQLite3.Database.getWriteCoordinatorStatistics(),
+            writers = [];
+
+        spec.async(
+          WinJS.Promise.join([
+            SQLite3JS.openAsync(dbFilename, { coordinateWrites: true }),
+            SQLite3JS.openAsync(dbFilename, { coordinateWrites: true }),
+            SQLite3JS.openAsync(dbFilename, { coordinateWrites: true })
+          ]).then(function (opened) {
+            writers = opened;
+            expect(writers[0].coordinateWrites).toEqual(true);
+            return writers[0].runAsync("DROP TABLE IF EXISTS Counter");
+          }).then(function () {
+            var increments = [];
+            writers.forEach(function (writerDb) {
+              increments.push(increment(writerDb), increment(writerDb));
+            });
+            return WinJS.Promise.join(increments);
+          }).then(function () {
+            return writers[0].oneAsync("SELECT value FROM Counter");
+          }).then(function (row) {
+            expect(row.value).toEqual(6);
+            var statistics = SQLite3.Database.getWriteCoordinatorStatistics();
+            expect(statistics.acquisitions - before.acquisitions).toEqual(6);
+            expect(statistics.totalWaitMilliseconds).not.toBeLessThan(before.totalWaitMilliseconds);
+            writers.forEach(function (writerDb) {
+              writerDb.close();
+            });
+          })
+        );
+      });
+    });
+
+    describe('Immutable databases', function () {
+      var tempFolder = Windows.Storage.ApplicationData.current.temporaryFolder,
+          dbFilename = tempFolder.path + "\\immutable test.sqlite",
+          hotStatement = "SELECT name FROM Fruit WHERE rowid = ?";
+
+      beforeEach(function () {
+        spec.async(
+          SQLite3JS.openAsync(dbFilename).then(function (fileDb) {
+            return fileDb.runAsync("DROP TABLE IF EXISTS Fruit").then(function () {
+              return fileDb.runAsync("CREATE TABLE Fruit (name TEXT)");
+            }).then(function () {
+              return fileDb.runAsync("INSERT INTO Fruit VALUES ('Apple')");
+            }).then(function () {
+              fileDb.close();
+            });
+          })
+        );
+      });
+
+      it('should answer hot statements from the statement cache', function () {
+        var immutableDb = null;
+
+        spec.async(
+          SQLite3JS.openAsync(dbFilename, { immutable: true, prepare: [hotStatement] }).then(function (opened) {
+            immutableDb = opened;
+            expect(immutableDb.immutable).toEqual(true);
+            expect(immutableDb.getStatementCacheStatistics().entries).toEqual(1);
+            return immutableDb.oneAsync(hotStatement, [1]);
+          }).then(function (row) {
+            expect(row.name).toEqual("Apple");
+            var statistics = immutableDb.getStatementCacheStatistics();
+            expect(statistics.hits).toEqual(1);
+            expect(statistics.misses).toEqual(0);
+            return immutableDb.oneAsync("PRAGMA mmap_size");
+          }).then(function (row) {
+            expect(row.mmap_size).toBeGreaterThan(0);
+            immutableDb.close();
+          })
+        );
+      });
+
+      it('should reject writes', function () {
+        var thisSpec = this,
+            immutableDb = null;
+
+        spec.async(
+          SQLite3JS.openAsync(dbFilename, { immutable: true }).then(function (opened) {
+            immutableDb = opened;
+            return immutableDb.runAsync("INSERT INTO Fruit VALUES ('Orange')");
+          }).then(function () {
+            thisSpec.fail('The error handler was not called.');
+          }, function (error) {
+            expect(error.resultCode).toEqual(SQLite3.ResultCode.readOnly);
+            immutableDb.close();
+          })
+        );
+      });
+
+      it('should report the time spent in each phase of the open', function () {
+        spec.async(
+          SQLite3JS.openAsync(dbFilename, { prepare: [hotStatement, "SELECT COUNT(*) FROM Fruit"] }).then(function (fileDb) {
+            var statistics = fileDb.getOpenStatistics();
+            expect(statistics.preparedStatements).toEqual(2);
+            expect(statistics.openMilliseconds).toBeGreaterThan(0);
+            expect(statistics.totalMilliseconds).not.toBeLessThan(statistics.openMilliseconds +
+              statistics.schemaMilliseconds + statistics.prepareMilliseconds);
+            expect(SQLite3JS.version).toContain(SQLite3.Database.version);
+            fileDb.close();
+          })
+        );
+      });
+
+      it('should fail to open with a statement that does not prepare', function () {
+        var thisSpec = this;
+
+        spec.async(
+          SQLite3JS.openAsync(dbFilename, { immutable: true, prepare: ["SELECT * FROM Vegetable"] }).then(function () {
+            thisSpec.fail('The error handler was not called.');
+          }, function (error) {
+            expect(error.resultCode).toEqual(SQLite3.ResultCode.error);
+          })
+        );
+      });
+    });
+
+    describe('Temp store', function () {
+      var report = "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 20000) " +
+                   "SELECT i FROM n ORDER BY randomblob(200)";
+
+      afterEach(function () {
+        db.tempStoreBudget = 0;
+      });
+
+      it('should keep temporary data in memory by default', function () {
+        var before = SQLite3.Database.getTempStoreStatistics();
+        expect(db.tempStoreBudget).toEqual(0);
+
+        spec.async(
+          db.allAsync(report).then(function (rows) {
+            expect(rows.length).toEqual(20000);
+            expect(SQLite3.Database.getTempStoreStatistics().spills).toEqual(before.spills);
+          })
+        );
+      });
+
+      it('should spill large sorts beyond the budget to temporary files', function () {
+        var before = SQLite3.Database.getTempStoreStatistics();
+        db.tempStoreBudget = 64 * 1024;
+
+        spec.async(
+          db.runAsync("PRAGMA cache_size = -256").then(function () {
+            return db.allAsync(report);
+          }).then(function (rows) {
+            var statistics = SQLite3.Database.getTempStoreStatistics();
+            expect(rows.length).toEqual(20000);
+            expect(statistics.spills).toBeGreaterThan(before.spills);
+            expect(statistics.spilledBytes).toBeGreaterThan(before.spilledBytes);
+            expect(statistics.peakBytes).toBeGreaterThan(0);
+          })
+        );
+      });
+
+      it('should not accept a negative budget', function () {
+        expect(function () {
+          db.tempStoreBudget = -1;
+        }).toThrow();
+      });
+    });
+
+    describe('Worker threads', function () {
+      afterEach(function () {
+        db.workerThreads = 0;
+      });
+
+      it('should sort on the connection thread by default', function () {
+        expect(db.workerThreads).toEqual(0);
+      });
+
+      it('should sort with the requested worker threads', function () {
+        db.workerThreads = 2;
+        expect(db.workerThreads).toEqual(2);
+
+        spec.async(
+          db.allAsync("SELECT name FROM Item ORDER BY name").then(function (rows) {
+            expect(rows.map(function (row) { return row.name; })).toEqual(['Apple', 'Banana', 'Orange']);
+          })
+        );
+      });
+
+      it('should take the thread count as an open option', function () {
+        spec.async(
+          SQLite3JS.openAsync(':memory:', { threads: 4 }).then(function (threadedDb) {
+            expect(threadedDb.workerThreads).toEqual(4);
+            threadedDb.close();
+          })
+        );
+      });
+
+      it('should not accept a negative thread count', function () {
+        expect(function () {
+          db.workerThreads = -1;
+        }).toThrow();
+      });
+    });
+
+    describe('No mutex', function () {
+      it('should lock per call by default', function () {
+        expect(db.noMutex).toEqual(false);
+        expect(db.getExecutionContextStatistics().entries).toEqual(0);
+      });
+
+      it('should run the operations of a connection without mutex one at a time', function () {
+        spec.async(
+          SQLite3JS.openAsync(':memory:', { noMutex: true }).then(function (unlockedDb) {
+            expect(unlockedDb.noMutex).toEqual(true);
+            return unlockedDb.runAsync("CREATE TABLE Item (name TEXT)").then(function () {
+              return WinJS.Promise.join([
+                unlockedDb.runAsync("INSERT INTO Item VALUES ('Apple')"),
+                unlockedDb.runAsync("INSERT INTO Item VALUES ('Banana')"),
+                unlockedDb.oneAsync("SELECT COUNT(*) AS count FROM Item")
+              ]);
+            }).then(function () {
+              unlockedDb.statementCacheCapacity = 4;
+              return unlockedDb.oneAsync("SELECT COUNT(*) AS count FROM Item");
+            }).then(function (row) {
+              expect(row.count).toEqual(2);
+              var statistics = unlockedDb.getExecutionContextStatistics();
+              expect(statistics.entries).toBeGreaterThan(4);
+              expect(statistics.contended).not.toBeGreaterThan(statistics.entries);
+              unlockedDb.close();
+            });
+          })
+        );
+      });
+    });
+
+    describe('Page profiles', function () {
+      var tempFolder = Windows.Storage.ApplicationData.current.temporaryFolder,
+          dbFilename = tempFolder.path + "\\profileTest.sqlite",
+          previousDuration;
+
+      beforeEach(function () {
+        previousDuration = SQLite3.Database.pageProfileDuration;
+        SQLite3.Database.pageProfileDuration = 60000;
+      });
+
+      afterEach(function () {
+        SQLite3.Database.pageProfileDuration = previousDuration;
+      });
+
+      function readAll() {
+        return SQLite3JS.openAsync(dbFilename, { pageProfile: true }).then(function (profiledDb) {
+          return profiledDb.runAsync("CREATE TABLE IF NOT EXISTS Fruit (name TEXT)").then(function () {
+            return profiledDb.runAsync("INSERT INTO Fruit VALUES ('Apple')");
+          }).then(function () {
+            return profiledDb.allAsync("SELECT * FROM Fruit");
+          }).then(function () {
+            profiledDb.close();
+          });
+        });
+      }
+
+      it('should record the pages read and prefetch them on the next open', function () {
+        var before = SQLite3.Database.getPageProfileStatistics();
+
+        spec.async(
+          readAll().then(function () {
+            var statistics = SQLite3.Database.getPageProfileStatistics();
+            expect(statistics.recordedPages).toBeGreaterThan(before.recordedPages);
+            expect(statistics.profilesWritten).toEqual(before.profilesWritten + 1);
+            return readAll();
+          }).then(function () {
+            var statistics = SQLite3.Database.getPageProfileStatistics();
+            // Closing the database stops a prefetch that is still running
+            expect(statistics.prefetches).toEqual(before.prefetches + 1);
+          })
+        );
+      });
+
+      it('should not combine page profiles with loading into memory', function () {
+        expect(function () {
+          SQLite3JS.openAsync(dbFilename, { pageProfile: true, loadIntoMemory: true });
+        }).toThrow();
+      });
+    });
+
+    describe('WAL checkpoints', function () {
+      var tempFolder = Windows.Storage.ApplicationData.current.temporaryFolder,
+          dbFilename = tempFolder.path + "\\walTest.sqlite";
+
+      function writeInWalMode(configure) {
+        var walDb = null;
+        return SQLite3JS.openAsync(dbFilename).then(function (opened) {
+          walDb = opened;
+          configure(walDb);
+          return walDb.oneAsync("PRAGMA journal_mode = WAL");
+        }).then(function (row) {
+          expect(row.journal_mode).toEqual("wal");
+          return walDb.runAsync("CREATE TABLE IF NOT EXISTS WalData (id INTEGER PRIMARY KEY, value TEXT)");
+        }).then(function () {
+          return walDb.runAsync("INSERT INTO WalData (value) VALUES (?)", ["value"]);
+        }).then(function () {
+          // The checkpoint runs after the insert, once the connection is idle
+          return WinJS.Promise.timeout(100);
+        }).then(function () {
+          var statistics = walDb.getCheckpointStatistics();
+          walDb.close();
+          return statistics;
+        });
+      }
+
+      it('should checkpoint passively after the commit', function () {
+        spec.async(
+          writeInWalMode(function (walDb) {
+            expect(walDb.checkpointFrames).toEqual(1000);
+            walDb.checkpointFrames = 0;
+          }).then(function (statistics) {
+            expect(statistics.passive).toBeGreaterThan(0);
+            expect(statistics.restart).toEqual(0);
+            expect(statistics.framesRemaining).toEqual(0);
+            expect(statistics.framesCheckpointed).toBeGreaterThan(0);
+          })
+        );
+      });
+
+      it('should restart the WAL once it is large enough', function () {
+        spec.async(
+          writeInWalMode(function (walDb) {
+            walDb.checkpointRestartFrames = 1;
+          }).then(function (statistics) {
+            expect(statistics.passive).toEqual(0);
+            expect(statistics.restart).toBeGreaterThan(0);
+            expect(statistics.busy).toEqual(0);
+          })
+        );
+      });
+
+      it('should not accept negative thresholds', function () {
+        expect(function () { db.checkpointRestartAge = -1; }).toThrow();
+        expect(db.checkpointRestartAge).toEqual(30000);
+      });
+    });
+
     describe('Opening databases', function () {
       it('should open file with URI notation', function () {
         var thisSpec = this,
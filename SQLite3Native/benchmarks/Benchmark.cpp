@@ -0,0 +1,710 @@
+// Benchmarks for the portable hot paths of SQLite3Component: binding,
+// row serialization, string escaping, BASE64 encoding, the collation
+// adapter, REGEXP, the bulk importer and sorting with worker threads. Runs
+// against the system SQLite on Linux.
+//
+//   SQLite3Bench [--quick] [--max-rows N] [--filter TEXT]
+//                [--json FILE] [--baseline FILE] [--tolerance PERCENT]
+//                [--allocator system|pool] [--profile default|performance]
+//
+// The performance profile switches off SQLite's memory status accounting at
+// runtime, the part of the SQLITE_PROFILE=Performance compile options a
+// system SQLite can follow, so its numbers measure that toggle only. An
+// engine built with that profile from an amalgamation already runs without
+// it.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ConnectionOptions.h"
+#include "Importer.h"
+#include "MemoryAllocator.h"
+#include "ResultArena.h"
+#include "RowWriter.h"
+#include "SqlFunctions.h"
+
+namespace {
+  unsigned long long allocationCount = 0;
+}
+
+void* operator new(std::size_t size) {
+  ++allocationCount;
+  void* memory = std::malloc(size ? size : 1);
+  if (!memory) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+void operator delete(void* memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+  std::free(memory);
+}
+
+namespace {
+  using SQLite3::RowWriter;
+
+  sqlite3_mem_methods defaultMemMethods;
+
+  void* countingMalloc(int size) {
+    ++allocationCount;
+    return defaultMemMethods.xMalloc(size);
+  }
+
+  void* countingRealloc(void* memory, int size) {
+    ++allocationCount;
+    return defaultMemMethods.xRealloc(memory, size);
+  }
+
+  void installCountingAllocator() {
+    sqlite3_config(SQLITE_CONFIG_GETMALLOC, &defaultMemMethods);
+    sqlite3_mem_methods counting = defaultMemMethods;
+    counting.xMalloc = countingMalloc;
+    counting.xRealloc = countingRealloc;
+    if (sqlite3_config(SQLITE_CONFIG_MALLOC, &counting) != SQLITE_OK) {
+      throw std::runtime_error("Could not install the counting allocator");
+    }
+  }
+
+  struct Options {
+    bool quick;
+    size_t maxRows;
+    std::string filter;
+    std::string jsonPath;
+    std::string baselinePath;
+    double tolerance;
+    bool poolAllocator;
+    bool performanceProfile;
+  };
+
+  struct Result {
+    std::string name;
+    double nsPerRow;
+    double allocsPerRow;
+  };
+
+  class Random {
+  public:
+    explicit Random(unsigned int seed) : state(seed) {}
+
+    unsigned int Next() {
+      state = state * 1103515245u + 12345u;
+      return (state >> 8) & 0xffffff;
+    }
+
+    unsigned int Next(unsigned int limit) {
+      return Next() % limit;
+    }
+
+  private:
+    unsigned int state;
+  };
+
+  void check(int result, sqlite3* db, const char* what) {
+    if (result != SQLITE_OK && result != SQLITE_ROW && result != SQLITE_DONE) {
+      std::ostringstream message;
+      message << what << ": " << sqlite3_errmsg(db);
+      throw std::runtime_error(message.str());
+    }
+  }
+
+  sqlite3_stmt* prepare(sqlite3* db, const std::string& sql) {
+    sqlite3_stmt* statement = nullptr;
+    check(sqlite3_prepare_v2(db, sql.c_str(), -1, &statement, nullptr), db, sql.c_str());
+    return statement;
+  }
+
+  // Text with the characters that need escaping: quotes, backslashes,
+  // control characters and multi-byte UTF-8 sequences.
+  std::string makeText(Random& random, size_t length) {
+    static const char* const words[] = {
+      "apple", "Orange", "banana", "\"quoted\"", "back\\slash", "line\nbreak",
+      "tab\there", "M\xc3\xbcnchen", "\xe6\x9d\xb1\xe4\xba\xac", "caf\xc3\xa9", "plain", "text"
+    };
+    std::string text;
+    while (text.size() < length) {
+      if (!text.empty()) {
+        text.push_back(' ');
+      }
+      text.append(words[random.Next(sizeof(words) / sizeof(words[0]))]);
+    }
+    return text;
+  }
+
+  struct Mix {
+    const char* name;
+    const char* schema;
+    const char* insert;
+    void (*bind)(sqlite3_stmt* statement, Random& random, int row);
+  };
+
+  void bindIntegers(sqlite3_stmt* statement, Random& random, int row) {
+    sqlite3_bind_int(statement, 1, row);
+    sqlite3_bind_int64(statement, 2, static_cast<sqlite3_int64>(random.Next()) * 1000003);
+    sqlite3_bind_int(statement, 3, random.Next(100));
+  }
+
+  void bindMixed(sqlite3_stmt* statement, Random& random, int row) {
+    std::string name = makeText(random, 12);
+    sqlite3_bind_text(statement, 1, name.data(), static_cast<int>(name.size()), SQLITE_TRANSIENT);
+    sqlite3_bind_double(statement, 2, random.Next(100000) / 100.0);
+    sqlite3_bind_int(statement, 3, row % 17);
+    if (row % 2) {
+      std::string note = makeText(random, 40);
+      sqlite3_bind_text(statement, 4, note.data(), static_cast<int>(note.size()), SQLITE_TRANSIENT);
+    } else {
+      sqlite3_bind_null(statement, 4);
+    }
+  }
+
+  void bindText(sqlite3_stmt* statement, Random& random, int) {
+    std::string title = makeText(random, 40);
+    std::string body = makeText(random, 200);
+    sqlite3_bind_text(statement, 1, title.data(), static_cast<int>(title.size()), SQLITE_TRANSIENT);
+    sqlite3_bind_text(statement, 2, body.data(), static_cast<int>(body.size()), SQLITE_TRANSIENT);
+  }
+
+  void bindBlobs(sqlite3_stmt* statement, Random& random, int) {
+    unsigned char data[256];
+    for (size_t i = 0; i < sizeof(data); ++i) {
+      data[i] = static_cast<unsigned char>(random.Next());
+    }
+    std::string name = makeText(random, 12);
+    sqlite3_bind_text(statement, 1, name.data(), static_cast<int>(name.size()), SQLITE_TRANSIENT);
+    sqlite3_bind_blob(statement, 2, data, sizeof(data), SQLITE_TRANSIENT);
+  }
+
+  const Mix mixes[] = {
+    { "integers", "CREATE TABLE data (id INTEGER PRIMARY KEY, a INTEGER, b INTEGER, c INTEGER)",
+      "INSERT INTO data (a, b, c) VALUES (?, ?, ?)", bindIntegers },
+    { "mixed", "CREATE TABLE data (id INTEGER PRIMARY KEY, name TEXT, price REAL, quantity INTEGER, note TEXT)",
+      "INSERT INTO data (name, price, quantity, note) VALUES (?, ?, ?, ?)", bindMixed },
+    { "text", "CREATE TABLE data (id INTEGER PRIMARY KEY, title TEXT, body TEXT)",
+      "INSERT INTO data (title, body) VALUES (?, ?)", bindText },
+    { "blobs", "CREATE TABLE data (id INTEGER PRIMARY KEY, name TEXT, data BLOB)",
+      "INSERT INTO data (name, data) VALUES (?, ?)", bindBlobs }
+  };
+
+  // Ordinal, ASCII case-insensitive comparison standing in for
+  // CompareStringEx, which is not available outside of Windows.
+  int ordinalCollateUtf16(void*, int str1Length, const void* str1Data, int str2Length, const void* str2Data) {
+    auto string1 = static_cast<const unsigned short*>(str1Data);
+    auto string2 = static_cast<const unsigned short*>(str2Data);
+    int length1 = str1Length / 2;
+    int length2 = str2Length / 2;
+    for (int i = 0; i < length1 && i < length2; ++i) {
+      unsigned short c1 = string1[i] >= 'A' && string1[i] <= 'Z' ? string1[i] + 32 : string1[i];
+      unsigned short c2 = string2[i] >= 'A' && string2[i] <= 'Z' ? string2[i] + 32 : string2[i];
+      if (c1 != c2) {
+        return c1 < c2 ? -1 : 1;
+      }
+    }
+    return length1 == length2 ? 0 : (length1 < length2 ? -1 : 1);
+  }
+
+  int benchCollateUtf8(void* data, int str1Length, const void* str1Data, int str2Length, const void* str2Data) {
+    return SQLite3::CollateUtf8AsUtf16(ordinalCollateUtf16, data, str1Length, str1Data, str2Length, str2Data);
+  }
+
+  sqlite3* openDatabase() {
+    sqlite3* db = nullptr;
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK) {
+      throw std::runtime_error("Could not open database");
+    }
+    sqlite3_create_collation_v2(db, "WINLOCALE", SQLITE_UTF8, nullptr, benchCollateUtf8, nullptr);
+    sqlite3_create_function_v2(db, "REGEXP", 2, SQLITE_UTF8, nullptr, SQLite3::SqliteRegexUtf8, nullptr, nullptr, nullptr);
+    return db;
+  }
+
+  class Runner {
+  public:
+    explicit Runner(const Options& options) : options(options) {}
+
+    bool Enabled(const std::string& name) const {
+      return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    // Runs body until the minimum duration is reached and records the
+    // average time and allocation count per row.
+    template <typename Body>
+    void Measure(const std::string& name, size_t rows, Body body) {
+      if (!Enabled(name)) {
+        return;
+      }
+      const std::chrono::nanoseconds minimumDuration = std::chrono::milliseconds(options.quick ? 0 : 200);
+      if (!options.quick && rows < 100000) {
+        body();
+      }
+
+      size_t iterations = 0;
+      unsigned long long allocationsBefore = allocationCount;
+      auto start = std::chrono::steady_clock::now();
+      std::chrono::nanoseconds elapsed;
+      do {
+        body();
+        ++iterations;
+        elapsed = std::chrono::steady_clock::now() - start;
+      } while (elapsed < minimumDuration);
+      unsigned long long allocations = allocationCount - allocationsBefore;
+
+      Result result;
+      result.name = name;
+      result.nsPerRow = static_cast<double>(elapsed.count()) / iterations / rows;
+      result.allocsPerRow = static_cast<double>(allocations) / iterations / rows;
+      results.push_back(result);
+
+      std::printf("%-36s %12.1f ns/row %10.3f allocs/row\n", name.c_str(), result.nsPerRow, result.allocsPerRow);
+      std::fflush(stdout);
+    }
+
+    const std::vector<Result>& Results() const {
+      return results;
+    }
+
+  private:
+    const Options& options;
+    std::vector<Result> results;
+  };
+
+  void runMix(Runner& runner, const Mix& mix, size_t rows) {
+    std::ostringstream suffix;
+    suffix << '/' << mix.name << '/' << rows;
+
+    sqlite3* db = openDatabase();
+    check(sqlite3_exec(db, mix.schema, nullptr, nullptr, nullptr), db, mix.schema);
+
+    // Populating the table is the bind benchmark: one cached INSERT,
+    // parameters bound per row like Statement::Bind does.
+    {
+      Random random(42);
+      sqlite3_stmt* insert = prepare(db, mix.insert);
+      bool populated = false;
+      runner.Measure("bind_insert" + suffix.str(), rows, [&]() {
+        if (populated) {
+          check(sqlite3_exec(db, "DELETE FROM data", nullptr, nullptr, nullptr), db, "DELETE");
+        }
+        check(sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr), db, "BEGIN");
+        for (size_t row = 0; row < rows; ++row) {
+          mix.bind(insert, random, static_cast<int>(row));
+          check(sqlite3_step(insert), db, "INSERT");
+          sqlite3_reset(insert);
+        }
+        check(sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr), db, "COMMIT");
+        populated = true;
+      });
+      sqlite3_finalize(insert);
+      if (!populated) {
+        // Filtered out, the table is still needed by the other benchmarks
+        check(sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr), db, "BEGIN");
+        insert = prepare(db, mix.insert);
+        for (size_t row = 0; row < rows; ++row) {
+          mix.bind(insert, random, static_cast<int>(row));
+          check(sqlite3_step(insert), db, "INSERT");
+          sqlite3_reset(insert);
+        }
+        sqlite3_finalize(insert);
+        check(sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr), db, "COMMIT");
+      }
+    }
+
+    // Statement::All: the whole result set as one JSON array
+    {
+      sqlite3_stmt* select = prepare(db, "SELECT * FROM data");
+      size_t outputSize = 0;
+      runner.Measure("all_json" + suffix.str(), rows, [&]() {
+        RowWriter writer(select);
+        std::string result("[");
+        while (sqlite3_step(select) == SQLITE_ROW) {
+          if (result.size() > 1) {
+            result.push_back(',');
+          }
+          writer.WriteRow(result);
+        }
+        result.push_back(']');
+        sqlite3_reset(select);
+        outputSize = result.size();
+      });
+      sqlite3_finalize(select);
+      if (outputSize == 1) {
+        throw std::runtime_error("all_json produced no rows");
+      }
+    }
+
+    // Statement::Collect: the result set as typed values in a ResultArena
+    {
+      sqlite3_stmt* select = prepare(db, "SELECT * FROM data");
+      bool complete = true;
+      runner.Measure("all_arena" + suffix.str(), rows, [&]() {
+        SQLite3::ResultArena arena(select);
+        while (sqlite3_step(select) == SQLITE_ROW) {
+          arena.AppendRow(select);
+        }
+        sqlite3_reset(select);
+        complete = arena.RowCount() == rows;
+      });
+      sqlite3_finalize(select);
+      if (!complete) {
+        throw std::runtime_error("all_arena lost rows");
+      }
+    }
+
+    // Statement::Each: one JSON object per row
+    {
+      sqlite3_stmt* select = prepare(db, "SELECT * FROM data");
+      runner.Measure("each_json" + suffix.str(), rows, [&]() {
+        RowWriter writer(select);
+        std::string row;
+        while (sqlite3_step(select) == SQLITE_ROW) {
+          row.clear();
+          writer.WriteRow(row);
+        }
+        sqlite3_reset(select);
+      });
+      sqlite3_finalize(select);
+    }
+
+    if (std::strcmp(mix.name, "mixed") == 0) {
+      // Database::PrepareAndBind for a typical lookup
+      Random random(7);
+      runner.Measure("prepare_bind" + suffix.str(), rows, [&]() {
+        for (size_t row = 0; row < rows; ++row) {
+          sqlite3_stmt* lookup = prepare(db, "SELECT * FROM data WHERE id = ? AND quantity < ?");
+          sqlite3_bind_int64(lookup, 1, random.Next(static_cast<unsigned int>(rows)) + 1);
+          sqlite3_bind_int(lookup, 2, 10);
+          sqlite3_step(lookup);
+          sqlite3_finalize(lookup);
+        }
+      });
+
+      runner.Measure("collation" + suffix.str(), rows, [&]() {
+        sqlite3_stmt* sorted = prepare(db, "SELECT name FROM data ORDER BY name COLLATE WINLOCALE");
+        while (sqlite3_step(sorted) == SQLITE_ROW) {
+        }
+        sqlite3_finalize(sorted);
+      });
+
+      runner.Measure("regexp" + suffix.str(), rows, [&]() {
+        sqlite3_stmt* matching = prepare(db, "SELECT COUNT(*) FROM data WHERE name REGEXP '^[a-m].*e$'");
+        check(sqlite3_step(matching), db, "REGEXP");
+        sqlite3_finalize(matching);
+      });
+    }
+
+    if (std::strcmp(mix.name, "text") == 0) {
+      std::vector<std::string> texts;
+      sqlite3_stmt* select = prepare(db, "SELECT title, body FROM data");
+      while (sqlite3_step(select) == SQLITE_ROW) {
+        texts.push_back(reinterpret_cast<const char*>(sqlite3_column_text(select, 0)));
+        texts.push_back(reinterpret_cast<const char*>(sqlite3_column_text(select, 1)));
+      }
+      sqlite3_finalize(select);
+
+      std::string output;
+      runner.Measure("write_escaped" + suffix.str(), rows, [&]() {
+        for (size_t i = 0; i < texts.size(); ++i) {
+          output.clear();
+          SQLite3::writeEscaped(texts[i].data(), texts[i].size(), output);
+        }
+      });
+    }
+
+    if (std::strcmp(mix.name, "blobs") == 0) {
+      std::vector<std::string> blobs;
+      sqlite3_stmt* select = prepare(db, "SELECT data FROM data");
+      while (sqlite3_step(select) == SQLITE_ROW) {
+        auto data = static_cast<const char*>(sqlite3_column_blob(select, 0));
+        blobs.push_back(std::string(data, sqlite3_column_bytes(select, 0)));
+      }
+      sqlite3_finalize(select);
+
+      std::string output;
+      runner.Measure("base64" + suffix.str(), rows, [&]() {
+        for (size_t i = 0; i < blobs.size(); ++i) {
+          output.clear();
+          SQLite3::writeBase64(reinterpret_cast<const unsigned char*>(blobs[i].data()), blobs[i].size(), output);
+        }
+      });
+    }
+
+    sqlite3_close(db);
+  }
+
+  class MemorySource : public SQLite3::ImportSource {
+  public:
+    explicit MemorySource(const std::string& data) : data(data), position(0) {}
+
+    size_t Read(char* buffer, size_t size) {
+      size_t length = std::min(size, data.size() - position);
+      std::memcpy(buffer, data.data() + position, length);
+      position += length;
+      return length;
+    }
+
+  private:
+    const std::string& data;
+    size_t position;
+  };
+
+  std::string quoteCsv(const std::string& text) {
+    std::string quoted("\"");
+    for (size_t i = 0; i < text.size(); ++i) {
+      if (text[i] == '"') {
+        quoted.push_back('"');
+      }
+      quoted.push_back(text[i]);
+    }
+    quoted.push_back('"');
+    return quoted;
+  }
+
+  // Database::ImportAsync for the mixed rows, from memory so that only the
+  // tokenizer and the binder are measured
+  void runImport(Runner& runner, size_t rows) {
+    Random random(11);
+    std::ostringstream csv;
+    std::ostringstream ndjson;
+    csv << "name,price,quantity,note\n";
+    for (size_t row = 0; row < rows; ++row) {
+      std::string name = makeText(random, 12);
+      std::string note = makeText(random, 40);
+      double price = random.Next(100000) / 100.0;
+      int quantity = static_cast<int>(row % 17);
+      csv << quoteCsv(name) << ',' << price << ',' << quantity << ',' << quoteCsv(note) << '\n';
+      std::string escapedName;
+      std::string escapedNote;
+      SQLite3::writeEscaped(name.data(), name.size(), escapedName);
+      SQLite3::writeEscaped(note.data(), note.size(), escapedNote);
+      ndjson << "{\"name\": " << escapedName << ", \"price\": " << price << ", \"quantity\": " << quantity
+             << ", \"note\": " << escapedNote << "}\n";
+    }
+
+    const char* const formats[] = { "csv", "ndjson" };
+    for (int format = 0; format < 2; ++format) {
+      std::ostringstream name;
+      name << "import_" << formats[format] << '/' << rows;
+      std::string data = format == 0 ? csv.str() : ndjson.str();
+
+      sqlite3* db = openDatabase();
+      check(sqlite3_exec(db, mixes[1].schema, nullptr, nullptr, nullptr), db, mixes[1].schema);
+      SQLite3::ImportOptions options;
+      options.format = format == 0 ? SQLite3::ImportCsv : SQLite3::ImportNdjson;
+      options.table = "data";
+      if (format == 1) {
+        options.columns.push_back("name");
+        options.columns.push_back("price");
+        options.columns.push_back("quantity");
+        options.columns.push_back("note");
+      }
+      runner.Measure(name.str(), rows, [&]() {
+        check(sqlite3_exec(db, "DELETE FROM data", nullptr, nullptr, nullptr), db, "DELETE");
+        MemorySource source(data);
+        SQLite3::ImportResult result = SQLite3::Import(db, options, source, nullptr);
+        if (result.resultCode != SQLITE_OK || result.rows != static_cast<long long>(rows)) {
+          throw std::runtime_error("Import failed: " + result.message);
+        }
+      });
+      sqlite3_close(db);
+    }
+  }
+
+  // CREATE INDEX and a large ORDER BY for each worker thread count of
+  // Database::WorkerThreads. The sorter only hands work to its threads when
+  // it writes sorted runs to temporary files, as it does with temp_store
+  // FILE once a run outgrows the cache.
+  void runSort(Runner& runner, size_t rows) {
+    sqlite3* db = openDatabase();
+    check(sqlite3_exec(db, mixes[1].schema, nullptr, nullptr, nullptr), db, mixes[1].schema);
+    check(sqlite3_exec(db, "PRAGMA temp_store = FILE", nullptr, nullptr, nullptr), db, "temp_store");
+    Random random(13);
+    check(sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr), db, "BEGIN");
+    sqlite3_stmt* insert = prepare(db, mixes[1].insert);
+    for (size_t row = 0; row < rows; ++row) {
+      mixes[1].bind(insert, random, static_cast<int>(row));
+      check(sqlite3_step(insert), db, "INSERT");
+      sqlite3_reset(insert);
+    }
+    sqlite3_finalize(insert);
+    check(sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr), db, "COMMIT");
+
+    const int threadCounts[] = { 0, 1, 2, 4, 8 };
+    for (size_t i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); ++i) {
+      int threads = SQLite3::SetWorkerThreads(db, threadCounts[i]);
+      if (threads < 0) {
+        throw std::runtime_error("The SQLite library does not sort with worker threads");
+      }
+      std::ostringstream suffix;
+      suffix << "/threads" << threadCounts[i] << '/' << rows;
+
+      runner.Measure("create_index" + suffix.str(), rows, [&]() {
+        check(sqlite3_exec(db, "CREATE INDEX data_name ON data (name, price)", nullptr, nullptr, nullptr), db, "CREATE INDEX");
+        check(sqlite3_exec(db, "DROP INDEX data_name", nullptr, nullptr, nullptr), db, "DROP INDEX");
+      });
+
+      size_t sortedRows = 0;
+      runner.Measure("order_by" + suffix.str(), rows, [&]() {
+        sqlite3_stmt* sorted = prepare(db, "SELECT name, note FROM data ORDER BY note, name");
+        sortedRows = 0;
+        while (sqlite3_step(sorted) == SQLITE_ROW) {
+          ++sortedRows;
+        }
+        sqlite3_finalize(sorted);
+      });
+      if (runner.Enabled("order_by" + suffix.str()) && sortedRows != rows) {
+        throw std::runtime_error("order_by lost rows");
+      }
+    }
+    sqlite3_close(db);
+  }
+
+  void writeJson(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream out(path.c_str());
+    out << "{\n  \"sqliteVersion\": \"" << sqlite3_libversion() << "\",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+      char line[256];
+      std::snprintf(line, sizeof(line), "    {\"name\": \"%s\", \"nsPerRow\": %.2f, \"allocsPerRow\": %.4f}%s\n",
+                    results[i].name.c_str(), results[i].nsPerRow, results[i].allocsPerRow,
+                    i + 1 < results.size() ? "," : "");
+      out << line;
+    }
+    out << "  ]\n}\n";
+    if (!out) {
+      throw std::runtime_error("Could not write " + path);
+    }
+  }
+
+  // Reads the files written by writeJson, it is not a general JSON parser
+  std::map<std::string, Result> readBaseline(const std::string& path) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+      throw std::runtime_error("Could not read " + path);
+    }
+    std::map<std::string, Result> baseline;
+    std::string line;
+    while (std::getline(in, line)) {
+      char name[128];
+      Result result;
+      if (std::sscanf(line.c_str(), " {\"name\": \"%127[^\"]\", \"nsPerRow\": %lf, \"allocsPerRow\": %lf",
+                      name, &result.nsPerRow, &result.allocsPerRow) == 3) {
+        result.name = name;
+        baseline[result.name] = result;
+      }
+    }
+    return baseline;
+  }
+
+  int compareWithBaseline(const std::vector<Result>& results, const std::map<std::string, Result>& baseline, double tolerance) {
+    int regressions = 0;
+    std::printf("\n%-36s %12s %12s %8s\n", "benchmark", "baseline", "current", "change");
+    for (size_t i = 0; i < results.size(); ++i) {
+      auto entry = baseline.find(results[i].name);
+      if (entry == baseline.end()) {
+        continue;
+      }
+      double change = (results[i].nsPerRow / entry->second.nsPerRow - 1.0) * 100.0;
+      bool regressed = change > tolerance || results[i].allocsPerRow > entry->second.allocsPerRow + 0.01;
+      std::printf("%-36s %12.1f %12.1f %+7.1f%%%s\n", results[i].name.c_str(), entry->second.nsPerRow,
+                  results[i].nsPerRow, change, regressed ? "  REGRESSION" : "");
+      if (regressed) {
+        ++regressions;
+      }
+    }
+    return regressions;
+  }
+
+  Options parseOptions(int argc, char** argv) {
+    Options options;
+    options.quick = false;
+    options.maxRows = 1000000;
+    options.tolerance = 25.0;
+    options.poolAllocator = false;
+    options.performanceProfile = false;
+    for (int i = 1; i < argc; ++i) {
+      std::string argument(argv[i]);
+      bool hasValue = i + 1 < argc;
+      if (argument == "--quick") {
+        options.quick = true;
+      } else if (argument == "--max-rows" && hasValue) {
+        options.maxRows = std::strtoul(argv[++i], nullptr, 10);
+      } else if (argument == "--filter" && hasValue) {
+        options.filter = argv[++i];
+      } else if (argument == "--json" && hasValue) {
+        options.jsonPath = argv[++i];
+      } else if (argument == "--baseline" && hasValue) {
+        options.baselinePath = argv[++i];
+      } else if (argument == "--tolerance" && hasValue) {
+        options.tolerance = std::strtod(argv[++i], nullptr);
+      } else if (argument == "--allocator" && hasValue) {
+        std::string allocator(argv[++i]);
+        if (allocator != "system" && allocator != "pool") {
+          throw std::invalid_argument("Unknown allocator " + allocator);
+        }
+        options.poolAllocator = allocator == "pool";
+      } else if (argument == "--profile" && hasValue) {
+        std::string profile(argv[++i]);
+        if (profile != "default" && profile != "performance") {
+          throw std::invalid_argument("Unknown profile " + profile);
+        }
+        options.performanceProfile = profile == "performance";
+      } else {
+        throw std::invalid_argument("Unknown argument " + argument);
+      }
+    }
+    if (options.quick) {
+      options.maxRows = 1000;
+    }
+    return options;
+  }
+}
+
+int main(int argc, char** argv) {
+  try {
+    Options options = parseOptions(argc, argv);
+    // SQLITE_DEFAULT_MEMSTATUS=0
+    if (options.performanceProfile && sqlite3_config(SQLITE_CONFIG_MEMSTATUS, 0) != SQLITE_OK) {
+      throw std::runtime_error("Could not switch off the memory status");
+    }
+    if (options.poolAllocator && SQLite3::MemoryAllocator::Install(SQLite3::MemoryAllocator::Pool) != SQLITE_OK) {
+      throw std::runtime_error("Could not install the pool allocator");
+    }
+    // Wraps whichever allocator is configured
+    installCountingAllocator();
+
+    Runner runner(options);
+    const size_t sizes[] = { 1000, 10000, 100000, 1000000 };
+    for (size_t size = 0; size < sizeof(sizes) / sizeof(sizes[0]) && sizes[size] <= options.maxRows; ++size) {
+      for (size_t mix = 0; mix < sizeof(mixes) / sizeof(mixes[0]); ++mix) {
+        runMix(runner, mixes[mix], sizes[size]);
+      }
+      runImport(runner, sizes[size]);
+      runSort(runner, sizes[size]);
+    }
+
+    if (!options.jsonPath.empty()) {
+      writeJson(options.jsonPath, runner.Results());
+    }
+    if (!options.baselinePath.empty()) {
+      int regressions = compareWithBaseline(runner.Results(), readBaseline(options.baselinePath), options.tolerance);
+      if (regressions) {
+        std::printf("\n%d benchmark(s) regressed by more than %.0f%%\n", regressions, options.tolerance);
+        return 1;
+      }
+    }
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 2;
+  }
+}
@@ -0,0 +1,158 @@
+// Copies a database in small steps and checks that writers are not blocked
+// between the steps, that writes of other connections restart the copy and
+// that an unfinished backup leaves the destination alone.
+
+#include <cstdio>
+#include <string>
+
+#include <unistd.h>
+
+#include "Backup.h"
+
+#include "TestSupport.h"
+
+namespace {
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  long long queryInt(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    long long result = -1;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+      result = sqlite3_column_int64(statement, 0);
+    }
+    sqlite3_finalize(statement);
+    return result;
+  }
+
+  std::string tempPath(const char* name) {
+    char path[96];
+    std::snprintf(path, sizeof(path), "/tmp/SQLite3BackupTest-%d-%s.db", static_cast<int>(getpid()), name);
+    std::remove(path);
+    return path;
+  }
+
+  long long countIn(const std::string& path) {
+    sqlite3* db = nullptr;
+    CHECK(sqlite3_open(path.c_str(), &db) == SQLITE_OK);
+    long long count = queryInt(db, "SELECT COUNT(*) FROM item");
+    sqlite3_close(db);
+    return count;
+  }
+
+  void testSteps(sqlite3* source, sqlite3* writer) {
+    std::string path = tempPath("steps");
+    SQLite3::Backup backup;
+    CHECK_EQUAL(backup.OpenFile(path.c_str(), source, 0), SQLITE_OK);
+
+    int steps = 0;
+    int result;
+    while ((result = backup.Step(10)) == SQLITE_OK) {
+      ++steps;
+      CHECK(backup.Remaining() > 0);
+      // The source is not locked between the steps
+      if (steps == 1) {
+        CHECK_EQUAL(sqlite3_exec(writer, "BEGIN IMMEDIATE; COMMIT", nullptr, nullptr, nullptr), SQLITE_OK);
+      }
+    }
+    CHECK_EQUAL(result, SQLITE_DONE);
+    CHECK(steps > 5);
+    CHECK_EQUAL(backup.Remaining(), 0);
+    CHECK(backup.PageCount() > 50);
+    CHECK_EQUAL(backup.Restarts(), 0);
+    CHECK_EQUAL(backup.Finish(), SQLITE_OK);
+    CHECK_EQUAL(countIn(path), 1000);
+    std::remove(path.c_str());
+  }
+
+  void testRestart(sqlite3* source, sqlite3* writer) {
+    std::string path = tempPath("restart");
+    SQLite3::Backup backup;
+    CHECK_EQUAL(backup.OpenFile(path.c_str(), source, 0), SQLITE_OK);
+    CHECK_EQUAL(backup.Step(10), SQLITE_OK);
+    CHECK_EQUAL(backup.Step(10), SQLITE_OK);
+    // Another connection's write starts the copy over
+    exec(writer, "INSERT INTO item (value) VALUES (randomblob(500))");
+    CHECK_EQUAL(backup.Step(10), SQLITE_OK);
+    CHECK_EQUAL(backup.Restarts(), 1);
+    CHECK_EQUAL(backup.PageCount() - backup.Remaining(), 10);
+
+    // Writes through the source connection are copied along
+    int result;
+    bool written = false;
+    while ((result = backup.Step(10)) == SQLITE_OK) {
+      if (!written) {
+        exec(source, "INSERT INTO item (value) VALUES (randomblob(500))");
+        written = true;
+      }
+    }
+    CHECK_EQUAL(result, SQLITE_DONE);
+    CHECK_EQUAL(backup.Restarts(), 1);
+    CHECK_EQUAL(backup.Finish(), SQLITE_OK);
+    CHECK_EQUAL(countIn(path), 1002);
+
+    exec(source, "DELETE FROM item WHERE id > 1000");
+    std::remove(path.c_str());
+  }
+
+  void testUnfinished(sqlite3* source) {
+    std::string path = tempPath("unfinished");
+    sqlite3* existing = nullptr;
+    CHECK(sqlite3_open(path.c_str(), &existing) == SQLITE_OK);
+    exec(existing, "CREATE TABLE item (id INTEGER PRIMARY KEY, value BLOB); INSERT INTO item (value) VALUES (1)");
+    sqlite3_close(existing);
+
+    {
+      SQLite3::Backup backup;
+      CHECK_EQUAL(backup.OpenFile(path.c_str(), source, 0), SQLITE_OK);
+      CHECK_EQUAL(backup.Step(10), SQLITE_OK);
+      CHECK_EQUAL(backup.Finish(), SQLITE_OK);
+    }
+    CHECK_EQUAL(countIn(path), 1);
+    std::remove(path.c_str());
+
+    SQLite3::Backup failing;
+    CHECK(failing.OpenFile("/nonexistent/directory/backup.db", source, 0) != SQLITE_OK);
+    CHECK(std::string(failing.ErrorMessage()).size() > 0);
+    CHECK_EQUAL(failing.Step(10), SQLITE_MISUSE);
+  }
+
+  void testIntoConnection(sqlite3* source) {
+    sqlite3* memory = nullptr;
+    CHECK(sqlite3_open(":memory:", &memory) == SQLITE_OK);
+    SQLite3::Backup backup;
+    CHECK_EQUAL(backup.Open(memory, source), SQLITE_OK);
+    CHECK_EQUAL(backup.Step(-1), SQLITE_DONE);
+    CHECK_EQUAL(backup.Finish(), SQLITE_OK);
+    CHECK_EQUAL(queryInt(memory, "SELECT COUNT(*) FROM item"), 1000);
+    sqlite3_close(memory);
+  }
+}
+
+int main() {
+  std::string path = tempPath("source");
+  sqlite3* source = nullptr;
+  sqlite3* writer = nullptr;
+  CHECK(sqlite3_open(path.c_str(), &source) == SQLITE_OK);
+  CHECK(sqlite3_open(path.c_str(), &writer) == SQLITE_OK);
+  exec(source, "CREATE TABLE item (id INTEGER PRIMARY KEY, value BLOB)");
+  exec(source, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 1000) "
+               "INSERT INTO item (value) SELECT randomblob(500) FROM n");
+
+  testSteps(source, writer);
+  testRestart(source, writer);
+  testUnfinished(source);
+  testIntoConnection(source);
+
+  sqlite3_close(writer);
+  sqlite3_close(source);
+  std::remove(path.c_str());
+  return TestSupport::Finish();
+}
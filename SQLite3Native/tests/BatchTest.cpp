@@ -0,0 +1,142 @@
+// Runs batches of statements with and without a transaction, including
+// entries made of several statements, failing entries and a throwing
+// binder.
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Batch.h"
+
+#include "TestSupport.h"
+
+namespace {
+  // Binds integers, the entries' values are used in order across their
+  // statements
+  class IntegerBinder : public SQLite3::BatchBinder {
+  public:
+    IntegerBinder() : throwAt(-1) {}
+
+    int Bind(size_t entry, int offset, sqlite3_stmt* statement) {
+      if (static_cast<int>(entry) == throwAt) {
+        throw std::runtime_error("binder failed");
+      }
+      for (int i = 0; i < sqlite3_bind_parameter_count(statement); ++i) {
+        int result = sqlite3_bind_int(statement, i + 1, values[entry][offset + i]);
+        if (result != SQLITE_OK) {
+          return result;
+        }
+      }
+      return SQLITE_OK;
+    }
+
+    std::vector<std::vector<int>> values;
+    int throwAt;
+  };
+
+  std::string queryText(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    std::string result;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+      result = reinterpret_cast<const char*>(sqlite3_column_text(statement, 0));
+    }
+    sqlite3_finalize(statement);
+    return result;
+  }
+
+  void testResults(sqlite3* db) {
+    std::vector<std::string> sql;
+    IntegerBinder binder;
+    sql.push_back("INSERT INTO item (id, quantity) VALUES (?, ?)");
+    binder.values.push_back(std::vector<int>{ 1, 10 });
+    sql.push_back("INSERT INTO item (id, quantity) VALUES (?, ?); INSERT INTO item (id, quantity) VALUES (?, ?);  ");
+    binder.values.push_back(std::vector<int>{ 2, 20, 3, 30 });
+    sql.push_back("UPDATE item SET quantity = quantity + 1 WHERE id > ?");
+    binder.values.push_back(std::vector<int>{ 1 });
+    sql.push_back("SELECT id, quantity FROM item WHERE quantity > ? ORDER BY id");
+    binder.values.push_back(std::vector<int>{ 15 });
+    sql.push_back("  -- nothing to run\n");
+    binder.values.push_back(std::vector<int>());
+
+    SQLite3::BatchResult result = SQLite3::ExecuteBatch(db, sql, &binder, true, false, nullptr);
+    CHECK_EQUAL(result.resultCode, SQLITE_OK);
+    CHECK_EQUAL(result.json, std::string(
+      "[{\"changes\":1,\"lastInsertRowId\":1},"
+      "{\"changes\":1,\"lastInsertRowId\":3},"
+      "{\"changes\":2,\"lastInsertRowId\":3},"
+      "{\"rows\":[{\"id\":2,\"quantity\":21},{\"id\":3,\"quantity\":31}]},"
+      "{\"changes\":0,\"lastInsertRowId\":0}]"));
+    CHECK(sqlite3_get_autocommit(db));
+  }
+
+  void testTransactionalFailure(sqlite3* db) {
+    std::vector<std::string> sql;
+    IntegerBinder binder;
+    sql.push_back("INSERT INTO item (id, quantity) VALUES (?, ?)");
+    binder.values.push_back(std::vector<int>{ 4, 40 });
+    sql.push_back("INSERT INTO item (id, quantity) VALUES (?, ?)");
+    binder.values.push_back(std::vector<int>{ 1, 50 });
+
+    SQLite3::BatchResult result = SQLite3::ExecuteBatch(db, sql, &binder, true, false, nullptr);
+    CHECK_EQUAL(result.resultCode, SQLITE_CONSTRAINT);
+    CHECK_EQUAL(result.entry, 1u);
+    CHECK(result.message.find("Statement 2: ") == 0);
+    CHECK(result.json.empty());
+    CHECK_EQUAL(queryText(db, "SELECT COUNT(*) FROM item"), std::string("3"));
+    CHECK(sqlite3_get_autocommit(db));
+
+    // Without a transaction the first entry stays
+    result = SQLite3::ExecuteBatch(db, sql, &binder, false, false, nullptr);
+    CHECK_EQUAL(result.resultCode, SQLITE_CONSTRAINT);
+    CHECK_EQUAL(queryText(db, "SELECT COUNT(*) FROM item"), std::string("4"));
+
+    std::vector<std::string> broken(1, "SELEC 1");
+    result = SQLite3::ExecuteBatch(db, broken, nullptr, true, false, nullptr);
+    CHECK_EQUAL(result.resultCode, SQLITE_ERROR);
+    CHECK(result.message.find("syntax error") != std::string::npos);
+  }
+
+  void testThrowingBinder(sqlite3* db) {
+    std::vector<std::string> sql;
+    IntegerBinder binder;
+    sql.push_back("DELETE FROM item WHERE id = ?");
+    binder.values.push_back(std::vector<int>{ 4 });
+    sql.push_back("DELETE FROM item WHERE id = ?");
+    binder.values.push_back(std::vector<int>{ 3 });
+    binder.throwAt = 1;
+
+    bool threw = false;
+    try {
+      SQLite3::ExecuteBatch(db, sql, &binder, true, false, nullptr);
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    CHECK(threw);
+    CHECK_EQUAL(queryText(db, "SELECT COUNT(*) FROM item"), std::string("4"));
+    CHECK(sqlite3_get_autocommit(db));
+  }
+
+  void testInsideTransaction(sqlite3* db) {
+    CHECK_EQUAL(sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr), SQLITE_OK);
+    std::vector<std::string> sql(1, "DELETE FROM item");
+    SQLite3::BatchResult result = SQLite3::ExecuteBatch(db, sql, nullptr, true, false, nullptr);
+    CHECK_EQUAL(result.resultCode, SQLITE_OK);
+    // The savepoint is released into the outer transaction
+    CHECK(!sqlite3_get_autocommit(db));
+    CHECK_EQUAL(sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr), SQLITE_OK);
+    CHECK_EQUAL(queryText(db, "SELECT COUNT(*) FROM item"), std::string("4"));
+  }
+}
+
+int main() {
+  sqlite3* db = nullptr;
+  CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+  CHECK_EQUAL(sqlite3_exec(db, "CREATE TABLE item (id INTEGER PRIMARY KEY, quantity INTEGER)", nullptr, nullptr, nullptr), SQLITE_OK);
+  testResults(db);
+  testTransactionalFailure(db);
+  testThrowingBinder(db);
+  testInsideTransaction(db);
+  sqlite3_close(db);
+  return TestSupport::Finish();
+}
@@ -0,0 +1,106 @@
+// Streams a BLOB preallocated with zeroblob in chunks, reads past its end
+// and checks that changing the row expires the handle.
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Blob.h"
+
+#include "TestSupport.h"
+
+namespace {
+  void exec(sqlite3* db, const char* sql) {
+    CHECK_EQUAL(sqlite3_exec(db, sql, nullptr, nullptr, nullptr), SQLITE_OK);
+  }
+
+  void testChunkedReadAndWrite(sqlite3* db) {
+    const int size = 3 * 1024 * 1024 + 17;
+    const int chunkSize = 64 * 1024;
+    sqlite3_stmt* insert = nullptr;
+    CHECK(sqlite3_prepare_v2(db, "INSERT INTO media (id, data) VALUES (1, ?)", -1, &insert, nullptr) == SQLITE_OK);
+    CHECK_EQUAL(sqlite3_bind_zeroblob(insert, 1, size), SQLITE_OK);
+    CHECK_EQUAL(sqlite3_step(insert), SQLITE_DONE);
+    sqlite3_finalize(insert);
+
+    SQLite3::Blob blob;
+    CHECK_EQUAL(blob.Open(db, "media", "data", 1, true), SQLITE_OK);
+    CHECK_EQUAL(blob.Size(), size);
+
+    std::vector<unsigned char> chunk(chunkSize);
+    for (int offset = 0; offset < size; offset += chunkSize) {
+      int length = std::min(chunkSize, size - offset);
+      for (int i = 0; i < length; ++i) {
+        chunk[i] = static_cast<unsigned char>((offset + i) * 7);
+      }
+      CHECK_EQUAL(blob.Write(offset, chunk.data(), length), SQLITE_OK);
+    }
+
+    // Reads in a different chunk size, the last one is shortened
+    bool matches = true;
+    int total = 0;
+    int read = 0;
+    std::vector<unsigned char> buffer(50000);
+    do {
+      CHECK_EQUAL(blob.Read(total, buffer.data(), static_cast<int>(buffer.size()), read), SQLITE_OK);
+      for (int i = 0; i < read; ++i) {
+        matches = matches && buffer[i] == static_cast<unsigned char>((total + i) * 7);
+      }
+      total += read;
+    } while (read > 0);
+    CHECK(matches);
+    CHECK_EQUAL(total, size);
+
+    CHECK_EQUAL(blob.Read(size + 10, buffer.data(), 10, read), SQLITE_OK);
+    CHECK_EQUAL(read, 0);
+    CHECK_EQUAL(blob.Read(-1, buffer.data(), 10, read), SQLITE_RANGE);
+    CHECK_EQUAL(blob.Write(size - 2, "abc", 3), SQLITE_RANGE);
+    CHECK_EQUAL(blob.Close(), SQLITE_OK);
+    CHECK(!blob.IsOpen());
+
+    sqlite3_stmt* check = nullptr;
+    CHECK(sqlite3_prepare_v2(db, "SELECT length(data), hex(substr(data, 65537, 3)) FROM media WHERE id = 1", -1, &check, nullptr) == SQLITE_OK);
+    CHECK_EQUAL(sqlite3_step(check), SQLITE_ROW);
+    CHECK_EQUAL(sqlite3_column_int(check, 0), size);
+    CHECK_EQUAL(std::string(reinterpret_cast<const char*>(sqlite3_column_text(check, 1))), std::string("00070E"));
+    sqlite3_finalize(check);
+  }
+
+  void testReopenAndExpiry(sqlite3* db) {
+    exec(db, "INSERT INTO media (id, data) VALUES (2, x'0102'), (3, x'030405')");
+
+    SQLite3::Blob blob;
+    char buffer[8];
+    int read = 0;
+    CHECK_EQUAL(blob.Read(0, buffer, 1, read), SQLITE_MISUSE);
+    CHECK_EQUAL(blob.Open(db, "media", "data", 2, false), SQLITE_OK);
+    CHECK_EQUAL(blob.Read(0, buffer, sizeof(buffer), read), SQLITE_OK);
+    CHECK_EQUAL(read, 2);
+    CHECK(blob.Write(0, "x", 1) != SQLITE_OK);
+
+    CHECK_EQUAL(blob.Reopen(3), SQLITE_OK);
+    CHECK_EQUAL(blob.Size(), 3);
+    CHECK_EQUAL(blob.Read(1, buffer, sizeof(buffer), read), SQLITE_OK);
+    CHECK_EQUAL(read, 2);
+    CHECK(std::memcmp(buffer, "\x04\x05", 2) == 0);
+
+    exec(db, "UPDATE media SET data = x'ff' WHERE id = 3");
+    CHECK_EQUAL(blob.Read(0, buffer, 1, read), SQLITE_ABORT);
+
+    CHECK(blob.Reopen(42) != SQLITE_OK);
+    CHECK(blob.Open(db, "media", "missing", 2, false) != SQLITE_OK);
+    CHECK(!blob.IsOpen());
+    CHECK(std::strlen(blob.ErrorMessage()) > 0);
+  }
+}
+
+int main() {
+  sqlite3* db = nullptr;
+  CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+  exec(db, "CREATE TABLE media (id INTEGER PRIMARY KEY, data BLOB)");
+  testChunkedReadAndWrite(db);
+  testReopenAndExpiry(db);
+  CHECK_EQUAL(sqlite3_close(db), SQLITE_OK);
+  return TestSupport::Finish();
+}
@@ -0,0 +1,159 @@
+// Locks a database file from one connection and checks how another one
+// waits for it under each busy policy, that an operation's budget cuts the
+// waits short and what the counters record.
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include <unistd.h>
+
+#include "BusyHandler.h"
+
+#include "TestSupport.h"
+
+namespace {
+  typedef std::chrono::steady_clock Clock;
+
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  long long millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+  }
+
+  SQLite3::BusyPolicy policy(SQLite3::BusyPolicyKind kind, unsigned timeoutMilliseconds) {
+    SQLite3::BusyPolicy policy;
+    policy.kind = kind;
+    policy.timeoutMilliseconds = timeoutMilliseconds;
+    return policy;
+  }
+
+  void testFailAndTimeout(sqlite3* holder, sqlite3* waiter) {
+    SQLite3::BusyHandler handler;
+    handler.Install(waiter);
+    exec(holder, "BEGIN IMMEDIATE");
+
+    handler.SetPolicy(policy(SQLite3::BusyFail, 1000));
+    Clock::time_point start = Clock::now();
+    CHECK_EQUAL(sqlite3_exec(waiter, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr), SQLITE_BUSY);
+    CHECK(millisecondsSince(start) < 50);
+    SQLite3::BusyCounters counters = handler.Counters();
+    CHECK_EQUAL(counters.waits, 1);
+    CHECK_EQUAL(counters.retries, 0);
+    CHECK_EQUAL(counters.failures, 1);
+
+    handler.SetPolicy(policy(SQLite3::BusyTimeout, 100));
+    start = Clock::now();
+    CHECK_EQUAL(sqlite3_exec(waiter, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr), SQLITE_BUSY);
+    CHECK(millisecondsSince(start) >= 100);
+    counters = handler.Counters();
+    CHECK_EQUAL(counters.waits, 2);
+    CHECK_EQUAL(counters.failures, 2);
+    // A fixed 2ms interval
+    CHECK(counters.retries > 20);
+    CHECK(counters.longestWaitMicroseconds >= 90000);
+    CHECK(counters.waitMicroseconds >= 90000);
+
+    exec(holder, "ROLLBACK");
+  }
+
+  void testBackoff(sqlite3* holder, sqlite3* waiter) {
+    SQLite3::BusyHandler handler;
+    handler.Install(waiter);
+    handler.SetPolicy(policy(SQLite3::BusyBackoff, 5000));
+
+    exec(holder, "BEGIN IMMEDIATE");
+    std::thread release([holder]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      exec(holder, "ROLLBACK");
+    });
+    CHECK_EQUAL(sqlite3_exec(waiter, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr), SQLITE_OK);
+    release.join();
+    exec(waiter, "ROLLBACK");
+
+    SQLite3::BusyCounters counters = handler.Counters();
+    CHECK_EQUAL(counters.waits, 1);
+    CHECK_EQUAL(counters.failures, 0);
+    // Far fewer retries than polling every 2ms
+    CHECK(counters.retries > 2);
+    CHECK(counters.retries < 20);
+    CHECK(counters.longestWaitMicroseconds >= 150000);
+  }
+
+  void testDeadline(sqlite3* holder, sqlite3* waiter) {
+    SQLite3::BusyHandler handler;
+    handler.Install(waiter);
+    handler.SetPolicy(policy(SQLite3::BusyDeadline, 150));
+
+    exec(holder, "BEGIN IMMEDIATE");
+    // The operation already used most of its time
+    handler.BeginOperation();
+    std::this_thread::sleep_for(std::chrono::milliseconds(120));
+    Clock::time_point start = Clock::now();
+    CHECK_EQUAL(sqlite3_exec(waiter, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr), SQLITE_BUSY);
+    CHECK(millisecondsSince(start) < 100);
+    CHECK_EQUAL(handler.Counters().failures, 1);
+
+    // A new operation gets the whole timeout again
+    handler.BeginOperation();
+    start = Clock::now();
+    CHECK_EQUAL(sqlite3_exec(waiter, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr), SQLITE_BUSY);
+    CHECK(millisecondsSince(start) >= 140);
+    exec(holder, "ROLLBACK");
+  }
+
+  void testBudget(sqlite3* holder, sqlite3* waiter) {
+    SQLite3::BusyHandler handler;
+    handler.Install(waiter);
+    handler.SetPolicy(policy(SQLite3::BusyBackoff, 5000));
+
+    exec(holder, "BEGIN IMMEDIATE");
+    handler.BeginOperation(80);
+    Clock::time_point start = Clock::now();
+    CHECK_EQUAL(sqlite3_exec(waiter, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr), SQLITE_BUSY);
+    long long waited = millisecondsSince(start);
+    CHECK(waited >= 70);
+    CHECK(waited < 500);
+    CHECK_EQUAL(handler.Counters().failures, 1);
+
+    // The next operation waits as long as the policy allows again
+    handler.BeginOperation();
+    std::thread release([holder]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      exec(holder, "ROLLBACK");
+    });
+    CHECK_EQUAL(sqlite3_exec(waiter, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr), SQLITE_OK);
+    release.join();
+    exec(waiter, "ROLLBACK");
+    CHECK_EQUAL(handler.Counters().failures, 1);
+  }
+}
+
+int main() {
+  char path[64];
+  std::snprintf(path, sizeof(path), "/tmp/SQLite3BusyHandlerTest-%d.db", static_cast<int>(getpid()));
+  std::remove(path);
+
+  sqlite3* holder = nullptr;
+  sqlite3* waiter = nullptr;
+  CHECK(sqlite3_open(path, &holder) == SQLITE_OK);
+  CHECK(sqlite3_open(path, &waiter) == SQLITE_OK);
+  exec(holder, "CREATE TABLE item (id INTEGER)");
+
+  testFailAndTimeout(holder, waiter);
+  testBackoff(holder, waiter);
+  testDeadline(holder, waiter);
+  testBudget(holder, waiter);
+
+  sqlite3_close(waiter);
+  sqlite3_close(holder);
+  std::remove(path);
+  return TestSupport::Finish();
+}
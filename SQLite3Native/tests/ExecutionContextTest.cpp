@@ -0,0 +1,254 @@
+// Opens a connection with SQLITE_OPEN_NOMUTEX and hammers it from scheduler
+// jobs and from threads entering the execution context directly, checking
+// that SQLite only ever runs on the thread holding the context and never on
+// two threads at once. Also checks nesting, a disabled context and owners
+// destroyed by their own jobs.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ExecutionContext.h"
+#include "Scheduler.h"
+#include "sqlite3.h"
+
+#include "TestSupport.h"
+
+namespace {
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  long long queryInt(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    long long result = -1;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+      result = sqlite3_column_int64(statement, 0);
+    }
+    sqlite3_finalize(statement);
+    return result;
+  }
+
+  // A connection without SQLite's mutex and the checks run on every use
+  struct Connection {
+    explicit Connection(SQLite3::ExecutionContext& context)
+      : context(context)
+      , db(nullptr)
+      , inside(0)
+      , overlaps(0)
+      , outsideContext(0) {
+    }
+
+    // Counts the threads using the connection at once, plus the callers
+    // that did not hold the context
+    void Use(const char* sql) {
+      if (inside.fetch_add(1) != 0) {
+        ++overlaps;
+      }
+      if (!context.HeldByCurrentThread()) {
+        ++outsideContext;
+      }
+      exec(db, sql);
+      --inside;
+    }
+
+    SQLite3::ExecutionContext& context;
+    sqlite3* db;
+    std::atomic<int> inside;
+    std::atomic<int> overlaps;
+    std::atomic<int> outsideContext;
+  };
+
+  // Also called from within SQLite, so steps of a statement are checked and
+  // not only the calls into it
+  int checkProgress(void* data) {
+    Connection* connection = static_cast<Connection*>(data);
+    if (!connection->context.HeldByCurrentThread()) {
+      ++connection->outsideContext;
+    }
+    return 0;
+  }
+
+  void testStress() {
+    const int submitters = 4;
+    const int jobsPerSubmitter = 250;
+    const int directThreads = 3;
+    const int usesPerThread = 250;
+
+    SQLite3::ExecutionContext context(true);
+    Connection connection(context);
+    CHECK_EQUAL(sqlite3_open_v2(":memory:", &connection.db,
+      SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, nullptr), SQLITE_OK);
+    // Only connections SQLite serializes itself have a mutex
+    CHECK(sqlite3_db_mutex(connection.db) == nullptr);
+    exec(connection.db, "CREATE TABLE item (id INTEGER PRIMARY KEY, source TEXT)");
+    sqlite3_progress_handler(connection.db, 10, checkProgress, &connection);
+
+    {
+      SQLite3::Scheduler scheduler(0, &context);
+      std::vector<std::thread> threads;
+      for (int i = 0; i < submitters; ++i) {
+        threads.push_back(std::thread([&scheduler, &connection]() {
+          for (int j = 0; j < jobsPerSubmitter; ++j) {
+            scheduler.Submit(j % 2 ? SQLite3::PriorityNormal : SQLite3::PriorityInteractive, [&connection]() {
+              connection.Use("INSERT INTO item (source) VALUES ('job')");
+            });
+          }
+        }));
+      }
+      // Like the component's property setters, which run on the calling
+      // thread while jobs may be running
+      for (int i = 0; i < directThreads; ++i) {
+        threads.push_back(std::thread([&context, &connection]() {
+          for (int j = 0; j < usesPerThread; ++j) {
+            SQLite3::ExecutionContext::Scope scope(context);
+            connection.Use(j % 2 ? "INSERT INTO item (source) VALUES ('direct')" : "SELECT COUNT(*) FROM item");
+            // Nested scopes do not wait for themselves
+            SQLite3::ExecutionContext::Scope nested(context);
+            connection.Use("SELECT MAX(id) FROM item");
+          }
+        }));
+      }
+      for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+      }
+      // Runs the jobs still queued
+    }
+
+    CHECK_EQUAL(connection.overlaps.load(), 0);
+    CHECK_EQUAL(connection.outsideContext.load(), 0);
+    CHECK_EQUAL(queryInt(connection.db, "SELECT COUNT(*) FROM item WHERE source = 'job'"), submitters * jobsPerSubmitter);
+    CHECK_EQUAL(queryInt(connection.db, "SELECT COUNT(*) FROM item WHERE source = 'direct'"), directThreads * usesPerThread / 2);
+
+    SQLite3::ExecutionContextCounters counters = context.Counters();
+    CHECK_EQUAL(counters.entries, submitters * jobsPerSubmitter + directThreads * usesPerThread);
+    CHECK(counters.contended <= counters.entries);
+    CHECK(counters.waitMicroseconds >= 0);
+    CHECK(!context.HeldByCurrentThread());
+    sqlite3_close(connection.db);
+  }
+
+  void testNesting() {
+    SQLite3::ExecutionContext context(true);
+    CHECK(context.Enabled());
+    CHECK(!context.HeldByCurrentThread());
+    {
+      SQLite3::ExecutionContext::Scope outer(context);
+      CHECK(context.HeldByCurrentThread());
+      {
+        SQLite3::ExecutionContext::Scope inner(context);
+        CHECK(context.HeldByCurrentThread());
+      }
+      CHECK(context.HeldByCurrentThread());
+      // Other threads wait until the outer scope is left
+      bool heldElsewhere = true;
+      std::thread other([&context, &heldElsewhere]() {
+        heldElsewhere = context.HeldByCurrentThread();
+      });
+      other.join();
+      CHECK(!heldElsewhere);
+    }
+    CHECK(!context.HeldByCurrentThread());
+    CHECK_EQUAL(context.Counters().entries, 1);
+  }
+
+  void testContended() {
+    SQLite3::ExecutionContext context(true);
+    std::promise<void> entered;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::thread holder([&context, &entered, released]() {
+      SQLite3::ExecutionContext::Scope scope(context);
+      entered.set_value();
+      released.wait();
+    });
+    entered.get_future().wait();
+    std::thread waiter([&context]() {
+      SQLite3::ExecutionContext::Scope scope(context);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    release.set_value();
+    holder.join();
+    waiter.join();
+
+    SQLite3::ExecutionContextCounters counters = context.Counters();
+    CHECK_EQUAL(counters.entries, 2);
+    CHECK_EQUAL(counters.contended, 1);
+    CHECK(counters.waitMicroseconds > 0);
+  }
+
+  void testDisabled() {
+    SQLite3::ExecutionContext context(false);
+    CHECK(!context.Enabled());
+    {
+      SQLite3::ExecutionContext::Scope scope(context);
+      CHECK(!context.HeldByCurrentThread());
+    }
+    CHECK_EQUAL(context.Counters().entries, 0);
+  }
+
+  // Declared like the component's Database, the scheduler last so it goes
+  // first
+  struct Owner {
+    Owner()
+      : context(true)
+      , scheduler(0, &context) {
+    }
+
+    SQLite3::ExecutionContext context;
+    SQLite3::Scheduler scheduler;
+  };
+
+  void testDestroyedByJob() {
+    // Inside the job, while the worker holds the context
+    {
+      auto owner = std::make_shared<Owner>();
+      std::promise<void> released;
+      std::promise<void> done;
+      std::shared_future<void> release = released.get_future().share();
+      std::shared_ptr<Owner> last = owner;
+      owner->scheduler.Submit(SQLite3::PriorityNormal, [last, release, &done]() mutable {
+        release.wait();
+        CHECK(last->context.HeldByCurrentThread());
+        last.reset();
+        done.set_value();
+      });
+      last.reset();
+      owner.reset();
+      released.set_value();
+      done.get_future().wait();
+    }
+    // Along with the job after it ran, outside of the context
+    {
+      auto owner = std::make_shared<Owner>();
+      std::promise<void> done;
+      std::shared_ptr<Owner> last = owner;
+      owner->scheduler.Submit(SQLite3::PriorityNormal, [last, &done]() {
+        done.set_value();
+      });
+      last.reset();
+      owner.reset();
+      done.get_future().wait();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+}
+
+int main() {
+  testNesting();
+  testContended();
+  testDisabled();
+  testStress();
+  testDestroyedByJob();
+  return TestSupport::Finish();
+}
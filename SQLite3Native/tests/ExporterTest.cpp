@@ -0,0 +1,169 @@
+// Checks the CSV and NDJSON output of the export writer, that it writes in
+// bounded chunks and that exported files import back unchanged.
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+#include <unistd.h>
+
+#include "Exporter.h"
+#include "Importer.h"
+
+#include "TestSupport.h"
+
+namespace {
+  class StringSink : public SQLite3::ExportSink {
+  public:
+    StringSink() : writes(0), largestWrite(0), failAfter(-1) {}
+
+    bool Write(const char* data, size_t size) {
+      if (writes++ == failAfter) {
+        return false;
+      }
+      largestWrite = std::max(largestWrite, size);
+      text.append(data, size);
+      return true;
+    }
+
+    std::string text;
+    int writes;
+    size_t largestWrite;
+    int failAfter;
+  };
+
+  class FileSource : public SQLite3::ImportSource {
+  public:
+    explicit FileSource(std::FILE* file) : file(file) {}
+
+    size_t Read(char* buffer, size_t size) {
+      return std::fread(buffer, 1, size, file);
+    }
+
+  private:
+    std::FILE* file;
+  };
+
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  std::string queryText(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    std::string result;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+      result = reinterpret_cast<const char*>(sqlite3_column_text(statement, 0));
+    }
+    sqlite3_finalize(statement);
+    return result;
+  }
+
+  // Steps the statement like Statement::Export does
+  long long exportRows(sqlite3* db, const char* sql, SQLite3::ExportFormat format, SQLite3::ExportSink& sink) {
+    sqlite3_stmt* statement = nullptr;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    SQLite3::ExportWriter writer(statement, format, sink);
+    bool written = true;
+    while (written && sqlite3_step(statement) == SQLITE_ROW) {
+      written = writer.WriteRow();
+    }
+    written = written && writer.Finish();
+    sqlite3_finalize(statement);
+    return written ? writer.Rows() : -1;
+  }
+
+  void testFormats(sqlite3* db) {
+    exec(db, "CREATE TABLE sample (id INTEGER, name TEXT, price REAL, data BLOB)");
+    exec(db, "INSERT INTO sample VALUES (1, 'plain', 1.5, NULL)");
+    exec(db, "INSERT INTO sample VALUES (2, 'comma, \"quote\"', NULL, x'00ff')");
+    exec(db, "INSERT INTO sample VALUES (3, 'line\nbreak', -2.0, NULL)");
+    exec(db, "INSERT INTO sample VALUES (4, '', 0.25, NULL)");
+    exec(db, "INSERT INTO sample VALUES (NULL, 'M\xc3\xbcnchen', NULL, NULL)");
+
+    StringSink csv;
+    CHECK_EQUAL(exportRows(db, "SELECT id, name AS \"the, name\", price, data FROM sample", SQLite3::ExportCsv, csv), 5);
+    CHECK_EQUAL(csv.text, std::string(
+      "id,\"the, name\",price,data\r\n"
+      "1,plain,1.5,\r\n"
+      "2,\"comma, \"\"quote\"\"\",,AP8=\r\n"
+      "3,\"line\nbreak\",-2.0,\r\n"
+      "4,\"\",0.25,\r\n"
+      ",M\xc3\xbcnchen,,\r\n"));
+
+    StringSink ndjson;
+    CHECK_EQUAL(exportRows(db, "SELECT * FROM sample", SQLite3::ExportNdjson, ndjson), 5);
+    CHECK_EQUAL(ndjson.text, std::string(
+      "{\"id\":1,\"name\":\"plain\",\"price\":1.5,\"data\":null}\n"
+      "{\"id\":2,\"name\":\"comma, \\\"quote\\\"\",\"price\":null,\"data\":\"AP8=\"}\n"
+      "{\"id\":3,\"name\":\"line\\nbreak\",\"price\":-2.0,\"data\":null}\n"
+      "{\"id\":4,\"name\":\"\",\"price\":0.25,\"data\":null}\n"
+      "{\"id\":null,\"name\":\"M\xc3\xbcnchen\",\"price\":null,\"data\":null}\n"));
+
+    // An empty result still has the CSV header
+    StringSink empty;
+    CHECK_EQUAL(exportRows(db, "SELECT id FROM sample WHERE 0", SQLite3::ExportCsv, empty), 0);
+    CHECK_EQUAL(empty.text, std::string("id\r\n"));
+  }
+
+  void testChunksAndRoundTrip(sqlite3* db) {
+    exec(db, "CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT, price REAL, note TEXT)");
+    exec(db, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 100000) "
+             "INSERT INTO item SELECT i, 'item, \"' || i || '\"', i / 8.0, "
+             "CASE WHEN i % 3 = 0 THEN NULL ELSE 'line ' || char(10) || i END FROM n");
+
+    StringSink chunked;
+    CHECK_EQUAL(exportRows(db, "SELECT * FROM item", SQLite3::ExportNdjson, chunked), 100000);
+    CHECK(chunked.writes > 50);
+    CHECK(chunked.largestWrite < 64 * 1024 + 256);
+
+    StringSink failing;
+    failing.failAfter = 3;
+    CHECK_EQUAL(exportRows(db, "SELECT * FROM item", SQLite3::ExportCsv, failing), -1);
+
+    const SQLite3::ExportFormat formats[] = { SQLite3::ExportCsv, SQLite3::ExportNdjson };
+    for (int i = 0; i < 2; ++i) {
+      char path[64];
+      std::snprintf(path, sizeof(path), "/tmp/SQLite3ExporterTest-%d", static_cast<int>(getpid()));
+      std::FILE* file = std::fopen(path, "wb");
+      CHECK(file != nullptr);
+      SQLite3::FileExportSink sink(file);
+      // NULL only survives the round trip through NDJSON
+      const char* sql = formats[i] == SQLite3::ExportCsv ? "SELECT id, name, price, coalesce(note, '') AS note FROM item"
+                                                         : "SELECT * FROM item";
+      CHECK_EQUAL(exportRows(db, sql, formats[i], sink), 100000);
+      std::fclose(file);
+
+      exec(db, "CREATE TABLE copy (id INTEGER PRIMARY KEY, name TEXT, price REAL, note TEXT)");
+      file = std::fopen(path, "rb");
+      FileSource source(file);
+      SQLite3::ImportOptions options;
+      options.format = formats[i] == SQLite3::ExportCsv ? SQLite3::ImportCsv : SQLite3::ImportNdjson;
+      options.table = "copy";
+      SQLite3::ImportResult result = SQLite3::Import(db, options, source, nullptr);
+      std::fclose(file);
+      std::remove(path);
+      CHECK_EQUAL(result.resultCode, SQLITE_OK);
+      CHECK_EQUAL(result.rows, 100000);
+      CHECK_EQUAL(queryText(db, formats[i] == SQLite3::ExportCsv
+        ? "SELECT COUNT(*) FROM (SELECT id, name, price, coalesce(note, '') FROM item EXCEPT SELECT * FROM copy)"
+        : "SELECT COUNT(*) FROM (SELECT * FROM item EXCEPT SELECT * FROM copy)"), std::string("0"));
+      CHECK_EQUAL(queryText(db, "SELECT COUNT(*) FROM copy WHERE typeof(price) = 'real'"), std::string("100000"));
+      exec(db, "DROP TABLE copy");
+    }
+  }
+}
+
+int main() {
+  sqlite3* db = nullptr;
+  CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+  testFormats(db);
+  testChunksAndRoundTrip(db);
+  sqlite3_close(db);
+  return TestSupport::Finish();
+}
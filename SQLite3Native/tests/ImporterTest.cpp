@@ -0,0 +1,294 @@
+// Imports CSV and NDJSON through the two stage pipeline, with the input
+// split at every possible position, and checks the 64-bit integer limits,
+// errors, sources that throw and cancellation.
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Importer.h"
+
+#include "TestSupport.h"
+
+namespace {
+  // Hands out the input in pieces of a fixed size
+  class StringSource : public SQLite3::ImportSource {
+  public:
+    StringSource(const std::string& data, size_t pieceSize) : data(data), pieceSize(pieceSize), position(0) {}
+
+    size_t Read(char* buffer, size_t size) {
+      size_t length = std::min(std::min(size, pieceSize), data.size() - position);
+      std::memcpy(buffer, data.data() + position, length);
+      position += length;
+      return length;
+    }
+
+  private:
+    std::string data;
+    size_t pieceSize;
+    size_t position;
+  };
+
+  // Fails like a stream whose read throws once the data ran out
+  class ThrowingSource : public SQLite3::ImportSource {
+  public:
+    explicit ThrowingSource(const std::string& data) : data(data), done(false) {}
+
+    size_t Read(char* buffer, size_t size) {
+      if (done) {
+        throw std::runtime_error("read failed");
+      }
+      done = true;
+      size_t length = std::min(size, data.size());
+      std::memcpy(buffer, data.data(), length);
+      return length;
+    }
+
+  private:
+    std::string data;
+    bool done;
+  };
+
+  class CountingProgress : public SQLite3::ImportProgress {
+  public:
+    explicit CountingProgress(int cancelAfter) : reports(0), lastRows(0), cancelAfter(cancelAfter) {}
+
+    bool Report(long long rows) {
+      CHECK(rows > lastRows);
+      lastRows = rows;
+      return ++reports != cancelAfter;
+    }
+
+    int reports;
+    long long lastRows;
+
+  private:
+    int cancelAfter;
+  };
+
+  sqlite3* openDatabase(const char* schema) {
+    sqlite3* db = nullptr;
+    CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    CHECK(sqlite3_exec(db, schema, nullptr, nullptr, nullptr) == SQLITE_OK);
+    return db;
+  }
+
+  // All rows as "a|b|c" lines, NULL shown as <null>, with the type of
+  // every value appended
+  std::string dump(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    std::string result;
+    while (sqlite3_step(statement) == SQLITE_ROW) {
+      for (int i = 0; i < sqlite3_column_count(statement); ++i) {
+        if (i) {
+          result += '|';
+        }
+        static const char* const types[] = { "", "i:", "f:", "t:", "b:", "" };
+        int type = sqlite3_column_type(statement, i);
+        if (type == SQLITE_NULL) {
+          result += "<null>";
+        } else {
+          result += types[type];
+          result += reinterpret_cast<const char*>(sqlite3_column_text(statement, i));
+        }
+      }
+      result += '\n';
+    }
+    sqlite3_finalize(statement);
+    return result;
+  }
+
+  SQLite3::ImportResult import(sqlite3* db, const SQLite3::ImportOptions& options, const std::string& data,
+                               size_t pieceSize = 4096, SQLite3::ImportProgress* progress = nullptr) {
+    StringSource source(data, pieceSize);
+    return SQLite3::Import(db, options, source, progress);
+  }
+
+  void testCsv() {
+    const std::string csv =
+      "name,price,note\r\n"
+      "apple,1.5,plain\r\n"
+      "\"comma, inside\",2,\"quote \"\"here\"\"\"\r\n"
+      "\r\n"
+      "\"multi\nline\",3,\n"
+      "M\xc3\xbcnchen,4,\"\"\n"
+      "last,5,no newline";
+    const std::string expected =
+      "t:apple|f:1.5|t:plain\n"
+      "t:comma, inside|f:2.0|t:quote \"here\"\n"
+      "t:multi\nline|f:3.0|t:\n"
+      "t:M\xc3\xbcnchen|f:4.0|t:\n"
+      "t:last|f:5.0|t:no newline\n";
+
+    // Every piece size, so records and escapes are split everywhere
+    for (size_t pieceSize = 1; pieceSize <= csv.size(); ++pieceSize) {
+      sqlite3* db = openDatabase("CREATE TABLE item (name TEXT, price REAL, note TEXT)");
+      SQLite3::ImportOptions options;
+      options.table = "item";
+      SQLite3::ImportResult result = import(db, options, csv, pieceSize);
+      CHECK_EQUAL(result.resultCode, SQLITE_OK);
+      CHECK_EQUAL(result.rows, 5);
+      CHECK_EQUAL(dump(db, "SELECT name, price, note FROM item"), expected);
+      sqlite3_close(db);
+    }
+  }
+
+  void testCsvWithoutHeader() {
+    sqlite3* db = openDatabase("CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT)");
+    SQLite3::ImportOptions options;
+    options.table = "item";
+    options.header = false;
+    options.delimiter = ';';
+    CHECK_EQUAL(import(db, options, "1;one\n2;two\n").resultCode, SQLITE_OK);
+    CHECK_EQUAL(dump(db, "SELECT * FROM item"), std::string("i:1|t:one\ni:2|t:two\n"));
+
+    // Columns given explicitly, conflicting rows replaced
+    options.columns.push_back("name");
+    options.columns.push_back("id");
+    options.conflict = "REPLACE";
+    CHECK_EQUAL(import(db, options, "uno;1\ntres;3\n").resultCode, SQLITE_OK);
+    CHECK_EQUAL(dump(db, "SELECT * FROM item"), std::string("i:1|t:uno\ni:2|t:two\ni:3|t:tres\n"));
+    sqlite3_close(db);
+  }
+
+  void testNdjson() {
+    const std::string ndjson =
+      "{\"id\": 1, \"name\": \"one\", \"price\": 1.25, \"tags\": [\"a\", \"]\"], \"active\": true}\n"
+      "\n"
+      "  {\"name\":\"esc \\\"\\\\\\/\\n\\u00fc\\ud83d\\ude00\",\"id\":2,\"active\":false,\"unknown\":{\"x\":[1,{}]}}\r\n"
+      "{\"id\": -3, \"price\": -2.5e3, \"name\": null, \"tags\": {\"k\": \"v\"}}\n"
+      "{}";
+    const std::string expected =
+      "i:1|t:one|f:1.25|t:[\"a\", \"]\"]|i:1\n"
+      "i:2|t:esc \"\\/\n\xc3\xbc\xf0\x9f\x98\x80|<null>|<null>|i:0\n"
+      "i:-3|<null>|f:-2500.0|t:{\"k\": \"v\"}|<null>\n"
+      "<null>|<null>|<null>|<null>|<null>\n";
+
+    for (size_t pieceSize = 1; pieceSize <= ndjson.size(); pieceSize += 3) {
+      sqlite3* db = openDatabase("CREATE TABLE item (id, name, price, tags, active)");
+      SQLite3::ImportOptions options;
+      options.format = SQLite3::ImportNdjson;
+      options.table = "item";
+      SQLite3::ImportResult result = import(db, options, ndjson, pieceSize);
+      CHECK_EQUAL(result.resultCode, SQLITE_OK);
+      CHECK_EQUAL(result.rows, 4);
+      CHECK_EQUAL(dump(db, "SELECT * FROM item"), expected);
+      sqlite3_close(db);
+    }
+  }
+
+  void testIntegerLimits() {
+    const std::string ndjson =
+      "{\"id\": 1234567890123456789}\n"
+      "{\"id\": -123456789012345678}\n"
+      "{\"id\": 9223372036854775807}\n"
+      "{\"id\": -9223372036854775808}\n"
+      "{\"id\": 9223372036854775808}\n"
+      "{\"id\": -9223372036854775809}\n";
+    sqlite3* db = openDatabase("CREATE TABLE item (id)");
+    SQLite3::ImportOptions options;
+    options.format = SQLite3::ImportNdjson;
+    options.table = "item";
+    SQLite3::ImportResult result = import(db, options, ndjson);
+    CHECK_EQUAL(result.resultCode, SQLITE_OK);
+    CHECK_EQUAL(dump(db, "SELECT id FROM item"), std::string(
+      "i:1234567890123456789\n"
+      "i:-123456789012345678\n"
+      "i:9223372036854775807\n"
+      "i:-9223372036854775808\n"
+      "f:9.22337203685478e+18\n"
+      "f:-9.22337203685478e+18\n"));
+    sqlite3_close(db);
+  }
+
+  void testErrors() {
+    sqlite3* db = openDatabase("CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT NOT NULL)");
+    SQLite3::ImportOptions options;
+    options.table = "item";
+    options.batchSize = 2;
+
+    // The transactions committed before the bad record stay
+    SQLite3::ImportResult result = import(db, options, "id,name\n1,a\n2,b\n3,c\n4\n5,e\n", 3);
+    CHECK_EQUAL(result.resultCode, SQLITE_FORMAT);
+    CHECK_EQUAL(result.message, std::string("Record 5: Expected 2 fields but found 1"));
+    CHECK_EQUAL(result.rows, 2);
+    CHECK_EQUAL(dump(db, "SELECT COUNT(*) FROM item"), std::string("i:2\n"));
+
+    result = import(db, options, "id,name\n10,\"open\n");
+    CHECK_EQUAL(result.resultCode, SQLITE_FORMAT);
+    CHECK_EQUAL(result.message, std::string("Record 2: Unterminated quoted field"));
+
+    result = import(db, options, "id,name\n10,x\n11,y\n12,z\n2,duplicate\n13,w\n");
+    CHECK_EQUAL(result.resultCode, SQLITE_CONSTRAINT);
+    CHECK(result.message.find("Row 4: ") == 0);
+    CHECK_EQUAL(result.rows, 2);
+    CHECK_EQUAL(dump(db, "SELECT COUNT(*) FROM item"), std::string("i:4\n"));
+    CHECK(sqlite3_get_autocommit(db));
+
+    options.format = SQLite3::ImportNdjson;
+    result = import(db, options, "{\"id\": 20, \"name\": \"x\"}\n{\"id\": 21 \"name\": \"y\"}\n");
+    CHECK_EQUAL(result.resultCode, SQLITE_FORMAT);
+    CHECK_EQUAL(result.message, std::string("Record 2: Expected ',' or '}'"));
+
+    options.table = "missing";
+    result = import(db, options, "{}\n");
+    CHECK_EQUAL(result.resultCode, SQLITE_ERROR);
+
+    // The rows read before the source threw are rolled back
+    options.table = "item";
+    options.batchSize = 100;
+    ThrowingSource failing("{\"id\": 30, \"name\": \"x\"}\n{\"id\": 31, \"name\": \"y\"}\n");
+    bool thrown = false;
+    try {
+      SQLite3::Import(db, options, failing, nullptr);
+    } catch (const std::runtime_error&) {
+      thrown = true;
+    }
+    CHECK(thrown);
+    CHECK_EQUAL(dump(db, "SELECT COUNT(*) FROM item WHERE id >= 30"), std::string("i:0\n"));
+    CHECK(sqlite3_get_autocommit(db));
+    sqlite3_close(db);
+  }
+
+  void testLargeImportAndCancellation() {
+    std::ostringstream csv;
+    csv << "id,name,price,quantity\n";
+    for (int i = 1; i <= 200000; ++i) {
+      csv << i << ",\"item " << i << "\"," << (i % 1000) / 10.0 << ',' << i % 17 << '\n';
+    }
+
+    sqlite3* db = openDatabase("CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT, price REAL, quantity INTEGER)");
+    SQLite3::ImportOptions options;
+    options.table = "item";
+    CountingProgress progress(0);
+    SQLite3::ImportResult result = import(db, options, csv.str(), 65536, &progress);
+    CHECK_EQUAL(result.resultCode, SQLITE_OK);
+    CHECK_EQUAL(result.rows, 200000);
+    CHECK_EQUAL(progress.reports, 20);
+    CHECK_EQUAL(progress.lastRows, 200000);
+    CHECK_EQUAL(dump(db, "SELECT COUNT(*), SUM(quantity), MAX(name) FROM item"), std::string("i:200000|i:1599982|t:item 99999\n"));
+
+    CHECK(sqlite3_exec(db, "DELETE FROM item", nullptr, nullptr, nullptr) == SQLITE_OK);
+    options.batchSize = 1000;
+    CountingProgress cancelling(3);
+    result = import(db, options, csv.str(), 65536, &cancelling);
+    CHECK_EQUAL(result.resultCode, SQLITE_INTERRUPT);
+    CHECK_EQUAL(result.rows, 3000);
+    CHECK_EQUAL(dump(db, "SELECT COUNT(*) FROM item"), std::string("i:3000\n"));
+    CHECK(sqlite3_get_autocommit(db));
+    sqlite3_close(db);
+  }
+}
+
+int main() {
+  testCsv();
+  testCsvWithoutHeader();
+  testNdjson();
+  testIntegerLimits();
+  testErrors();
+  testLargeImportAndCancellation();
+  return TestSupport::Finish();
+}
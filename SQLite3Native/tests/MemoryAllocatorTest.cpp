@@ -0,0 +1,176 @@
+// Runs SQLite on top of the pool allocator from several threads and checks
+// the block bookkeeping, the counters and the lookaside options, and that
+// threads that exit hand their cached blocks back.
+
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ConnectionOptions.h"
+#include "MemoryAllocator.h"
+
+#include "TestSupport.h"
+
+namespace {
+  // Some distributions build SQLite without lookaside
+  bool lookasideCompiled() {
+    return !sqlite3_compileoption_used("OMIT_LOOKASIDE");
+  }
+
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  std::string queryText(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    std::string result;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+      result = reinterpret_cast<const char*>(sqlite3_column_text(statement, 0));
+    }
+    sqlite3_finalize(statement);
+    return result;
+  }
+
+  void checkBlocks() {
+    // Every size class, the large blocks and the moves between them
+    for (int size = 1; size <= 5000; size += 7) {
+      unsigned char* memory = static_cast<unsigned char*>(sqlite3_malloc(size));
+      CHECK(memory != nullptr);
+      CHECK(reinterpret_cast<size_t>(memory) % 8 == 0);
+      std::memset(memory, size & 0xff, size);
+      memory = static_cast<unsigned char*>(sqlite3_realloc(memory, size * 2));
+      CHECK(memory != nullptr);
+      CHECK(memory[0] == (size & 0xff) && memory[size - 1] == (size & 0xff));
+      memory = static_cast<unsigned char*>(sqlite3_realloc(memory, size / 2 + 1));
+      CHECK(memory[size / 2] == (size & 0xff));
+      sqlite3_free(memory);
+    }
+  }
+
+  // Allocations on this thread are freed by the next one
+  void workload(int seed, std::vector<void*>* handOver) {
+    sqlite3* db = nullptr;
+    CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    SQLite3::ConnectionOptions options;
+    options.lookasideSlotSize = 256;
+    options.lookasideSlotCount = 64;
+    CHECK_EQUAL(SQLite3::ApplyConnectionOptions(db, options), SQLITE_OK);
+
+    exec(db, "CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT, payload BLOB)");
+    exec(db, "BEGIN");
+    exec(db, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 5000) "
+             "INSERT INTO item SELECT i, 'item ' || i, randomblob(i % 3000) FROM n");
+    exec(db, "COMMIT");
+    CHECK_EQUAL(queryText(db, "SELECT COUNT(DISTINCT length(payload)) FROM item"), std::string("2999"));
+    CHECK_EQUAL(queryText(db, "SELECT SUM(length(name)) FROM (SELECT name FROM item ORDER BY payload)"),
+                std::string("43893"));
+    CHECK_EQUAL(queryText(db, "PRAGMA integrity_check"), std::string("ok"));
+
+    int current = 0;
+    int hits = 0;
+    sqlite3_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_HIT, &current, &hits, 0);
+    CHECK(hits > 0 || !lookasideCompiled());
+    sqlite3_close(db);
+
+    for (int i = 0; i < 1000; ++i) {
+      handOver->push_back(sqlite3_malloc(16 + (i * seed) % 2000));
+    }
+  }
+
+  // Fills the cache of every size class and exits
+  void fillThreadCache() {
+    std::vector<void*> blocks;
+    for (int size = 16; size <= 1024; size += 16) {
+      for (int i = 0; i < 48; ++i) {
+        blocks.push_back(sqlite3_malloc(size));
+      }
+    }
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      sqlite3_free(blocks[i]);
+    }
+  }
+
+  // Like connections opened and closed one after the other, each with its
+  // own scheduler thread
+  void checkThreadChurn() {
+    std::thread first(fillThreadCache);
+    first.join();
+    long long poolBytes = SQLite3::MemoryAllocator::Counters().poolBytes;
+    for (int i = 0; i < 100; ++i) {
+      std::thread next(fillThreadCache);
+      next.join();
+    }
+    // Without the blocks of the exited threads every one of them would
+    // carve up to 64 blocks per size class out of new chunks
+    CHECK(SQLite3::MemoryAllocator::Counters().poolBytes - poolBytes <= 1024 * 1024);
+  }
+}
+
+int main() {
+  CHECK_EQUAL(SQLite3::MemoryAllocator::Install(SQLite3::MemoryAllocator::Pool), SQLITE_OK);
+  CHECK(SQLite3::MemoryAllocator::Installed());
+  CHECK(SQLite3::MemoryAllocator::InstalledKind() == SQLite3::MemoryAllocator::Pool);
+  CHECK(sqlite3_initialize() == SQLITE_OK);
+  long long allocationsBefore = SQLite3::MemoryAllocator::Counters().allocationsInUse;
+
+  checkBlocks();
+
+  std::vector<std::vector<void*> > handOver(4);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.push_back(std::thread(workload, i + 3, &handOver[i]));
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+
+  SQLite3::MemoryCounters counters = SQLite3::MemoryAllocator::Counters();
+  CHECK(counters.totalAllocations > 20000);
+  CHECK(counters.poolBytes > 0);
+  // The performance profile builds SQLite without memory status
+  CHECK_EQUAL(counters.statusAvailable, !sqlite3_compileoption_used("DEFAULT_MEMSTATUS=0"));
+  if (counters.statusAvailable) {
+    CHECK(counters.bytesInUse > 0);
+    CHECK(counters.bytesHighWater > counters.bytesInUse);
+    CHECK(counters.allocationsHighWater > counters.allocationsInUse);
+    CHECK(counters.largestRequest >= 2000);
+  }
+
+  std::thread freeing([&handOver]() {
+    for (size_t i = 0; i < handOver.size(); ++i) {
+      for (size_t j = 0; j < handOver[i].size(); ++j) {
+        sqlite3_free(handOver[i][j]);
+      }
+    }
+  });
+  freeing.join();
+  CHECK_EQUAL(SQLite3::MemoryAllocator::Counters().allocationsInUse, allocationsBefore);
+
+  SQLite3::MemoryAllocator::ResetHighWater();
+  counters = SQLite3::MemoryAllocator::Counters();
+  CHECK_EQUAL(counters.bytesHighWater, counters.bytesInUse);
+
+  checkThreadChurn();
+
+  // Lookaside can be switched off per connection
+  sqlite3* db = nullptr;
+  CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+  SQLite3::ConnectionOptions options;
+  options.lookasideSlotCount = 0;
+  CHECK_EQUAL(SQLite3::ApplyConnectionOptions(db, options), SQLITE_OK);
+  exec(db, "CREATE TABLE t (a, b); INSERT INTO t VALUES (1, 'one'); SELECT * FROM t");
+  int current = 0;
+  int hits = 0;
+  sqlite3_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_HIT, &current, &hits, 0);
+  CHECK_EQUAL(hits, 0);
+  sqlite3_close(db);
+
+  return TestSupport::Finish();
+}
@@ -0,0 +1,155 @@
+// Loads a file database into memory and checks that changes stay in memory
+// until persisted, that only changed databases are written back and that
+// the file ends up with the changes. A persist to a file locked by another
+// connection fails with SQLITE_BUSY and keeps the changes, or waits for the
+// lock within the busy timeout.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "MemoryDatabase.h"
+
+#include "TestSupport.h"
+
+namespace {
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  long long queryInt(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    long long result = -1;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+      result = sqlite3_column_int64(statement, 0);
+    }
+    sqlite3_finalize(statement);
+    return result;
+  }
+
+  long long countIn(const std::string& path, const char* sql) {
+    sqlite3* db = nullptr;
+    CHECK(sqlite3_open(path.c_str(), &db) == SQLITE_OK);
+    long long count = queryInt(db, sql);
+    sqlite3_close(db);
+    return count;
+  }
+
+  void createFile(const std::string& path) {
+    sqlite3* db = nullptr;
+    CHECK(sqlite3_open(path.c_str(), &db) == SQLITE_OK);
+    // A page size other than the default of a fresh in-memory database
+    exec(db, "PRAGMA page_size = 8192");
+    exec(db, "CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT)");
+    exec(db, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 5000) "
+             "INSERT INTO item (name) SELECT 'item ' || i FROM n");
+    sqlite3_close(db);
+  }
+
+  void testLoadAndPersist(const std::string& path) {
+    sqlite3* memory = nullptr;
+    CHECK(sqlite3_open(":memory:", &memory) == SQLITE_OK);
+    SQLite3::MemoryDatabase database;
+    CHECK_EQUAL(database.Load(memory, path.c_str()), SQLITE_OK);
+    CHECK_EQUAL(queryInt(memory, "SELECT COUNT(*) FROM item"), 5000);
+    CHECK_EQUAL(queryInt(memory, "PRAGMA page_size"), 8192);
+
+    SQLite3::MemoryDatabaseCounters counters = database.Counters();
+    CHECK(counters.loadMicroseconds > 0);
+    CHECK_EQUAL(counters.bytes, queryInt(memory, "PRAGMA page_count") * 8192);
+    CHECK(!database.Dirty(memory));
+
+    // Reads leave nothing to persist
+    CHECK_EQUAL(queryInt(memory, "SELECT name = 'item 7' FROM item WHERE id = 7"), 1);
+    CHECK_EQUAL(database.Persist(memory, 0), SQLITE_OK);
+    CHECK_EQUAL(database.Counters().persists, 0);
+
+    // Changes stay in memory until persisted
+    exec(memory, "DELETE FROM item WHERE id > 4000");
+    CHECK(database.Dirty(memory));
+    CHECK_EQUAL(countIn(path, "SELECT COUNT(*) FROM item"), 5000);
+
+    exec(memory, "BEGIN");
+    CHECK_EQUAL(database.Persist(memory, 0), SQLITE_BUSY);
+    exec(memory, "COMMIT");
+
+    CHECK_EQUAL(database.Persist(memory, 0), SQLITE_OK);
+    CHECK(!database.Dirty(memory));
+    counters = database.Counters();
+    CHECK_EQUAL(counters.persists, 1);
+    CHECK_EQUAL(counters.persistFailures, 0);
+    CHECK(counters.lastPersistMicroseconds > 0);
+    CHECK_EQUAL(countIn(path, "SELECT COUNT(*) FROM item"), 4000);
+
+    // Schema changes count as changes
+    exec(memory, "CREATE INDEX item_name ON item (name)");
+    CHECK(database.Dirty(memory));
+    CHECK_EQUAL(database.Persist(memory, 0), SQLITE_OK);
+    CHECK_EQUAL(countIn(path, "SELECT COUNT(*) FROM sqlite_master WHERE name = 'item_name'"), 1);
+    sqlite3_close(memory);
+  }
+
+  void testLockedFile(const std::string& path) {
+    sqlite3* memory = nullptr;
+    CHECK(sqlite3_open(":memory:", &memory) == SQLITE_OK);
+    SQLite3::MemoryDatabase database;
+    CHECK_EQUAL(database.Load(memory, path.c_str()), SQLITE_OK);
+    exec(memory, "DELETE FROM item WHERE id > 3000");
+
+    sqlite3* holder = nullptr;
+    CHECK(sqlite3_open(path.c_str(), &holder) == SQLITE_OK);
+    exec(holder, "BEGIN EXCLUSIVE");
+    CHECK_EQUAL(database.Persist(memory, 0), SQLITE_BUSY);
+    CHECK(std::strcmp(database.ErrorMessage().c_str(), "not an error") != 0);
+    CHECK(database.Dirty(memory));
+    CHECK_EQUAL(database.Counters().persistFailures, 1);
+    exec(holder, "COMMIT");
+    CHECK_EQUAL(countIn(path, "SELECT COUNT(*) FROM item"), 4000);
+
+    // Released while the persist waits
+    exec(holder, "BEGIN EXCLUSIVE");
+    std::thread release([holder]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      exec(holder, "COMMIT");
+    });
+    CHECK_EQUAL(database.Persist(memory, 5000), SQLITE_OK);
+    release.join();
+    CHECK(!database.Dirty(memory));
+    CHECK_EQUAL(countIn(path, "SELECT COUNT(*) FROM item"), 3000);
+    sqlite3_close(holder);
+    sqlite3_close(memory);
+  }
+
+  void testLoadFailure() {
+    sqlite3* memory = nullptr;
+    CHECK(sqlite3_open(":memory:", &memory) == SQLITE_OK);
+    SQLite3::MemoryDatabase database;
+    CHECK(database.Load(memory, "/nonexistent/directory/database.db") != SQLITE_OK);
+    CHECK(!database.ErrorMessage().empty());
+    sqlite3_close(memory);
+  }
+}
+
+int main() {
+  char path[64];
+  std::snprintf(path, sizeof(path), "/tmp/SQLite3MemoryDatabaseTest-%d.db", static_cast<int>(getpid()));
+  std::remove(path);
+  createFile(path);
+
+  testLoadAndPersist(path);
+  testLockedFile(path);
+  testLoadFailure();
+
+  std::remove(path);
+  return TestSupport::Finish();
+}
@@ -0,0 +1,116 @@
+// Runs SQLite on top of the slab/2Q page cache and checks that the database
+// stays intact and that a table scan does not evict the hot pages.
+
+#include <cstdio>
+#include <string>
+
+#include <unistd.h>
+
+#include "PageCache.h"
+
+#include "TestSupport.h"
+
+namespace {
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  std::string queryText(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    std::string result;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+      result = reinterpret_cast<const char*>(sqlite3_column_text(statement, 0));
+    }
+    sqlite3_finalize(statement);
+    return result;
+  }
+
+  void lookup(sqlite3_stmt* statement, int id) {
+    sqlite3_bind_int(statement, 1, id);
+    CHECK(sqlite3_step(statement) == SQLITE_ROW);
+    sqlite3_reset(statement);
+  }
+
+  // Ten leaf pages that the "UI" keeps looking at
+  void lookupHotRows(sqlite3_stmt* statement) {
+    for (int page = 0; page < 10; ++page) {
+      lookup(statement, 1 + page * 400);
+    }
+  }
+
+  long long misses() {
+    return SQLite3::PageCache::Counters().misses;
+  }
+}
+
+int main() {
+  CHECK_EQUAL(SQLite3::PageCache::Install(), SQLITE_OK);
+  CHECK(SQLite3::PageCache::Installed());
+
+  char path[64];
+  std::snprintf(path, sizeof(path), "/tmp/SQLite3PageCacheTest-%d.db", static_cast<int>(getpid()));
+  std::remove(path);
+
+  sqlite3* db = nullptr;
+  CHECK(sqlite3_open(path, &db) == SQLITE_OK);
+  exec(db, "PRAGMA cache_size = 100");
+  exec(db, "CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT, payload TEXT)");
+  exec(db, "BEGIN");
+  exec(db, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 20000) "
+           "INSERT INTO item SELECT i, 'item ' || i, substr(hex(randomblob(60)), 1, 60) FROM n");
+  exec(db, "COMMIT");
+
+  // Rolled back changes and VACUUM exercise truncation and rekeying
+  exec(db, "BEGIN");
+  exec(db, "DELETE FROM item WHERE id % 3 = 0");
+  exec(db, "ROLLBACK");
+  exec(db, "DELETE FROM item WHERE id % 7 = 0");
+  exec(db, "VACUUM");
+  exec(db, "PRAGMA cache_size = 100");
+  CHECK_EQUAL(queryText(db, "PRAGMA integrity_check"), std::string("ok"));
+  CHECK_EQUAL(queryText(db, "SELECT COUNT(*) FROM item"), std::string("17143"));
+  exec(db, "INSERT INTO item VALUES (7, 'seven', '')");
+
+  SQLite3::PageCacheCounters counters = SQLite3::PageCache::Counters();
+  CHECK(counters.hits > 0);
+  CHECK(counters.misses > 0);
+  CHECK(counters.evictions > 0);
+  CHECK(counters.slabs > 0);
+  CHECK(counters.arenaBytes > 0);
+  sqlite3_close(db);
+  CHECK_EQUAL(SQLite3::PageCache::Counters().pages, 0);
+  CHECK_EQUAL(SQLite3::PageCache::Counters().slabs, 0);
+
+  // Scan resistance: the hot pages get referenced, pushed out of the
+  // probationary queue by other traffic and referenced again, which
+  // promotes them. A full scan afterwards must not evict them.
+  CHECK(sqlite3_open(path, &db) == SQLITE_OK);
+  exec(db, "PRAGMA cache_size = 100");
+  sqlite3_stmt* statement = nullptr;
+  CHECK(sqlite3_prepare_v2(db, "SELECT name FROM item WHERE id >= ? LIMIT 1", -1, &statement, nullptr) == SQLITE_OK);
+  lookupHotRows(statement);
+  // About 120 other pages: more than the cache holds, but few enough that
+  // the hot pages are still remembered as recently evicted
+  for (int id = 4500; id < 10500; id += 50) {
+    lookup(statement, id);
+  }
+  long long promotionsBefore = SQLite3::PageCache::Counters().promotions;
+  lookupHotRows(statement);
+  CHECK(SQLite3::PageCache::Counters().promotions - promotionsBefore >= 10);
+
+  CHECK_EQUAL(queryText(db, "SELECT COUNT(*) FROM item WHERE payload LIKE '%zz%'"), std::string("0"));
+  long long missesBefore = misses();
+  lookupHotRows(statement);
+  CHECK_EQUAL(misses() - missesBefore, 0);
+
+  sqlite3_finalize(statement);
+  sqlite3_close(db);
+  std::remove(path);
+  return TestSupport::Finish();
+}
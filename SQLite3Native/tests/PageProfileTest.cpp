@@ -0,0 +1,187 @@
+// Opens databases through the page profile VFS on top of the unix VFS and
+// checks that the pages read while recording end up in the profile, that
+// reads after the recording window are left out and that the next open
+// prefetches the profile in fewer, larger reads.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "PageProfile.h"
+
+#include "TestSupport.h"
+
+namespace {
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  long long queryInt(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    long long result = -1;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+      result = sqlite3_column_int64(statement, 0);
+    }
+    sqlite3_finalize(statement);
+    return result;
+  }
+
+  sqlite3* openProfiled(const std::string& path) {
+    sqlite3* db = nullptr;
+    CHECK_EQUAL(sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, SQLite3::PageProfile::VfsName), SQLITE_OK);
+    return db;
+  }
+
+  std::string tempPath(const char* name) {
+    char path[96];
+    std::snprintf(path, sizeof(path), "/tmp/SQLite3PageProfileTest-%d-%s.db", static_cast<int>(getpid()), name);
+    std::remove(path);
+    std::remove(SQLite3::PageProfile::ProfilePath(path).c_str());
+    return path;
+  }
+
+  void removeDatabase(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove(SQLite3::PageProfile::ProfilePath(path).c_str());
+  }
+
+  void createFile(const std::string& path) {
+    sqlite3* db = nullptr;
+    CHECK(sqlite3_open(path.c_str(), &db) == SQLITE_OK);
+    exec(db, "PRAGMA page_size = 4096");
+    exec(db, "CREATE TABLE item (id INTEGER PRIMARY KEY, value BLOB)");
+    exec(db, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 2000) "
+             "INSERT INTO item (value) SELECT randomblob(1000) FROM n");
+    sqlite3_close(db);
+  }
+
+  void testRecordAndPrefetch() {
+    std::string path = tempPath("record");
+    createFile(path);
+    SQLite3::PageProfile::ResetCounters();
+    SQLite3::PageProfile::SetRecordMilliseconds(60000);
+
+    sqlite3* db = openProfiled(path);
+    CHECK_EQUAL(queryInt(db, "SELECT SUM(length(value)) FROM item WHERE id <= 300"), 300000);
+    // Writes go through the VFS unchanged
+    exec(db, "INSERT INTO item (value) VALUES (zeroblob(10))");
+    sqlite3_close(db);
+
+    SQLite3::PageProfileCounters counters = SQLite3::PageProfile::Counters();
+    CHECK(counters.recordedPages > 50);
+    CHECK_EQUAL(counters.profilesWritten, 1);
+    CHECK_EQUAL(counters.prefetches, 0);
+
+    unsigned pageSize = 0;
+    std::vector<unsigned> pages;
+    CHECK_EQUAL(SQLite3::PageProfile::LoadProfile(SQLite3::PageProfile::ProfilePath(path), pageSize, pages), SQLITE_OK);
+    CHECK_EQUAL(pageSize, 4096u);
+    CHECK_EQUAL(static_cast<long long>(pages.size()), counters.recordedPages);
+    // The first page holds the schema and is read first
+    CHECK_EQUAL(pages[0], 0u);
+
+    db = openProfiled(path);
+    SQLite3::PageProfile::WaitForPrefetches();
+    counters = SQLite3::PageProfile::Counters();
+    CHECK_EQUAL(counters.prefetches, 1);
+    CHECK_EQUAL(counters.prefetchedPages, static_cast<long long>(pages.size()));
+    // Neighbouring pages are read together
+    CHECK(counters.prefetchReads * 4 < counters.prefetchedPages);
+    CHECK(counters.prefetchBytes >= counters.prefetchedPages * 4096);
+    CHECK_EQUAL(queryInt(db, "SELECT COUNT(*) FROM item"), 2001);
+    sqlite3_close(db);
+    removeDatabase(path);
+  }
+
+  void testRecordingWindow() {
+    std::string path = tempPath("window");
+    createFile(path);
+    SQLite3::PageProfile::ResetCounters();
+    SQLite3::PageProfile::SetRecordMilliseconds(100);
+
+    sqlite3* db = openProfiled(path);
+    CHECK_EQUAL(queryInt(db, "SELECT length(value) FROM item WHERE id = 1"), 1000);
+    long long early = SQLite3::PageProfile::Counters().recordedPages;
+    CHECK(early > 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    // The first read after the window writes the profile, later reads are
+    // not recorded
+    CHECK_EQUAL(queryInt(db, "SELECT SUM(length(value)) FROM item"), 2000000);
+    CHECK_EQUAL(SQLite3::PageProfile::Counters().profilesWritten, 1);
+    CHECK_EQUAL(SQLite3::PageProfile::Counters().recordedPages, early);
+    sqlite3_close(db);
+    CHECK_EQUAL(SQLite3::PageProfile::Counters().profilesWritten, 1);
+
+    // Recording also stops at the page limit
+    SQLite3::PageProfile::SetRecordMilliseconds(60000);
+    SQLite3::PageProfile::SetMaxPages(10);
+    db = openProfiled(path);
+    CHECK_EQUAL(queryInt(db, "SELECT SUM(length(value)) FROM item"), 2000000);
+    sqlite3_close(db);
+    unsigned pageSize = 0;
+    std::vector<unsigned> pages;
+    CHECK_EQUAL(SQLite3::PageProfile::LoadProfile(SQLite3::PageProfile::ProfilePath(path), pageSize, pages), SQLITE_OK);
+    CHECK_EQUAL(static_cast<int>(pages.size()), 10);
+    SQLite3::PageProfile::SetMaxPages(65536);
+    removeDatabase(path);
+  }
+
+  void testMemoryMapped() {
+    std::string path = tempPath("mmap");
+    createFile(path);
+    SQLite3::PageProfile::ResetCounters();
+    SQLite3::PageProfile::SetRecordMilliseconds(60000);
+
+    sqlite3* db = openProfiled(path);
+    exec(db, "PRAGMA mmap_size = 268435456");
+    CHECK_EQUAL(queryInt(db, "SELECT SUM(length(value)) FROM item WHERE id <= 300"), 300000);
+    sqlite3_close(db);
+    // Fetched pages are recorded like read ones
+    CHECK(SQLite3::PageProfile::Counters().recordedPages > 50);
+    removeDatabase(path);
+  }
+
+  void testBadProfile() {
+    std::string path = tempPath("bad");
+    createFile(path);
+    FILE* file = std::fopen(SQLite3::PageProfile::ProfilePath(path).c_str(), "wb");
+    std::fputs("not a profile at all", file);
+    std::fclose(file);
+
+    unsigned pageSize = 0;
+    std::vector<unsigned> pages;
+    CHECK_EQUAL(SQLite3::PageProfile::LoadProfile(SQLite3::PageProfile::ProfilePath(path), pageSize, pages), SQLITE_CORRUPT);
+    CHECK_EQUAL(SQLite3::PageProfile::LoadProfile(path + "-missing", pageSize, pages), SQLITE_NOTFOUND);
+
+    // A broken profile is not prefetched, the database opens as usual
+    SQLite3::PageProfile::ResetCounters();
+    sqlite3* db = openProfiled(path);
+    CHECK_EQUAL(queryInt(db, "SELECT COUNT(*) FROM item"), 2000);
+    sqlite3_close(db);
+    CHECK_EQUAL(SQLite3::PageProfile::Counters().prefetches, 0);
+    removeDatabase(path);
+  }
+}
+
+int main() {
+  CHECK_EQUAL(SQLite3::PageProfile::Register("unix"), SQLITE_OK);
+  CHECK(SQLite3::PageProfile::Registered());
+  CHECK(sqlite3_vfs_find(SQLite3::PageProfile::VfsName) != nullptr);
+
+  testRecordAndPrefetch();
+  testRecordingWindow();
+  testMemoryMapped();
+  testBadProfile();
+
+  return TestSupport::Finish();
+}
@@ -0,0 +1,112 @@
+// Captures rows of every type into the arena and reads them back, including
+// values larger than a chunk and a result with many rows.
+
+#include <cstring>
+#include <string>
+
+#include "ResultArena.h"
+
+#include "TestSupport.h"
+
+namespace {
+  sqlite3_stmt* prepare(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    return statement;
+  }
+
+  std::string bytes(const SQLite3::ResultArena& arena, size_t row, int column) {
+    size_t length = 0;
+    const char* data = arena.Bytes(row, column, length);
+    return data ? std::string(data, length) : std::string("<none>");
+  }
+
+  void testTypes(sqlite3* db) {
+    sqlite3_stmt* statement = prepare(db,
+      "SELECT 42 AS id, 1.5 AS price, 'M\xc3\xbcnchen' AS name, x'00ff10' AS data, NULL AS note, '' AS empty "
+      "UNION ALL SELECT -7, 2, 'second', zeroblob(0), 'x', ''");
+    SQLite3::ResultArena arena(statement);
+    while (sqlite3_step(statement) == SQLITE_ROW) {
+      arena.AppendRow(statement);
+    }
+    sqlite3_finalize(statement);
+
+    CHECK_EQUAL(arena.RowCount(), 2u);
+    CHECK_EQUAL(arena.ColumnCount(), 6);
+    CHECK_EQUAL(arena.ColumnName(2), std::string("name"));
+    CHECK_EQUAL(arena.ColumnIndex("data"), 3);
+    CHECK_EQUAL(arena.ColumnIndex("missing"), -1);
+
+    CHECK_EQUAL(arena.Type(0, 0), SQLITE_INTEGER);
+    CHECK_EQUAL(arena.Int64(0, 0), 42);
+    CHECK_EQUAL(arena.Double(0, 0), 42.0);
+    CHECK_EQUAL(arena.Type(0, 1), SQLITE_FLOAT);
+    CHECK_EQUAL(arena.Double(0, 1), 1.5);
+    CHECK_EQUAL(arena.Int64(0, 1), 1);
+    CHECK_EQUAL(arena.Type(0, 2), SQLITE_TEXT);
+    CHECK_EQUAL(bytes(arena, 0, 2), std::string("M\xc3\xbcnchen"));
+    CHECK_EQUAL(arena.Type(0, 3), SQLITE_BLOB);
+    CHECK_EQUAL(bytes(arena, 0, 3), std::string("\x00\xff\x10", 3));
+    CHECK_EQUAL(arena.Type(0, 4), SQLITE_NULL);
+    CHECK_EQUAL(bytes(arena, 0, 4), std::string("<none>"));
+    CHECK_EQUAL(arena.Int64(0, 4), 0);
+    CHECK_EQUAL(arena.Type(0, 5), SQLITE_TEXT);
+    CHECK_EQUAL(bytes(arena, 0, 5), std::string());
+
+    CHECK_EQUAL(arena.Int64(1, 0), -7);
+    CHECK_EQUAL(arena.Type(1, 1), SQLITE_INTEGER);
+    CHECK_EQUAL(bytes(arena, 1, 2), std::string("second"));
+    CHECK_EQUAL(arena.Type(1, 3), SQLITE_BLOB);
+    CHECK_EQUAL(bytes(arena, 1, 3), std::string());
+    CHECK_EQUAL(bytes(arena, 1, 4), std::string("x"));
+  }
+
+  void testManyAndLargeValues(sqlite3* db) {
+    sqlite3_stmt* statement = prepare(db,
+      "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 20000) "
+      "SELECT i, 'row ' || i, CASE WHEN i % 5000 = 0 THEN zeroblob(100000) || x'7f' END FROM n");
+    SQLite3::ResultArena arena(statement);
+    while (sqlite3_step(statement) == SQLITE_ROW) {
+      arena.AppendRow(statement);
+    }
+    sqlite3_finalize(statement);
+
+    CHECK_EQUAL(arena.RowCount(), 20000u);
+    bool matches = true;
+    for (size_t row = 0; row < arena.RowCount(); ++row) {
+      long long id = arena.Int64(row, 0);
+      matches = matches && id == static_cast<long long>(row + 1);
+      matches = matches && bytes(arena, row, 1) == "row " + std::to_string(id);
+      size_t length = 0;
+      const char* large = arena.Bytes(row, 2, length);
+      if (id % 5000 == 0) {
+        matches = matches && length == 100001 && large[0] == 0 && large[100000] == 0x7f;
+      } else {
+        matches = matches && arena.Type(row, 2) == SQLITE_NULL;
+      }
+    }
+    CHECK(matches);
+    // The small values share chunks, the four large ones get their own
+    CHECK(arena.ArenaBytes() < 4 * 100001 + 8 * 64 * 1024);
+  }
+
+  void testEmptyResult(sqlite3* db) {
+    sqlite3_stmt* statement = prepare(db, "SELECT 1 AS one WHERE 0");
+    SQLite3::ResultArena arena(statement);
+    CHECK_EQUAL(sqlite3_step(statement), SQLITE_DONE);
+    sqlite3_finalize(statement);
+    CHECK_EQUAL(arena.RowCount(), 0u);
+    CHECK_EQUAL(arena.ColumnCount(), 1);
+    CHECK_EQUAL(arena.ArenaBytes(), 0u);
+  }
+}
+
+int main() {
+  sqlite3* db = nullptr;
+  CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+  testTypes(db);
+  testManyAndLargeValues(db);
+  testEmptyResult(db);
+  sqlite3_close(db);
+  return TestSupport::Finish();
+}
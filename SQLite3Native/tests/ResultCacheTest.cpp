@@ -0,0 +1,280 @@
+// Checks that cached results are reused and that every way a table can
+// change invalidates them: row changes, truncating deletes, rolled back and
+// committed transactions, other connections and schema changes, also when
+// the writing statement comes from the statement cache. Also checks
+// uncacheable statements, eviction within the budget and that the cache
+// refuses connections whose external commits it could not notice.
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include <unistd.h>
+
+#include "ResultCache.h"
+#include "StatementCache.h"
+
+#include "TestSupport.h"
+
+namespace {
+  class TextResult : public SQLite3::CachedResult {
+  public:
+    explicit TextResult(const std::string& text) : text(text) {}
+
+    std::string text;
+  };
+
+  struct Connection {
+    sqlite3* db;
+    SQLite3::ResultCache* cache;
+  };
+
+  void onRowChanged(void* cache, int, const char*, const char* table, sqlite3_int64) {
+    static_cast<SQLite3::ResultCache*>(cache)->OnRowChanged(table);
+  }
+
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  // Runs the query through the cache like Database::AllAsync does, the rows
+  // are joined into one string
+  std::string query(Connection& connection, const std::string& sql) {
+    auto cached = connection.cache->Lookup(sql);
+    if (cached) {
+      return static_cast<const TextResult&>(*cached).text;
+    }
+    sqlite3_stmt* statement = nullptr;
+    SQLite3::StatementTables tables;
+    {
+      SQLite3::ResultCache::Collection collection(*connection.cache);
+      CHECK(sqlite3_prepare_v2(connection.db, sql.c_str(), -1, &statement, nullptr) == SQLITE_OK);
+      tables = collection.Tables(sqlite3_stmt_readonly(statement) != 0);
+    }
+    std::string text;
+    while (sqlite3_step(statement) == SQLITE_ROW) {
+      for (int i = 0; i < sqlite3_column_count(statement); ++i) {
+        const unsigned char* value = sqlite3_column_text(statement, i);
+        text += value ? reinterpret_cast<const char*>(value) : "NULL";
+        text += ";";
+      }
+    }
+    sqlite3_finalize(statement);
+    connection.cache->Insert(sql, tables, std::make_shared<TextResult>(text), text.size());
+    return text;
+  }
+
+  long long hits(const Connection& connection) {
+    return connection.cache->Counters().hits;
+  }
+
+  void testInvalidation(Connection& connection) {
+    sqlite3* db = connection.db;
+    exec(db, "CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT)");
+    exec(db, "CREATE TABLE other (id INTEGER PRIMARY KEY)");
+    exec(db, "CREATE VIEW named AS SELECT name FROM item WHERE name IS NOT NULL");
+    exec(db, "INSERT INTO item VALUES (1, 'Apple'), (2, 'Orange')");
+
+    const std::string names = "SELECT name FROM item ORDER BY id";
+    CHECK_EQUAL(query(connection, names), std::string("Apple;Orange;"));
+    CHECK_EQUAL(query(connection, names), std::string("Apple;Orange;"));
+    CHECK_EQUAL(hits(connection), 1);
+
+    // Writes to unrelated tables keep the entry
+    exec(db, "INSERT INTO other VALUES (1)");
+    query(connection, names);
+    CHECK_EQUAL(hits(connection), 2);
+
+    exec(db, "UPDATE item SET name = 'Banana' WHERE id = 2");
+    CHECK_EQUAL(query(connection, names), std::string("Apple;Banana;"));
+    CHECK_EQUAL(hits(connection), 2);
+
+    // Views depend on the tables they read
+    const std::string viewed = "SELECT * FROM named";
+    CHECK_EQUAL(query(connection, viewed), std::string("Apple;Banana;"));
+    exec(db, "INSERT INTO item VALUES (3, 'Cherry')");
+    CHECK_EQUAL(query(connection, viewed), std::string("Apple;Banana;Cherry;"));
+
+    // Rolled back changes invalidate too, the update hook saw them
+    query(connection, names);
+    exec(db, "BEGIN");
+    exec(db, "DELETE FROM item WHERE id = 1");
+    CHECK_EQUAL(query(connection, names), std::string("Banana;Cherry;"));
+    exec(db, "ROLLBACK");
+    CHECK_EQUAL(query(connection, names), std::string("Apple;Banana;Cherry;"));
+
+    // DELETE without WHERE skips the update hook
+    long long before = hits(connection);
+    query(connection, names);
+    CHECK_EQUAL(hits(connection), before + 1);
+    exec(db, "BEGIN");
+    exec(db, "DELETE FROM item");
+    CHECK_EQUAL(query(connection, names), std::string(""));
+    exec(db, "INSERT INTO item VALUES (1, 'Apple')");
+    exec(db, "COMMIT");
+    CHECK_EQUAL(query(connection, names), std::string("Apple;"));
+
+    // Nothing read inside a transaction is kept
+    exec(db, "BEGIN");
+    const std::string count = "SELECT COUNT(*) FROM item";
+    query(connection, count);
+    before = hits(connection);
+    query(connection, count);
+    CHECK_EQUAL(hits(connection), before);
+    exec(db, "COMMIT");
+
+    exec(db, "DROP TABLE other");
+    exec(db, "CREATE TABLE other (id INTEGER PRIMARY KEY, value TEXT)");
+    exec(db, "INSERT INTO other VALUES (1, 'x')");
+    query(connection, "SELECT * FROM other");
+    exec(db, "ALTER TABLE other ADD COLUMN extra TEXT DEFAULT 'y'");
+    CHECK_EQUAL(query(connection, "SELECT * FROM other"), std::string("1;x;y;"));
+  }
+
+  void testUncacheable(Connection& connection) {
+    long long insertions = connection.cache->Counters().insertions;
+    query(connection, "SELECT random()");
+    query(connection, "SELECT datetime('now'), name FROM item");
+    query(connection, "PRAGMA user_version");
+    query(connection, "SELECT last_insert_rowid()");
+    CHECK_EQUAL(connection.cache->Counters().insertions, insertions);
+
+    // Reads no table, so nothing would ever invalidate it
+    long long before = hits(connection);
+    query(connection, "SELECT CURRENT_TIMESTAMP");
+    query(connection, "SELECT CURRENT_TIMESTAMP");
+    query(connection, "SELECT current_date, current_time");
+    query(connection, "SELECT current_date, current_time");
+    CHECK_EQUAL(hits(connection), before);
+    CHECK_EQUAL(connection.cache->Counters().insertions, insertions);
+
+    // Deterministic functions are fine
+    query(connection, "SELECT upper(name) FROM item");
+    CHECK_EQUAL(connection.cache->Counters().insertions, insertions + 1);
+  }
+
+  // Runs a statement through the statement cache like Database::RunAsync
+  void run(SQLite3::StatementCache& statements, sqlite3* db, const std::string& sql) {
+    sqlite3_stmt* statement = statements.Acquire(sql);
+    if (!statement) {
+      CHECK(sqlite3_prepare_v2(db, sql.c_str(), -1, &statement, nullptr) == SQLITE_OK);
+    }
+    CHECK_EQUAL(sqlite3_step(statement), SQLITE_DONE);
+    statements.Release(sql, statement);
+  }
+
+  void testCachedWrite(Connection& connection) {
+    sqlite3* db = connection.db;
+    SQLite3::StatementCache statements(4);
+    statements.SetCacheWrites(false);
+    const std::string names = "SELECT name FROM item ORDER BY id";
+    const std::string truncate = "DELETE FROM item";
+
+    CHECK_EQUAL(query(connection, names), std::string("Apple;"));
+    run(statements, db, truncate);
+    CHECK_EQUAL(query(connection, names), std::string(""));
+
+    // The second DELETE without WHERE skips the update hook as well, only
+    // preparing it again tells the cache which table it writes
+    exec(db, "INSERT INTO item VALUES (1, 'Apple')");
+    CHECK_EQUAL(query(connection, names), std::string("Apple;"));
+    run(statements, db, truncate);
+    CHECK_EQUAL(query(connection, names), std::string(""));
+    CHECK_EQUAL(statements.Counters().hits, 0);
+    CHECK_EQUAL(statements.Counters().entries, 0);
+
+    // Reads are still reused
+    run(statements, db, "SELECT name FROM item");
+    run(statements, db, "SELECT name FROM item");
+    CHECK_EQUAL(statements.Counters().hits, 1);
+    exec(db, "INSERT INTO item VALUES (1, 'Apple')");
+  }
+
+  void testOtherConnection(Connection& connection, const char* path) {
+    const std::string names = "SELECT name FROM item ORDER BY id";
+    CHECK_EQUAL(query(connection, names), std::string("Apple;"));
+
+    sqlite3* other = nullptr;
+    CHECK(sqlite3_open(path, &other) == SQLITE_OK);
+    exec(other, "INSERT INTO item VALUES (2, 'Orange')");
+    sqlite3_close(other);
+
+    CHECK_EQUAL(query(connection, names), std::string("Apple;Orange;"));
+  }
+
+  int denyPragmas(void*, int action, const char*, const char*, const char*, const char*) {
+    return action == SQLITE_PRAGMA ? SQLITE_DENY : SQLITE_OK;
+  }
+
+  void testWithoutDataVersion() {
+    // Denying the pragma stands in for a SQLite older than 3.8.4
+    sqlite3* db = nullptr;
+    CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    SQLite3::ResultCache cache(1024);
+    sqlite3_set_authorizer(db, denyPragmas, nullptr);
+    CHECK(!cache.Attach(db));
+    CHECK(!cache.Attached());
+    // Connections no other one writes through do not need it
+    CHECK(cache.Attach(db, false));
+    CHECK(cache.Attached());
+    cache.Detach();
+    sqlite3_close(db);
+  }
+
+  void testBudget(Connection& connection) {
+    connection.cache->Clear();
+    connection.cache->SetBudget(4096);
+    for (int i = 0; i < 100; ++i) {
+      char sql[64];
+      std::snprintf(sql, sizeof(sql), "SELECT name, %d FROM item", i);
+      query(connection, sql);
+    }
+    SQLite3::ResultCacheCounters counters = connection.cache->Counters();
+    CHECK(counters.bytes <= 4096);
+    CHECK(counters.evictions > 0);
+    CHECK_EQUAL(counters.entries + counters.evictions, 100);
+
+    // The most recently used entries stay
+    long long before = hits(connection);
+    query(connection, "SELECT name, 99 FROM item");
+    CHECK_EQUAL(hits(connection), before + 1);
+    query(connection, "SELECT name, 0 FROM item");
+    CHECK_EQUAL(hits(connection), before + 1);
+
+    // Results larger than the whole budget are not cached
+    connection.cache->SetBudget(64);
+    CHECK_EQUAL(connection.cache->Counters().entries, 0);
+    query(connection, "SELECT name FROM item");
+    CHECK_EQUAL(connection.cache->Counters().entries, 0);
+  }
+}
+
+int main() {
+  char path[64];
+  std::snprintf(path, sizeof(path), "/tmp/SQLite3ResultCacheTest-%d.db", static_cast<int>(getpid()));
+  std::remove(path);
+
+  Connection connection;
+  CHECK(sqlite3_open(path, &connection.db) == SQLITE_OK);
+  SQLite3::ResultCache cache(1024 * 1024);
+  connection.cache = &cache;
+  CHECK(cache.Attach(connection.db));
+  sqlite3_update_hook(connection.db, onRowChanged, &cache);
+
+  testInvalidation(connection);
+  testUncacheable(connection);
+  testCachedWrite(connection);
+  testOtherConnection(connection, path);
+  testBudget(connection);
+  testWithoutDataVersion();
+
+  cache.Detach();
+  sqlite3_close(connection.db);
+  std::remove(path);
+  return TestSupport::Finish();
+}
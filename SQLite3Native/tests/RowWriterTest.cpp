@@ -0,0 +1,77 @@
+// Checks the JSON produced by RowWriter and the REGEXP and collation
+// helpers against a real SQLite connection.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "RowWriter.h"
+#include "SqlFunctions.h"
+
+#include "TestSupport.h"
+
+namespace {
+  std::string firstRowJson(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    CHECK(sqlite3_step(statement) == SQLITE_ROW);
+    std::string json;
+    SQLite3::RowWriter(statement).WriteRow(json);
+    sqlite3_finalize(statement);
+    return json;
+  }
+
+  int queryInt(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    CHECK(sqlite3_step(statement) == SQLITE_ROW);
+    int value = sqlite3_column_int(statement, 0);
+    sqlite3_finalize(statement);
+    return value;
+  }
+
+  int reverseCollateUtf16(void*, int str1Length, const void* str1Data, int str2Length, const void* str2Data) {
+    std::u16string string1(static_cast<const char16_t*>(str1Data), str1Length / 2);
+    std::u16string string2(static_cast<const char16_t*>(str2Data), str2Length / 2);
+    return string2.compare(string1);
+  }
+
+  int reverseCollateUtf8(void* data, int str1Length, const void* str1Data, int str2Length, const void* str2Data) {
+    return SQLite3::CollateUtf8AsUtf16(reverseCollateUtf16, data, str1Length, str1Data, str2Length, str2Data);
+  }
+}
+
+int main() {
+  sqlite3* db = nullptr;
+  CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+  sqlite3_create_function_v2(db, "REGEXP", 2, SQLITE_UTF8, nullptr, SQLite3::SqliteRegexUtf8, nullptr, nullptr, nullptr);
+  sqlite3_create_collation_v2(db, "REVERSE", SQLITE_UTF8, nullptr, reverseCollateUtf8, nullptr);
+
+  CHECK_EQUAL(firstRowJson(db, "SELECT 1 AS a, -9223372036854775808 AS b, 2.5 AS c, NULL AS d"),
+              std::string("{\"a\":1,\"b\":-9223372036854775808,\"c\":2.5,\"d\":null}"));
+  CHECK_EQUAL(firstRowJson(db, "SELECT 'Foo' || char(10) || 'Bar''n \"q\" \\ ' || char(1) AS \"we\"\"ird\""),
+              std::string("{\"we\\\"ird\":\"Foo\\nBar'n \\\"q\\\" \\\\ \\u0001\"}"));
+  CHECK_EQUAL(firstRowJson(db, "SELECT 'M\xc3\xbcnchen' AS city"), std::string("{\"city\":\"M\xc3\xbcnchen\"}"));
+  CHECK_EQUAL(firstRowJson(db, "SELECT x'' AS a, x'66' AS b, x'666f' AS c, x'666f6f' AS d"),
+              std::string("{\"a\":\"\",\"b\":\"Zg==\",\"c\":\"Zm8=\",\"d\":\"Zm9v\"}"));
+
+  CHECK_EQUAL(queryInt(db, "SELECT 'Banana' REGEXP '.*a'"), 1);
+  CHECK_EQUAL(queryInt(db, "SELECT 'Melon' REGEXP '^a'"), 0);
+  CHECK_EQUAL(queryInt(db, "SELECT 'M\xc3\xbcnchen' REGEXP '^M.nchen$'"), 1);
+  CHECK_EQUAL(queryInt(db, "SELECT COUNT(*) FROM (SELECT 'abc' AS v UNION ALL SELECT 'xbz') WHERE v REGEXP 'b'"), 2);
+  CHECK_EQUAL(queryInt(db, "SELECT ('a' REGEXP NULL) IS NULL"), 1);
+  {
+    sqlite3_stmt* statement = nullptr;
+    CHECK(sqlite3_prepare_v2(db, "SELECT 'a' REGEXP '('", -1, &statement, nullptr) == SQLITE_OK);
+    CHECK_EQUAL(sqlite3_step(statement), SQLITE_ERROR);
+    sqlite3_finalize(statement);
+  }
+
+  CHECK_EQUAL(SQLite3::Utf8ToWString("\xf0\x9f\x98\x80!", 5).size(), sizeof(wchar_t) == 2 ? 3u : 2u);
+  CHECK_EQUAL(queryInt(db, "SELECT 'b' < 'a' COLLATE REVERSE"), 1);
+  CHECK_EQUAL(queryInt(db, "SELECT 'x\xc3\xa9' = 'x\xc3\xa9' COLLATE REVERSE"), 1);
+
+  sqlite3_close(db);
+  return TestSupport::Finish();
+}
@@ -0,0 +1,256 @@
+// Checks the order the scheduler runs queued jobs in, that aging lets old
+// background jobs pass newer interactive ones, that delayed jobs wait
+// without holding up others, that the worker survives throwing jobs and
+// jobs destroying the scheduler and that an owner stopping the scheduler
+// before closing its connection drops the queued jobs instead of running
+// them against the closed handle.
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "Scheduler.h"
+#include "sqlite3.h"
+
+#include "TestSupport.h"
+
+namespace {
+  // Records the order jobs ran in
+  class Trace {
+  public:
+    SQLite3::Scheduler::Job Job(const std::string& name) {
+      return [this, name]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        order += name;
+        order += " ";
+      };
+    }
+
+    std::string Order() {
+      std::lock_guard<std::mutex> lock(mutex);
+      return order;
+    }
+
+  private:
+    std::mutex mutex;
+    std::string order;
+  };
+
+  // Keeps the worker busy until released, so the following jobs queue up
+  std::shared_ptr<std::promise<void>> block(SQLite3::Scheduler& scheduler) {
+    auto release = std::make_shared<std::promise<void>>();
+    auto started = std::make_shared<std::promise<void>>();
+    std::shared_future<void> released = release->get_future().share();
+    scheduler.Submit(SQLite3::PriorityNormal, [started, released]() {
+      started->set_value();
+      released.wait();
+    });
+    started->get_future().wait();
+    return release;
+  }
+
+  void testPriorities() {
+    Trace trace;
+    {
+      SQLite3::Scheduler scheduler(0);
+      auto release = block(scheduler);
+      scheduler.Submit(SQLite3::PriorityBackground, trace.Job("b1"));
+      scheduler.Submit(SQLite3::PriorityNormal, trace.Job("n1"));
+      scheduler.Submit(SQLite3::PriorityBackground, trace.Job("b2"));
+      scheduler.Submit(SQLite3::PriorityInteractive, trace.Job("i1"));
+      scheduler.Submit(SQLite3::PriorityNormal, trace.Job("n2"));
+      scheduler.Submit(SQLite3::PriorityInteractive, trace.Job("i2"));
+      CHECK_EQUAL(scheduler.Counters().pending, 6);
+      release->set_value();
+      // The destructor runs the queued jobs
+    }
+    CHECK_EQUAL(trace.Order(), std::string("i1 i2 n1 n2 b1 b2 "));
+  }
+
+  void testAging() {
+    Trace trace;
+    SQLite3::SchedulerCounters counters;
+    {
+      SQLite3::Scheduler scheduler(20);
+      auto release = block(scheduler);
+      scheduler.Submit(SQLite3::PriorityBackground, trace.Job("old"));
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      scheduler.Submit(SQLite3::PriorityInteractive, trace.Job("i1"));
+      scheduler.Submit(SQLite3::PriorityBackground, trace.Job("new"));
+      scheduler.Submit(SQLite3::PriorityInteractive, trace.Job("i2"));
+      release->set_value();
+
+      std::promise<void> done;
+      scheduler.Submit(SQLite3::PriorityBackground, [&done]() { done.set_value(); });
+      done.get_future().wait();
+      counters = scheduler.Counters();
+    }
+    CHECK_EQUAL(trace.Order(), std::string("old i1 i2 new "));
+    CHECK_EQUAL(counters.aged, 1);
+    CHECK_EQUAL(counters.completed[SQLite3::PriorityInteractive], 2);
+    CHECK_EQUAL(counters.completed[SQLite3::PriorityNormal], 1);
+  }
+
+  void testDelayed() {
+    typedef std::chrono::steady_clock Clock;
+    Trace trace;
+    {
+      SQLite3::Scheduler scheduler(0);
+      Clock::time_point start = Clock::now();
+      std::promise<long long> late;
+      scheduler.SubmitAfter(SQLite3::PriorityInteractive, 50, [&trace, &late, start]() {
+        trace.Job("late")();
+        late.set_value(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count());
+      });
+      scheduler.SubmitAfter(SQLite3::PriorityNormal, 20, trace.Job("soon"));
+      scheduler.Submit(SQLite3::PriorityBackground, trace.Job("now"));
+      CHECK_EQUAL(scheduler.Counters().delayed, 2);
+      CHECK(late.get_future().get() >= 50);
+      CHECK_EQUAL(scheduler.Counters().delayed, 0);
+
+      // Queued right away when the scheduler is destroyed
+      scheduler.SubmitAfter(SQLite3::PriorityNormal, 60000, trace.Job("pending"));
+    }
+    CHECK_EQUAL(trace.Order(), std::string("now soon late pending "));
+  }
+
+  void testThrowingJob() {
+    Trace trace;
+    {
+      SQLite3::Scheduler scheduler(0);
+      scheduler.Submit(SQLite3::PriorityNormal, []() { throw std::runtime_error("failed"); });
+      scheduler.Submit(SQLite3::PriorityNormal, trace.Job("after"));
+    }
+    CHECK_EQUAL(trace.Order(), std::string("after "));
+  }
+
+  void testDestroyedByJob() {
+    auto scheduler = std::make_shared<SQLite3::Scheduler>(0);
+    std::promise<void> done;
+    std::shared_ptr<SQLite3::Scheduler> owner = scheduler;
+    scheduler->Submit(SQLite3::PriorityNormal, [owner, &done]() mutable {
+      done.set_value();
+    });
+    // The job now holds the last reference and destroys the scheduler on
+    // the worker
+    scheduler.reset();
+    owner.reset();
+    done.get_future().wait();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+
+  // Closes its connection the way Database does when it is destroyed
+  struct Owner {
+    Owner()
+      : db(nullptr)
+      , closed(false)
+      , scheduler(0) {
+      sqlite3_open(":memory:", &db);
+    }
+
+    ~Owner() {
+      scheduler.Stop();
+      closed = true;
+      sqlite3_close(db);
+      if (onClosed) {
+        onClosed();
+      }
+    }
+
+    SQLite3::Scheduler::Job Query(std::shared_ptr<int> marker, std::atomic<int>& ran) {
+      return [this, marker, &ran]() {
+        if (!closed) {
+          sqlite3_exec(db, "SELECT 1", nullptr, nullptr, nullptr);
+        }
+        ++ran;
+      };
+    }
+
+    sqlite3* db;
+    std::atomic<bool> closed;
+    std::function<void()> onClosed;
+    SQLite3::Scheduler scheduler;
+  };
+
+  // Counts the jobs holding the marker that were destroyed
+  std::shared_ptr<int> marker(std::atomic<int>& destroyed) {
+    return std::shared_ptr<int>(new int(0), [&destroyed](int* value) {
+      delete value;
+      ++destroyed;
+    });
+  }
+
+  void testStoppedByOwner() {
+    std::atomic<int> ran(0);
+    std::atomic<int> destroyed(0);
+    std::unique_ptr<Owner> owner(new Owner());
+    auto release = block(owner->scheduler);
+    for (int i = 0; i < 100; ++i) {
+      owner->scheduler.Submit(SQLite3::PriorityNormal, owner->Query(marker(destroyed), ran));
+    }
+    owner->scheduler.SubmitAfter(SQLite3::PriorityNormal, 60000, owner->Query(marker(destroyed), ran));
+    CHECK_EQUAL(owner->scheduler.Counters().pending, 100);
+
+    // The owner goes away while the blocking job still runs
+    std::thread releaser([release]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      release->set_value();
+    });
+    owner.reset();
+    releaser.join();
+    CHECK_EQUAL(ran.load(), 0);
+    CHECK_EQUAL(destroyed.load(), 101);
+
+    // Jobs submitted once stopped are dropped right away
+    owner.reset(new Owner());
+    SQLite3::Scheduler& scheduler = owner->scheduler;
+    scheduler.Stop();
+    scheduler.Submit(SQLite3::PriorityNormal, owner->Query(marker(destroyed), ran));
+    scheduler.SubmitAfter(SQLite3::PriorityNormal, 0, owner->Query(marker(destroyed), ran));
+    CHECK_EQUAL(destroyed.load(), 103);
+    CHECK_EQUAL(scheduler.Counters().pending, 0);
+    CHECK_EQUAL(scheduler.Counters().delayed, 0);
+    CHECK_EQUAL(ran.load(), 0);
+  }
+
+  void testStoppedByOwnJob() {
+    std::atomic<int> ran(0);
+    std::atomic<int> destroyed(0);
+    std::promise<void> closed;
+    auto owner = std::make_shared<Owner>();
+    owner->onClosed = [&closed]() {
+      closed.set_value();
+    };
+    auto release = block(owner->scheduler);
+    // Holds the last reference, so the owner is destroyed on the worker
+    // with the jobs behind it still queued
+    owner->scheduler.Submit(SQLite3::PriorityNormal, [owner]() mutable {
+      owner.reset();
+    });
+    for (int i = 0; i < 10; ++i) {
+      owner->scheduler.Submit(SQLite3::PriorityNormal, owner->Query(marker(destroyed), ran));
+    }
+    owner.reset();
+    release->set_value();
+    closed.get_future().wait();
+    CHECK_EQUAL(ran.load(), 0);
+    CHECK_EQUAL(destroyed.load(), 10);
+  }
+}
+
+int main() {
+  testPriorities();
+  testAging();
+  testDelayed();
+  testThrowingJob();
+  testDestroyedByJob();
+  testStoppedByOwner();
+  testStoppedByOwnJob();
+  return TestSupport::Finish();
+}
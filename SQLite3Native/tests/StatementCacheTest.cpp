@@ -0,0 +1,224 @@
+// Reuses prepared statements through the cache and checks eviction, that
+// concurrent uses of the same SQL get statements of their own, that writes
+// can be kept out of the cache and that an immutable database opened with
+// hot statements answers from the cache.
+
+#include <cstdio>
+#include <string>
+
+#include <unistd.h>
+
+#include "ConnectionOptions.h"
+#include "StatementCache.h"
+
+#include "TestSupport.h"
+
+namespace {
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  long long queryInt(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    long long result = -1;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+      result = sqlite3_column_int64(statement, 0);
+    }
+    sqlite3_finalize(statement);
+    return result;
+  }
+
+  sqlite3_stmt* prepare(sqlite3* db, const std::string& sql) {
+    sqlite3_stmt* statement = nullptr;
+    CHECK(sqlite3_prepare_v2(db, sql.c_str(), -1, &statement, nullptr) == SQLITE_OK);
+    return statement;
+  }
+
+  // Like an operation of the component, takes the statement from the cache
+  // or prepares it, runs it and hands it back
+  long long run(SQLite3::StatementCache& cache, sqlite3* db, const std::string& sql, int parameter) {
+    sqlite3_stmt* statement = cache.Acquire(sql);
+    if (!statement) {
+      statement = prepare(db, sql);
+    }
+    sqlite3_bind_int(statement, 1, parameter);
+    long long result = -1;
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+      result = sqlite3_column_int64(statement, 0);
+    }
+    cache.Release(sql, statement);
+    return result;
+  }
+
+  int openStatements(sqlite3* db) {
+    int count = 0;
+    for (sqlite3_stmt* statement = sqlite3_next_stmt(db, nullptr); statement; statement = sqlite3_next_stmt(db, statement)) {
+      ++count;
+    }
+    return count;
+  }
+
+  void testReuse(sqlite3* db) {
+    SQLite3::StatementCache cache(2);
+    const std::string byId = "SELECT value FROM item WHERE id = ?";
+    CHECK_EQUAL(run(cache, db, byId, 3), 30);
+    CHECK_EQUAL(run(cache, db, byId, 4), 40);
+    SQLite3::StatementCacheCounters counters = cache.Counters();
+    CHECK_EQUAL(counters.misses, 1);
+    CHECK_EQUAL(counters.hits, 1);
+    CHECK_EQUAL(counters.entries, 1);
+
+    // Released statements are reset and their bindings cleared
+    sqlite3_stmt* statement = cache.Acquire(byId);
+    CHECK(statement != nullptr);
+    CHECK_EQUAL(sqlite3_stmt_busy(statement), 0);
+    CHECK_EQUAL(sqlite3_step(statement), SQLITE_DONE);
+    cache.Release(byId, statement);
+
+    // Schema changes re-prepare cached statements on their next step
+    exec(db, "ALTER TABLE item ADD COLUMN extra INTEGER");
+    CHECK_EQUAL(run(cache, db, byId, 5), 50);
+    CHECK_EQUAL(cache.Counters().hits, 3);
+
+    cache.Clear();
+    CHECK_EQUAL(openStatements(db), 0);
+  }
+
+  void testSameSqlTwice(sqlite3* db) {
+    SQLite3::StatementCache cache(4);
+    const std::string all = "SELECT value FROM item ORDER BY id";
+    sqlite3_stmt* outer = prepare(db, all);
+    cache.Release(all, outer);
+
+    sqlite3_stmt* first = cache.Acquire(all);
+    CHECK(first == outer);
+    CHECK_EQUAL(sqlite3_step(first), SQLITE_ROW);
+    // Used again while the first one still steps
+    CHECK(cache.Acquire(all) == nullptr);
+    sqlite3_stmt* second = prepare(db, all);
+    CHECK_EQUAL(sqlite3_step(second), SQLITE_ROW);
+
+    cache.Release(all, second);
+    // The cache holds one statement per SQL, the other one is finalized
+    cache.Release(all, first);
+    CHECK_EQUAL(cache.Counters().entries, 1);
+    CHECK_EQUAL(openStatements(db), 1);
+    cache.Clear();
+  }
+
+  void testEviction(sqlite3* db) {
+    SQLite3::StatementCache cache(2);
+    const std::string a = "SELECT 1";
+    const std::string b = "SELECT 2";
+    const std::string c = "SELECT 3";
+    cache.Release(a, prepare(db, a));
+    cache.Release(b, prepare(db, b));
+    // Using a makes b the least recently used
+    cache.Release(a, cache.Acquire(a));
+    cache.Release(c, prepare(db, c));
+    CHECK_EQUAL(cache.Counters().evictions, 1);
+    CHECK_EQUAL(openStatements(db), 2);
+    sqlite3_stmt* statement = cache.Acquire(b);
+    CHECK(statement == nullptr);
+    statement = cache.Acquire(a);
+    CHECK(statement != nullptr);
+    cache.Release(a, statement);
+
+    cache.SetCapacity(0);
+    CHECK_EQUAL(openStatements(db), 0);
+    cache.Release(a, prepare(db, a));
+    CHECK_EQUAL(cache.Counters().entries, 0);
+    CHECK_EQUAL(openStatements(db), 0);
+  }
+
+  void testCacheWrites(sqlite3* db) {
+    SQLite3::StatementCache cache(4);
+    const std::string read = "SELECT value FROM item WHERE id = ?";
+    const std::string write = "UPDATE item SET value = value WHERE id = ?";
+    cache.Release(read, prepare(db, read));
+    cache.Release(write, prepare(db, write));
+    CHECK_EQUAL(cache.Counters().entries, 2);
+
+    // Cached writes are finalized right away, later ones on release
+    cache.SetCacheWrites(false);
+    CHECK_EQUAL(cache.Counters().entries, 1);
+    CHECK_EQUAL(openStatements(db), 1);
+    cache.Release(write, prepare(db, write));
+    CHECK(cache.Acquire(write) == nullptr);
+    CHECK_EQUAL(run(cache, db, read, 1), 10);
+    CHECK_EQUAL(openStatements(db), 1);
+
+    cache.SetCacheWrites(true);
+    cache.Release(write, prepare(db, write));
+    CHECK_EQUAL(cache.Counters().entries, 2);
+    cache.Clear();
+  }
+
+  void testImmutableUri() {
+    CHECK(SQLite3::ImmutableUri("/tmp/a b/data#1.db") == "file:/tmp/a%20b/data%231.db?immutable=1&nolock=1");
+    CHECK(SQLite3::ImmutableUri("C:\\Data\\app?.db") == "file:///C:/Data/app%3F.db?immutable=1&nolock=1");
+  }
+
+  void testImmutable(const std::string& path) {
+    SQLite3::ConnectionOptions options;
+    options.immutable = true;
+    options.mmapSize = SQLite3::defaultImmutableMmapSize;
+    sqlite3* db = nullptr;
+    CHECK_EQUAL(sqlite3_open_v2(SQLite3::ImmutableUri(path).c_str(), &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, nullptr), SQLITE_OK);
+    CHECK_EQUAL(SQLite3::ApplyConnectionOptions(db, options), SQLITE_OK);
+    CHECK_EQUAL(queryInt(db, "PRAGMA mmap_size"), SQLite3::defaultImmutableMmapSize);
+    CHECK_EQUAL(sqlite3_db_readonly(db, "main"), 1);
+
+    // Hot statements prepared at open are hits on their first run
+    SQLite3::StatementCache cache(16);
+    const std::string byId = "SELECT value FROM item WHERE id = ?";
+    cache.Release(byId, prepare(db, byId));
+    CHECK_EQUAL(run(cache, db, byId, 7), 70);
+    CHECK_EQUAL(cache.Counters().hits, 1);
+    CHECK_EQUAL(cache.Counters().misses, 0);
+
+    // No locks are taken, a writer holding an exclusive lock does not block
+    // the reads
+    sqlite3* writer = nullptr;
+    CHECK(sqlite3_open(path.c_str(), &writer) == SQLITE_OK);
+    exec(writer, "BEGIN EXCLUSIVE");
+    CHECK_EQUAL(run(cache, db, byId, 8), 80);
+    exec(writer, "ROLLBACK");
+    sqlite3_close(writer);
+
+    char* error = nullptr;
+    CHECK(sqlite3_exec(db, "DELETE FROM item", nullptr, nullptr, &error) == SQLITE_READONLY);
+    sqlite3_free(error);
+    cache.Clear();
+    CHECK_EQUAL(sqlite3_close(db), SQLITE_OK);
+  }
+}
+
+int main() {
+  char path[64];
+  std::snprintf(path, sizeof(path), "/tmp/SQLite3StatementCacheTest-%d.db", static_cast<int>(getpid()));
+  std::remove(path);
+  sqlite3* db = nullptr;
+  CHECK(sqlite3_open(path, &db) == SQLITE_OK);
+  exec(db, "CREATE TABLE item (id INTEGER PRIMARY KEY, value INTEGER)");
+  exec(db, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 100) "
+           "INSERT INTO item (value) SELECT i * 10 FROM n");
+
+  testReuse(db);
+  testSameSqlTwice(db);
+  testEviction(db);
+  testCacheWrites(db);
+  sqlite3_close(db);
+
+  testImmutableUri();
+  testImmutable(path);
+
+  std::remove(path);
+  return TestSupport::Finish();
+}
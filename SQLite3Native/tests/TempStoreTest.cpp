@@ -0,0 +1,155 @@
+// Installs the temp store VFS as the default VFS and checks that large sorts
+// and temporary tables spill to counted temporary files once they outgrow
+// the budget, that small queries and a zero budget keep everything in
+// memory and that the budget can not change inside a transaction of a
+// connection with temporary tables.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+#include "TempStore.h"
+
+#include "TestSupport.h"
+
+namespace {
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  long long queryInt(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    long long result = -1;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+      result = sqlite3_column_int64(statement, 0);
+    }
+    sqlite3_finalize(statement);
+    return result;
+  }
+
+  // Steps through all rows, so the sorter has to produce every one of them
+  long long countRows(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    long long rows = 0;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    while (sqlite3_step(statement) == SQLITE_ROW) {
+      ++rows;
+    }
+    sqlite3_finalize(statement);
+    return rows;
+  }
+
+  std::string tempPath(const char* name) {
+    char path[96];
+    std::snprintf(path, sizeof(path), "/tmp/SQLite3TempStoreTest-%d-%s.db", static_cast<int>(getpid()), name);
+    std::remove(path);
+    return path;
+  }
+
+  sqlite3* openReport(const std::string& path) {
+    sqlite3* db = nullptr;
+    CHECK_EQUAL(sqlite3_open(path.c_str(), &db), SQLITE_OK);
+    // A small main cache makes the sorter write its runs early
+    exec(db, "PRAGMA cache_size = -256");
+    exec(db, "CREATE TABLE IF NOT EXISTS item (id INTEGER PRIMARY KEY, value BLOB)");
+    if (queryInt(db, "SELECT COUNT(*) FROM item") == 0) {
+      exec(db, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 40000) "
+               "INSERT INTO item (value) SELECT randomblob(200) FROM n");
+    }
+    return db;
+  }
+
+  void testSortSpills() {
+    std::string path = tempPath("sort");
+    sqlite3* db = openReport(path);
+    CHECK_EQUAL(SQLite3::ApplyTempStoreBudget(db, 64 * 1024), SQLITE_OK);
+    CHECK_EQUAL(queryInt(db, "PRAGMA temp_store"), 1);
+    CHECK_EQUAL(queryInt(db, "PRAGMA temp.cache_size"), -64);
+
+    SQLite3::TempStore::ResetCounters();
+    CHECK_EQUAL(countRows(db, "SELECT id FROM item ORDER BY value"), 40000);
+    SQLite3::TempStoreCounters counters = SQLite3::TempStore::Counters();
+    CHECK(counters.spills > 0);
+    CHECK(counters.spilledBytes > 40000 * 200);
+    CHECK(counters.peakBytes > 0);
+    // The files are gone once the statement is finalized
+    CHECK_EQUAL(counters.liveBytes, 0);
+
+    // Small sorts stay within the budget
+    SQLite3::TempStore::ResetCounters();
+    CHECK_EQUAL(countRows(db, "SELECT id FROM item WHERE id <= 100 ORDER BY value"), 100);
+    CHECK_EQUAL(SQLite3::TempStore::Counters().spills, 0);
+    sqlite3_close(db);
+    std::remove(path.c_str());
+  }
+
+  void testTemporaryTableSpills() {
+    std::string path = tempPath("table");
+    sqlite3* db = openReport(path);
+    CHECK_EQUAL(SQLite3::ApplyTempStoreBudget(db, 64 * 1024), SQLITE_OK);
+
+    SQLite3::TempStore::ResetCounters();
+    exec(db, "CREATE TEMP TABLE report AS SELECT id, value FROM item");
+    CHECK_EQUAL(queryInt(db, "SELECT COUNT(*) FROM temp.report"), 40000);
+    SQLite3::TempStoreCounters counters = SQLite3::TempStore::Counters();
+    CHECK(counters.spills > 0);
+    CHECK(counters.liveBytes > 0);
+    CHECK(counters.peakBytes >= counters.liveBytes);
+
+    exec(db, "DROP TABLE temp.report");
+    sqlite3_close(db);
+    CHECK_EQUAL(SQLite3::TempStore::Counters().liveBytes, 0);
+    std::remove(path.c_str());
+  }
+
+  void testMemoryBudget() {
+    std::string path = tempPath("memory");
+    sqlite3* db = openReport(path);
+    CHECK_EQUAL(SQLite3::ApplyTempStoreBudget(db, 0), SQLITE_OK);
+    CHECK_EQUAL(queryInt(db, "PRAGMA temp_store"), 2);
+
+    SQLite3::TempStore::ResetCounters();
+    CHECK_EQUAL(countRows(db, "SELECT id FROM item ORDER BY value"), 40000);
+    exec(db, "CREATE TEMP TABLE report AS SELECT id, value FROM item");
+    CHECK_EQUAL(SQLite3::TempStore::Counters().spills, 0);
+    CHECK_EQUAL(SQLite3::TempStore::Counters().spilledBytes, 0);
+    sqlite3_close(db);
+    std::remove(path.c_str());
+  }
+
+  void testInsideTransaction() {
+    std::string path = tempPath("transaction");
+    sqlite3* db = openReport(path);
+    exec(db, "CREATE TEMP TABLE scratch (value)");
+    exec(db, "BEGIN");
+    exec(db, "INSERT INTO item (value) VALUES (zeroblob(10))");
+    CHECK(SQLite3::ApplyTempStoreBudget(db, 64 * 1024) != SQLITE_OK);
+    exec(db, "ROLLBACK");
+    CHECK_EQUAL(SQLite3::ApplyTempStoreBudget(db, 64 * 1024), SQLITE_OK);
+    sqlite3_close(db);
+    std::remove(path.c_str());
+  }
+}
+
+int main() {
+  CHECK_EQUAL(SQLite3::TempStore::Install(), SQLITE_OK);
+  CHECK(SQLite3::TempStore::Installed());
+  // Installing twice keeps the first registration
+  CHECK_EQUAL(SQLite3::TempStore::Install(), SQLITE_OK);
+  CHECK(std::strcmp(sqlite3_vfs_find(nullptr)->zName, SQLite3::TempStore::VfsName) == 0);
+
+  testSortSpills();
+  testTemporaryTableSpills();
+  testMemoryBudget();
+  testInsideTransaction();
+
+  return TestSupport::Finish();
+}
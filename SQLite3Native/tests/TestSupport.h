@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdio>
+#include <iostream>
+
+// Minimal assertion helpers so the native tests only depend on SQLite.
+namespace TestSupport {
+  inline int& Failures() {
+    static int failures = 0;
+    return failures;
+  }
+
+  inline int Finish() {
+    if (Failures()) {
+      std::fprintf(stderr, "%d check(s) failed\n", Failures());
+      return 1;
+    }
+    return 0;
+  }
+}
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      ++TestSupport::Failures(); \
+    } \
+  } while (0)
+
+#define CHECK_EQUAL(actual, expected) \
+  do { \
+    if (!((actual) == (expected))) { \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": " << #actual << " == " << #expected \
+                << " failed, got " << (actual) << std::endl; \
+      ++TestSupport::Failures(); \
+    } \
+  } while (0)
@@ -0,0 +1,151 @@
+// Binds and reads every supported type through the typed query API, checks
+// that iterating rows does not allocate and that errors surface as
+// QueryError.
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "TypedQuery.h"
+
+#include "TestSupport.h"
+
+namespace {
+  int allocations = 0;
+  sqlite3_mem_methods defaultMethods;
+
+  void* countingMalloc(int size) {
+    ++allocations;
+    return defaultMethods.xMalloc(size);
+  }
+
+  void* countingRealloc(void* memory, int size) {
+    ++allocations;
+    return defaultMethods.xRealloc(memory, size);
+  }
+
+  void testBindAndRead(SQLite3::TypedDatabase& db) {
+    db.Execute("CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT, price REAL, active INTEGER, note TEXT, data BLOB)");
+    const unsigned char bytes[] = { 0, 1, 254, 255 };
+    std::string name("Kiwi");
+    CHECK_EQUAL(db.Execute("INSERT INTO item VALUES (?, ?, ?, ?, ?, ?)",
+      1, "Apple", 1.25, true, std::optional<std::string>(), SQLite3::BlobView{ bytes, sizeof(bytes) }), 1);
+    CHECK_EQUAL(db.Execute("INSERT INTO item VALUES (?, ?, ?, ?, ?, ?)",
+      2, name, 2, false, std::optional<std::string_view>("ripe"), nullptr), 1);
+    CHECK_EQUAL(db.Execute("INSERT INTO item VALUES (?, ?, ?, ?, ?, ?)",
+      int64_t(1) << 40, std::string_view("M\xc3\xbcnchen"), -0.5f, 1, std::nullopt, SQLite3::BlobView{ "", 0 }), 1);
+
+    std::vector<int64_t> ids;
+    std::string names;
+    double total = 0;
+    for (auto [id, itemName, price] : db.Query<int64_t, std::string_view, double>("SELECT id, name, price FROM item ORDER BY id")) {
+      ids.push_back(id);
+      names.append(itemName).push_back('|');
+      total += price;
+    }
+    CHECK_EQUAL(ids.size(), 3u);
+    CHECK_EQUAL(ids[2], int64_t(1) << 40);
+    CHECK_EQUAL(names, std::string("Apple|Kiwi|M\xc3\xbcnchen|"));
+    CHECK_EQUAL(total, 2.75);
+
+    auto first = db.QueryOne<bool, std::optional<std::string>, std::optional<int>>(
+      "SELECT active, note, length(data) FROM item WHERE id = ?", 1);
+    CHECK(first.has_value());
+    auto [active, note, length] = *first;
+    CHECK(active);
+    CHECK(!note);
+    CHECK(length && *length == 4);
+
+    auto second = db.QueryOne<std::string, std::optional<std::string>>("SELECT name, note FROM item WHERE id = :id", 2);
+    CHECK(second && std::get<0>(*second) == "Kiwi" && std::get<1>(*second) == std::string("ripe"));
+
+    CHECK(!db.QueryOne<int>("SELECT id FROM item WHERE id = ?", 42));
+
+    for (auto [data, empty] : db.Query<SQLite3::BlobView, std::optional<SQLite3::BlobView>>(
+           "SELECT data, CASE WHEN id = 1 THEN NULL ELSE x'' END FROM item WHERE id = ?", 1)) {
+      CHECK_EQUAL(data.size, sizeof(bytes));
+      CHECK(std::memcmp(data.data, bytes, sizeof(bytes)) == 0);
+      CHECK(!empty);
+    }
+  }
+
+  void testNoAllocationPerRow(SQLite3::TypedDatabase& db) {
+    db.Execute("CREATE TABLE numbers (n INTEGER, label TEXT)");
+    db.Execute("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 10000) "
+               "INSERT INTO numbers SELECT i, 'label ' || i FROM n");
+
+    auto rows = db.Query<int64_t, std::string_view>("SELECT n, label FROM numbers");
+    int allocationsBefore = allocations;
+    int64_t sum = 0;
+    size_t labelBytes = 0;
+    for (auto [n, label] : rows) {
+      sum += n;
+      labelBytes += label.size();
+    }
+    CHECK_EQUAL(sum, 50005000);
+    CHECK(labelBytes > 10000 * 6);
+    // SQLite's own buffers are allocated once, not per row
+    CHECK(allocations - allocationsBefore < 10);
+  }
+
+  void testMoveOnlyHandles(SQLite3::TypedDatabase& db) {
+    SQLite3::StatementHandle handle = db.Prepare("SELECT count(*) FROM numbers WHERE n > ?", 9990);
+    SQLite3::StatementHandle moved(std::move(handle));
+    CHECK(handle.Get() == nullptr);
+    SQLite3::Rows<int> rows(std::move(moved));
+    int count = 0;
+    for (auto [value] : rows) {
+      count = value;
+    }
+    CHECK_EQUAL(count, 10);
+
+    bool threw = false;
+    try {
+      rows.begin();
+    } catch (const SQLite3::QueryError& e) {
+      threw = e.ResultCode() == SQLITE_MISUSE;
+    }
+    CHECK(threw);
+  }
+
+  template <typename Body>
+  int errorCode(Body body) {
+    try {
+      body();
+    } catch (const SQLite3::QueryError& e) {
+      return e.ResultCode();
+    }
+    return SQLITE_OK;
+  }
+
+  void testErrors(SQLite3::TypedDatabase& db) {
+    CHECK_EQUAL(errorCode([&]() { db.Execute("SELECT * FROM missing"); }), SQLITE_ERROR);
+    CHECK_EQUAL(errorCode([&]() { db.Execute("INSERT INTO item (id) VALUES (?)", 1); }), SQLITE_CONSTRAINT);
+    CHECK_EQUAL(errorCode([&]() { db.Execute("SELECT ?, ?", 1); }), SQLITE_RANGE);
+    CHECK_EQUAL(errorCode([&]() { db.Query<int, int, int>("SELECT 1, 2"); }), SQLITE_RANGE);
+    CHECK_EQUAL(errorCode([&]() {
+      for (auto [value] : db.Query<int>("SELECT abs(-9223372036854775807 - 1)")) {
+        (void)value;
+      }
+    }), SQLITE_ERROR);
+    CHECK(std::strlen(sqlite3_errmsg(db.Handle())) > 0);
+  }
+}
+
+int main() {
+  sqlite3_config(SQLITE_CONFIG_GETMALLOC, &defaultMethods);
+  sqlite3_mem_methods methods = defaultMethods;
+  methods.xMalloc = countingMalloc;
+  methods.xRealloc = countingRealloc;
+  sqlite3_config(SQLITE_CONFIG_MALLOC, &methods);
+
+  sqlite3* sqlite = nullptr;
+  CHECK(sqlite3_open(":memory:", &sqlite) == SQLITE_OK);
+  SQLite3::TypedDatabase db(sqlite);
+  testBindAndRead(db);
+  testNoAllocationPerRow(db);
+  testMoveOnlyHandles(db);
+  testErrors(db);
+  sqlite3_close(sqlite);
+  return TestSupport::Finish();
+}
@@ -0,0 +1,219 @@
+// Runs connections of a shared cache into each other's table locks and
+// checks that blocked statements wait for the unlock, give up after the
+// timeout and fail right away on a deadlock, also when they run in a batch
+// or an import.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Batch.h"
+#include "Importer.h"
+#include "UnlockWait.h"
+
+#include "TestSupport.h"
+
+namespace {
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  // Steps the statement through the waiter, returns the first column of the
+  // first row or the error
+  std::string query(SQLite3::UnlockWait& wait, sqlite3* db, const char16_t* sql) {
+    sqlite3_stmt* statement = nullptr;
+    int result = wait.Prepare16(db, sql, &statement);
+    if (result == SQLITE_OK) {
+      result = wait.Step(statement, true);
+    }
+    std::string text;
+    if (result == SQLITE_ROW) {
+      text = reinterpret_cast<const char*>(sqlite3_column_text(statement, 0));
+    } else if (result != SQLITE_DONE) {
+      text = "error " + std::to_string(result);
+    }
+    sqlite3_finalize(statement);
+    return text;
+  }
+
+  class StringSource : public SQLite3::ImportSource {
+  public:
+    explicit StringSource(const std::string& text) : text(text), position(0) {}
+
+    size_t Read(char* buffer, size_t size) {
+      size_t count = std::min(size, text.size() - position);
+      std::memcpy(buffer, text.data() + position, count);
+      position += count;
+      return count;
+    }
+
+  private:
+    std::string text;
+    size_t position;
+  };
+
+  sqlite3* open(const char* path) {
+    sqlite3* db = nullptr;
+    CHECK(sqlite3_open(path, &db) == SQLITE_OK);
+    return db;
+  }
+
+  void testWaitForCommit(const char* path) {
+    sqlite3* writer = open(path);
+    sqlite3* reader = open(path);
+    SQLite3::UnlockWait wait(5000);
+
+    exec(writer, "BEGIN");
+    exec(writer, "INSERT INTO item VALUES (2)");
+    std::thread commit([writer]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      exec(writer, "COMMIT");
+    });
+    CHECK_EQUAL(query(wait, reader, u"SELECT COUNT(*) FROM item"), std::string("2"));
+    commit.join();
+
+    SQLite3::UnlockWaitCounters counters = wait.Counters();
+    CHECK_EQUAL(counters.waits, 1);
+    CHECK_EQUAL(counters.timeouts, 0);
+    CHECK(counters.longestWaitMicroseconds >= 50000);
+    CHECK_EQUAL(counters.waitMicroseconds, counters.longestWaitMicroseconds);
+
+    sqlite3_close(reader);
+    sqlite3_close(writer);
+  }
+
+  void testTimeout(const char* path) {
+    sqlite3* writer = open(path);
+    sqlite3* reader = open(path);
+    SQLite3::UnlockWait wait(50);
+
+    exec(writer, "BEGIN");
+    exec(writer, "INSERT INTO item VALUES (3)");
+    CHECK_EQUAL(query(wait, reader, u"SELECT COUNT(*) FROM item"), std::string("error 6"));
+    CHECK_EQUAL(wait.Counters().timeouts, 1);
+
+    // Waiting disabled fails like plain SQLite
+    wait.SetTimeout(0);
+    CHECK_EQUAL(query(wait, reader, u"SELECT COUNT(*) FROM item"), std::string("error 6"));
+    CHECK_EQUAL(wait.Counters().waits, 1);
+    exec(writer, "ROLLBACK");
+
+    // The schema is locked while another connection changes it
+    wait.SetTimeout(5000);
+    exec(writer, "BEGIN");
+    exec(writer, "CREATE TABLE other (id INTEGER)");
+    std::thread commit([writer]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      exec(writer, "COMMIT");
+    });
+    CHECK_EQUAL(query(wait, reader, u"SELECT COUNT(*) FROM other"), std::string("0"));
+    commit.join();
+
+    sqlite3_close(reader);
+    sqlite3_close(writer);
+  }
+
+  void testBatchAndImport(const char* path) {
+    sqlite3* writer = open(path);
+    sqlite3* reader = open(path);
+    SQLite3::UnlockWait wait(5000);
+
+    exec(writer, "BEGIN");
+    exec(writer, "INSERT INTO item VALUES (5)");
+    std::thread commit([writer]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      exec(writer, "COMMIT");
+    });
+    std::vector<std::string> sql(1, "SELECT COUNT(*) AS count FROM item");
+    SQLite3::BatchResult batch = SQLite3::ExecuteBatch(reader, sql, nullptr, false, false, &wait);
+    CHECK_EQUAL(batch.resultCode, SQLITE_OK);
+    CHECK_EQUAL(batch.json, std::string("[{\"rows\":[{\"count\":3}]}]"));
+    commit.join();
+    CHECK_EQUAL(wait.Counters().waits, 1);
+
+    // The inserts of the binding thread wait for the write lock
+    exec(writer, "BEGIN");
+    exec(writer, "INSERT INTO item VALUES (6)");
+    std::thread release([writer]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      exec(writer, "COMMIT");
+    });
+    SQLite3::ImportOptions options;
+    options.table = "item";
+    options.unlockWait = &wait;
+    StringSource source("id\n7\n8\n");
+    SQLite3::ImportResult imported = SQLite3::Import(reader, options, source, nullptr);
+    release.join();
+    CHECK_EQUAL(imported.resultCode, SQLITE_OK);
+    CHECK_EQUAL(imported.rows, 2);
+    CHECK_EQUAL(wait.Counters().waits, 2);
+    CHECK_EQUAL(query(wait, reader, u"SELECT COUNT(*) FROM item"), std::string("6"));
+
+    sqlite3_close(reader);
+    sqlite3_close(writer);
+  }
+
+  void testDeadlock(const char* path) {
+    sqlite3* first = open(path);
+    sqlite3* second = open(path);
+    SQLite3::UnlockWait firstWait(5000);
+    SQLite3::UnlockWait secondWait(5000);
+
+    // The first connection writes item and the second reads other, then
+    // each of them needs the table of the other
+    exec(first, "BEGIN");
+    exec(first, "INSERT INTO item VALUES (4)");
+    exec(second, "BEGIN");
+    CHECK_EQUAL(query(secondWait, second, u"SELECT COUNT(*) FROM other"), std::string("0"));
+
+    std::string firstResult;
+    std::thread blocked([&firstWait, &firstResult, first]() {
+      firstResult = query(firstWait, first, u"INSERT INTO other VALUES (1)");
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK_EQUAL(query(secondWait, second, u"SELECT COUNT(*) FROM item"), std::string("error 6"));
+    CHECK_EQUAL(secondWait.Counters().deadlocks, 1);
+
+    // Giving up the read lock lets the first connection go on
+    exec(second, "ROLLBACK");
+    blocked.join();
+    CHECK_EQUAL(firstResult, std::string(""));
+    CHECK_EQUAL(firstWait.Counters().waits, 1);
+    CHECK_EQUAL(firstWait.Counters().deadlocks, 0);
+    exec(first, "COMMIT");
+
+    sqlite3_close(second);
+    sqlite3_close(first);
+  }
+}
+
+int main() {
+  char path[64];
+  std::snprintf(path, sizeof(path), "/tmp/SQLite3UnlockWaitTest-%d.db", static_cast<int>(getpid()));
+  std::remove(path);
+  sqlite3_enable_shared_cache(1);
+
+  sqlite3* db = open(path);
+  exec(db, "CREATE TABLE item (id INTEGER)");
+  exec(db, "INSERT INTO item VALUES (1)");
+
+  testWaitForCommit(path);
+  testTimeout(path);
+  testBatchAndImport(path);
+  testDeadlock(path);
+
+  sqlite3_close(db);
+  std::remove(path);
+  return TestSupport::Finish();
+}
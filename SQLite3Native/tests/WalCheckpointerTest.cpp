@@ -0,0 +1,207 @@
+// Writes to a database in WAL mode and checks which checkpoints the
+// checkpointer asks for, how readers hold them back and what the counters
+// record.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "WalCheckpointer.h"
+
+#include "TestSupport.h"
+
+namespace {
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  void insertRows(sqlite3* db, int count) {
+    for (int i = 0; i < count; ++i) {
+      exec(db, "INSERT INTO item (value) VALUES (randomblob(3000))");
+    }
+  }
+
+  long long fileSize(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? static_cast<long long>(info.st_size) : -1;
+  }
+
+  SQLite3::CheckpointPolicy policy(unsigned passiveFrames, unsigned restartFrames, unsigned truncateFrames) {
+    SQLite3::CheckpointPolicy policy;
+    policy.passiveFrames = passiveFrames;
+    policy.restartFrames = restartFrames;
+    policy.truncateFrames = truncateFrames;
+    policy.restartAgeMilliseconds = 0;
+    policy.retryMilliseconds = 50;
+    return policy;
+  }
+
+  void testReplacesAutomaticCheckpoint(sqlite3* db) {
+    SQLite3::WalCheckpointer checkpointer;
+    checkpointer.Install(db);
+    checkpointer.SetPolicy(policy(1000000, 1000000, 1000000));
+    // SQLite would have checkpointed and restarted the WAL at 1000 frames
+    insertRows(db, 600);
+    CHECK(checkpointer.Counters().walFrames > 1000);
+    CHECK(!checkpointer.Due());
+    CHECK_EQUAL(checkpointer.Counters().passive, 0);
+  }
+
+  void testPassive(sqlite3* db) {
+    SQLite3::WalCheckpointer checkpointer;
+    checkpointer.Install(db);
+    checkpointer.SetPolicy(policy(20, 1000000, 1000000));
+    CHECK(!checkpointer.Due());
+    insertRows(db, 20);
+    CHECK(checkpointer.Due());
+    // Queued once until it ran
+    CHECK(!checkpointer.Due());
+    CHECK_EQUAL(checkpointer.Run(db), SQLITE_OK);
+
+    SQLite3::CheckpointCounters counters = checkpointer.Counters();
+    CHECK_EQUAL(counters.passive, 1);
+    CHECK_EQUAL(counters.restart, 0);
+    CHECK_EQUAL(counters.framesRemaining, 0);
+    CHECK(counters.framesCheckpointed >= 20);
+    CHECK(counters.walFrames >= 20);
+    CHECK(counters.latencyMicroseconds > 0);
+    CHECK(!checkpointer.Due());
+
+    // Not inside a transaction of the connection
+    exec(db, "BEGIN");
+    insertRows(db, 1);
+    exec(db, "COMMIT");
+    insertRows(db, 20);
+    exec(db, "BEGIN");
+    CHECK(checkpointer.Due());
+    CHECK_EQUAL(checkpointer.Run(db), SQLITE_OK);
+    CHECK_EQUAL(checkpointer.Counters().passive, 1);
+    exec(db, "COMMIT");
+    CHECK(checkpointer.Due());
+    CHECK_EQUAL(checkpointer.Run(db), SQLITE_OK);
+    CHECK_EQUAL(checkpointer.Counters().passive, 2);
+  }
+
+  void testReadersAndRestart(sqlite3* db, sqlite3* reader, const std::string& walPath) {
+    SQLite3::WalCheckpointer checkpointer;
+    checkpointer.Install(db);
+    checkpointer.SetPolicy(policy(10, 200, 1000000));
+
+    // The reader's snapshot keeps the newer frames out of the database
+    exec(reader, "BEGIN");
+    exec(reader, "SELECT COUNT(*) FROM item");
+    insertRows(db, 20);
+    CHECK(checkpointer.Due());
+    CHECK_EQUAL(checkpointer.Run(db), SQLITE_OK);
+    SQLite3::CheckpointCounters counters = checkpointer.Counters();
+    CHECK_EQUAL(counters.passive, 1);
+    CHECK(counters.framesRemaining >= 20);
+
+    // Without a busy handler the restart gives up on the reader right away
+    insertRows(db, 200);
+    CHECK(checkpointer.Due());
+    CHECK_EQUAL(checkpointer.Run(db), SQLITE_BUSY);
+    counters = checkpointer.Counters();
+    CHECK_EQUAL(counters.restart, 1);
+    CHECK_EQUAL(counters.busy, 1);
+    CHECK(counters.framesRemaining > 0);
+    // Only passive checkpoints until the retry interval passed
+    insertRows(db, 1);
+    CHECK(checkpointer.Due());
+    CHECK_EQUAL(checkpointer.Run(db), SQLITE_OK);
+    counters = checkpointer.Counters();
+    CHECK_EQUAL(counters.passive, 2);
+    CHECK_EQUAL(counters.restart, 1);
+
+    exec(reader, "COMMIT");
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    CHECK(checkpointer.Due());
+    CHECK_EQUAL(checkpointer.Run(db), SQLITE_OK);
+    counters = checkpointer.Counters();
+    CHECK_EQUAL(counters.restart, 2);
+    CHECK_EQUAL(counters.framesRemaining, 0);
+    CHECK(!checkpointer.Due());
+
+    // The next commit starts over at the beginning of the WAL, which keeps
+    // its size on disk
+    long long walBytes = fileSize(walPath);
+    insertRows(db, 1);
+    CHECK(checkpointer.Counters().walFrames < 10);
+    CHECK_EQUAL(fileSize(walPath), walBytes);
+  }
+
+  void testAge(sqlite3* db) {
+    SQLite3::WalCheckpointer checkpointer;
+    checkpointer.Install(db);
+    SQLite3::CheckpointPolicy aged = policy(1000000, 1000000, 1000000);
+    aged.restartAgeMilliseconds = 50;
+    checkpointer.SetPolicy(aged);
+
+    // Too few frames for any checkpoint until they waited long enough
+    insertRows(db, 10);
+    CHECK(!checkpointer.Due());
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    CHECK(checkpointer.Due());
+    CHECK_EQUAL(checkpointer.Run(db), SQLITE_OK);
+    SQLite3::CheckpointCounters counters = checkpointer.Counters();
+    CHECK_EQUAL(counters.passive, 0);
+    CHECK_EQUAL(counters.restart, 1);
+    CHECK_EQUAL(counters.framesRemaining, 0);
+    CHECK(!checkpointer.Due());
+  }
+
+  void testTruncate(sqlite3* db, const std::string& walPath) {
+    SQLite3::WalCheckpointer checkpointer;
+    checkpointer.Install(db);
+    checkpointer.SetPolicy(policy(1000000, 1000000, 100));
+    insertRows(db, 100);
+    CHECK(fileSize(walPath) > 0);
+    CHECK(checkpointer.Due());
+    CHECK_EQUAL(checkpointer.Run(db), SQLITE_OK);
+    SQLite3::CheckpointCounters counters = checkpointer.Counters();
+#ifdef SQLITE_CHECKPOINT_TRUNCATE
+    CHECK_EQUAL(counters.truncate, 1);
+    CHECK_EQUAL(counters.walFrames, 0);
+    CHECK_EQUAL(fileSize(walPath), 0);
+#else
+    CHECK_EQUAL(counters.restart, 1);
+#endif
+    CHECK_EQUAL(counters.framesRemaining, 0);
+  }
+}
+
+int main() {
+  char path[64];
+  std::snprintf(path, sizeof(path), "/tmp/SQLite3WalCheckpointerTest-%d.db", static_cast<int>(getpid()));
+  std::string walPath = std::string(path) + "-wal";
+  std::remove(path);
+
+  sqlite3* db = nullptr;
+  sqlite3* reader = nullptr;
+  CHECK(sqlite3_open(path, &db) == SQLITE_OK);
+  CHECK(sqlite3_open(path, &reader) == SQLITE_OK);
+  exec(db, "PRAGMA journal_mode = WAL");
+  exec(db, "CREATE TABLE item (id INTEGER PRIMARY KEY, value BLOB)");
+
+  testReplacesAutomaticCheckpoint(db);
+  testPassive(db);
+  testReadersAndRestart(db, reader, walPath);
+  testAge(db);
+  testTruncate(db, walPath);
+
+  sqlite3_close(reader);
+  sqlite3_close(db);
+  std::remove(path);
+  std::remove(walPath.c_str());
+  std::remove((std::string(path) + "-shm").c_str());
+  return TestSupport::Finish();
+}
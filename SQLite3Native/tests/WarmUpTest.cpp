@@ -0,0 +1,123 @@
+// Warms up a freshly opened connection and checks that the schema is
+// parsed before the first query, that the hot statements end up in the
+// statement cache and that a statement that does not prepare is reported.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "WarmUp.h"
+
+#include "TestSupport.h"
+
+namespace {
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  int schemaBytes(sqlite3* db) {
+    int current = 0;
+    int highWater = 0;
+    sqlite3_db_status(db, SQLITE_DBSTATUS_SCHEMA_USED, &current, &highWater, 0);
+    return current;
+  }
+
+  void createFile(const std::string& path) {
+    sqlite3* db = nullptr;
+    CHECK(sqlite3_open(path.c_str(), &db) == SQLITE_OK);
+    for (int i = 0; i < 50; ++i) {
+      char sql[160];
+      std::snprintf(sql, sizeof(sql), "CREATE TABLE t%d (id INTEGER PRIMARY KEY, name TEXT, value REAL); "
+                                      "CREATE INDEX t%d_name ON t%d (name)", i, i, i);
+      exec(db, sql);
+    }
+    exec(db, "INSERT INTO t7 (name, value) VALUES ('seven', 7)");
+    sqlite3_close(db);
+  }
+
+  void testWarmUp(const std::string& path) {
+    sqlite3* db = nullptr;
+    CHECK(sqlite3_open(path.c_str(), &db) == SQLITE_OK);
+    // Opening does not read the schema yet
+    int before = schemaBytes(db);
+
+    SQLite3::WarmUp warmUp;
+    CHECK_EQUAL(warmUp.LoadSchema(db), SQLITE_OK);
+    CHECK(schemaBytes(db) > before);
+
+    std::vector<std::string> statements;
+    statements.push_back("SELECT name FROM t7 WHERE id = ?");
+    statements.push_back("SELECT id FROM t3 WHERE name = ?");
+    statements.push_back("INSERT INTO t1 (name, value) VALUES (?, ?)");
+    SQLite3::StatementCache cache(2);
+    CHECK_EQUAL(warmUp.Prepare(db, statements, cache), SQLITE_OK);
+    // The cache grew to keep all of them
+    CHECK_EQUAL(cache.Capacity(), 3u);
+    CHECK_EQUAL(cache.Counters().entries, 3);
+
+    SQLite3::WarmUpCounters counters = warmUp.Counters();
+    CHECK_EQUAL(counters.statements, 3);
+    CHECK(counters.schemaMicroseconds > 0);
+    CHECK(counters.prepareMicroseconds > 0);
+
+    sqlite3_stmt* statement = cache.Acquire(statements[0]);
+    CHECK(statement != nullptr);
+    sqlite3_bind_int(statement, 1, 1);
+    CHECK_EQUAL(sqlite3_step(statement), SQLITE_ROW);
+    CHECK(std::string(reinterpret_cast<const char*>(sqlite3_column_text(statement, 0))) == "seven");
+    cache.Release(statements[0], statement);
+    CHECK_EQUAL(cache.Counters().hits, 1);
+    CHECK_EQUAL(cache.Counters().misses, 0);
+
+    cache.Clear();
+    sqlite3_close(db);
+  }
+
+  void testFailure(const std::string& path) {
+    sqlite3* db = nullptr;
+    CHECK(sqlite3_open(path.c_str(), &db) == SQLITE_OK);
+    std::vector<std::string> statements;
+    statements.push_back("SELECT name FROM t7");
+    statements.push_back("SELECT name FROM missing");
+    statements.push_back("SELECT name FROM t8");
+    SQLite3::StatementCache cache(16);
+    SQLite3::WarmUp warmUp;
+    CHECK_EQUAL(warmUp.Prepare(db, statements, cache), SQLITE_ERROR);
+    CHECK(warmUp.FailedSql() == "SELECT name FROM missing");
+    CHECK_EQUAL(warmUp.Counters().statements, 1);
+    CHECK_EQUAL(cache.Counters().entries, 1);
+    cache.Clear();
+    sqlite3_close(db);
+
+    // A file that is not a database fails while the schema is read
+    std::string garbage = path + "-garbage";
+    FILE* file = std::fopen(garbage.c_str(), "wb");
+    std::fputs("This is not an SQLite database, just enough text to fill a header of one hundred bytes.........", file);
+    std::fclose(file);
+    CHECK(sqlite3_open(garbage.c_str(), &db) == SQLITE_OK);
+    SQLite3::WarmUp failing;
+    CHECK_EQUAL(failing.LoadSchema(db), SQLITE_NOTADB);
+    sqlite3_close(db);
+    std::remove(garbage.c_str());
+  }
+}
+
+int main() {
+  char path[64];
+  std::snprintf(path, sizeof(path), "/tmp/SQLite3WarmUpTest-%d.db", static_cast<int>(getpid()));
+  std::remove(path);
+  createFile(path);
+
+  testWarmUp(path);
+  testFailure(path);
+
+  std::remove(path);
+  return TestSupport::Finish();
+}
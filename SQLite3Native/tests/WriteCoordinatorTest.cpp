@@ -0,0 +1,337 @@
+// Checks that writers get their slot on a database file in the order they
+// asked, that files, in-memory databases and nested transactions do not
+// wait, and stresses one WAL file with coordinated writers on their own
+// connections and threads plus readers that never queue. The writers must
+// never see SQLITE_BUSY or call their busy handler. Coordinated imports
+// queue for every batch they commit.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Batch.h"
+#include "Importer.h"
+#include "WriteCoordinator.h"
+
+#include "TestSupport.h"
+
+namespace {
+  void exec(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+      std::fprintf(stderr, "%s: %s\n", sql, error);
+      sqlite3_free(error);
+      ++TestSupport::Failures();
+    }
+  }
+
+  long long queryInt(sqlite3* db, const char* sql) {
+    sqlite3_stmt* statement = nullptr;
+    long long result = -1;
+    CHECK(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK);
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+      result = sqlite3_column_int64(statement, 0);
+    }
+    sqlite3_finalize(statement);
+    return result;
+  }
+
+  void removeFiles(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+  }
+
+  std::string tempPath(const char* name) {
+    char path[96];
+    std::snprintf(path, sizeof(path), "/tmp/SQLite3WriteCoordinatorTest-%d-%s.db", static_cast<int>(getpid()), name);
+    removeFiles(path);
+    return path;
+  }
+
+  sqlite3* open(const std::string& path) {
+    sqlite3* db = nullptr;
+    CHECK_EQUAL(sqlite3_open(path.c_str(), &db), SQLITE_OK);
+    return db;
+  }
+
+  // Waits until the given number of writers queued for the path
+  void waitForQueue(const std::string& path, int waiting) {
+    while (SQLite3::WriteCoordinator::Waiting(path) < waiting) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  void testFairOrder() {
+    const std::string path = "/coordinated/order.db";
+    const int writers = 6;
+    SQLite3::WriteCoordinator::ResetCounters();
+
+    SQLite3::WriteSlot first;
+    first.Acquire(path);
+    CHECK(first.Held());
+    CHECK_EQUAL(SQLite3::WriteCoordinator::Waiting(path), 0);
+
+    std::mutex mutex;
+    std::string order;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < writers; ++i) {
+      threads.push_back(std::thread([&path, &mutex, &order, i]() {
+        SQLite3::WriteSlot slot;
+        slot.Acquire(path);
+        std::lock_guard<std::mutex> lock(mutex);
+        order += static_cast<char>('0' + i);
+      }));
+      // Each one asks after the previous one
+      waitForQueue(path, i + 1);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    first.Release();
+    CHECK(!first.Held());
+    for (size_t i = 0; i < threads.size(); ++i) {
+      threads[i].join();
+    }
+
+    CHECK_EQUAL(order, std::string("012345"));
+    CHECK_EQUAL(SQLite3::WriteCoordinator::Waiting(path), 0);
+    SQLite3::WriteCoordinatorCounters counters = SQLite3::WriteCoordinator::Counters();
+    CHECK_EQUAL(counters.acquisitions, writers + 1);
+    CHECK_EQUAL(counters.contended, writers);
+    CHECK(counters.longestWaitMicroseconds >= 20000);
+    CHECK(counters.waitMicroseconds >= counters.longestWaitMicroseconds);
+  }
+
+  void testIndependentFiles() {
+    SQLite3::WriteSlot held;
+    held.Acquire("/coordinated/a.db");
+    // Another file does not queue behind it
+    std::future<void> other = std::async(std::launch::async, []() {
+      SQLite3::WriteSlot slot;
+      slot.Acquire("/coordinated/b.db");
+    });
+    CHECK(other.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+  }
+
+  void testWithoutSlot() {
+    SQLite3::WriteCoordinator::ResetCounters();
+    sqlite3* memory = nullptr;
+    CHECK_EQUAL(sqlite3_open(":memory:", &memory), SQLITE_OK);
+    {
+      SQLite3::WriteTransaction transaction(memory);
+      CHECK_EQUAL(transaction.Begin(), SQLITE_OK);
+      CHECK(!sqlite3_get_autocommit(memory));
+      CHECK_EQUAL(transaction.Commit(), SQLITE_OK);
+    }
+    CHECK(sqlite3_get_autocommit(memory));
+    sqlite3_close(memory);
+    CHECK_EQUAL(SQLite3::WriteCoordinator::Counters().acquisitions, 0);
+
+    // Inside a transaction of the connection the outer transaction decides
+    std::string path = tempPath("nested");
+    sqlite3* db = open(path);
+    exec(db, "CREATE TABLE item (value)");
+    exec(db, "BEGIN");
+    {
+      SQLite3::WriteTransaction transaction(db);
+      CHECK_EQUAL(transaction.Begin(), SQLITE_OK);
+      exec(db, "INSERT INTO item VALUES (1)");
+      CHECK_EQUAL(transaction.Commit(), SQLITE_OK);
+    }
+    CHECK(!sqlite3_get_autocommit(db));
+    exec(db, "ROLLBACK");
+    CHECK_EQUAL(queryInt(db, "SELECT COUNT(*) FROM item"), 0);
+    CHECK_EQUAL(SQLite3::WriteCoordinator::Counters().acquisitions, 0);
+
+    // Rolled back, and the slot released, unless committed
+    {
+      SQLite3::WriteTransaction transaction(db);
+      CHECK_EQUAL(transaction.Begin(), SQLITE_OK);
+      exec(db, "INSERT INTO item VALUES (1)");
+    }
+    CHECK_EQUAL(queryInt(db, "SELECT COUNT(*) FROM item"), 0);
+    CHECK_EQUAL(SQLite3::WriteCoordinator::Waiting(sqlite3_db_filename(db, "main")), 0);
+    CHECK_EQUAL(SQLite3::WriteCoordinator::Counters().acquisitions, 1);
+    sqlite3_close(db);
+    removeFiles(path);
+  }
+
+  // What the coordinator avoids: two deferred transactions that read and
+  // then write can not both commit
+  void testDeferredUpgradeFails() {
+    std::string path = tempPath("deferred");
+    sqlite3* first = open(path);
+    sqlite3* second = open(path);
+    exec(first, "PRAGMA journal_mode = WAL");
+    exec(first, "CREATE TABLE counter (value INTEGER); INSERT INTO counter VALUES (0)");
+
+    exec(first, "BEGIN");
+    exec(second, "BEGIN");
+    CHECK_EQUAL(queryInt(first, "SELECT value FROM counter"), 0);
+    CHECK_EQUAL(queryInt(second, "SELECT value FROM counter"), 0);
+    exec(first, "UPDATE counter SET value = value + 1");
+    exec(first, "COMMIT");
+    int upgrade = sqlite3_exec(second, "UPDATE counter SET value = value + 1", nullptr, nullptr, nullptr);
+    CHECK_EQUAL(upgrade & 0xff, SQLITE_BUSY);
+    exec(second, "ROLLBACK");
+
+    sqlite3_close(second);
+    sqlite3_close(first);
+    removeFiles(path);
+  }
+
+  class StringSource : public SQLite3::ImportSource {
+  public:
+    explicit StringSource(const std::string& data) : data(data), position(0) {}
+
+    size_t Read(char* buffer, size_t size) {
+      size_t length = std::min(size, data.size() - position);
+      data.copy(buffer, length, position);
+      position += length;
+      return length;
+    }
+
+  private:
+    std::string data;
+    size_t position;
+  };
+
+  void testCoordinatedImport() {
+    std::string path = tempPath("import");
+    sqlite3* db = open(path);
+    exec(db, "CREATE TABLE item (id INTEGER, name TEXT)");
+    std::string csv = "id,name\n";
+    for (int i = 1; i <= 25; ++i) {
+      csv += std::to_string(i) + ",item\n";
+    }
+    SQLite3::WriteCoordinator::ResetCounters();
+
+    SQLite3::WriteSlot held;
+    held.Acquire(sqlite3_db_filename(db, "main"));
+    std::future<SQLite3::ImportResult> imported = std::async(std::launch::async, [db, &csv]() {
+      SQLite3::ImportOptions options;
+      options.table = "item";
+      options.batchSize = 10;
+      options.coordinateWrites = true;
+      StringSource source(csv);
+      return SQLite3::Import(db, options, source, nullptr);
+    });
+    // Waits for its first transaction behind the held slot
+    waitForQueue(sqlite3_db_filename(db, "main"), 1);
+    held.Release();
+
+    SQLite3::ImportResult result = imported.get();
+    CHECK_EQUAL(result.resultCode, SQLITE_OK);
+    CHECK_EQUAL(result.rows, 25);
+    CHECK_EQUAL(queryInt(db, "SELECT COUNT(*) FROM item"), 25);
+    CHECK(sqlite3_get_autocommit(db));
+    // The held slot plus one transaction per batch of up to ten rows
+    SQLite3::WriteCoordinatorCounters counters = SQLite3::WriteCoordinator::Counters();
+    CHECK_EQUAL(counters.acquisitions, 4);
+    CHECK_EQUAL(counters.contended, 1);
+    sqlite3_close(db);
+    removeFiles(path);
+  }
+
+  int countBusy(void* data, int) {
+    ++*static_cast<std::atomic<int>*>(data);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return 1;
+  }
+
+  void testStress() {
+    const int writers = 4;
+    const int transactionsPerWriter = 150;
+    const int readers = 2;
+
+    std::string path = tempPath("stress");
+    sqlite3* setup = open(path);
+    exec(setup, "PRAGMA journal_mode = WAL");
+    exec(setup, "CREATE TABLE counter (value INTEGER); INSERT INTO counter VALUES (0)");
+    sqlite3_close(setup);
+    SQLite3::WriteCoordinator::ResetCounters();
+
+    std::atomic<int> writerBusy(0);
+    std::atomic<int> failures(0);
+    std::atomic<int> writersDone(0);
+    std::atomic<long long> reads(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < writers; ++i) {
+      threads.push_back(std::thread([&, i]() {
+        sqlite3* db = open(path);
+        exec(db, "PRAGMA synchronous = OFF");
+        sqlite3_busy_handler(db, countBusy, &writerBusy);
+        std::vector<std::string> batch(1, "UPDATE counter SET value = value + 1");
+        for (int j = 0; j < transactionsPerWriter; ++j) {
+          if ((i + j) % 2) {
+            // Reads before it writes, which deferred transactions can not
+            SQLite3::WriteTransaction transaction(db);
+            if (transaction.Begin() != SQLITE_OK) {
+              ++failures;
+              continue;
+            }
+            long long value = queryInt(db, "SELECT value FROM counter");
+            std::string update = "UPDATE counter SET value = " + std::to_string(value + 1);
+            if (sqlite3_exec(db, update.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK || transaction.Commit() != SQLITE_OK) {
+              ++failures;
+            }
+          } else if (SQLite3::ExecuteBatch(db, batch, nullptr, true, true, nullptr).resultCode != SQLITE_OK) {
+            ++failures;
+          }
+        }
+        sqlite3_close(db);
+        ++writersDone;
+      }));
+    }
+    for (int i = 0; i < readers; ++i) {
+      threads.push_back(std::thread([&]() {
+        sqlite3* db = open(path);
+        sqlite3_busy_timeout(db, 5000);
+        long long last = 0;
+        while (writersDone < writers) {
+          long long value = queryInt(db, "SELECT value FROM counter");
+          // Never sees a value going back
+          if (value < last) {
+            ++failures;
+          }
+          last = value;
+          ++reads;
+        }
+        sqlite3_close(db);
+      }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+      threads[i].join();
+    }
+
+    CHECK_EQUAL(failures.load(), 0);
+    CHECK_EQUAL(writerBusy.load(), 0);
+    CHECK(reads.load() > 0);
+    sqlite3* db = open(path);
+    CHECK_EQUAL(queryInt(db, "SELECT value FROM counter"), writers * transactionsPerWriter);
+    sqlite3_close(db);
+
+    SQLite3::WriteCoordinatorCounters counters = SQLite3::WriteCoordinator::Counters();
+    CHECK_EQUAL(counters.acquisitions, writers * transactionsPerWriter);
+    CHECK(counters.contended <= counters.acquisitions);
+    CHECK(counters.waitMicroseconds >= counters.longestWaitMicroseconds);
+    removeFiles(path);
+  }
+}
+
+int main() {
+  testFairOrder();
+  testIndependentFiles();
+  testWithoutSlot();
+  testDeferredUpgradeFails();
+  testCoordinatedImport();
+  testStress();
+  return TestSupport::Finish();
+}